@@ -0,0 +1,91 @@
+#include "Benchmarks.hpp"
+#include "Animation.hpp"
+#include "Scene.hpp"
+#include "Utils.hpp"
+
+#include <glm/gtx/transform.hpp>
+#include <memory>
+#include <random>
+
+namespace
+{
+const uint32_t c_skinnedVertexCount = 1'000'000;
+const uint32_t c_jointCount = 256;
+
+struct SkinningData
+{
+    std::vector<Model::Vertex> restVertices;
+    std::vector<Model::SkinVertex> skinVertices;
+    std::vector<glm::mat4> jointMatrices;
+    std::vector<Model::Vertex> vertices;
+};
+
+// Every vertex uses four random joints so that all weights are used like in a character mesh
+void createSkinningData(SkinningData& data)
+{
+    std::mt19937 generator(1);
+    std::uniform_int_distribution<uint32_t> jointDistribution(0, c_jointCount - 1);
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+
+    data.restVertices.resize(c_skinnedVertexCount);
+    data.skinVertices.resize(c_skinnedVertexCount);
+    for (uint32_t i = 0; i < c_skinnedVertexCount; ++i)
+    {
+        Model::Vertex& vertex = data.restVertices[i];
+        vertex.position = glm::vec4(distribution(generator), distribution(generator), distribution(generator), 1.0f);
+        vertex.normal = glm::vec4(c_up, 0.0f);
+        vertex.tangent = glm::vec4(c_right, 1.0f);
+
+        Model::SkinVertex& skinVertex = data.skinVertices[i];
+        skinVertex.joints = glm::uvec4(jointDistribution(generator), jointDistribution(generator), jointDistribution(generator), jointDistribution(generator));
+        skinVertex.weights = glm::vec4(0.4f, 0.3f, 0.2f, 0.1f);
+    }
+
+    data.jointMatrices.resize(c_jointCount);
+    for (glm::mat4& jointMatrix : data.jointMatrices)
+    {
+        jointMatrix = glm::translate(glm::vec3(distribution(generator), distribution(generator), distribution(generator))) * glm::rotate(distribution(generator), c_up);
+    }
+}
+} // namespace
+
+void addAnimationBenchmarks(BenchmarkRunner& runner)
+{
+    SceneParameters tentacles;
+    tentacles.model = SceneModel::Tentacles;
+    tentacles.triangleCount = 100'000;
+    tentacles.meshCount = 1'000;
+
+    // Created on first use so that filtered runs don't pay for it
+    std::shared_ptr<Scene> scene(new Scene());
+    std::shared_ptr<SkeletonPose> pose(new SkeletonPose());
+    runner.add(
+        "poseSkeleton/tentacles",
+        [scene, pose]() {
+            poseSkeleton(scene->model->skeleton, 0.5, *pose);
+            doNotOptimize(pose->jointMatrices);
+        },
+        [scene, tentacles]() {
+            if (!scene->model)
+            {
+                *scene = createScene(tentacles);
+            }
+        },
+        tentacles.meshCount);
+
+    // CPU reference of the skinning shader, reported per vertex
+    std::shared_ptr<SkinningData> skinning(new SkinningData());
+    runner.add(
+        "skinVertices/4-weights",
+        [skinning]() {
+            skinVertices(skinning->restVertices, skinning->skinVertices, skinning->jointMatrices, skinning->vertices);
+            doNotOptimize(skinning->vertices);
+        },
+        [skinning]() {
+            if (skinning->restVertices.empty())
+            {
+                createSkinningData(*skinning);
+            }
+        },
+        c_skinnedVertexCount);
+}
@@ -0,0 +1,222 @@
+#include "Benchmark.hpp"
+#include "Utils.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <numeric>
+
+namespace
+{
+BenchmarkResult computeResult(const std::string& name, std::vector<double> times, uint64_t itemsPerIteration)
+{
+    std::sort(times.begin(), times.end());
+
+    BenchmarkResult result;
+    result.name = name;
+    result.repetitions = ui32Size(times);
+    result.itemsPerIteration = itemsPerIteration;
+    result.meanMs = std::accumulate(times.begin(), times.end(), 0.0) / times.size();
+    result.minMs = times.front();
+    result.maxMs = times.back();
+    result.p95Ms = times[static_cast<size_t>(0.95 * (times.size() - 1))];
+
+    const size_t middle = times.size() / 2;
+    result.medianMs = times.size() % 2 == 0 ? (times[middle - 1] + times[middle]) * 0.5 : times[middle];
+
+    double variance = 0.0;
+    for (double time : times)
+    {
+        variance += (time - result.meanMs) * (time - result.meanMs);
+    }
+    result.stddevMs = times.size() > 1 ? std::sqrt(variance / (times.size() - 1)) : 0.0;
+
+    return result;
+}
+
+// Minimal reader for the format written by writeResultsJson, not a general JSON parser
+bool readString(const std::string& line, const std::string& key, std::string& value)
+{
+    const std::string pattern = "\"" + key + "\": \"";
+    const size_t start = line.find(pattern);
+    if (start == std::string::npos)
+    {
+        return false;
+    }
+    const size_t valueStart = start + pattern.size();
+    const size_t valueEnd = line.find('"', valueStart);
+    if (valueEnd == std::string::npos)
+    {
+        return false;
+    }
+    value = line.substr(valueStart, valueEnd - valueStart);
+    return true;
+}
+
+double readNumber(const std::string& line, const std::string& key)
+{
+    const std::string pattern = "\"" + key + "\": ";
+    const size_t start = line.find(pattern);
+    if (start == std::string::npos)
+    {
+        return 0.0;
+    }
+    return std::strtod(line.c_str() + start + pattern.size(), nullptr);
+}
+} // namespace
+
+void BenchmarkRunner::add(const std::string& name, Function run, Function setup, uint64_t itemsPerIteration)
+{
+    m_benchmarks.push_back(Benchmark{name, std::move(run), std::move(setup), itemsPerIteration});
+}
+
+std::vector<BenchmarkResult> BenchmarkRunner::run(const BenchmarkSettings& settings) const
+{
+    if (settings.pinnedCore >= 0 && !pinCurrentThreadToCore(static_cast<uint32_t>(settings.pinnedCore)))
+    {
+        printf("Could not pin the benchmark thread to core %d, results may be noisier\n", settings.pinnedCore);
+    }
+
+    std::vector<BenchmarkResult> results;
+    for (const Benchmark& benchmark : m_benchmarks)
+    {
+        if (!settings.filter.empty() && benchmark.name.find(settings.filter) == std::string::npos)
+        {
+            continue;
+        }
+
+        printf("Running %s...\n", benchmark.name.c_str());
+
+        for (uint32_t i = 0; i < settings.warmupIterations; ++i)
+        {
+            if (benchmark.setup)
+            {
+                benchmark.setup();
+            }
+            benchmark.run();
+        }
+
+        std::vector<double> times;
+        times.reserve(settings.repetitions);
+        for (uint32_t i = 0; i < std::max(settings.repetitions, 1u); ++i)
+        {
+            if (benchmark.setup)
+            {
+                benchmark.setup();
+            }
+
+            const std::chrono::high_resolution_clock::time_point startTime = std::chrono::high_resolution_clock::now();
+            benchmark.run();
+            times.push_back(getMillisecondsSince(startTime));
+        }
+
+        results.push_back(computeResult(benchmark.name, std::move(times), benchmark.itemsPerIteration));
+    }
+    return results;
+}
+
+void printResults(const std::vector<BenchmarkResult>& results)
+{
+    printf("%-40s %10s %10s %10s %10s %10s %14s\n", "Benchmark", "median ms", "mean ms", "stddev ms", "min ms", "p95 ms", "items/s");
+    for (const BenchmarkResult& result : results)
+    {
+        const double itemsPerSecond = result.medianMs > 0.0 ? result.itemsPerIteration / (result.medianMs / 1000.0) : 0.0;
+        printf("%-40s %10.3f %10.3f %10.3f %10.3f %10.3f %14.4g\n",
+               result.name.c_str(),
+               result.medianMs,
+               result.meanMs,
+               result.stddevMs,
+               result.minMs,
+               result.p95Ms,
+               itemsPerSecond);
+    }
+}
+
+void writeResultsJson(const std::vector<BenchmarkResult>& results, const std::string& filename)
+{
+    FILE* file = fopen(filename.c_str(), "w");
+    CHECK(file);
+
+    fprintf(file, "{\"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const BenchmarkResult& result = results[i];
+        fprintf(file,
+                "{\"name\": \"%s\", \"repetitions\": %u, \"items_per_iteration\": %llu, \"median_ms\": %.6f, \"mean_ms\": %.6f, "
+                "\"stddev_ms\": %.6f, \"min_ms\": %.6f, \"max_ms\": %.6f, \"p95_ms\": %.6f}%s\n",
+                result.name.c_str(),
+                result.repetitions,
+                static_cast<unsigned long long>(result.itemsPerIteration),
+                result.medianMs,
+                result.meanMs,
+                result.stddevMs,
+                result.minMs,
+                result.maxMs,
+                result.p95Ms,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "]}\n");
+
+    fclose(file);
+}
+
+std::vector<BenchmarkResult> readResultsJson(const std::string& filename)
+{
+    std::ifstream file(filename);
+    if (!file)
+    {
+        LOGE(("Could not open baseline " + filename).c_str());
+    }
+
+    std::vector<BenchmarkResult> results;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        BenchmarkResult result;
+        if (!readString(line, "name", result.name))
+        {
+            continue;
+        }
+        result.repetitions = static_cast<uint32_t>(readNumber(line, "repetitions"));
+        result.itemsPerIteration = static_cast<uint64_t>(readNumber(line, "items_per_iteration"));
+        result.medianMs = readNumber(line, "median_ms");
+        result.meanMs = readNumber(line, "mean_ms");
+        result.stddevMs = readNumber(line, "stddev_ms");
+        result.minMs = readNumber(line, "min_ms");
+        result.maxMs = readNumber(line, "max_ms");
+        result.p95Ms = readNumber(line, "p95_ms");
+        results.push_back(result);
+    }
+    return results;
+}
+
+uint32_t compareToBaseline(const std::vector<BenchmarkResult>& results, const std::vector<BenchmarkResult>& baseline, double threshold)
+{
+    printf("%-40s %12s %12s %9s\n", "Benchmark", "baseline ms", "current ms", "change");
+
+    uint32_t regressionCount = 0;
+    for (const BenchmarkResult& result : results)
+    {
+        auto baselineResult = std::find_if(baseline.begin(), baseline.end(), [&result](const BenchmarkResult& r) { return r.name == result.name; });
+        if (baselineResult == baseline.end() || baselineResult->medianMs <= 0.0)
+        {
+            printf("%-40s %12s %12.3f %9s\n", result.name.c_str(), "-", result.medianMs, "new");
+            continue;
+        }
+
+        const double change = result.medianMs / baselineResult->medianMs - 1.0;
+        // Differences within the noise of either run are not counted as regressions
+        const double noise = std::max(result.stddevMs, baselineResult->stddevMs) / baselineResult->medianMs;
+        const bool regression = change > threshold && change > noise;
+        regressionCount += regression ? 1 : 0;
+
+        printf("%-40s %12.3f %12.3f %+8.1f%%%s\n",
+               result.name.c_str(),
+               baselineResult->medianMs,
+               result.medianMs,
+               change * 100.0,
+               regression ? "  REGRESSION" : "");
+    }
+    return regressionCount;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Keeps the compiler from optimizing away a result that is otherwise unused
+template<typename T>
+void doNotOptimize(const T& value)
+{
+#if defined(_MSC_VER)
+    static const void* volatile s_sink;
+    s_sink = &value;
+#else
+    asm volatile("" : : "g"(&value) : "memory");
+#endif
+}
+
+struct BenchmarkSettings
+{
+    uint32_t warmupIterations = 3;
+    uint32_t repetitions = 20;
+    // Core the benchmark thread is pinned to, -1 to not pin
+    int pinnedCore = 0;
+    // Only benchmarks whose name contains this are run
+    std::string filter;
+};
+
+struct BenchmarkResult
+{
+    std::string name;
+    uint32_t repetitions = 0;
+    uint64_t itemsPerIteration = 0;
+    double meanMs = 0.0;
+    double medianMs = 0.0;
+    double stddevMs = 0.0;
+    double minMs = 0.0;
+    double maxMs = 0.0;
+    double p95Ms = 0.0;
+};
+
+class BenchmarkRunner final
+{
+public:
+    using Function = std::function<void()>;
+
+    // setup is run before every iteration and is not timed.
+    // itemsPerIteration is used for reporting throughput, e.g. vertices or triangles.
+    void add(const std::string& name, Function run, Function setup = nullptr, uint64_t itemsPerIteration = 0);
+    std::vector<BenchmarkResult> run(const BenchmarkSettings& settings) const;
+
+private:
+    struct Benchmark
+    {
+        std::string name;
+        Function run;
+        Function setup;
+        uint64_t itemsPerIteration;
+    };
+
+    std::vector<Benchmark> m_benchmarks;
+};
+
+void printResults(const std::vector<BenchmarkResult>& results);
+// One result object per line so that the file is easy to diff and to parse back
+void writeResultsJson(const std::vector<BenchmarkResult>& results, const std::string& filename);
+std::vector<BenchmarkResult> readResultsJson(const std::string& filename);
+// Compares medians, returns the number of benchmarks that are slower than the baseline by more than threshold (0.05 = 5%)
+uint32_t compareToBaseline(const std::vector<BenchmarkResult>& results, const std::vector<BenchmarkResult>& baseline, double threshold);
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "Benchmark.hpp"
+
+void addModelBenchmarks(BenchmarkRunner& runner);
+void addSceneBenchmarks(BenchmarkRunner& runner);
+void addCameraBenchmarks(BenchmarkRunner& runner);
+void addJobSystemBenchmarks(BenchmarkRunner& runner);
+void addAnimationBenchmarks(BenchmarkRunner& runner);
@@ -0,0 +1,32 @@
+#include "Benchmarks.hpp"
+#include "Camera.hpp"
+
+#include <memory>
+
+namespace
+{
+const uint32_t c_updateCount = 100'000;
+} // namespace
+
+void addCameraBenchmarks(BenchmarkRunner& runner)
+{
+    std::shared_ptr<Camera> camera(new Camera());
+
+    // Same calls as Raytracer::updateCamera does per frame with keys held down
+    runner.add(
+        "Camera/translateAndRotate",
+        [camera]() {
+            for (uint32_t i = 0; i < c_updateCount; ++i)
+            {
+                camera->translate(camera->getForward() * 0.001f);
+                camera->translate(camera->getLeft() * 0.001f);
+                camera->rotate(c_up, 0.001f);
+                doNotOptimize(camera->getViewMatrix());
+            }
+        },
+        [camera]() {
+            camera->setPosition({6.3f, 4.5f, -0.7f});
+            camera->setRotation({0.0f, 1.57f, 0.0f});
+        },
+        c_updateCount);
+}
@@ -0,0 +1,113 @@
+#include "Benchmarks.hpp"
+#include "SyntheticGltf.hpp"
+#include "JobSystem.hpp"
+#include "ModelLoader.hpp"
+#include "MeshAssembly.hpp"
+#include "Model.hpp"
+
+#define TINYGLTF_NOEXCEPTION
+#include <tiny_gltf.h>
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace
+{
+const uint32_t c_primitiveCount = 400;
+const uint32_t c_verticesPerSide = 64;
+const size_t c_parallelForCount = 1 << 22;
+const size_t c_emptyJobCount = 10'000;
+
+// Created before the runner pins the benchmark thread, new threads inherit its affinity and would all share its core.
+// Idle workers sleep, so the job systems of the other thread counts don't disturb the benchmarks.
+std::shared_ptr<JobSystem> createJobSystem(uint32_t threadCount)
+{
+    JobSystemSettings settings;
+    settings.threadCount = threadCount;
+    return std::make_shared<JobSystem>(settings);
+}
+
+std::vector<uint32_t> getThreadCounts()
+{
+    const uint32_t hardwareThreadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<uint32_t> threadCounts;
+    for (uint32_t threadCount = 1; threadCount < hardwareThreadCount; threadCount *= 2)
+    {
+        threadCounts.push_back(threadCount);
+    }
+    threadCounts.push_back(hardwareThreadCount);
+    return threadCounts;
+}
+} // namespace
+
+void addJobSystemBenchmarks(BenchmarkRunner& runner)
+{
+    std::shared_ptr<tinygltf::Model> gltfModel(new tinygltf::Model());
+    std::shared_ptr<Model> model(new Model());
+    std::shared_ptr<std::vector<float>> values(new std::vector<float>());
+    const uint64_t vertexCount = static_cast<uint64_t>(c_primitiveCount) * c_verticesPerSide * c_verticesPerSide;
+
+    // Shared inputs are also created on first use
+    auto createInputs = [gltfModel, model, values]() {
+        if (!values->empty())
+        {
+            return;
+        }
+        createSyntheticGltf(*gltfModel, c_primitiveCount, c_verticesPerSide);
+        model->submeshes = loadSubmeshes(*gltfModel);
+        model->updateBufferSizes();
+        values->resize(c_parallelForCount, 1.0f);
+    };
+
+    // The same work at increasing thread counts, 1 thread is the sequential baseline
+    for (uint32_t threadCount : getThreadCounts())
+    {
+        const std::string suffix = "/threads-" + std::to_string(threadCount);
+        std::shared_ptr<JobSystem> jobSystem = createJobSystem(threadCount);
+
+        runner.add(
+            "JobSystem/parallelFor" + suffix,
+            [jobSystem, values]() {
+                std::vector<float>& v = *values;
+                jobSystem->parallelFor(v.size(), [&v](size_t begin, size_t end) {
+                    for (size_t i = begin; i < end; ++i)
+                    {
+                        v[i] = std::sqrt(v[i] * v[i] + 1.0f) - 0.5f;
+                    }
+                });
+                doNotOptimize(v);
+            },
+            createInputs,
+            c_parallelForCount);
+
+        runner.add(
+            "JobSystem/emptyJobs" + suffix,
+            [jobSystem]() {
+                JobSystem& js = *jobSystem;
+                std::vector<JobSystem::JobHandle> jobs;
+                jobs.reserve(c_emptyJobCount);
+                for (size_t i = 0; i < c_emptyJobCount; ++i)
+                {
+                    jobs.push_back(js.schedule([]() {}));
+                }
+                js.wait(jobs);
+            },
+            createInputs,
+            c_emptyJobCount);
+
+        runner.add(
+            "JobSystem/loadSubmeshes" + suffix,
+            [jobSystem, gltfModel]() { doNotOptimize(loadSubmeshes(*gltfModel, *jobSystem)); },
+            createInputs,
+            vertexCount);
+
+        runner.add(
+            "JobSystem/assembleMesh" + suffix,
+            [jobSystem, model]() { doNotOptimize(assembleMesh(*model, *jobSystem)); },
+            createInputs,
+            vertexCount);
+    }
+}
@@ -0,0 +1,69 @@
+#include "Benchmarks.hpp"
+#include "SyntheticGltf.hpp"
+#include "ModelLoader.hpp"
+#include "MeshAssembly.hpp"
+#include "Model.hpp"
+#include "Utils.hpp"
+
+#define TINYGLTF_NOEXCEPTION
+#include <tiny_gltf.h>
+
+#include <filesystem>
+#include <memory>
+
+namespace
+{
+// Roughly the size of Sponza: 100 primitives with 4096 vertices each
+const uint32_t c_primitiveCount = 100;
+const uint32_t c_verticesPerSide = 64;
+const uint32_t c_imageCount = 16;
+const uint32_t c_imageSize = 1024;
+const std::string c_sponzaFile = "sponza/Sponza.gltf";
+} // namespace
+
+void addModelBenchmarks(BenchmarkRunner& runner)
+{
+    std::shared_ptr<tinygltf::Model> gltfModel(new tinygltf::Model());
+    createSyntheticGltf(*gltfModel, c_primitiveCount, c_verticesPerSide);
+    const uint64_t vertexCount = static_cast<uint64_t>(c_primitiveCount) * c_verticesPerSide * c_verticesPerSide;
+
+    runner.add(
+        "loadSubmeshes/synthetic",
+        [gltfModel]() { doNotOptimize(loadSubmeshes(*gltfModel)); },
+        nullptr,
+        vertexCount);
+
+    runner.add(
+        "loadMaterials/synthetic",
+        [gltfModel]() { doNotOptimize(loadMaterials(*gltfModel)); },
+        nullptr,
+        gltfModel->materials.size());
+
+    // loadImages moves the decoded data out, so the images are refilled before every iteration
+    std::shared_ptr<tinygltf::Model> imageModel(new tinygltf::Model());
+    runner.add(
+        "loadImages/synthetic",
+        [imageModel]() { doNotOptimize(loadImages(*imageModel)); },
+        [imageModel]() { addSyntheticImages(*imageModel, c_imageCount, c_imageSize); },
+        c_imageCount);
+
+    std::shared_ptr<Model> model(new Model());
+    model->submeshes = loadSubmeshes(*gltfModel);
+    model->updateBufferSizes();
+
+    runner.add(
+        "assembleMesh/synthetic",
+        [model]() { doNotOptimize(assembleMesh(*model)); },
+        nullptr,
+        vertexCount);
+
+    // Full load including JSON parsing and image decoding, only when the asset is available
+    if (std::filesystem::exists(c_modelsFolder + c_sponzaFile))
+    {
+        runner.add("Model/sponza", []() { doNotOptimize(Model(c_sponzaFile)); });
+    }
+    else
+    {
+        printf("%s not found, skipping Model/sponza\n", (c_modelsFolder + c_sponzaFile).c_str());
+    }
+}
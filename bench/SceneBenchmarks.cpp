@@ -0,0 +1,78 @@
+#include "Benchmarks.hpp"
+#include "Scene.hpp"
+#include "MeshAssembly.hpp"
+#include "LightTree.hpp"
+
+#include <memory>
+
+void addSceneBenchmarks(BenchmarkRunner& runner)
+{
+    SceneParameters hugeMesh;
+    hugeMesh.model = SceneModel::HugeMesh;
+    hugeMesh.triangleCount = 1'000'000;
+
+    SceneParameters smallMeshes;
+    smallMeshes.model = SceneModel::SmallMeshes;
+    smallMeshes.triangleCount = 1'000'000;
+    smallMeshes.meshCount = 1'000;
+
+    SceneParameters triangleSoup;
+    triangleSoup.model = SceneModel::TriangleSoup;
+    triangleSoup.triangleCount = 1'000'000;
+
+    SceneParameters instanceGrid;
+    instanceGrid.model = SceneModel::HugeMesh;
+    instanceGrid.triangleCount = 10'000;
+    instanceGrid.instanceCount = 1'000'000;
+
+    runner.add("createScene/huge-mesh", [hugeMesh]() { doNotOptimize(createScene(hugeMesh)); }, nullptr, hugeMesh.triangleCount);
+    runner.add("createScene/small-meshes", [smallMeshes]() { doNotOptimize(createScene(smallMeshes)); }, nullptr, smallMeshes.triangleCount);
+    runner.add("createScene/soup", [triangleSoup]() { doNotOptimize(createScene(triangleSoup)); }, nullptr, triangleSoup.triangleCount);
+    runner.add("createScene/instance-grid", [instanceGrid]() { doNotOptimize(createScene(instanceGrid)); }, nullptr, instanceGrid.instanceCount);
+
+    // Created on first use so that filtered runs don't pay for it
+    std::shared_ptr<Scene> scene(new Scene());
+    runner.add(
+        "assembleMesh/small-meshes",
+        [scene]() { doNotOptimize(assembleMesh(*scene->model)); },
+        [scene, smallMeshes]() {
+            if (!scene->model)
+            {
+                *scene = createScene(smallMeshes);
+            }
+        },
+        smallMeshes.triangleCount);
+
+    std::shared_ptr<MeshAssembly> assembly(new MeshAssembly());
+    const auto createAssembly = [assembly, smallMeshes]() {
+        if (assembly->vertices.empty())
+        {
+            *assembly = assembleMesh(*createScene(smallMeshes).model);
+        }
+    };
+    runner.add(
+        "packPositions/small-meshes", [assembly]() { doNotOptimize(packPositions(assembly->vertices)); }, createAssembly, smallMeshes.triangleCount);
+    runner.add(
+        "quantizePositions/small-meshes", [assembly]() { doNotOptimize(quantizePositions(assembly->vertices)); }, createAssembly, smallMeshes.triangleCount);
+    runner.add("bakeShadingData/small-meshes", [assembly]() { doNotOptimize(bakeShadingData(*assembly)); }, createAssembly, smallMeshes.triangleCount);
+
+    std::shared_ptr<Scene> grid(new Scene());
+    std::shared_ptr<std::vector<glm::mat4>> animatedTransforms(new std::vector<glm::mat4>());
+    runner.add(
+        "animateInstances/instance-grid",
+        [grid, animatedTransforms]() {
+            animateInstances(grid->instanceTransforms, grid->instanceExtent, 1.0, *animatedTransforms);
+            doNotOptimize(*animatedTransforms);
+        },
+        [grid, instanceGrid]() {
+            if (!grid->model)
+            {
+                *grid = createScene(instanceGrid);
+            }
+        },
+        instanceGrid.instanceCount);
+
+    const uint32_t lightCount = 10'000;
+    const std::vector<Light> lights = createLights(lightCount, glm::vec3(-10.0f, 0.0f, -10.0f), glm::vec3(10.0f, 10.0f, 10.0f), 1);
+    runner.add("buildLightTree/10k-lights", [lights]() { doNotOptimize(buildLightTree(lights)); }, nullptr, lightCount);
+}
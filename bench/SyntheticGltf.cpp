@@ -0,0 +1,117 @@
+#include "SyntheticGltf.hpp"
+#include "Utils.hpp"
+
+#define TINYGLTF_NOEXCEPTION
+#include <tiny_gltf.h>
+
+#include <cstring>
+
+namespace
+{
+// position, normal, uv, tangent
+const size_t c_vertexStride = sizeof(float) * (3 + 3 + 2 + 4);
+
+int addAccessor(tinygltf::Model& model, int bufferView, size_t byteOffset, int componentType, int type, size_t count)
+{
+    tinygltf::Accessor accessor;
+    accessor.bufferView = bufferView;
+    accessor.byteOffset = byteOffset;
+    accessor.componentType = componentType;
+    accessor.type = type;
+    accessor.count = count;
+    model.accessors.push_back(accessor);
+    return static_cast<int>(model.accessors.size()) - 1;
+}
+
+int addBufferView(tinygltf::Model& model, size_t byteOffset, size_t byteLength, size_t byteStride)
+{
+    tinygltf::BufferView bufferView;
+    bufferView.buffer = 0;
+    bufferView.byteOffset = byteOffset;
+    bufferView.byteLength = byteLength;
+    bufferView.byteStride = byteStride;
+    model.bufferViews.push_back(bufferView);
+    return static_cast<int>(model.bufferViews.size()) - 1;
+}
+} // namespace
+
+void createSyntheticGltf(tinygltf::Model& model, uint32_t primitiveCount, uint32_t verticesPerSide)
+{
+    CHECK(verticesPerSide >= 2 && verticesPerSide * verticesPerSide <= 65536);
+
+    const uint32_t quadsPerSide = verticesPerSide - 1;
+    const size_t vertexCount = verticesPerSide * verticesPerSide;
+    const size_t indexCount = quadsPerSide * quadsPerSide * 6;
+    const size_t vertexDataSize = vertexCount * c_vertexStride;
+    // Keep the index data 4 byte aligned like glTF requires for the following vertex data
+    const size_t indexDataSize = (indexCount * sizeof(uint16_t) + 3) & ~size_t(3);
+
+    model.buffers.resize(1);
+    std::vector<unsigned char>& data = model.buffers[0].data;
+    data.resize((vertexDataSize + indexDataSize) * primitiveCount);
+
+    model.meshes.resize(1);
+    model.meshes[0].primitives.resize(primitiveCount);
+
+    size_t offset = 0;
+    for (uint32_t p = 0; p < primitiveCount; ++p)
+    {
+        unsigned char* vertexPtr = &data[offset];
+        for (uint32_t z = 0; z < verticesPerSide; ++z)
+        {
+            for (uint32_t x = 0; x < verticesPerSide; ++x)
+            {
+                const float u = static_cast<float>(x) / quadsPerSide;
+                const float v = static_cast<float>(z) / quadsPerSide;
+                const float vertex[] = {u, static_cast<float>(p), v, 0.0f, 1.0f, 0.0f, u, v, 1.0f, 0.0f, 0.0f, 1.0f};
+                static_assert(sizeof(vertex) == c_vertexStride, "Vertex layout mismatch");
+                std::memcpy(vertexPtr, vertex, c_vertexStride);
+                vertexPtr += c_vertexStride;
+            }
+        }
+
+        uint16_t* indexPtr = reinterpret_cast<uint16_t*>(&data[offset + vertexDataSize]);
+        for (uint32_t z = 0; z < quadsPerSide; ++z)
+        {
+            for (uint32_t x = 0; x < quadsPerSide; ++x)
+            {
+                const uint16_t a = static_cast<uint16_t>(z * verticesPerSide + x);
+                const uint16_t b = a + 1;
+                const uint16_t c = static_cast<uint16_t>(a + verticesPerSide);
+                const uint16_t d = c + 1;
+                const uint16_t quad[] = {a, c, b, b, c, d};
+                std::memcpy(indexPtr, quad, sizeof(quad));
+                indexPtr += 6;
+            }
+        }
+
+        const int vertexView = addBufferView(model, offset, vertexDataSize, c_vertexStride);
+        const int indexView = addBufferView(model, offset + vertexDataSize, indexCount * sizeof(uint16_t), 0);
+
+        tinygltf::Primitive& primitive = model.meshes[0].primitives[p];
+        primitive.material = 0;
+        primitive.indices = addAccessor(model, indexView, 0, TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT, TINYGLTF_TYPE_SCALAR, indexCount);
+        primitive.attributes["POSITION"] = addAccessor(model, vertexView, 0, TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3, vertexCount);
+        primitive.attributes["NORMAL"] = addAccessor(model, vertexView, 12, TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3, vertexCount);
+        primitive.attributes["TEXCOORD_0"] = addAccessor(model, vertexView, 24, TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC2, vertexCount);
+        primitive.attributes["TANGENT"] = addAccessor(model, vertexView, 32, TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC4, vertexCount);
+
+        offset += vertexDataSize + indexDataSize;
+    }
+
+    model.materials.resize(1);
+}
+
+void addSyntheticImages(tinygltf::Model& model, uint32_t imageCount, uint32_t imageSize)
+{
+    model.images.resize(imageCount);
+    for (uint32_t i = 0; i < imageCount; ++i)
+    {
+        tinygltf::Image& image = model.images[i];
+        image.width = static_cast<int>(imageSize);
+        image.height = static_cast<int>(imageSize);
+        image.component = 4;
+        image.bits = 8;
+        image.image.assign(static_cast<size_t>(imageSize) * imageSize * 4, static_cast<unsigned char>(i));
+    }
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+
+namespace tinygltf
+{
+class Model;
+}
+
+// Builds a glTF model in memory with the same layout as Sponza: one mesh, interleaved
+// position/normal/uv/tangent vertices and 16-bit indices, so the loaders can be
+// benchmarked without assets on disk.
+void createSyntheticGltf(tinygltf::Model& model, uint32_t primitiveCount, uint32_t verticesPerSide);
+void addSyntheticImages(tinygltf::Model& model, uint32_t imageCount, uint32_t imageSize);
@@ -0,0 +1,170 @@
+#include "Benchmarks.hpp"
+#include "Utils.hpp"
+#include "JobSystem.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace
+{
+struct BenchOptions
+{
+    BenchmarkSettings settings;
+    std::string jsonFile;
+    std::string baselineFile;
+    double threshold = 0.05;
+    JobSystemSettings jobSystemSettings;
+};
+
+void printUsage()
+{
+    printf("Usage: vkrt-bench [options]\n"
+           "  --filter <text>         Run only benchmarks whose name contains text\n"
+           "  --warmup <n>            Untimed iterations before measuring, default 3\n"
+           "  --repetitions <n>       Timed iterations, default 20\n"
+           "  --core <n>              Pin the benchmark thread to core n, -1 to not pin, default 0\n"
+           "  --json <file>           Write results as JSON\n"
+           "  --baseline <file>       Compare against results written earlier with --json\n"
+           "  --threshold <percent>   Slowdown of the median counted as regression, default 5\n"
+           "  --threads <n>           Threads of the shared job system used by the non-scaling benchmarks, default all\n");
+}
+
+// Same as parseNumber of Options.cpp, the whole value must be a number and anything else exits with the usage
+template<typename T, typename Parse>
+T parseValue(const std::string& option, const std::string& value, Parse parse)
+{
+    size_t end = 0;
+    T number{};
+    try
+    {
+        number = parse(value, &end);
+    }
+    catch (...)
+    {
+        end = 0;
+    }
+
+    if (end == 0 || end != value.size())
+    {
+        printUsage();
+        LOGE(("Invalid value " + value + " for " + option).c_str());
+    }
+    return number;
+}
+
+uint32_t parseCount(const std::string& option, const std::string& value)
+{
+    const uint64_t number = parseValue<uint64_t>(option, value, [](const std::string& v, size_t* end) { return std::stoull(v, end); });
+    // std::stoull accepts a sign and wraps negative values around
+    if (value[0] == '-' || number > UINT32_MAX)
+    {
+        printUsage();
+        LOGE(("Invalid value " + value + " for " + option).c_str());
+    }
+    return static_cast<uint32_t>(number);
+}
+
+int parseInteger(const std::string& option, const std::string& value)
+{
+    return parseValue<int>(option, value, [](const std::string& v, size_t* end) { return std::stoi(v, end); });
+}
+
+double parseReal(const std::string& option, const std::string& value)
+{
+    return parseValue<double>(option, value, [](const std::string& v, size_t* end) { return std::stod(v, end); });
+}
+
+BenchOptions parseBenchOptions(int argc, char** argv)
+{
+    BenchOptions options;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string option = argv[i];
+        if (option == "--help")
+        {
+            printUsage();
+            exit(0);
+        }
+        if (i + 1 >= argc)
+        {
+            printUsage();
+            LOGE(("Missing value for " + option).c_str());
+        }
+        const std::string value = argv[++i];
+
+        if (option == "--filter")
+        {
+            options.settings.filter = value;
+        }
+        else if (option == "--warmup")
+        {
+            options.settings.warmupIterations = parseCount(option, value);
+        }
+        else if (option == "--repetitions")
+        {
+            options.settings.repetitions = parseCount(option, value);
+        }
+        else if (option == "--core")
+        {
+            options.settings.pinnedCore = parseInteger(option, value);
+        }
+        else if (option == "--json")
+        {
+            options.jsonFile = value;
+        }
+        else if (option == "--baseline")
+        {
+            options.baselineFile = value;
+        }
+        else if (option == "--threshold")
+        {
+            options.threshold = parseReal(option, value) / 100.0;
+        }
+        else if (option == "--threads")
+        {
+            options.jobSystemSettings.threadCount = parseCount(option, value);
+        }
+        else
+        {
+            printUsage();
+            LOGE(("Unknown option " + option).c_str());
+        }
+    }
+    return options;
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const BenchOptions options = parseBenchOptions(argc, argv);
+    JobSystem::configure(options.jobSystemSettings);
+    // Started before the runner pins this thread, whose affinity its workers would otherwise inherit
+    JobSystem::get();
+
+    BenchmarkRunner runner;
+    addModelBenchmarks(runner);
+    addSceneBenchmarks(runner);
+    addCameraBenchmarks(runner);
+    addJobSystemBenchmarks(runner);
+    addAnimationBenchmarks(runner);
+
+    const std::vector<BenchmarkResult> results = runner.run(options.settings);
+    printResults(results);
+
+    if (!options.jsonFile.empty())
+    {
+        writeResultsJson(results, options.jsonFile);
+    }
+
+    if (!options.baselineFile.empty())
+    {
+        const uint32_t regressionCount = compareToBaseline(results, readResultsJson(options.baselineFile), options.threshold);
+        if (regressionCount > 0)
+        {
+            printf("%u benchmarks regressed\n", regressionCount);
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -5,6 +5,12 @@ layout(set = 1, binding = 0) uniform sampler2D baseColor;
 layout(set = 1, binding = 1) uniform sampler2D metallicRoughness;
 layout(set = 1, binding = 2) uniform sampler2D normal;
 
+layout(push_constant) uniform PushConstants
+{
+    float alphaCutoff;
+}
+pushConstants;
+
 layout(location = 0) in vec3 inNormal;
 layout(location = 1) in vec2 inUv;
 
@@ -13,9 +19,8 @@ layout(location = 0) out vec4 outColor;
 void main()
 {
     vec4 color = texture(baseColor, inUv);
-    if (color.a < 0.1)
+    if (color.a < pushConstants.alphaCutoff)
     {
-        // A bit nasty but works for this case.
         discard;
     }
     outColor = color;
@@ -5,10 +5,11 @@ layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inNormal;
 layout(location = 2) in vec2 inUv;
 layout(location = 3) in vec4 inTangent;
+layout(location = 4) in mat4 inModelMatrix;
 
 layout(set = 0, binding = 0) uniform UBO
 {
-    mat4 wvpMatrix;
+    mat4 viewProjectionMatrix;
 }
 ubo;
 
@@ -17,7 +18,7 @@ layout(location = 1) out vec2 outUv;
 
 void main()
 {
-    gl_Position = ubo.wvpMatrix * vec4(inPosition, 1.0);
+    gl_Position = ubo.viewProjectionMatrix * inModelMatrix * vec4(inPosition, 1.0);
     outNormal = inNormal;
     outUv = inUv;
 }
@@ -0,0 +1,124 @@
+#include "AccelerationStructureCache.hpp"
+#include "Utils.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+const uint32_t c_magic = 0x43535256; // "VRSC"
+const uint32_t c_version = 1;
+const char* c_cacheFolder = "cache";
+// Magic, version and acceleration structure count
+const uint64_t c_fileHeaderSize = 3 * sizeof(uint32_t);
+
+// Serialization header: driver UUID, compatibility UUID, serialized size, deserialized size, handle count
+const size_t c_uuidSize = 16;
+const size_t c_deserializedSizeOffset = 2 * c_uuidSize + sizeof(uint64_t);
+
+template<typename T>
+bool readValue(std::ifstream& file, T& value)
+{
+    file.read(reinterpret_cast<char*>(&value), sizeof(T));
+    return file.good();
+}
+
+template<typename T>
+void writeValue(std::ofstream& file, const T& value)
+{
+    file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+} // namespace
+
+std::filesystem::path getAccelerationStructureCachePath(uint64_t key)
+{
+    char fileName[32];
+    snprintf(fileName, sizeof(fileName), "as-%016llx.bin", static_cast<unsigned long long>(key));
+    return getCurrentExecutableDirectory() / c_cacheFolder / fileName;
+}
+
+bool readAccelerationStructureCache(const std::filesystem::path& path, std::vector<SerializedAccelerationStructure>& accelerationStructures)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open())
+    {
+        return false;
+    }
+    const uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+    file.seekg(0);
+
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    uint32_t count = 0;
+    if (!readValue(file, magic) || !readValue(file, version) || !readValue(file, count) || magic != c_magic || version != c_version)
+    {
+        return false;
+    }
+
+    // Every acceleration structure has at least its size, so a corrupt count can't allocate more than the file holds
+    if (count > (fileSize - c_fileHeaderSize) / sizeof(uint64_t))
+    {
+        return false;
+    }
+
+    accelerationStructures.resize(count);
+    for (SerializedAccelerationStructure& accelerationStructure : accelerationStructures)
+    {
+        uint64_t size = 0;
+        if (!readValue(file, size) || size > fileSize - static_cast<uint64_t>(file.tellg()))
+        {
+            return false;
+        }
+        accelerationStructure.resize(size);
+        file.read(reinterpret_cast<char*>(accelerationStructure.data()), size);
+        if (!file.good())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool writeAccelerationStructureCache(const std::filesystem::path& path, const std::vector<SerializedAccelerationStructure>& accelerationStructures)
+{
+    std::error_code error;
+    std::filesystem::create_directories(path.parent_path(), error);
+
+    // Written to a temporary file first so that an interrupted write never leaves a broken cache file
+    std::filesystem::path temporaryPath = path;
+    temporaryPath += ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+        {
+            return false;
+        }
+
+        writeValue(file, c_magic);
+        writeValue(file, c_version);
+        writeValue(file, ui32Size(accelerationStructures));
+        for (const SerializedAccelerationStructure& accelerationStructure : accelerationStructures)
+        {
+            writeValue(file, static_cast<uint64_t>(accelerationStructure.size()));
+            file.write(reinterpret_cast<const char*>(accelerationStructure.data()), accelerationStructure.size());
+        }
+        if (!file.good())
+        {
+            return false;
+        }
+    }
+
+    std::filesystem::rename(temporaryPath, path, error);
+    return !error;
+}
+
+uint64_t getDeserializedSize(const SerializedAccelerationStructure& accelerationStructure)
+{
+    if (accelerationStructure.size() < c_deserializedSizeOffset + sizeof(uint64_t))
+    {
+        return 0;
+    }
+    uint64_t size;
+    std::memcpy(&size, accelerationStructure.data() + c_deserializedSizeOffset, sizeof(uint64_t));
+    return size;
+}
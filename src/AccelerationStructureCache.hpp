@@ -0,0 +1,16 @@
+#pragma once
+
+#include <filesystem>
+#include <vector>
+#include <cstdint>
+
+// Acceleration structures serialized by vkCmdCopyAccelerationStructureToMemoryKHR
+using SerializedAccelerationStructure = std::vector<uint8_t>;
+
+// The key must cover everything that affects the build: geometry, build flags, device and driver
+std::filesystem::path getAccelerationStructureCachePath(uint64_t key);
+// Returns false if the file doesn't exist or isn't a complete cache file
+bool readAccelerationStructureCache(const std::filesystem::path& path, std::vector<SerializedAccelerationStructure>& accelerationStructures);
+bool writeAccelerationStructureCache(const std::filesystem::path& path, const std::vector<SerializedAccelerationStructure>& accelerationStructures);
+// Size of the acceleration structure when deserialized, read from the serialization header, 0 if the header is incomplete
+uint64_t getDeserializedSize(const SerializedAccelerationStructure& accelerationStructure);
@@ -0,0 +1,372 @@
+#include "AdaptiveSampler.hpp"
+#include "DebugMarker.hpp"
+#include "Utils.hpp"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <numeric>
+
+namespace
+{
+// Values of the c_stage specialization constant of adaptive_sampling.comp
+const uint32_t c_stageEstimate = 0;
+const uint32_t c_stageAllocate = 1;
+const uint32_t c_stageCount = 2;
+const std::array<const char*, c_stageCount> c_stageNames{"estimate", "allocate"};
+
+// Same as local_size_x and local_size_y in adaptive_sampling.comp
+const uint32_t c_workGroupSize = 8;
+// Same as in adaptive_sampling.comp, the error sums are in fixed point
+const double c_fixedPointScale = 1023.0;
+// Every pixel adds at most c_fixedPointScale to the 32-bit sums, e.g. with an error of 1 on every pixel after a reset,
+// and 1023 * 4M is still below 2^32
+const uint32_t c_maxPixelCount = 4u << 20;
+const VkFormat c_statisticsFormat = VK_FORMAT_R32G32B32A32_SFLOAT;
+// Weight, error, converged pixel and sample sums of the SamplingState block
+const uint32_t c_stateValueCount = 4;
+const VkDeviceSize c_stateSize = sizeof(uint32_t) * c_stateValueCount;
+
+struct PushConstants
+{
+    uint32_t sampleIndex;
+    uint32_t frameIndex;
+};
+
+struct SpecializationData
+{
+    uint32_t stage;
+    VkBool32 adaptive;
+    uint32_t samplesPerPixel;
+};
+} // namespace
+
+AdaptiveSampler::AdaptiveSampler(const InitData& initData) :
+    m_device(initData.device),
+    m_physicalDevice(initData.physicalDevice),
+    m_extent(initData.extent),
+    m_pixelCount(initData.extent.width * initData.extent.height),
+    m_adaptive(initData.adaptive),
+    m_samplesPerPixel(initData.samplesPerPixel),
+    m_statePending(initData.slotCount, false),
+    m_slotSampleIndices(initData.slotCount, 0),
+    m_slotFrameNumbers(initData.slotCount, 0)
+{
+    CHECK(m_samplesPerPixel > 0);
+    CHECK(m_pixelCount <= c_maxPixelCount);
+
+    m_statistics = createStorageImage(m_device, m_physicalDevice, initData.commandPool, initData.queue, m_extent, c_statisticsFormat, VK_IMAGE_USAGE_STORAGE_BIT, "Sample statistics");
+    createBuffers();
+    createDescriptorSet(initData.accumulationView);
+    createPipelines();
+
+    const std::string modeName = m_adaptive ? "adaptive" : "uniform";
+    m_timer = std::make_unique<GpuTimer>("sample allocation " + modeName, m_device, m_physicalDevice, initData.slotCount);
+    m_timer->setItemCount(m_pixelCount, "pixel");
+
+    printf("Sampling: %s, %u samples per pixel and frame\n", modeName.c_str(), m_samplesPerPixel);
+}
+
+AdaptiveSampler::~AdaptiveSampler()
+{
+    vkDeviceWaitIdle(m_device);
+    // Oldest first, so that the last frame read is the last one recorded
+    std::vector<uint32_t> slots(m_statePending.size());
+    std::iota(slots.begin(), slots.end(), 0);
+    std::sort(slots.begin(), slots.end(), [this](uint32_t a, uint32_t b) { return m_slotFrameNumbers[a] < m_slotFrameNumbers[b]; });
+    for (uint32_t slot : slots)
+    {
+        readState(slot);
+    }
+
+    if (m_frameCount > 0)
+    {
+        printf("Sampling %s: %.2f samples per pixel and frame over %llu frames. Last frame: %.1f samples per pixel since the restart, "
+               "estimated relative error %.4f, %.1f%% converged after %.1f samples per pixel\n",
+               m_adaptive ? "adaptive" : "uniform",
+               static_cast<double>(m_totalSampleCount) / (static_cast<double>(m_frameCount) * m_pixelCount),
+               static_cast<unsigned long long>(m_frameCount),
+               m_samplesSinceReset,
+               m_meanError,
+               100.0 * m_convergedFraction,
+               m_errorSamplesPerPixel);
+    }
+
+    m_timer.reset();
+
+    for (VkPipeline pipeline : m_pipelines)
+    {
+        vkDestroyPipeline(m_device, pipeline, nullptr);
+    }
+    vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+    vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, nullptr);
+
+    vkUnmapMemory(m_device, m_stateReadbackBuffer.memory);
+    destroyBufferAndFreeMemory(m_device, m_stateBuffer.buffer, m_stateBuffer.memory);
+    destroyBufferAndFreeMemory(m_device, m_stateReadbackBuffer.buffer, m_stateReadbackBuffer.memory);
+    destroyStorageImage(m_device, m_statistics);
+}
+
+void AdaptiveSampler::record(VkCommandBuffer commandBuffer, uint32_t slot, uint32_t sampleIndex, uint32_t frameIndex)
+{
+    readState(slot);
+
+    DebugMarker::beginLabel(commandBuffer, "Sample allocation", DebugMarker::green);
+    m_timer->begin(commandBuffer, slot);
+
+    // The previous frame's ray generation shader has written the images and its state copy has read the sums
+    VkMemoryBarrier inputBarrier{};
+    inputBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    inputBarrier.pNext = NULL;
+    inputBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    inputBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0,
+                         1,
+                         &inputBarrier,
+                         0,
+                         nullptr,
+                         0,
+                         nullptr);
+
+    vkCmdFillBuffer(commandBuffer, m_stateBuffer.buffer, 0, c_stateSize, 0);
+    VkMemoryBarrier clearBarrier{};
+    clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    clearBarrier.pNext = NULL;
+    clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
+    dispatch(commandBuffer, c_stageEstimate, sampleIndex, frameIndex);
+
+    // The allocation divides by the weight sum of all pixels
+    VkMemoryBarrier estimateBarrier{};
+    estimateBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    estimateBarrier.pNext = NULL;
+    estimateBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    estimateBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &estimateBarrier, 0, nullptr, 0, nullptr);
+
+    dispatch(commandBuffer, c_stageAllocate, sampleIndex, frameIndex);
+
+    // The ray generation shader reads the sample counts and updates the statistics
+    VkMemoryBarrier outputBarrier{};
+    outputBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    outputBarrier.pNext = NULL;
+    outputBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    outputBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 1, &outputBarrier, 0, nullptr, 0, nullptr);
+
+    m_timer->end(commandBuffer, slot);
+
+    recordStateCopy(commandBuffer, slot);
+    m_slotSampleIndices[slot] = sampleIndex;
+    m_slotFrameNumbers[slot] = m_recordedFrameCount++;
+
+    DebugMarker::endLabel(commandBuffer);
+}
+
+void AdaptiveSampler::createBuffers()
+{
+    m_stateBuffer.buffer = createBuffer(m_device, c_stateSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    m_stateBuffer.memory = allocateAndBindMemory(m_device, m_physicalDevice, m_stateBuffer.buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_BUFFER, m_stateBuffer.buffer, "Buffer - Sampling state");
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_DEVICE_MEMORY, m_stateBuffer.memory, "Memory - Sampling state");
+
+    const uint32_t slotCount = ui32Size(m_statePending);
+    m_stateReadbackBuffer.buffer = createBuffer(m_device, slotCount * c_stateSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    m_stateReadbackBuffer.memory = allocateAndBindMemory(m_device, m_physicalDevice, m_stateReadbackBuffer.buffer, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_BUFFER, m_stateReadbackBuffer.buffer, "Buffer - Sampling state readback");
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_DEVICE_MEMORY, m_stateReadbackBuffer.memory, "Memory - Sampling state readback");
+    void* stateMapped;
+    VK_CHECK(vkMapMemory(m_device, m_stateReadbackBuffer.memory, 0, VK_WHOLE_SIZE, 0, &stateMapped));
+    m_stateReadback = static_cast<const uint32_t*>(stateMapped);
+}
+
+void AdaptiveSampler::createDescriptorSet(VkImageView accumulationView)
+{
+    std::array<VkDescriptorSetLayoutBinding, 3> bindings{};
+    for (uint32_t i = 0; i < ui32Size(bindings); ++i)
+    {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = i < 2 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        bindings[i].pImmutableSamplers = nullptr;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = ui32Size(bindings);
+    layoutInfo.pBindings = bindings.data();
+
+    VK_CHECK(vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &m_descriptorSetLayout));
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, m_descriptorSetLayout, "Desc set layout - Adaptive sampling");
+
+    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSizes[0].descriptorCount = 2;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[1].descriptorCount = 1;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = ui32Size(poolSizes);
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = 1;
+
+    VK_CHECK(vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &m_descriptorPool));
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_DESCRIPTOR_POOL, m_descriptorPool, "Descriptor pool - Adaptive sampling");
+
+    VkDescriptorSetAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocateInfo.pNext = NULL;
+    allocateInfo.descriptorPool = m_descriptorPool;
+    allocateInfo.descriptorSetCount = 1;
+    allocateInfo.pSetLayouts = &m_descriptorSetLayout;
+
+    VK_CHECK(vkAllocateDescriptorSets(m_device, &allocateInfo, &m_descriptorSet));
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_DESCRIPTOR_SET, m_descriptorSet, "Desc set - Adaptive sampling");
+
+    // In binding order of the shader
+    const std::array<VkDescriptorImageInfo, 2> imageInfos{{
+        {VK_NULL_HANDLE, accumulationView, VK_IMAGE_LAYOUT_GENERAL}, //
+        {VK_NULL_HANDLE, m_statistics.view, VK_IMAGE_LAYOUT_GENERAL} //
+    }};
+    const VkDescriptorBufferInfo bufferInfo{m_stateBuffer.buffer, 0, VK_WHOLE_SIZE};
+
+    std::array<VkWriteDescriptorSet, 3> descriptorWrites{};
+    for (uint32_t i = 0; i < ui32Size(descriptorWrites); ++i)
+    {
+        descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[i].pNext = NULL;
+        descriptorWrites[i].dstSet = m_descriptorSet;
+        descriptorWrites[i].dstBinding = i;
+        descriptorWrites[i].dstArrayElement = 0;
+        descriptorWrites[i].descriptorCount = 1;
+        descriptorWrites[i].descriptorType = bindings[i].descriptorType;
+        descriptorWrites[i].pImageInfo = i < 2 ? &imageInfos[i] : nullptr;
+        descriptorWrites[i].pBufferInfo = i < 2 ? nullptr : &bufferInfo;
+    }
+
+    vkUpdateDescriptorSets(m_device, ui32Size(descriptorWrites), descriptorWrites.data(), 0, nullptr);
+}
+
+void AdaptiveSampler::createPipelines()
+{
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(PushConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    VK_CHECK(vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_pipelineLayout));
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_PIPELINE_LAYOUT, m_pipelineLayout, "Pipeline layout - Adaptive sampling");
+
+    VkShaderModule shaderModule = createShaderModule(m_device, getCurrentExecutableDirectory() / "adaptive_sampling.comp.spv");
+
+    const std::array<VkSpecializationMapEntry, 3> mapEntries{{
+        {0, offsetof(SpecializationData, stage), sizeof(uint32_t)}, //
+        {1, offsetof(SpecializationData, adaptive), sizeof(VkBool32)}, //
+        {2, offsetof(SpecializationData, samplesPerPixel), sizeof(uint32_t)} //
+    }};
+    std::vector<SpecializationData> specializationData(c_stageCount);
+    std::vector<VkSpecializationInfo> specializationInfos(c_stageCount);
+    std::vector<VkComputePipelineCreateInfo> pipelineInfos(c_stageCount);
+    for (uint32_t stage = 0; stage < c_stageCount; ++stage)
+    {
+        specializationData[stage].stage = stage;
+        specializationData[stage].adaptive = m_adaptive ? VK_TRUE : VK_FALSE;
+        specializationData[stage].samplesPerPixel = m_samplesPerPixel;
+
+        specializationInfos[stage].mapEntryCount = ui32Size(mapEntries);
+        specializationInfos[stage].pMapEntries = mapEntries.data();
+        specializationInfos[stage].dataSize = sizeof(SpecializationData);
+        specializationInfos[stage].pData = &specializationData[stage];
+
+        VkComputePipelineCreateInfo& pipelineInfo = pipelineInfos[stage];
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.pNext = NULL;
+        pipelineInfo.flags = 0;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.pNext = NULL;
+        pipelineInfo.stage.flags = 0;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.stage.pSpecializationInfo = &specializationInfos[stage];
+        pipelineInfo.layout = m_pipelineLayout;
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+        pipelineInfo.basePipelineIndex = 0;
+    }
+
+    m_pipelines.resize(c_stageCount);
+    VK_CHECK(vkCreateComputePipelines(m_device, VK_NULL_HANDLE, ui32Size(pipelineInfos), pipelineInfos.data(), nullptr, m_pipelines.data()));
+    for (uint32_t stage = 0; stage < c_stageCount; ++stage)
+    {
+        DebugMarker::setObjectName(VK_OBJECT_TYPE_PIPELINE, m_pipelines[stage], std::string("Pipeline - Adaptive sampling ") + c_stageNames[stage]);
+    }
+
+    vkDestroyShaderModule(m_device, shaderModule, nullptr);
+}
+
+void AdaptiveSampler::dispatch(VkCommandBuffer commandBuffer, uint32_t stage, uint32_t sampleIndex, uint32_t frameIndex)
+{
+    const PushConstants pushConstants{sampleIndex, frameIndex};
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelines[stage]);
+    vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+    vkCmdDispatch(commandBuffer, (m_extent.width + c_workGroupSize - 1) / c_workGroupSize, (m_extent.height + c_workGroupSize - 1) / c_workGroupSize, 1);
+}
+
+void AdaptiveSampler::recordStateCopy(VkCommandBuffer commandBuffer, uint32_t slot)
+{
+    VkMemoryBarrier copyBarrier{};
+    copyBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    copyBarrier.pNext = NULL;
+    copyBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    copyBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &copyBarrier, 0, nullptr, 0, nullptr);
+
+    VkBufferCopy copyRegion{0, slot * c_stateSize, c_stateSize};
+    vkCmdCopyBuffer(commandBuffer, m_stateBuffer.buffer, m_stateReadbackBuffer.buffer, 1, &copyRegion);
+
+    VkMemoryBarrier hostBarrier{};
+    hostBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    hostBarrier.pNext = NULL;
+    hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &hostBarrier, 0, nullptr, 0, nullptr);
+
+    m_statePending[slot] = true;
+}
+
+void AdaptiveSampler::readState(uint32_t slot)
+{
+    if (!m_statePending[slot])
+    {
+        return;
+    }
+
+    // Like the GPU timers, the command buffer of the slot has finished when it is recorded again
+    const uint32_t* state = m_stateReadback + slot * c_stateValueCount;
+    if (m_slotSampleIndices[slot] == 0)
+    {
+        m_samplesSinceReset = 0.0;
+    }
+    m_errorSamplesPerPixel = m_samplesSinceReset;
+    m_meanError = static_cast<double>(state[1]) / (c_fixedPointScale * m_pixelCount);
+    m_convergedFraction = static_cast<double>(state[2]) / m_pixelCount;
+    m_samplesSinceReset += static_cast<double>(state[3]) / m_pixelCount;
+    m_totalSampleCount += state[3];
+    ++m_frameCount;
+    m_statePending[slot] = false;
+}
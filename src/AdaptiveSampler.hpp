@@ -0,0 +1,97 @@
+#pragma once
+
+#include "GpuTimer.hpp"
+#include "VulkanUtils.hpp"
+#include <vulkan/vulkan.h>
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+// Spends a fixed budget of samples per frame where the accumulation is still noisy. The ray generation shader tracks
+// the sample count and luminance moment of every pixel in a statistics image next to the accumulation image. Before
+// each frame, compute passes estimate the relative error of every pixel mean from them and write the samples to trace
+// per pixel into the same image, proportional to the error and none once converged. Uniform mode gives every pixel the
+// same samples and only tracks the error, for comparing the two at the same ray count.
+class AdaptiveSampler final
+{
+public:
+    struct InitData
+    {
+        VkDevice device;
+        VkPhysicalDevice physicalDevice;
+        // Used for creating the image, must not be in use by other threads during construction
+        VkCommandPool commandPool;
+        VkQueue queue;
+        VkExtent2D extent;
+        // RGBA32F running average written by the ray generation shader
+        VkImageView accumulationView;
+        bool adaptive;
+        // Average samples per pixel and frame
+        uint32_t samplesPerPixel;
+        uint32_t slotCount;
+    };
+
+    AdaptiveSampler(const InitData& initData);
+    // Prints the samples traced and the estimated error of the last measured frame
+    ~AdaptiveSampler();
+
+    // RGBA32F samples since the last reset, mean luminance square and the samples to trace this frame
+    VkImageView getStatisticsView() const { return m_statistics.view; }
+
+    // Records the error estimate and the sample allocation with barriers on both sides. The previous frame's ray
+    // generation shader must have written the accumulation and statistics images, afterwards the ray generation
+    // shader can read them. sampleIndex is the one of the uniform buffer, 0 restarts the statistics.
+    void record(VkCommandBuffer commandBuffer, uint32_t slot, uint32_t sampleIndex, uint32_t frameIndex);
+
+private:
+    struct Buffer
+    {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+    };
+
+    void createBuffers();
+    void createDescriptorSet(VkImageView accumulationView);
+    void createPipelines();
+    void dispatch(VkCommandBuffer commandBuffer, uint32_t stage, uint32_t sampleIndex, uint32_t frameIndex);
+    void recordStateCopy(VkCommandBuffer commandBuffer, uint32_t slot);
+    void readState(uint32_t slot);
+
+    VkDevice m_device;
+    VkPhysicalDevice m_physicalDevice;
+    const VkExtent2D m_extent;
+    const uint32_t m_pixelCount;
+    const bool m_adaptive;
+    const uint32_t m_samplesPerPixel;
+
+    StorageImage m_statistics;
+    // Error and sample sums of the current frame
+    Buffer m_stateBuffer;
+    // Per slot copy of the sums, read when the slot is recorded again
+    Buffer m_stateReadbackBuffer;
+    const uint32_t* m_stateReadback = nullptr;
+    std::vector<bool> m_statePending;
+    // sampleIndex and number of the frame recorded in each slot
+    std::vector<uint32_t> m_slotSampleIndices;
+    std::vector<uint64_t> m_slotFrameNumbers;
+    uint64_t m_recordedFrameCount = 0;
+
+    // Totals of the frames read back so far
+    uint64_t m_frameCount = 0;
+    uint64_t m_totalSampleCount = 0;
+    // Samples per pixel since the last restart, up to the last frame read back
+    double m_samplesSinceReset = 0.0;
+    // Estimated before the last frame read back traced its samples, over m_errorSamplesPerPixel samples per pixel
+    double m_meanError = 0.0;
+    double m_convergedFraction = 0.0;
+    double m_errorSamplesPerPixel = 0.0;
+
+    VkDescriptorSetLayout m_descriptorSetLayout;
+    VkDescriptorPool m_descriptorPool;
+    VkDescriptorSet m_descriptorSet;
+    VkPipelineLayout m_pipelineLayout;
+    // Indexed by the stage
+    std::vector<VkPipeline> m_pipelines;
+
+    std::unique_ptr<GpuTimer> m_timer;
+};
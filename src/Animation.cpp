@@ -0,0 +1,145 @@
+#include "Animation.hpp"
+#include "Utils.hpp"
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtx/transform.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+// Vertices per job, small enough to balance and large enough to amortize the scheduling
+const size_t c_skinningChunkSize = 4096;
+
+glm::quat toQuat(const glm::vec4& value)
+{
+    return glm::quat(value.w, value.x, value.y, value.z);
+}
+
+glm::vec4 sampleChannel(const Model::AnimationChannel& channel, float time)
+{
+    const std::vector<float>& times = channel.times;
+    if (time <= times.front())
+    {
+        return channel.values.front();
+    }
+    if (time >= times.back())
+    {
+        return channel.values.back();
+    }
+
+    const size_t next = static_cast<size_t>(std::upper_bound(times.begin(), times.end(), time) - times.begin());
+    const size_t previous = next - 1;
+    if (channel.interpolation == Model::Interpolation::Step)
+    {
+        return channel.values[previous];
+    }
+
+    const float t = (time - times[previous]) / (times[next] - times[previous]);
+    if (channel.path == Model::AnimationPath::Rotation)
+    {
+        const glm::quat rotation = glm::slerp(toQuat(channel.values[previous]), toQuat(channel.values[next]), t);
+        return glm::vec4(rotation.x, rotation.y, rotation.z, rotation.w);
+    }
+    return glm::mix(channel.values[previous], channel.values[next], t);
+}
+
+glm::mat4 getLocalMatrix(const Model::Node& node)
+{
+    if (node.hasMatrix)
+    {
+        return node.matrix;
+    }
+    return glm::translate(node.translation) * glm::mat4_cast(node.rotation) * glm::scale(node.scale);
+}
+
+glm::vec3 transformDirection(const glm::mat4& matrix, const glm::vec4& direction)
+{
+    // Not the inverse transpose, so non-uniform joint scales skew the normals slightly
+    const glm::vec3 transformed = glm::vec3(matrix * glm::vec4(glm::vec3(direction), 0.0f));
+    const float length = glm::length(transformed);
+    return length > 0.0f ? transformed / length : glm::vec3(direction);
+}
+} // namespace
+
+void poseSkeleton(const Model::Skeleton& skeleton, double time, SkeletonPose& pose)
+{
+    pose.localTransforms = skeleton.nodes;
+
+    if (!skeleton.animations.empty())
+    {
+        const Model::Animation& animation = skeleton.animations[0];
+        const float animationTime = animation.duration > 0.0f ? static_cast<float>(std::fmod(time, static_cast<double>(animation.duration))) : 0.0f;
+        for (const Model::AnimationChannel& channel : animation.channels)
+        {
+            if (channel.times.empty())
+            {
+                continue;
+            }
+
+            const glm::vec4 value = sampleChannel(channel, animationTime);
+            Model::Node& node = pose.localTransforms[channel.node];
+            switch (channel.path)
+            {
+            case Model::AnimationPath::Translation:
+                node.translation = glm::vec3(value);
+                break;
+            case Model::AnimationPath::Rotation:
+                node.rotation = glm::normalize(toQuat(value));
+                break;
+            case Model::AnimationPath::Scale:
+                node.scale = glm::vec3(value);
+                break;
+            }
+        }
+    }
+
+    pose.globalTransforms.resize(skeleton.nodes.size());
+    for (int node : skeleton.nodeOrder)
+    {
+        const Model::Node& localTransform = pose.localTransforms[node];
+        const glm::mat4 localMatrix = getLocalMatrix(localTransform);
+        pose.globalTransforms[node] = localTransform.parent < 0 ? localMatrix : pose.globalTransforms[localTransform.parent] * localMatrix;
+    }
+
+    pose.jointMatrices.resize(skeleton.joints.size());
+    for (size_t i = 0; i < skeleton.joints.size(); ++i)
+    {
+        pose.jointMatrices[i] = pose.globalTransforms[skeleton.joints[i]] * skeleton.inverseBindMatrices[i];
+    }
+}
+
+void skinVertices(const std::vector<Model::Vertex>& restVertices,
+                  const std::vector<Model::SkinVertex>& skinVertices,
+                  const std::vector<glm::mat4>& jointMatrices,
+                  std::vector<Model::Vertex>& vertices,
+                  JobSystem& jobSystem)
+{
+    CHECK(restVertices.size() == skinVertices.size());
+    vertices.resize(restVertices.size());
+
+    jobSystem.parallelFor(restVertices.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const Model::Vertex& restVertex = restVertices[i];
+            const Model::SkinVertex& skinVertex = skinVertices[i];
+            const glm::vec4& weights = skinVertex.weights;
+            if (weights.x + weights.y + weights.z + weights.w <= 0.0f)
+            {
+                vertices[i] = restVertex;
+                continue;
+            }
+
+            const glm::mat4 skinMatrix = //
+                jointMatrices[skinVertex.joints.x] * weights.x + //
+                jointMatrices[skinVertex.joints.y] * weights.y + //
+                jointMatrices[skinVertex.joints.z] * weights.z + //
+                jointMatrices[skinVertex.joints.w] * weights.w;
+
+            Model::Vertex& vertex = vertices[i];
+            vertex.position = glm::vec4(glm::vec3(skinMatrix * glm::vec4(glm::vec3(restVertex.position), 1.0f)), restVertex.position.w);
+            vertex.normal = glm::vec4(transformDirection(skinMatrix, restVertex.normal), restVertex.normal.w);
+            vertex.uv = restVertex.uv;
+            vertex.tangent = glm::vec4(transformDirection(skinMatrix, restVertex.tangent), restVertex.tangent.w);
+        }
+    }, c_skinningChunkSize);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "Model.hpp"
+#include "JobSystem.hpp"
+#include <glm/glm.hpp>
+#include <vector>
+
+// Result of posing a skeleton, kept between frames so that posing doesn't allocate
+struct SkeletonPose
+{
+    std::vector<Model::Node> localTransforms;
+    std::vector<glm::mat4> globalTransforms;
+    // Skinning matrix of each joint, from the rest pose to the posed model space
+    std::vector<glm::mat4> jointMatrices;
+};
+
+// Samples the first animation at time in seconds, looping it, and computes the joint matrices.
+// Without animations the joint matrices are for the rest pose.
+void poseSkeleton(const Model::Skeleton& skeleton, double time, SkeletonPose& pose);
+// Linear blend skinning of positions, normals and tangents. CPU reference of the skinning shader.
+void skinVertices(const std::vector<Model::Vertex>& restVertices,
+                  const std::vector<Model::SkinVertex>& skinVertices,
+                  const std::vector<glm::mat4>& jointMatrices,
+                  std::vector<Model::Vertex>& vertices,
+                  JobSystem& jobSystem = JobSystem::get());
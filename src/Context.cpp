@@ -119,18 +119,23 @@ VkSurfaceKHR Context::getSurface() const
     return m_surface;
 }
 
-bool Context::update()
+bool Context::update(double eventWaitTimeout)
 {
-    glfwPollEvents();
+    if (eventWaitTimeout > 0.0)
+    {
+        glfwWaitEventsTimeout(eventWaitTimeout);
+    }
+    else
+    {
+        glfwPollEvents();
+    }
     glfwGetCursorPos(m_window, &m_cursorPosition.x, &m_cursorPosition.y);
     return !(glfwWindowShouldClose(m_window) || m_shouldQuit);
 }
 
-std::vector<Context::KeyEvent> Context::getKeyEvents()
+bool Context::popKeyEvent(KeyEvent& event)
 {
-    std::vector<KeyEvent> events = m_keyEvents;
-    m_keyEvents.clear();
-    return events;
+    return m_keyEvents.pop(event);
 }
 
 glm::dvec2 Context::getCursorPosition()
@@ -250,7 +255,10 @@ void Context::handleKey(GLFWwindow* /*window*/, int key, int /*scancode*/, int a
     {
         m_shouldQuit = true;
     }
-    m_keyEvents.push_back({key, action});
+    if (!m_keyEvents.push({key, action}))
+    {
+        LOGW("Key event queue is full, dropping the event");
+    }
 }
 
 void Context::enumeratePhysicalDevice()
@@ -345,9 +353,15 @@ void Context::createDevice()
     physicalDeviceRayTracingPipelineFeatures.rayTracingPipelineTraceRaysIndirect = VK_FALSE;
     physicalDeviceRayTracingPipelineFeatures.rayTraversalPrimitiveCulling = VK_FALSE;
 
+    // For the compute renderer that traces with ray queries
+    VkPhysicalDeviceRayQueryFeaturesKHR physicalDeviceRayQueryFeatures{};
+    physicalDeviceRayQueryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_QUERY_FEATURES_KHR;
+    physicalDeviceRayQueryFeatures.pNext = &physicalDeviceRayTracingPipelineFeatures;
+    physicalDeviceRayQueryFeatures.rayQuery = VK_TRUE;
+
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    createInfo.pNext = &physicalDeviceRayTracingPipelineFeatures;
+    createInfo.pNext = &physicalDeviceRayQueryFeatures;
     createInfo.queueCreateInfoCount = ui32Size(queueCreateInfos);
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
     createInfo.pEnabledFeatures = &deviceFeatures;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "VulkanUtils.hpp"
+#include "SpscQueue.hpp"
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 #include <vector>
@@ -26,8 +27,11 @@ public:
     VkCommandPool getGraphicsCommandPool() const;
     VkSurfaceKHR getSurface() const;
 
-    bool update();
-    std::vector<KeyEvent> getKeyEvents();
+    // Must be called from the main thread. Waits up to eventWaitTimeout seconds for input, 0 only polls.
+    bool update(double eventWaitTimeout = 0.0);
+    // Key events are pushed by update() and popped by the main thread's simulation, which hands their effects to the
+    // render thread with the rest of the frame state. The queue would also allow a single consumer on another thread.
+    bool popKeyEvent(KeyEvent& event);
     glm::dvec2 getCursorPosition();
     uint32_t acquireNextSwapchainImage();
     void submitCommandBuffers(const std::vector<VkCommandBuffer>& commandBuffers);
@@ -48,7 +52,7 @@ private:
     VkDebugUtilsMessengerEXT m_debugMessenger;
     GLFWwindow* m_window;
     bool m_shouldQuit = false;
-    std::vector<KeyEvent> m_keyEvents;
+    SpscQueue<KeyEvent, 256> m_keyEvents;
     glm::dvec2 m_cursorPosition;
     VkSurfaceKHR m_surface;
     VkPhysicalDevice m_physicalDevice;
@@ -0,0 +1,344 @@
+#include "Denoiser.hpp"
+#include "DebugMarker.hpp"
+#include "Utils.hpp"
+#include <array>
+
+namespace
+{
+// Same as local_size_x and local_size_y in the svgf shaders
+const uint32_t c_workGroupSize = 8;
+// Odd so that the last iteration writes m_filtered
+const uint32_t c_atrousIterationCount = 5;
+const VkFormat c_filterFormat = VK_FORMAT_R32G32B32A32_SFLOAT;
+const VkFormat c_albedoFormat = VK_FORMAT_R8G8B8A8_UNORM;
+
+struct ReprojectPushConstants
+{
+    uint32_t resetHistory;
+};
+
+struct AtrousPushConstants
+{
+    int32_t stepSize;
+    uint32_t modulateAlbedo;
+};
+
+void computeBarrier(VkCommandBuffer commandBuffer)
+{
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.pNext = NULL;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+} // namespace
+
+Denoiser::Denoiser(const InitData& initData) :
+    m_device(initData.device),
+    m_physicalDevice(initData.physicalDevice),
+    m_extent(initData.extent)
+{
+    static_assert(c_atrousIterationCount % 2 == 1, "The last a-trous iteration must write m_filtered");
+
+    createImages(initData.commandPool, initData.queue);
+    m_reprojectStage = createStage("svgf_reproject", 10, sizeof(ReprojectPushConstants));
+    m_varianceStage = createStage("svgf_variance", 4, 0);
+    m_atrousStage = createStage("svgf_atrous", 4, sizeof(AtrousPushConstants));
+    createDescriptorSets(initData.noisyView);
+
+    const uint64_t pixelCount = static_cast<uint64_t>(m_extent.width) * m_extent.height;
+    m_reprojectTimer = std::make_unique<GpuTimer>("SVGF reproject", m_device, m_physicalDevice, initData.slotCount);
+    m_reprojectTimer->setItemCount(pixelCount, "pixel");
+    m_varianceTimer = std::make_unique<GpuTimer>("SVGF variance", m_device, m_physicalDevice, initData.slotCount);
+    m_varianceTimer->setItemCount(pixelCount, "pixel");
+    m_atrousTimer = std::make_unique<GpuTimer>("SVGF a-trous", m_device, m_physicalDevice, initData.slotCount);
+    m_atrousTimer->setItemCount(pixelCount, "pixel");
+    m_historyTimer = std::make_unique<GpuTimer>("SVGF history copy", m_device, m_physicalDevice, initData.slotCount);
+    m_historyTimer->setItemCount(pixelCount, "pixel");
+
+    printf("Denoiser: %u a-trous iterations at %ux%u\n", c_atrousIterationCount, m_extent.width, m_extent.height);
+}
+
+Denoiser::~Denoiser()
+{
+    m_reprojectTimer.reset();
+    m_varianceTimer.reset();
+    m_atrousTimer.reset();
+    m_historyTimer.reset();
+
+    vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
+    destroyStage(m_reprojectStage);
+    destroyStage(m_varianceStage);
+    destroyStage(m_atrousStage);
+
+    for (const StorageImage* image : {&m_normalDepth, &m_motionMaterial, &m_albedo, &m_previousNormalDepth, &m_previousMotionMaterial, &m_history, &m_moments, &m_previousMoments, &m_integrated, &m_filtered})
+    {
+        destroyStorageImage(m_device, *image);
+    }
+}
+
+void Denoiser::record(VkCommandBuffer commandBuffer, uint32_t slot)
+{
+    DebugMarker::beginLabel(commandBuffer, "Denoise", DebugMarker::green);
+
+    // The ray tracing shaders have written the noisy image and the G-buffer. The previous frame's history copies and
+    // reads of the output must have finished before they are overwritten.
+    VkMemoryBarrier inputBarrier{};
+    inputBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    inputBarrier.pNext = NULL;
+    inputBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    inputBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    const VkPipelineStageFlags inputStageMask = VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+    vkCmdPipelineBarrier(commandBuffer, inputStageMask, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &inputBarrier, 0, nullptr, 0, nullptr);
+
+    m_reprojectTimer->begin(commandBuffer, slot);
+    ReprojectPushConstants reprojectPushConstants{};
+    reprojectPushConstants.resetHistory = m_resetHistory ? 1 : 0;
+    dispatch(commandBuffer, m_reprojectStage, m_reprojectDescriptorSet, &reprojectPushConstants, sizeof(reprojectPushConstants));
+    m_reprojectTimer->end(commandBuffer, slot);
+    m_resetHistory = false;
+    computeBarrier(commandBuffer);
+
+    m_varianceTimer->begin(commandBuffer, slot);
+    dispatch(commandBuffer, m_varianceStage, m_varianceDescriptorSet, nullptr, 0);
+    m_varianceTimer->end(commandBuffer, slot);
+    computeBarrier(commandBuffer);
+
+    m_atrousTimer->begin(commandBuffer, slot);
+    for (uint32_t i = 0; i < c_atrousIterationCount; ++i)
+    {
+        AtrousPushConstants atrousPushConstants{};
+        atrousPushConstants.stepSize = 1 << i;
+        atrousPushConstants.modulateAlbedo = i + 1 == c_atrousIterationCount ? 1 : 0;
+        dispatch(commandBuffer, m_atrousStage, m_atrousDescriptorSets[i], &atrousPushConstants, sizeof(atrousPushConstants));
+        computeBarrier(commandBuffer);
+    }
+    m_atrousTimer->end(commandBuffer, slot);
+
+    m_historyTimer->begin(commandBuffer, slot);
+    recordHistoryCopies(commandBuffer);
+    m_historyTimer->end(commandBuffer, slot);
+
+    DebugMarker::endLabel(commandBuffer);
+}
+
+void Denoiser::createImages(VkCommandPool commandPool, VkQueue queue)
+{
+    const VkImageUsageFlags usage = VK_IMAGE_USAGE_STORAGE_BIT;
+    const VkImageUsageFlags copiedUsage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    m_normalDepth = createStorageImage(m_device, m_physicalDevice, commandPool, queue, m_extent, c_filterFormat, copiedUsage, "SVGF normal and depth");
+    m_motionMaterial = createStorageImage(m_device, m_physicalDevice, commandPool, queue, m_extent, c_filterFormat, copiedUsage, "SVGF motion and material");
+    m_albedo = createStorageImage(m_device, m_physicalDevice, commandPool, queue, m_extent, c_albedoFormat, usage, "SVGF albedo");
+    m_previousNormalDepth = createStorageImage(m_device, m_physicalDevice, commandPool, queue, m_extent, c_filterFormat, copiedUsage, "SVGF previous normal and depth");
+    m_previousMotionMaterial = createStorageImage(m_device, m_physicalDevice, commandPool, queue, m_extent, c_filterFormat, copiedUsage, "SVGF previous motion and material");
+    m_history = createStorageImage(m_device, m_physicalDevice, commandPool, queue, m_extent, c_filterFormat, usage, "SVGF history");
+    m_moments = createStorageImage(m_device, m_physicalDevice, commandPool, queue, m_extent, c_filterFormat, copiedUsage, "SVGF moments");
+    m_previousMoments = createStorageImage(m_device, m_physicalDevice, commandPool, queue, m_extent, c_filterFormat, copiedUsage, "SVGF previous moments");
+    m_integrated = createStorageImage(m_device, m_physicalDevice, commandPool, queue, m_extent, c_filterFormat, usage, "SVGF integrated");
+    m_filtered = createStorageImage(m_device, m_physicalDevice, commandPool, queue, m_extent, c_filterFormat, usage, "SVGF filtered");
+}
+
+Denoiser::Stage Denoiser::createStage(const std::string& name, uint32_t bindingCount, uint32_t pushConstantSize)
+{
+    Stage stage;
+
+    std::vector<VkDescriptorSetLayoutBinding> bindings(bindingCount);
+    for (uint32_t i = 0; i < bindingCount; ++i)
+    {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        bindings[i].pImmutableSamplers = nullptr;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = ui32Size(bindings);
+    layoutInfo.pBindings = bindings.data();
+
+    VK_CHECK(vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &stage.descriptorSetLayout));
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, stage.descriptorSetLayout, "Desc set layout - " + name);
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = pushConstantSize;
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &stage.descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = pushConstantSize > 0 ? 1 : 0;
+    pipelineLayoutInfo.pPushConstantRanges = pushConstantSize > 0 ? &pushConstantRange : nullptr;
+
+    VK_CHECK(vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &stage.pipelineLayout));
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_PIPELINE_LAYOUT, stage.pipelineLayout, "Pipeline layout - " + name);
+
+    VkShaderModule shaderModule = createShaderModule(m_device, getCurrentExecutableDirectory() / (name + ".comp.spv"));
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.pNext = NULL;
+    pipelineInfo.flags = 0;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.pNext = NULL;
+    pipelineInfo.stage.flags = 0;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.stage.pSpecializationInfo = NULL;
+    pipelineInfo.layout = stage.pipelineLayout;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineInfo.basePipelineIndex = 0;
+
+    VK_CHECK(vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &stage.pipeline));
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_PIPELINE, stage.pipeline, "Pipeline - " + name);
+
+    vkDestroyShaderModule(m_device, shaderModule, nullptr);
+    return stage;
+}
+
+void Denoiser::destroyStage(const Stage& stage)
+{
+    vkDestroyPipeline(m_device, stage.pipeline, nullptr);
+    vkDestroyPipelineLayout(m_device, stage.pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(m_device, stage.descriptorSetLayout, nullptr);
+}
+
+void Denoiser::createDescriptorSets(VkImageView noisyView)
+{
+    const uint32_t setCount = 2 + c_atrousIterationCount;
+
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSize.descriptorCount = 10 + 4 + 4 * c_atrousIterationCount;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    poolInfo.maxSets = setCount;
+
+    VK_CHECK(vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &m_descriptorPool));
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_DESCRIPTOR_POOL, m_descriptorPool, "Descriptor pool - Denoiser");
+
+    // In binding order of the shaders
+    m_reprojectDescriptorSet = allocateDescriptorSet(m_reprojectStage,
+                                                     {noisyView,
+                                                      m_albedo.view,
+                                                      m_normalDepth.view,
+                                                      m_motionMaterial.view,
+                                                      m_previousNormalDepth.view,
+                                                      m_previousMotionMaterial.view,
+                                                      m_history.view,
+                                                      m_previousMoments.view,
+                                                      m_integrated.view,
+                                                      m_moments.view});
+    m_varianceDescriptorSet = allocateDescriptorSet(m_varianceStage, {m_integrated.view, m_moments.view, m_normalDepth.view, m_filtered.view});
+
+    // The first iteration writes the history of the next frame, the rest ping-pong between the integrated and the filtered image
+    for (uint32_t i = 0; i < c_atrousIterationCount; ++i)
+    {
+        VkImageView input = m_filtered.view;
+        VkImageView output = m_history.view;
+        if (i > 0)
+        {
+            input = i == 1 ? m_history.view : (i % 2 == 0 ? m_integrated.view : m_filtered.view);
+            output = i % 2 == 1 ? m_integrated.view : m_filtered.view;
+        }
+        m_atrousDescriptorSets.push_back(allocateDescriptorSet(m_atrousStage, {input, output, m_normalDepth.view, m_albedo.view}));
+    }
+}
+
+VkDescriptorSet Denoiser::allocateDescriptorSet(const Stage& stage, const std::vector<VkImageView>& views)
+{
+    VkDescriptorSetAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocateInfo.pNext = NULL;
+    allocateInfo.descriptorPool = m_descriptorPool;
+    allocateInfo.descriptorSetCount = 1;
+    allocateInfo.pSetLayouts = &stage.descriptorSetLayout;
+
+    VkDescriptorSet descriptorSet;
+    VK_CHECK(vkAllocateDescriptorSets(m_device, &allocateInfo, &descriptorSet));
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_DESCRIPTOR_SET, descriptorSet, "Desc set - Denoiser");
+
+    std::vector<VkDescriptorImageInfo> imageInfos(views.size());
+    std::vector<VkWriteDescriptorSet> descriptorWrites(views.size());
+    for (uint32_t i = 0; i < ui32Size(views); ++i)
+    {
+        imageInfos[i] = {VK_NULL_HANDLE, views[i], VK_IMAGE_LAYOUT_GENERAL};
+
+        descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[i].pNext = NULL;
+        descriptorWrites[i].dstSet = descriptorSet;
+        descriptorWrites[i].dstBinding = i;
+        descriptorWrites[i].dstArrayElement = 0;
+        descriptorWrites[i].descriptorCount = 1;
+        descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        descriptorWrites[i].pImageInfo = &imageInfos[i];
+    }
+
+    vkUpdateDescriptorSets(m_device, ui32Size(descriptorWrites), descriptorWrites.data(), 0, nullptr);
+    return descriptorSet;
+}
+
+void Denoiser::dispatch(VkCommandBuffer commandBuffer, const Stage& stage, VkDescriptorSet descriptorSet, const void* pushConstants, uint32_t pushConstantSize)
+{
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, stage.pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, stage.pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+    if (pushConstantSize > 0)
+    {
+        vkCmdPushConstants(commandBuffer, stage.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, pushConstantSize, pushConstants);
+    }
+    vkCmdDispatch(commandBuffer, (m_extent.width + c_workGroupSize - 1) / c_workGroupSize, (m_extent.height + c_workGroupSize - 1) / c_workGroupSize, 1);
+}
+
+void Denoiser::recordHistoryCopies(VkCommandBuffer commandBuffer)
+{
+    VkMemoryBarrier copyBarrier{};
+    copyBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    copyBarrier.pNext = NULL;
+    copyBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    copyBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &copyBarrier, 0, nullptr, 0, nullptr);
+
+    VkImageCopy region{};
+    region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.srcSubresource.baseArrayLayer = 0;
+    region.srcSubresource.mipLevel = 0;
+    region.srcSubresource.layerCount = 1;
+    region.srcOffset = {0, 0, 0};
+    region.dstSubresource = region.srcSubresource;
+    region.dstOffset = region.srcOffset;
+    region.extent = {m_extent.width, m_extent.height, 1};
+
+    const std::array<std::pair<const StorageImage*, const StorageImage*>, 3> copies{{
+        {&m_normalDepth, &m_previousNormalDepth}, //
+        {&m_motionMaterial, &m_previousMotionMaterial}, //
+        {&m_moments, &m_previousMoments} //
+    }};
+    for (const auto& copy : copies)
+    {
+        vkCmdCopyImage(commandBuffer, copy.first->image, VK_IMAGE_LAYOUT_GENERAL, copy.second->image, VK_IMAGE_LAYOUT_GENERAL, 1, &region);
+    }
+
+    // The next frame's ray tracing shaders overwrite the copied G-buffer and its compute passes read the copies
+    VkMemoryBarrier nextFrameBarrier{};
+    nextFrameBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    nextFrameBarrier.pNext = NULL;
+    nextFrameBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    nextFrameBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0,
+                         1,
+                         &nextFrameBarrier,
+                         0,
+                         nullptr,
+                         0,
+                         nullptr);
+}
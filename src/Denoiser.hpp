@@ -0,0 +1,94 @@
+#pragma once
+
+#include "GpuTimer.hpp"
+#include "VulkanUtils.hpp"
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <memory>
+#include <string>
+
+// SVGF-style spatiotemporal denoiser for one sample per pixel. The ray generation shader writes the noisy radiance
+// and a G-buffer of the primary hits, then compute passes accumulate the demodulated lighting over time, estimate its
+// variance and filter it with an edge-aware a-trous wavelet. All images are in VK_IMAGE_LAYOUT_GENERAL.
+class Denoiser final
+{
+public:
+    struct InitData
+    {
+        VkDevice device;
+        VkPhysicalDevice physicalDevice;
+        // Used for creating the images, must not be in use by other threads during construction
+        VkCommandPool commandPool;
+        VkQueue queue;
+        VkExtent2D extent;
+        // RGBA32F radiance written by the ray tracing shaders
+        VkImageView noisyView;
+        uint32_t slotCount;
+    };
+
+    Denoiser(const InitData& initData);
+    // Prints the GPU time of each stage
+    ~Denoiser();
+
+    // RGBA32F normal and hit distance, negative for misses
+    VkImageView getNormalDepthView() const { return m_normalDepth.view; }
+    // RGBA32F motion in pixels since the previous frame and material id
+    VkImageView getMotionMaterialView() const { return m_motionMaterial.view; }
+    // RGBA8 albedo that the lighting is divided by before filtering
+    VkImageView getAlbedoView() const { return m_albedo.view; }
+    // RGBA32F denoised radiance
+    VkImageView getOutputView() const { return m_filtered.view; }
+
+    // Records all stages with barriers on both sides. The ray tracing shaders must have written the noisy image and
+    // the G-buffer before, afterwards the output can be read by compute shaders.
+    void record(VkCommandBuffer commandBuffer, uint32_t slot);
+
+private:
+    struct Stage
+    {
+        VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+        VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+        VkPipeline pipeline = VK_NULL_HANDLE;
+    };
+
+    void createImages(VkCommandPool commandPool, VkQueue queue);
+    Stage createStage(const std::string& name, uint32_t bindingCount, uint32_t pushConstantSize);
+    void destroyStage(const Stage& stage);
+    void createDescriptorSets(VkImageView noisyView);
+    VkDescriptorSet allocateDescriptorSet(const Stage& stage, const std::vector<VkImageView>& views);
+    void dispatch(VkCommandBuffer commandBuffer, const Stage& stage, VkDescriptorSet descriptorSet, const void* pushConstants, uint32_t pushConstantSize);
+    void recordHistoryCopies(VkCommandBuffer commandBuffer);
+
+    VkDevice m_device;
+    VkPhysicalDevice m_physicalDevice;
+    const VkExtent2D m_extent;
+    bool m_resetHistory = true;
+
+    // G-buffer of this and the previous frame
+    StorageImage m_normalDepth;
+    StorageImage m_motionMaterial;
+    StorageImage m_albedo;
+    StorageImage m_previousNormalDepth;
+    StorageImage m_previousMotionMaterial;
+    // Lighting after the first a-trous iteration, reprojected by the next frame
+    StorageImage m_history;
+    StorageImage m_moments;
+    StorageImage m_previousMoments;
+    // Output of the temporal accumulation, then ping-pong image of the a-trous iterations with m_filtered
+    StorageImage m_integrated;
+    // Output of the variance estimation and of the last a-trous iteration
+    StorageImage m_filtered;
+
+    Stage m_reprojectStage;
+    Stage m_varianceStage;
+    Stage m_atrousStage;
+    VkDescriptorPool m_descriptorPool;
+    VkDescriptorSet m_reprojectDescriptorSet;
+    VkDescriptorSet m_varianceDescriptorSet;
+    std::vector<VkDescriptorSet> m_atrousDescriptorSets;
+
+    std::unique_ptr<GpuTimer> m_reprojectTimer;
+    std::unique_ptr<GpuTimer> m_varianceTimer;
+    std::unique_ptr<GpuTimer> m_atrousTimer;
+    std::unique_ptr<GpuTimer> m_historyTimer;
+};
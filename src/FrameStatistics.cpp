@@ -0,0 +1,80 @@
+#include "FrameStatistics.hpp"
+#include <algorithm>
+#include <cstdio>
+
+namespace
+{
+const double c_printInterval = 2.0;
+
+double getPercentile(const std::vector<double>& sortedValues, double percentile)
+{
+    const size_t index = static_cast<size_t>(percentile * (sortedValues.size() - 1));
+    return sortedValues[index];
+}
+} // namespace
+
+FrameStatistics::FrameStatistics(const std::string& name, bool printIntervals) :
+    m_name(name),
+    m_printIntervals(printIntervals)
+{
+}
+
+FrameStatistics::~FrameStatistics()
+{
+    if (m_frameTimes.empty())
+    {
+        return;
+    }
+
+    std::vector<double> sortedFrameTimes = m_frameTimes;
+    std::sort(sortedFrameTimes.begin(), sortedFrameTimes.end());
+
+    double total = 0.0;
+    for (double frameTime : sortedFrameTimes)
+    {
+        total += frameTime;
+    }
+
+    const std::string label = m_name.empty() ? "" : " (" + m_name + ")";
+    printf("Frame time summary%s over %zu frames: avg %.3f ms, median %.3f ms, p95 %.3f ms, p99 %.3f ms, min %.3f ms, max %.3f ms\n",
+           label.c_str(),
+           sortedFrameTimes.size(),
+           1000.0 * total / sortedFrameTimes.size(),
+           1000.0 * getPercentile(sortedFrameTimes, 0.5),
+           1000.0 * getPercentile(sortedFrameTimes, 0.95),
+           1000.0 * getPercentile(sortedFrameTimes, 0.99),
+           1000.0 * sortedFrameTimes.front(),
+           1000.0 * sortedFrameTimes.back());
+}
+
+void FrameStatistics::addFrame(double frameTimeInSeconds)
+{
+    m_frameTimes.push_back(frameTimeInSeconds);
+
+    m_intervalMin = m_intervalFrameCount == 0 ? frameTimeInSeconds : std::min(m_intervalMin, frameTimeInSeconds);
+    m_intervalMax = m_intervalFrameCount == 0 ? frameTimeInSeconds : std::max(m_intervalMax, frameTimeInSeconds);
+    m_intervalTime += frameTimeInSeconds;
+    ++m_intervalFrameCount;
+
+    if (m_printIntervals && m_intervalTime >= c_printInterval)
+    {
+        printInterval();
+    }
+}
+
+uint64_t FrameStatistics::getFrameCount() const
+{
+    return m_frameTimes.size();
+}
+
+void FrameStatistics::printInterval()
+{
+    printf("Frame time avg %.3f ms, min %.3f ms, max %.3f ms (%u frames)\n",
+           1000.0 * m_intervalTime / m_intervalFrameCount,
+           1000.0 * m_intervalMin,
+           1000.0 * m_intervalMax,
+           m_intervalFrameCount);
+
+    m_intervalTime = 0.0;
+    m_intervalFrameCount = 0;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+class FrameStatistics final
+{
+public:
+    FrameStatistics() = default;
+    // The name labels the summary, e.g. for the frames of one renderer next to the overall statistics
+    FrameStatistics(const std::string& name, bool printIntervals);
+    ~FrameStatistics();
+
+    void addFrame(double frameTimeInSeconds);
+    uint64_t getFrameCount() const;
+
+private:
+    void printInterval();
+
+    const std::string m_name;
+    const bool m_printIntervals = true;
+    std::vector<double> m_frameTimes;
+    double m_intervalTime = 0.0;
+    double m_intervalMin = 0.0;
+    double m_intervalMax = 0.0;
+    uint32_t m_intervalFrameCount = 0;
+};
@@ -0,0 +1,118 @@
+#include "GpuTimer.hpp"
+#include "VulkanUtils.hpp"
+#include <algorithm>
+#include <cstdio>
+
+GpuTimer::GpuTimer(const std::string& name, VkDevice device, VkPhysicalDevice physicalDevice, uint32_t slotCount) :
+    m_name(name),
+    m_device(device),
+    m_pending(slotCount, false)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    if (!properties.limits.timestampComputeAndGraphics)
+    {
+        LOGW("Timestamp queries are not supported, GPU times are not measured");
+        return;
+    }
+    m_timestampPeriod = properties.limits.timestampPeriod;
+
+    VkQueryPoolCreateInfo queryPoolInfo{};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.pNext = NULL;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolInfo.queryCount = 2 * slotCount;
+
+    VK_CHECK(vkCreateQueryPool(m_device, &queryPoolInfo, nullptr, &m_queryPool));
+}
+
+GpuTimer::~GpuTimer()
+{
+    if (m_queryPool == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    vkDeviceWaitIdle(m_device);
+    for (uint32_t slot = 0; slot < m_pending.size(); ++slot)
+    {
+        readResult(slot);
+    }
+    vkDestroyQueryPool(m_device, m_queryPool, nullptr);
+
+    if (m_times.empty())
+    {
+        return;
+    }
+
+    double total = 0.0;
+    for (double time : m_times)
+    {
+        total += time;
+    }
+    const double average = total / m_times.size();
+    const auto minMax = std::minmax_element(m_times.begin(), m_times.end());
+    printf("GPU time %s over %zu frames: avg %.3f ms, min %.3f ms, max %.3f ms",
+           m_name.c_str(),
+           m_times.size(),
+           average,
+           *minMax.first,
+           *minMax.second);
+    if (m_itemCount > 0)
+    {
+        printf(", %.3f ns per %s", average * 1'000'000.0 / static_cast<double>(m_itemCount), m_itemName.c_str());
+    }
+    if (m_addedItemCount > 0 && total > 0.0)
+    {
+        printf(", %.2f M %ss/s", static_cast<double>(m_addedItemCount) / (total * 1'000.0), m_itemName.c_str());
+    }
+    printf("\n");
+}
+
+void GpuTimer::setItemCount(uint64_t itemCount, const std::string& itemName)
+{
+    m_itemCount = itemCount;
+    m_itemName = itemName;
+}
+
+void GpuTimer::addItems(uint64_t itemCount)
+{
+    m_addedItemCount += itemCount;
+}
+
+void GpuTimer::begin(VkCommandBuffer commandBuffer, uint32_t slot)
+{
+    if (m_queryPool == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    readResult(slot);
+    vkCmdResetQueryPool(commandBuffer, m_queryPool, 2 * slot, 2);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_queryPool, 2 * slot);
+}
+
+void GpuTimer::end(VkCommandBuffer commandBuffer, uint32_t slot)
+{
+    if (m_queryPool == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_queryPool, 2 * slot + 1);
+    m_pending[slot] = true;
+}
+
+void GpuTimer::readResult(uint32_t slot)
+{
+    if (!m_pending[slot])
+    {
+        return;
+    }
+
+    // The command buffer of the slot has finished when it is recorded again, so this doesn't stall
+    uint64_t timestamps[2];
+    VK_CHECK(vkGetQueryPoolResults(m_device, m_queryPool, 2 * slot, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+    m_times.push_back(static_cast<double>(timestamps[1] - timestamps[0]) * m_timestampPeriod / 1'000'000.0);
+    m_pending[slot] = false;
+}
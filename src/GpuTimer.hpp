@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Measures the GPU time between two points of a command buffer with timestamp queries.
+// Each slot belongs to one command buffer, its previous result is read back when the slot is reused.
+class GpuTimer final
+{
+public:
+    GpuTimer(const std::string& name, VkDevice device, VkPhysicalDevice physicalDevice, uint32_t slotCount);
+    // Prints a summary of all measurements
+    ~GpuTimer();
+
+    // The summary also shows the average time per item, e.g. per vertex
+    void setItemCount(uint64_t itemCount, const std::string& itemName);
+    // For work whose size is only known afterwards, e.g. read back from the GPU. The summary also shows the
+    // throughput of all items added over all measured frames.
+    void addItems(uint64_t itemCount);
+
+    // Must be recorded outside of a render pass
+    void begin(VkCommandBuffer commandBuffer, uint32_t slot);
+    void end(VkCommandBuffer commandBuffer, uint32_t slot);
+
+private:
+    void readResult(uint32_t slot);
+
+    const std::string m_name;
+    VkDevice m_device;
+    VkQueryPool m_queryPool = VK_NULL_HANDLE;
+    double m_timestampPeriod = 0.0;
+    std::vector<bool> m_pending;
+    std::vector<double> m_times;
+    uint64_t m_itemCount = 0;
+    uint64_t m_addedItemCount = 0;
+    std::string m_itemName;
+};
@@ -0,0 +1,38 @@
+#include "Hash.hpp"
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+const uint64_t c_fnv1aPrime = 1099511628211ull;
+const size_t c_chunkSize = 1 << 20;
+} // namespace
+
+uint64_t fnv1a(const void* data, size_t size, uint64_t hash)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= c_fnv1aPrime;
+    }
+    return hash;
+}
+
+uint64_t hashParallel(const void* data, size_t size, uint64_t hash, JobSystem& jobSystem)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    const size_t chunkCount = (size + c_chunkSize - 1) / c_chunkSize;
+    std::vector<uint64_t> chunkHashes(chunkCount);
+
+    jobSystem.parallelFor(chunkCount, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const size_t offset = i * c_chunkSize;
+            chunkHashes[i] = fnv1a(bytes + offset, std::min(c_chunkSize, size - offset));
+        }
+    });
+
+    hash = fnv1aValue(size, hash);
+    return fnv1a(chunkHashes.data(), chunkHashes.size() * sizeof(uint64_t), hash);
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "JobSystem.hpp"
+#include <cstddef>
+#include <cstdint>
+
+const uint64_t c_fnv1aOffsetBasis = 14695981039346656037ull;
+
+// 64-bit FNV-1a, pass the previous result as hash to continue hashing
+uint64_t fnv1a(const void* data, size_t size, uint64_t hash = c_fnv1aOffsetBasis);
+
+template<typename T>
+uint64_t fnv1aValue(const T& value, uint64_t hash = c_fnv1aOffsetBasis)
+{
+    return fnv1a(&value, sizeof(T), hash);
+}
+
+// FNV-1a of fixed size chunks in parallel, combined with FNV-1a in order.
+// Deterministic for the same data but not the same as fnv1a over the whole data.
+uint64_t hashParallel(const void* data, size_t size, uint64_t hash = c_fnv1aOffsetBasis, JobSystem& jobSystem = JobSystem::get());
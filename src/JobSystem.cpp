@@ -0,0 +1,327 @@
+#include "JobSystem.hpp"
+#include "Utils.hpp"
+#include <algorithm>
+#include <cstdio>
+
+namespace
+{
+// Chunks per thread in parallelFor, more than one so that uneven chunks balance out
+const size_t c_chunksPerThread = 4;
+
+struct ThreadInfo
+{
+    const JobSystem* jobSystem = nullptr;
+    uint32_t index = 0;
+};
+
+thread_local ThreadInfo t_threadInfo;
+
+JobSystemSettings s_settings;
+bool s_instanceCreated = false;
+} // namespace
+
+JobSystem::JobSystem(const JobSystemSettings& settings) :
+    m_mainThreadId(std::this_thread::get_id()),
+    m_threadCount(settings.threadCount > 0 ? settings.threadCount : std::max(std::thread::hardware_concurrency(), 1u))
+{
+    const uint32_t workerCount = m_threadCount - 1;
+    // Without workers the jobs are queued in one deque and run by the waiting thread
+    for (uint32_t i = 0; i < std::max(workerCount, 1u); ++i)
+    {
+        m_workerQueues.push_back(std::make_unique<WorkerQueue>());
+    }
+    for (uint32_t i = 0; i < workerCount; ++i)
+    {
+        m_workers.emplace_back(&JobSystem::workerLoop, this, i, settings.pinThreads);
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    while (m_unfinishedJobCount > 0)
+    {
+        if (!runOneJob())
+        {
+            runMainThreadJobs();
+            std::this_thread::yield();
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_running = false;
+    }
+    m_wakeCondition.notify_all();
+
+    for (std::thread& worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+void JobSystem::configure(const JobSystemSettings& settings)
+{
+    CHECK(!s_instanceCreated);
+    s_settings = settings;
+}
+
+JobSystem& JobSystem::get()
+{
+    static JobSystem s_instance(s_settings);
+    s_instanceCreated = true;
+    return s_instance;
+}
+
+JobSystem::JobHandle JobSystem::schedule(Function function, const std::vector<JobHandle>& dependencies)
+{
+    return createJob(std::move(function), dependencies, false);
+}
+
+JobSystem::JobHandle JobSystem::scheduleOnMainThread(Function function, const std::vector<JobHandle>& dependencies)
+{
+    return createJob(std::move(function), dependencies, true);
+}
+
+void JobSystem::wait(const JobHandle& job)
+{
+    while (!job->finished)
+    {
+        if (!runOneJob())
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void JobSystem::wait(const std::vector<JobHandle>& jobs)
+{
+    for (const JobHandle& job : jobs)
+    {
+        wait(job);
+    }
+}
+
+void JobSystem::runMainThreadJobs()
+{
+    while (true)
+    {
+        JobHandle job;
+        {
+            std::lock_guard<std::mutex> lock(m_mainThreadMutex);
+            if (m_mainThreadJobs.empty())
+            {
+                return;
+            }
+            job = std::move(m_mainThreadJobs.front());
+            m_mainThreadJobs.pop_front();
+        }
+        job->function();
+        finish(job);
+    }
+}
+
+void JobSystem::parallelFor(size_t count, const RangeFunction& function, size_t minChunkSize)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    const size_t chunkSize = std::max({minChunkSize, count / (m_threadCount * c_chunksPerThread), size_t(1)});
+    const size_t chunkCount = (count + chunkSize - 1) / chunkSize;
+    if (chunkCount == 1 || m_threadCount == 1)
+    {
+        function(0, count);
+        return;
+    }
+
+    std::atomic<size_t> nextChunk{0};
+    auto runChunks = [&]() {
+        for (size_t chunk = nextChunk++; chunk < chunkCount; chunk = nextChunk++)
+        {
+            function(chunk * chunkSize, std::min(count, (chunk + 1) * chunkSize));
+        }
+    };
+
+    // Helpers that start after all chunks are taken return immediately
+    const size_t helperCount = std::min(chunkCount, static_cast<size_t>(m_threadCount)) - 1;
+    std::vector<JobHandle> helpers;
+    helpers.reserve(helperCount);
+    for (size_t i = 0; i < helperCount; ++i)
+    {
+        helpers.push_back(schedule(runChunks));
+    }
+
+    runChunks();
+    wait(helpers);
+}
+
+uint32_t JobSystem::getThreadCount() const
+{
+    return m_threadCount;
+}
+
+uint32_t JobSystem::getCurrentThreadIndex() const
+{
+    return t_threadInfo.jobSystem == this ? t_threadInfo.index : 0;
+}
+
+JobSystem::JobHandle JobSystem::createJob(Function function, const std::vector<JobHandle>& dependencies, bool mainThread)
+{
+    JobHandle job = std::make_shared<Job>();
+    job->function = std::move(function);
+    job->mainThread = mainThread;
+    job->remainingDependencies = ui32Size(dependencies) + 1;
+    ++m_unfinishedJobCount;
+
+    for (const JobHandle& dependency : dependencies)
+    {
+        std::unique_lock<std::mutex> lock(dependency->continuationMutex);
+        if (dependency->finished)
+        {
+            lock.unlock();
+            --job->remainingDependencies;
+        }
+        else
+        {
+            dependency->continuations.push_back(job);
+        }
+    }
+
+    release(job);
+    return job;
+}
+
+void JobSystem::release(const JobHandle& job)
+{
+    if (--job->remainingDependencies == 0)
+    {
+        enqueue(job);
+    }
+}
+
+void JobSystem::enqueue(const JobHandle& job)
+{
+    if (job->mainThread)
+    {
+        std::lock_guard<std::mutex> lock(m_mainThreadMutex);
+        m_mainThreadJobs.push_back(job);
+        return;
+    }
+
+    // Workers push to their own deque, other threads spread the jobs over all deques
+    const uint32_t threadIndex = getCurrentThreadIndex();
+    const size_t queueIndex = threadIndex > 0 ? threadIndex - 1 : m_nextQueue++ % m_workerQueues.size();
+    // Counted before pushing so that the count never goes below zero when the job is taken right away
+    ++m_queuedJobCount;
+    {
+        WorkerQueue& queue = *m_workerQueues[queueIndex];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(job);
+    }
+
+    {
+        // Taking the lock makes sure a worker that is about to sleep sees the new job
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+    }
+    m_wakeCondition.notify_one();
+}
+
+void JobSystem::finish(const JobHandle& job)
+{
+    std::vector<JobHandle> continuations;
+    {
+        std::lock_guard<std::mutex> lock(job->continuationMutex);
+        job->finished = true;
+        continuations.swap(job->continuations);
+    }
+
+    for (const JobHandle& continuation : continuations)
+    {
+        release(continuation);
+    }
+    --m_unfinishedJobCount;
+}
+
+JobSystem::JobHandle JobSystem::findJob(uint32_t threadIndex)
+{
+    // Newest job of the own deque first, it is most likely to have its data in cache
+    if (threadIndex > 0)
+    {
+        WorkerQueue& queue = *m_workerQueues[threadIndex - 1];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.jobs.empty())
+        {
+            JobHandle job = std::move(queue.jobs.back());
+            queue.jobs.pop_back();
+            --m_queuedJobCount;
+            return job;
+        }
+    }
+
+    // Steal the oldest job from the others
+    const size_t queueCount = m_workerQueues.size();
+    for (size_t i = 0; i < queueCount; ++i)
+    {
+        WorkerQueue& queue = *m_workerQueues[(threadIndex + i) % queueCount];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.jobs.empty())
+        {
+            JobHandle job = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+            --m_queuedJobCount;
+            return job;
+        }
+    }
+
+    return nullptr;
+}
+
+bool JobSystem::runOneJob()
+{
+    if (std::this_thread::get_id() == m_mainThreadId)
+    {
+        std::unique_lock<std::mutex> lock(m_mainThreadMutex);
+        if (!m_mainThreadJobs.empty())
+        {
+            JobHandle job = std::move(m_mainThreadJobs.front());
+            m_mainThreadJobs.pop_front();
+            lock.unlock();
+            job->function();
+            finish(job);
+            return true;
+        }
+    }
+
+    JobHandle job = findJob(getCurrentThreadIndex());
+    if (!job)
+    {
+        return false;
+    }
+
+    job->function();
+    finish(job);
+    return true;
+}
+
+void JobSystem::workerLoop(uint32_t workerIndex, bool pin)
+{
+    t_threadInfo.jobSystem = this;
+    t_threadInfo.index = workerIndex + 1;
+
+    if (pin && !pinCurrentThreadToCore(workerIndex + 1))
+    {
+        printf("Could not pin job worker %u to core %u\n", workerIndex, workerIndex + 1);
+    }
+
+    while (m_running)
+    {
+        if (runOneJob())
+        {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_wakeCondition.wait(lock, [this]() { return m_queuedJobCount > 0 || !m_running; });
+    }
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstdint>
+
+struct JobSystemSettings
+{
+    // Including the thread that waits for the jobs, 0 uses all hardware threads and 1 runs everything on the waiting thread
+    uint32_t threadCount = 0;
+    // Pins worker i to core i + 1, core 0 is left for the main thread
+    bool pinThreads = false;
+};
+
+// Work-stealing job scheduler. Every worker has its own deque, it pops its newest job and steals the oldest from others.
+// Waiting is never idle: a thread that waits for a job runs other jobs until the job has finished.
+class JobSystem final
+{
+public:
+    struct Job;
+    using JobHandle = std::shared_ptr<Job>;
+    using Function = std::function<void()>;
+    using RangeFunction = std::function<void(size_t begin, size_t end)>;
+
+    explicit JobSystem(const JobSystemSettings& settings);
+    ~JobSystem();
+
+    // The process-wide instance is created by the first call to get() with the settings given to configure()
+    static void configure(const JobSystemSettings& settings);
+    static JobSystem& get();
+
+    // The job runs after all dependencies have finished
+    JobHandle schedule(Function function, const std::vector<JobHandle>& dependencies = {});
+    // For work that must happen on the main thread, e.g. GLFW calls. Run by runMainThreadJobs() or while the main thread waits.
+    JobHandle scheduleOnMainThread(Function function, const std::vector<JobHandle>& dependencies = {});
+    void wait(const JobHandle& job);
+    void wait(const std::vector<JobHandle>& jobs);
+    void runMainThreadJobs();
+
+    // Calls function for [begin, end) ranges covering [0, count). Chunks are handed out dynamically, at least minChunkSize per call.
+    void parallelFor(size_t count, const RangeFunction& function, size_t minChunkSize = 1);
+
+    uint32_t getThreadCount() const;
+    // 0 for the main and other non-worker threads, i + 1 for worker i
+    uint32_t getCurrentThreadIndex() const;
+
+    // Only the JobSystem touches the members
+    struct Job
+    {
+        Function function;
+        bool mainThread = false;
+        // One extra count is held while the job is being scheduled
+        std::atomic<uint32_t> remainingDependencies{1};
+        std::atomic<bool> finished{false};
+        std::mutex continuationMutex;
+        std::vector<JobHandle> continuations;
+    };
+
+private:
+    struct WorkerQueue
+    {
+        std::mutex mutex;
+        std::deque<JobHandle> jobs;
+    };
+
+    JobHandle createJob(Function function, const std::vector<JobHandle>& dependencies, bool mainThread);
+    void release(const JobHandle& job);
+    void enqueue(const JobHandle& job);
+    void finish(const JobHandle& job);
+    JobHandle findJob(uint32_t threadIndex);
+    bool runOneJob();
+    void workerLoop(uint32_t workerIndex, bool pin);
+
+    const std::thread::id m_mainThreadId;
+    uint32_t m_threadCount;
+    std::vector<std::unique_ptr<WorkerQueue>> m_workerQueues;
+    std::vector<std::thread> m_workers;
+    std::atomic<uint32_t> m_nextQueue{0};
+    std::atomic<uint64_t> m_queuedJobCount{0};
+    std::atomic<uint64_t> m_unfinishedJobCount{0};
+    std::atomic<bool> m_running{true};
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wakeCondition;
+    std::mutex m_mainThreadMutex;
+    std::deque<JobHandle> m_mainThreadJobs;
+};
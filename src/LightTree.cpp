@@ -0,0 +1,87 @@
+#include "LightTree.hpp"
+#include "Utils.hpp"
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+const glm::vec3 c_luminanceWeights{0.2126f, 0.7152f, 0.0722f};
+
+// Lights [begin, end) of the sorted light indices that still need to be placed under a node
+struct BuildTask
+{
+    uint32_t node;
+    uint32_t begin;
+    uint32_t end;
+};
+
+int getLongestAxis(const glm::vec3& extent)
+{
+    if (extent.x >= extent.y && extent.x >= extent.z)
+    {
+        return 0;
+    }
+    return extent.y >= extent.z ? 1 : 2;
+}
+} // namespace
+
+float getLightPower(const Light& light)
+{
+    return light.intensity * glm::dot(light.color, c_luminanceWeights);
+}
+
+std::vector<LightTreeNode> buildLightTree(const std::vector<Light>& lights)
+{
+    if (lights.empty())
+    {
+        return {};
+    }
+    CHECK(lights.size() < c_lightTreeLeafBit);
+
+    std::vector<uint32_t> lightIndices(lights.size());
+    for (uint32_t i = 0; i < ui32Size(lightIndices); ++i)
+    {
+        lightIndices[i] = i;
+    }
+
+    std::vector<LightTreeNode> nodes(2 * lights.size() - 1);
+    uint32_t nodeCount = 1;
+    std::vector<BuildTask> stack{{0, 0, ui32Size(lights)}};
+    while (!stack.empty())
+    {
+        const BuildTask task = stack.back();
+        stack.pop_back();
+
+        LightTreeNode& node = nodes[task.node];
+        node.boundsMin = glm::vec3(std::numeric_limits<float>::max());
+        node.boundsMax = glm::vec3(std::numeric_limits<float>::lowest());
+        node.power = 0.0f;
+        for (uint32_t i = task.begin; i < task.end; ++i)
+        {
+            const Light& light = lights[lightIndices[i]];
+            node.boundsMin = glm::min(node.boundsMin, light.position);
+            node.boundsMax = glm::max(node.boundsMax, light.position);
+            node.power += getLightPower(light);
+        }
+
+        if (task.end - task.begin == 1)
+        {
+            node.child = c_lightTreeLeafBit | lightIndices[task.begin];
+            continue;
+        }
+
+        const int axis = getLongestAxis(node.boundsMax - node.boundsMin);
+        const uint32_t middle = task.begin + (task.end - task.begin) / 2;
+        std::nth_element(lightIndices.begin() + task.begin, lightIndices.begin() + middle, lightIndices.begin() + task.end, [&lights, axis](uint32_t a, uint32_t b) {
+            return lights[a].position[axis] < lights[b].position[axis];
+        });
+
+        node.child = nodeCount;
+        nodeCount += 2;
+        stack.push_back({node.child, task.begin, middle});
+        stack.push_back({node.child + 1, middle, task.end});
+    }
+    CHECK(nodeCount == nodes.size());
+
+    return nodes;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+
+// Spherical light in the std430 layout of the light buffer, the radius only softens the shadows
+struct Light
+{
+    glm::vec3 position{0.0f};
+    float intensity = 0.0f;
+    glm::vec3 color{1.0f};
+    float radius = 0.0f;
+};
+
+// Node of a binary light BVH in the std430 layout of the light tree buffer. The root is node 0 and the two children
+// of an internal node are next to each other, so a tree over N lights has 2N - 1 nodes.
+struct LightTreeNode
+{
+    glm::vec3 boundsMin{0.0f};
+    // Sum of the light powers below this node
+    float power = 0.0f;
+    glm::vec3 boundsMax{0.0f};
+    // Index of the first child, or c_lightTreeLeafBit | light index for leaves
+    uint32_t child = 0;
+};
+
+const uint32_t c_lightTreeLeafBit = 0x80000000u;
+
+// Intensity weighted by the luminance of the color, what the light tree importance is based on
+float getLightPower(const Light& light);
+
+// Splits the lights at the median of the longest axis of their position bounds until every leaf has one light.
+// Rebuilt from scratch whenever the lights change, empty for no lights.
+std::vector<LightTreeNode> buildLightTree(const std::vector<Light>& lights);
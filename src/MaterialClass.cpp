@@ -0,0 +1,121 @@
+#include "MaterialClass.hpp"
+#include "Utils.hpp"
+#include <cstdlib>
+
+namespace
+{
+const uint8_t c_normalImageUsage = 1u << 0;
+const uint8_t c_metallicRoughnessImageUsage = 1u << 1;
+// Normal map texels this close to (128, 128) in x and y tilt the normal by less than one 8-bit step
+const int c_flatNormalTolerance = 1;
+
+bool isValidImage(const Model& model, int image)
+{
+    return image >= 0 && image < static_cast<int>(model.images.size());
+}
+
+// The textures are uploaded as RGBA8, anything else is not scanned and assumed to need the full shading
+bool isRgba8(const Model::Image& image)
+{
+    return image.components == 4 && image.bitsPerChannel == 8 && image.data.size() == static_cast<size_t>(image.width) * image.height * 4;
+}
+
+bool hasNonFlatNormals(const Model::Image& image)
+{
+    if (!isRgba8(image))
+    {
+        return true;
+    }
+    for (size_t i = 0; i < image.data.size(); i += 4)
+    {
+        if (std::abs(image.data[i] - 128) > c_flatNormalTolerance || std::abs(image.data[i + 1] - 128) > c_flatNormalTolerance)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Filtering never exceeds the largest texel, so this holds for every texture level
+bool hasReflectiveTexels(const Model::Image& image)
+{
+    if (!isRgba8(image))
+    {
+        return true;
+    }
+    for (size_t i = 2; i < image.data.size(); i += 4)
+    {
+        if (image.data[i] / 255.0f > c_reflectionMetallicThreshold)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+} // namespace
+
+std::vector<uint32_t> classifyMaterials(const Model& model, JobSystem& jobSystem)
+{
+    std::vector<uint8_t> imageUsages(model.images.size(), 0);
+    for (const Model::Material& material : model.materials)
+    {
+        if (isValidImage(model, material.normalImage))
+        {
+            imageUsages[material.normalImage] |= c_normalImageUsage;
+        }
+        if (isValidImage(model, material.metallicRoughnessImage))
+        {
+            imageUsages[material.metallicRoughnessImage] |= c_metallicRoughnessImageUsage;
+        }
+    }
+
+    // The class bits each image enables, an image used both ways is scanned for both
+    std::vector<uint32_t> imageClasses(model.images.size(), 0);
+    jobSystem.parallelFor(model.images.size(), [&model, &imageUsages, &imageClasses](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            if ((imageUsages[i] & c_normalImageUsage) != 0 && hasNonFlatNormals(model.images[i]))
+            {
+                imageClasses[i] |= c_materialClassNormalMap;
+            }
+            if ((imageUsages[i] & c_metallicRoughnessImageUsage) != 0 && hasReflectiveTexels(model.images[i]))
+            {
+                imageClasses[i] |= c_materialClassReflective;
+            }
+        }
+    });
+
+    std::vector<uint32_t> materialClasses(model.materials.size(), 0);
+    for (size_t i = 0; i < model.materials.size(); ++i)
+    {
+        const Model::Material& material = model.materials[i];
+        if (isValidImage(model, material.baseColor))
+        {
+            materialClasses[i] |= c_materialClassBaseColorTexture;
+        }
+        if (isValidImage(model, material.normalImage))
+        {
+            materialClasses[i] |= imageClasses[material.normalImage] & c_materialClassNormalMap;
+        }
+        if (isValidImage(model, material.metallicRoughnessImage))
+        {
+            materialClasses[i] |= imageClasses[material.metallicRoughnessImage] & c_materialClassReflective;
+        }
+    }
+    return materialClasses;
+}
+
+std::string getMaterialClassName(uint32_t materialClass)
+{
+    CHECK(materialClass < c_materialClassCount);
+    std::string name = (materialClass & c_materialClassBaseColorTexture) != 0 ? "base color" : "untextured";
+    if ((materialClass & c_materialClassNormalMap) != 0)
+    {
+        name += " + normal map";
+    }
+    if ((materialClass & c_materialClassReflective) != 0)
+    {
+        name += " + reflective";
+    }
+    return name;
+}
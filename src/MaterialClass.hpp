@@ -0,0 +1,27 @@
+#pragma once
+
+#include "Model.hpp"
+#include "JobSystem.hpp"
+#include <vector>
+#include <string>
+#include <cstdint>
+
+// Shading features of a material. The ray tracer has one closest-hit shader variant per combination of these bits,
+// so the class of a material is also the index of its hit group variant.
+const uint32_t c_materialClassBaseColorTexture = 1u << 0;
+const uint32_t c_materialClassNormalMap = 1u << 1;
+const uint32_t c_materialClassReflective = 1u << 2;
+const uint32_t c_materialClassCount = 8;
+// Everything on, what the closest-hit shader did for every material before the classes
+const uint32_t c_materialClassGeneric = c_materialClassCount - 1;
+
+// Must match the closest-hit shader, which reflects where the blue channel of the metallic roughness texture is above it
+const float c_reflectionMetallicThreshold = 0.1f;
+
+// One class per material. The textures are looked at and not only whether a material has them: a normal map that is
+// flat everywhere needs no tangent frame, and a metallic roughness texture that never exceeds the reflection threshold
+// never reflects. Each image is scanned once however many materials use it.
+std::vector<uint32_t> classifyMaterials(const Model& model, JobSystem& jobSystem = JobSystem::get());
+
+// E.g. "base color + normal map", for the class counts printed at startup
+std::string getMaterialClassName(uint32_t materialClass);
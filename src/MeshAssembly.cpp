@@ -0,0 +1,242 @@
+#include "MeshAssembly.hpp"
+#include "Utils.hpp"
+#include "Hash.hpp"
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <limits>
+
+MeshAssembly assembleMesh(const Model& model, JobSystem& jobSystem)
+{
+    /*
+    Gather the vertices and indices of all submeshes into two big arrays.
+
+    Vertices can be copied one after another.
+
+    Indices need to have an index offset because every submesh starts indexing from 0.
+    So if first submesh has indices 0,1,2 and second also has 0,1,2,
+    the second submesh indices need to be updated to have 3,4,5 so it maps correctly to one
+    big continuous vertex buffer.
+
+    Also for each submesh, gather highest index, triangle (primitive) count and index byte offset
+    because BLAS creation needs them.
+
+    The offsets are known up front so the submeshes are copied in parallel.
+    */
+
+    const size_t submeshCount = model.submeshes.size();
+    std::vector<size_t> vertexOffsets(submeshCount);
+    std::vector<size_t> indexOffsets(submeshCount);
+    size_t vertexCount = 0;
+    size_t indexCount = 0;
+    for (size_t i = 0; i < submeshCount; ++i)
+    {
+        vertexOffsets[i] = vertexCount;
+        indexOffsets[i] = indexCount;
+        vertexCount += model.submeshes[i].vertices.size();
+        indexCount += model.submeshes[i].indices.size();
+    }
+
+    CHECK(model.vertexBufferSizeInBytes == sizeof(Model::Vertex) * vertexCount);
+    CHECK(model.indexBufferSizeInBytes == sizeof(Model::Index) * indexCount);
+
+    MeshAssembly assembly;
+    assembly.vertices.resize(vertexCount);
+    assembly.indices.resize(indexCount);
+    assembly.submeshIndexInfos.resize(submeshCount);
+    // Vertices of submeshes that are not skinned keep the zero weights
+    const bool skinned = model.isSkinned();
+    if (skinned)
+    {
+        assembly.skinVertices.resize(vertexCount);
+    }
+    const uint32_t jointCount = ui32Size(model.skeleton.joints);
+
+    jobSystem.parallelFor(submeshCount, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const Model::Submesh& submesh = model.submeshes[i];
+            const Model::Index indexCounterOffset = static_cast<Model::Index>(vertexOffsets[i]);
+            Model::Index* indices = assembly.indices.data() + indexOffsets[i];
+
+            Model::Index highestIndex = 0;
+            for (size_t j = 0; j < submesh.indices.size(); ++j)
+            {
+                indices[j] = indexCounterOffset + submesh.indices[j];
+                highestIndex = std::max(highestIndex, submesh.indices[j]);
+            }
+
+            assembly.submeshIndexInfos[i] = SubmeshIndexInfo{
+                indexCounterOffset + highestIndex, //
+                ui32Size(submesh.indices) / 3, //
+                sizeof(Model::Index) * indexOffsets[i] //
+            };
+
+            std::copy(submesh.vertices.begin(), submesh.vertices.end(), assembly.vertices.begin() + vertexOffsets[i]);
+
+            if (skinned && !submesh.skinVertices.empty())
+            {
+                for (const Model::SkinVertex& skinVertex : submesh.skinVertices)
+                {
+                    CHECK(skinVertex.joints.x < jointCount && skinVertex.joints.y < jointCount && skinVertex.joints.z < jointCount && skinVertex.joints.w < jointCount);
+                }
+                std::copy(submesh.skinVertices.begin(), submesh.skinVertices.end(), assembly.skinVertices.begin() + vertexOffsets[i]);
+            }
+        }
+    });
+
+    return assembly;
+}
+
+uint64_t hashMeshAssembly(const MeshAssembly& assembly, JobSystem& jobSystem)
+{
+    uint64_t hash = hashParallel(assembly.vertices.data(), sizeof(Model::Vertex) * assembly.vertices.size(), c_fnv1aOffsetBasis, jobSystem);
+    hash = hashParallel(assembly.indices.data(), sizeof(Model::Index) * assembly.indices.size(), hash, jobSystem);
+    for (const SubmeshIndexInfo& info : assembly.submeshIndexInfos)
+    {
+        hash = fnv1aValue(info.maxVertex, hash);
+        hash = fnv1aValue(info.triangleCount, hash);
+        hash = fnv1aValue(info.indexByteOffset, hash);
+    }
+    return hash;
+}
+
+namespace
+{
+const size_t c_positionChunkSize = 16384;
+const size_t c_triangleChunkSize = 4096;
+const float c_snorm16Max = 32767.0f;
+// Keeps the triangle LOD finite for degenerate triangles and UVs
+const float c_minTriangleArea = 1e-20f;
+
+// Octahedral mapping of a unit vector to two snorm16, x in the low half
+uint32_t packOctahedral(const glm::vec3& direction)
+{
+    const float length = std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z);
+    if (length == 0.0f)
+    {
+        return 0;
+    }
+    glm::vec2 octahedral = glm::vec2(direction) / length;
+    if (direction.z < 0.0f)
+    {
+        const glm::vec2 folded = 1.0f - glm::abs(glm::vec2(octahedral.y, octahedral.x));
+        octahedral = glm::vec2(octahedral.x >= 0.0f ? folded.x : -folded.x, octahedral.y >= 0.0f ? folded.y : -folded.y);
+    }
+    const glm::ivec2 snorm(glm::round(glm::clamp(octahedral, -1.0f, 1.0f) * c_snorm16Max));
+    return (static_cast<uint32_t>(snorm.x) & 0xFFFFu) | (static_cast<uint32_t>(snorm.y) << 16);
+}
+} // namespace
+
+std::vector<glm::vec3> packPositions(const std::vector<Model::Vertex>& vertices, JobSystem& jobSystem)
+{
+    std::vector<glm::vec3> positions(vertices.size());
+    jobSystem.parallelFor(
+        vertices.size(),
+        [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i)
+            {
+                positions[i] = glm::vec3(vertices[i].position);
+            }
+        },
+        c_positionChunkSize);
+    return positions;
+}
+
+QuantizedPositions quantizePositions(const std::vector<Model::Vertex>& vertices, JobSystem& jobSystem)
+{
+    glm::vec3 boundsMin(std::numeric_limits<float>::max());
+    glm::vec3 boundsMax(std::numeric_limits<float>::lowest());
+    std::mutex boundsMutex;
+    jobSystem.parallelFor(
+        vertices.size(),
+        [&](size_t begin, size_t end) {
+            glm::vec3 chunkMin(std::numeric_limits<float>::max());
+            glm::vec3 chunkMax(std::numeric_limits<float>::lowest());
+            for (size_t i = begin; i < end; ++i)
+            {
+                const glm::vec3 position(vertices[i].position);
+                chunkMin = glm::min(chunkMin, position);
+                chunkMax = glm::max(chunkMax, position);
+            }
+            const std::lock_guard<std::mutex> lock(boundsMutex);
+            boundsMin = glm::min(boundsMin, chunkMin);
+            boundsMax = glm::max(boundsMax, chunkMax);
+        },
+        c_positionChunkSize);
+
+    QuantizedPositions quantized;
+    quantized.positions.resize(vertices.size());
+    if (vertices.empty())
+    {
+        return quantized;
+    }
+    quantized.center = 0.5f * (boundsMin + boundsMax);
+    // A flat axis still needs a non-zero scale
+    quantized.halfExtent = glm::max(0.5f * (boundsMax - boundsMin), glm::vec3(std::numeric_limits<float>::min()));
+
+    const glm::vec3 center = quantized.center;
+    const glm::vec3 scale = c_snorm16Max / quantized.halfExtent;
+    jobSystem.parallelFor(
+        vertices.size(),
+        [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i)
+            {
+                const glm::vec3 snorm = glm::clamp(glm::round((glm::vec3(vertices[i].position) - center) * scale), -c_snorm16Max, c_snorm16Max);
+                quantized.positions[i] = glm::i16vec4(glm::ivec3(snorm), 0);
+            }
+        },
+        c_positionChunkSize);
+    return quantized;
+}
+
+std::vector<TriangleShadingData> bakeShadingData(const MeshAssembly& assembly, JobSystem& jobSystem)
+{
+    std::vector<uint32_t> triangleOffsets(assembly.submeshIndexInfos.size());
+    uint32_t triangleCount = 0;
+    for (size_t i = 0; i < assembly.submeshIndexInfos.size(); ++i)
+    {
+        triangleOffsets[i] = triangleCount;
+        triangleCount += assembly.submeshIndexInfos[i].triangleCount;
+    }
+    CHECK(3 * static_cast<size_t>(triangleCount) == assembly.indices.size());
+
+    std::vector<TriangleShadingData> shadingData(triangleCount);
+    jobSystem.parallelFor(
+        triangleCount,
+        [&](size_t begin, size_t end) {
+            // Submesh of the first triangle in the chunk, later ones only move forward
+            size_t submesh = std::upper_bound(triangleOffsets.begin(), triangleOffsets.end(), static_cast<uint32_t>(begin)) - triangleOffsets.begin() - 1;
+            for (size_t i = begin; i < end; ++i)
+            {
+                while (submesh + 1 < triangleOffsets.size() && i >= triangleOffsets[submesh + 1])
+                {
+                    ++submesh;
+                }
+
+                TriangleShadingData& triangle = shadingData[i];
+                const Model::Vertex* vertices[3] = {
+                    &assembly.vertices[assembly.indices[3 * i]], //
+                    &assembly.vertices[assembly.indices[3 * i + 1]], //
+                    &assembly.vertices[assembly.indices[3 * i + 2]] //
+                };
+                for (int j = 0; j < 3; ++j)
+                {
+                    triangle.uvs[j] = glm::vec2(vertices[j]->uv);
+                    triangle.normals[j] = packOctahedral(glm::vec3(vertices[j]->normal));
+                    triangle.tangents[j] = packOctahedral(glm::vec3(vertices[j]->tangent));
+                }
+
+                const glm::vec3 edge1 = glm::vec3(vertices[1]->position - vertices[0]->position);
+                const glm::vec3 edge2 = glm::vec3(vertices[2]->position - vertices[0]->position);
+                const glm::vec2 uvEdge1 = triangle.uvs[1] - triangle.uvs[0];
+                const glm::vec2 uvEdge2 = triangle.uvs[2] - triangle.uvs[0];
+                const float objectArea = glm::length(glm::cross(edge1, edge2));
+                const float uvArea = std::abs(uvEdge1.x * uvEdge2.y - uvEdge2.x * uvEdge1.y);
+                triangle.triangleLod = 0.5f * std::log2(std::max(uvArea, c_minTriangleArea) / std::max(objectArea, c_minTriangleArea));
+                triangle.materialId = static_cast<uint32_t>(submesh);
+            }
+        },
+        c_triangleChunkSize);
+    return shadingData;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Model.hpp"
+#include "JobSystem.hpp"
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+
+struct SubmeshIndexInfo
+{
+    Model::Index maxVertex;
+    uint32_t triangleCount;
+    uint64_t indexByteOffset;
+};
+
+// All submeshes of a model in one continuous vertex and index array
+struct MeshAssembly
+{
+    std::vector<Model::Vertex> vertices;
+    std::vector<Model::Index> indices;
+    std::vector<SubmeshIndexInfo> submeshIndexInfos;
+    // One per vertex if the model is skinned, otherwise empty
+    std::vector<Model::SkinVertex> skinVertices;
+};
+
+MeshAssembly assembleMesh(const Model& model, JobSystem& jobSystem = JobSystem::get());
+// Hash of the vertices, indices and submesh ranges, i.e. everything a BLAS build reads
+uint64_t hashMeshAssembly(const MeshAssembly& assembly, JobSystem& jobSystem = JobSystem::get());
+
+// Positions quantized to 16-bit snorm within the bounding box, position = center + halfExtent * snorm / 32767.
+// The fourth component is padding so that the stream can use the R16G16B16A16_SNORM format.
+struct QuantizedPositions
+{
+    std::vector<glm::i16vec4> positions;
+    glm::vec3 center{0.0f};
+    glm::vec3 halfExtent{0.0f};
+};
+
+// Tightly packed positions for the acceleration structure builds, which don't need the other vertex attributes
+std::vector<glm::vec3> packPositions(const std::vector<Model::Vertex>& vertices, JobSystem& jobSystem = JobSystem::get());
+QuantizedPositions quantizePositions(const std::vector<Model::Vertex>& vertices, JobSystem& jobSystem = JobSystem::get());
+
+// Everything the closest-hit shader needs of one triangle in the std430 layout of the shading data buffer, 64 bytes
+// so that a hit reads one cache line instead of an index and three full vertices. Normals and tangents are
+// octahedral encoded into two snorm16 each.
+struct TriangleShadingData
+{
+    glm::vec2 uvs[3];
+    uint32_t normals[3];
+    uint32_t tangents[3];
+    // 0.5 * log2(texture space area / object space area), the texel density term of the ray cone texture LOD
+    float triangleLod;
+    // Submesh of the triangle
+    uint32_t materialId;
+    uint32_t padding[2];
+};
+static_assert(sizeof(TriangleShadingData) == 64, "Must match the shader struct");
+
+// One entry per triangle in the order of the assembled index array, so a submesh starts at its triangle offset
+std::vector<TriangleShadingData> bakeShadingData(const MeshAssembly& assembly, JobSystem& jobSystem = JobSystem::get());
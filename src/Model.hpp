@@ -1,6 +1,7 @@
 #pragma once
 
 #include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
 #include <vector>
 #include <string>
 #include <unordered_map>
@@ -17,11 +18,24 @@ public:
         glm::vec4 tangent{};
     };
 
+    // Blend is alpha tested like mask, there is no transparency
+    enum class AlphaMode
+    {
+        Opaque,
+        Mask,
+        Blend
+    };
+
     struct Material
     {
         int baseColor = -1;
         int metallicRoughnessImage = -1;
         int normalImage = -1;
+        AlphaMode alphaMode = AlphaMode::Opaque;
+        // Surfaces with a lower base color alpha are cut out when the material is alpha tested
+        float alphaCutoff = 0.5f;
+
+        bool isAlphaTested() const { return alphaMode != AlphaMode::Opaque; }
     };
 
     struct Image
@@ -33,21 +47,87 @@ public:
         std::vector<unsigned char> data;
     };
 
+    // Same layout as the skinning shader input
+    struct SkinVertex
+    {
+        glm::uvec4 joints{0};
+        // All zero for vertices that are not skinned, they keep their rest pose
+        glm::vec4 weights{0.0f};
+    };
+
     using Index = uint32_t;
 
     struct Submesh
     {
         std::vector<Vertex> vertices;
         std::vector<Index> indices;
+        // Empty if the submesh isn't skinned, otherwise one per vertex
+        std::vector<SkinVertex> skinVertices;
         int material = -1;
     };
 
+    struct Node
+    {
+        int parent = -1;
+        glm::vec3 translation{0.0f};
+        glm::quat rotation{1.0f, 0.0f, 0.0f, 0.0f};
+        glm::vec3 scale{1.0f};
+        // Used instead of the translation, rotation and scale, glTF doesn't allow animating it
+        bool hasMatrix = false;
+        glm::mat4 matrix{1.0f};
+    };
+
+    enum class AnimationPath
+    {
+        Translation,
+        Rotation,
+        Scale
+    };
+
+    enum class Interpolation
+    {
+        Linear,
+        Step
+    };
+
+    struct AnimationChannel
+    {
+        int node = -1;
+        AnimationPath path = AnimationPath::Translation;
+        Interpolation interpolation = Interpolation::Linear;
+        std::vector<float> times;
+        // Translation and scale use xyz, rotation is a quaternion as xyzw
+        std::vector<glm::vec4> values;
+    };
+
+    struct Animation
+    {
+        std::vector<AnimationChannel> channels;
+        float duration = 0.0f;
+    };
+
+    // Node hierarchy of the skin used by all skinned submeshes and its animations
+    struct Skeleton
+    {
+        std::vector<Node> nodes;
+        // Parents come before their children
+        std::vector<int> nodeOrder;
+        std::vector<int> joints;
+        std::vector<glm::mat4> inverseBindMatrices;
+        std::vector<Animation> animations;
+    };
+
+    Model() = default;
     Model(const std::string& filename);
     ~Model() {}
 
+    void updateBufferSizes();
+    bool isSkinned() const { return !skeleton.joints.empty(); }
+
     std::vector<Submesh> submeshes;
     std::vector<Material> materials;
     std::vector<Image> images;
+    Skeleton skeleton;
 
     uint64_t vertexBufferSizeInBytes = 0;
     uint64_t indexBufferSizeInBytes = 0;
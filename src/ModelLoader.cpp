@@ -0,0 +1,443 @@
+#include "ModelLoader.hpp"
+#include "Utils.hpp"
+
+#define TINYGLTF_NOEXCEPTION
+#include <tiny_gltf.h>
+#include <stb_image.h>
+
+#include <cstring>
+#include <unordered_map>
+#include <algorithm>
+
+namespace
+{
+const std::unordered_map<int, size_t> c_componentTypeSizes{
+    {TINYGLTF_COMPONENT_TYPE_BYTE, 1},
+    {TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE, 1},
+    {TINYGLTF_COMPONENT_TYPE_SHORT, 2},
+    {TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT, 2},
+    {TINYGLTF_COMPONENT_TYPE_INT, 4},
+    {TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT, 4},
+    {TINYGLTF_COMPONENT_TYPE_FLOAT, 4},
+    {TINYGLTF_COMPONENT_TYPE_DOUBLE, 8},
+};
+
+const std::unordered_map<int, size_t> c_typeCounts{
+    {TINYGLTF_TYPE_SCALAR, 1},
+    {TINYGLTF_TYPE_VEC2, 2},
+    {TINYGLTF_TYPE_VEC3, 3},
+    {TINYGLTF_TYPE_VEC4, 4},
+};
+
+size_t getAccessorElementSizeInBytes(const tinygltf::Accessor& accessor)
+{
+    const size_t componentTypeSize = c_componentTypeSizes.at(accessor.componentType);
+    const size_t typeCount = c_typeCounts.at(accessor.type);
+    return componentTypeSize * typeCount;
+}
+
+float readComponent(const unsigned char* data, int componentType, bool normalized)
+{
+    switch (componentType)
+    {
+    case TINYGLTF_COMPONENT_TYPE_BYTE:
+    {
+        int8_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return normalized ? std::max(value / 127.0f, -1.0f) : value;
+    }
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+    {
+        uint8_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return normalized ? value / 255.0f : value;
+    }
+    case TINYGLTF_COMPONENT_TYPE_SHORT:
+    {
+        int16_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return normalized ? std::max(value / 32767.0f, -1.0f) : value;
+    }
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+    {
+        uint16_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return normalized ? value / 65535.0f : value;
+    }
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+    {
+        uint32_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return static_cast<float>(value);
+    }
+    case TINYGLTF_COMPONENT_TYPE_FLOAT:
+    {
+        float value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+    }
+    LOGE("Unsupported accessor component type");
+    return 0.0f;
+}
+
+// Reads element i of a scalar or vector accessor of any component type, missing components are zero
+glm::vec4 readAccessorVec4(const tinygltf::Model& model, const tinygltf::Accessor& accessor, size_t i)
+{
+    const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
+    const tinygltf::Buffer& buffer = model.buffers[bufferView.buffer];
+    const size_t componentSize = c_componentTypeSizes.at(accessor.componentType);
+    const size_t componentCount = c_typeCounts.at(accessor.type);
+    const size_t stride = bufferView.byteStride != 0 ? bufferView.byteStride : componentSize * componentCount;
+    const size_t offset = bufferView.byteOffset + accessor.byteOffset + i * stride;
+    CHECK(offset + componentSize * componentCount <= buffer.data.size());
+
+    glm::vec4 value{0.0f};
+    for (size_t c = 0; c < componentCount; ++c)
+    {
+        value[static_cast<int>(c)] = readComponent(&buffer.data[offset + c * componentSize], accessor.componentType, accessor.normalized);
+    }
+    return value;
+}
+
+int getSourceOrMinusOne(const std::vector<tinygltf::Texture>& textures, int index)
+{
+    if (index < 0)
+    {
+        return -1;
+    }
+    return textures[index].source;
+}
+
+void loadSubmesh(const tinygltf::Model& model, const tinygltf::Primitive& gltfPrimitive, Model::Submesh& submesh)
+{
+    submesh.material = gltfPrimitive.material;
+
+    { // Indices
+        const tinygltf::Accessor& accessor = model.accessors[gltfPrimitive.indices];
+        const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
+        const tinygltf::Buffer& buffer = model.buffers[bufferView.buffer];
+
+        std::vector<uint32_t>& indices = submesh.indices;
+        indices.resize(accessor.count);
+
+        const size_t elementSizeInBytes = getAccessorElementSizeInBytes(accessor);
+        const size_t indexOffset = bufferView.byteOffset + accessor.byteOffset;
+        const unsigned char* bufferPtr = &buffer.data[indexOffset];
+        unsigned short indexValue = 0;
+        const size_t lastIndex = indexOffset + bufferView.byteLength - 1;
+
+        for (size_t i = 0; i < accessor.count; ++i)
+        {
+            CHECK(bufferPtr < &buffer.data[lastIndex]);
+            std::memcpy(&indexValue, bufferPtr, sizeof(unsigned short));
+            indices[i] = indexValue;
+            bufferPtr += bufferView.byteStride + elementSizeInBytes;
+        }
+    }
+
+    // Vertices
+    for (const auto& [attributeName, attributeIndex] : gltfPrimitive.attributes)
+    {
+        const tinygltf::Accessor& accessor = model.accessors[attributeIndex];
+        const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
+        const tinygltf::Buffer& buffer = model.buffers[bufferView.buffer];
+
+        std::vector<Model::Vertex>& vertices = submesh.vertices;
+        vertices.resize(accessor.count);
+
+        const size_t elementSizeInBytes = getAccessorElementSizeInBytes(accessor);
+        const size_t offset = bufferView.byteOffset + accessor.byteOffset;
+        const unsigned char* bufferPtr = &buffer.data[offset];
+        const size_t lastIndex = offset + bufferView.byteLength - 1;
+
+        for (size_t accessorIndex = 0; accessorIndex < accessor.count; ++accessorIndex)
+        {
+            CHECK(bufferPtr < &buffer.data[lastIndex]);
+
+            if (attributeName == "POSITION")
+            {
+                std::memcpy(&vertices[accessorIndex].position, bufferPtr, elementSizeInBytes);
+            }
+            else if (attributeName == "NORMAL")
+            {
+                std::memcpy(&vertices[accessorIndex].normal, bufferPtr, elementSizeInBytes);
+            }
+            else if (attributeName == "TEXCOORD_0")
+            {
+                std::memcpy(&vertices[accessorIndex].uv, bufferPtr, elementSizeInBytes);
+            }
+            else if (attributeName == "TANGENT")
+            {
+                std::memcpy(&vertices[accessorIndex].tangent, bufferPtr, elementSizeInBytes);
+            }
+            bufferPtr += bufferView.byteStride;
+        }
+    }
+
+    // Skinning data only counts when both attributes are present
+    const auto joints = gltfPrimitive.attributes.find("JOINTS_0");
+    const auto weights = gltfPrimitive.attributes.find("WEIGHTS_0");
+    if (joints != gltfPrimitive.attributes.end() && weights != gltfPrimitive.attributes.end())
+    {
+        const tinygltf::Accessor& jointAccessor = model.accessors[joints->second];
+        const tinygltf::Accessor& weightAccessor = model.accessors[weights->second];
+        CHECK(jointAccessor.count == submesh.vertices.size() && weightAccessor.count == submesh.vertices.size());
+
+        submesh.skinVertices.resize(submesh.vertices.size());
+        for (size_t i = 0; i < submesh.skinVertices.size(); ++i)
+        {
+            submesh.skinVertices[i].joints = glm::uvec4(readAccessorVec4(model, jointAccessor, i));
+            submesh.skinVertices[i].weights = readAccessorVec4(model, weightAccessor, i);
+        }
+    }
+}
+
+Model::AnimationChannel loadAnimationChannel(const tinygltf::Model& model, const tinygltf::AnimationChannel& gltfChannel, const tinygltf::AnimationSampler& sampler)
+{
+    Model::AnimationChannel channel;
+    channel.node = gltfChannel.target_node;
+    if (gltfChannel.target_path == "rotation")
+    {
+        channel.path = Model::AnimationPath::Rotation;
+    }
+    else if (gltfChannel.target_path == "scale")
+    {
+        channel.path = Model::AnimationPath::Scale;
+    }
+    channel.interpolation = sampler.interpolation == "STEP" ? Model::Interpolation::Step : Model::Interpolation::Linear;
+
+    const tinygltf::Accessor& inputAccessor = model.accessors[sampler.input];
+    const tinygltf::Accessor& outputAccessor = model.accessors[sampler.output];
+    channel.times.resize(inputAccessor.count);
+    channel.values.resize(inputAccessor.count);
+
+    // Cubic spline keys are stored as in-tangent, value, out-tangent. Only the values are used and interpolated linearly.
+    const size_t valueStride = sampler.interpolation == "CUBICSPLINE" ? 3 : 1;
+    const size_t valueOffset = sampler.interpolation == "CUBICSPLINE" ? 1 : 0;
+    CHECK(outputAccessor.count == inputAccessor.count * valueStride);
+
+    for (size_t i = 0; i < inputAccessor.count; ++i)
+    {
+        channel.times[i] = readAccessorVec4(model, inputAccessor, i).x;
+        channel.values[i] = readAccessorVec4(model, outputAccessor, i * valueStride + valueOffset);
+    }
+    return channel;
+}
+
+Model::AlphaMode parseAlphaMode(const std::string& alphaMode)
+{
+    if (alphaMode == "MASK")
+    {
+        return Model::AlphaMode::Mask;
+    }
+    if (alphaMode == "BLEND")
+    {
+        return Model::AlphaMode::Blend;
+    }
+    return Model::AlphaMode::Opaque;
+}
+} // namespace
+
+std::vector<Model::Submesh> loadSubmeshes(const tinygltf::Model& model, JobSystem& jobSystem)
+{
+    std::vector<Model::Submesh> submeshes(model.meshes[0].primitives.size());
+    // Primitives are independent, each one writes only its own submesh
+    jobSystem.parallelFor(submeshes.size(), [&model, &submeshes](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            loadSubmesh(model, model.meshes[0].primitives[i], submeshes[i]);
+        }
+    });
+    return submeshes;
+}
+
+Model::Skeleton loadSkeleton(const tinygltf::Model& gltfModel)
+{
+    Model::Skeleton skeleton;
+    if (gltfModel.skins.empty())
+    {
+        return skeleton;
+    }
+
+    // The skin of the node that instantiates the loaded mesh
+    int skinIndex = 0;
+    for (const tinygltf::Node& node : gltfModel.nodes)
+    {
+        if (node.mesh == 0 && node.skin >= 0)
+        {
+            skinIndex = node.skin;
+            break;
+        }
+    }
+
+    skeleton.nodes.resize(gltfModel.nodes.size());
+    for (size_t i = 0; i < gltfModel.nodes.size(); ++i)
+    {
+        const tinygltf::Node& gltfNode = gltfModel.nodes[i];
+        Model::Node& node = skeleton.nodes[i];
+        if (gltfNode.matrix.size() == 16)
+        {
+            node.hasMatrix = true;
+            for (int column = 0; column < 4; ++column)
+            {
+                for (int row = 0; row < 4; ++row)
+                {
+                    node.matrix[column][row] = static_cast<float>(gltfNode.matrix[column * 4 + row]);
+                }
+            }
+        }
+        if (gltfNode.translation.size() == 3)
+        {
+            node.translation = glm::vec3(gltfNode.translation[0], gltfNode.translation[1], gltfNode.translation[2]);
+        }
+        if (gltfNode.rotation.size() == 4)
+        {
+            node.rotation = glm::quat(static_cast<float>(gltfNode.rotation[3]), static_cast<float>(gltfNode.rotation[0]), static_cast<float>(gltfNode.rotation[1]), static_cast<float>(gltfNode.rotation[2]));
+        }
+        if (gltfNode.scale.size() == 3)
+        {
+            node.scale = glm::vec3(gltfNode.scale[0], gltfNode.scale[1], gltfNode.scale[2]);
+        }
+        for (int child : gltfNode.children)
+        {
+            skeleton.nodes[child].parent = static_cast<int>(i);
+        }
+    }
+
+    // Depth first from the roots so that the global transforms can be computed in one pass
+    std::vector<int> stack;
+    for (size_t i = 0; i < gltfModel.nodes.size(); ++i)
+    {
+        if (skeleton.nodes[i].parent < 0)
+        {
+            stack.push_back(static_cast<int>(i));
+        }
+    }
+    while (!stack.empty())
+    {
+        const int node = stack.back();
+        stack.pop_back();
+        skeleton.nodeOrder.push_back(node);
+        stack.insert(stack.end(), gltfModel.nodes[node].children.begin(), gltfModel.nodes[node].children.end());
+    }
+
+    const tinygltf::Skin& skin = gltfModel.skins[skinIndex];
+    skeleton.joints = skin.joints;
+    skeleton.inverseBindMatrices.resize(skin.joints.size(), glm::mat4(1.0f));
+    if (skin.inverseBindMatrices >= 0)
+    {
+        const tinygltf::Accessor& accessor = gltfModel.accessors[skin.inverseBindMatrices];
+        const tinygltf::BufferView& bufferView = gltfModel.bufferViews[accessor.bufferView];
+        const tinygltf::Buffer& buffer = gltfModel.buffers[bufferView.buffer];
+        CHECK(accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT && accessor.count == skin.joints.size());
+        const size_t stride = bufferView.byteStride != 0 ? bufferView.byteStride : sizeof(glm::mat4);
+        const size_t offset = bufferView.byteOffset + accessor.byteOffset;
+        CHECK(offset + stride * (accessor.count - 1) + sizeof(glm::mat4) <= buffer.data.size());
+        for (size_t i = 0; i < accessor.count; ++i)
+        {
+            std::memcpy(&skeleton.inverseBindMatrices[i], &buffer.data[offset + i * stride], sizeof(glm::mat4));
+        }
+    }
+
+    for (const tinygltf::Animation& gltfAnimation : gltfModel.animations)
+    {
+        Model::Animation animation;
+        for (const tinygltf::AnimationChannel& gltfChannel : gltfAnimation.channels)
+        {
+            // Morph target weights are not supported
+            if (gltfChannel.target_node < 0 || gltfChannel.target_path == "weights")
+            {
+                continue;
+            }
+            animation.channels.push_back(loadAnimationChannel(gltfModel, gltfChannel, gltfAnimation.samplers[gltfChannel.sampler]));
+            if (!animation.channels.back().times.empty())
+            {
+                animation.duration = std::max(animation.duration, animation.channels.back().times.back());
+            }
+        }
+        skeleton.animations.push_back(std::move(animation));
+    }
+
+    return skeleton;
+}
+
+std::vector<Model::Material> loadMaterials(const tinygltf::Model& gltfModel)
+{
+    std::vector<Model::Material> materials(gltfModel.materials.size());
+    const std::vector<tinygltf::Texture>& t = gltfModel.textures;
+
+    for (size_t i = 0; i < gltfModel.materials.size(); ++i)
+    {
+        const tinygltf::Material& m = gltfModel.materials[i];
+        materials[i].baseColor = getSourceOrMinusOne(t, m.pbrMetallicRoughness.baseColorTexture.index);
+        materials[i].metallicRoughnessImage = getSourceOrMinusOne(t, m.pbrMetallicRoughness.metallicRoughnessTexture.index);
+        materials[i].normalImage = getSourceOrMinusOne(t, m.normalTexture.index);
+        materials[i].alphaMode = parseAlphaMode(m.alphaMode);
+        materials[i].alphaCutoff = static_cast<float>(m.alphaCutoff);
+    }
+
+    return materials;
+}
+
+std::vector<Model::Image> loadImages(tinygltf::Model& model, JobSystem& jobSystem)
+{
+    std::vector<Model::Image> images(model.images.size());
+
+    jobSystem.parallelFor(images.size(), [&model, &images](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            tinygltf::Image& gltfImage = model.images[i];
+            Model::Image& image = images[i];
+
+            if (gltfImage.component > 0)
+            {
+                image.width = gltfImage.width;
+                image.height = gltfImage.height;
+                image.components = gltfImage.component;
+                image.bitsPerChannel = gltfImage.bits;
+                image.data = std::move(gltfImage.image);
+                continue;
+            }
+
+            // Same as the tinygltf default loader: always RGBA8 because not all formats are supported by Vulkan drivers
+            const int requestedComponents = 4;
+            int width = 0;
+            int height = 0;
+            int fileComponents = 0;
+            unsigned char* pixels = stbi_load_from_memory(gltfImage.image.data(), static_cast<int>(gltfImage.image.size()), &width, &height, &fileComponents, requestedComponents);
+            if (pixels == nullptr)
+            {
+                LOGE(("Failed to decode image " + gltfImage.uri + ": " + stbi_failure_reason()).c_str());
+            }
+
+            image.width = width;
+            image.height = height;
+            image.components = requestedComponents;
+            image.bitsPerChannel = 8;
+            image.data.assign(pixels, pixels + static_cast<size_t>(width) * height * requestedComponents);
+            stbi_image_free(pixels);
+            gltfImage.image.clear();
+        }
+    });
+
+    return images;
+}
+
+bool storeEncodedImage(tinygltf::Image* image, const int imageIndex, std::string* error, std::string* warning, int requestedWidth, int requestedHeight, const unsigned char* bytes, int size, void* userData)
+{
+    (void)imageIndex;
+    (void)error;
+    (void)warning;
+    (void)requestedWidth;
+    (void)requestedHeight;
+    (void)userData;
+
+    // Zero components marks the data as encoded for loadImages
+    image->width = 0;
+    image->height = 0;
+    image->component = 0;
+    image->bits = 0;
+    image->image.assign(bytes, bytes + size);
+    return true;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "Model.hpp"
+#include "JobSystem.hpp"
+#include <string>
+#include <vector>
+
+namespace tinygltf
+{
+class Model;
+struct Image;
+}
+
+// glTF to Model conversion, used by Model and exposed separately for benchmarking
+std::vector<Model::Submesh> loadSubmeshes(const tinygltf::Model& model, JobSystem& jobSystem = JobSystem::get());
+std::vector<Model::Material> loadMaterials(const tinygltf::Model& gltfModel);
+// Nodes, joints and animations of the skin of the first mesh, empty if the model has no skins
+Model::Skeleton loadSkeleton(const tinygltf::Model& gltfModel);
+// Moves the image data out of the glTF model, images stored by storeEncodedImage are decoded in parallel
+std::vector<Model::Image> loadImages(tinygltf::Model& model, JobSystem& jobSystem = JobSystem::get());
+// Image loader callback for tinygltf that keeps the encoded file data so that decoding can be done later in parallel
+bool storeEncodedImage(tinygltf::Image* image, const int imageIndex, std::string* error, std::string* warning, int requestedWidth, int requestedHeight, const unsigned char* bytes, int size, void* userData);
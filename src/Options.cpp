@@ -0,0 +1,390 @@
+#include "Options.hpp"
+#include "Utils.hpp"
+#include <string>
+#include <cstdio>
+
+namespace
+{
+SceneModel parseSceneModel(const std::string& value)
+{
+    if (value == "sponza")
+    {
+        return SceneModel::Sponza;
+    }
+    if (value == "soup")
+    {
+        return SceneModel::TriangleSoup;
+    }
+    if (value == "small-meshes")
+    {
+        return SceneModel::SmallMeshes;
+    }
+    if (value == "huge-mesh")
+    {
+        return SceneModel::HugeMesh;
+    }
+    if (value == "tentacles")
+    {
+        return SceneModel::Tentacles;
+    }
+    LOGE(("Unknown scene " + value).c_str());
+    return SceneModel::Sponza;
+}
+
+AccelerationStructurePreset parseAccelerationStructurePreset(const std::string& value)
+{
+    if (value == "fast-trace")
+    {
+        return AccelerationStructurePreset::FastTrace;
+    }
+    if (value == "fast-build")
+    {
+        return AccelerationStructurePreset::FastBuild;
+    }
+    if (value == "low-memory")
+    {
+        return AccelerationStructurePreset::LowMemory;
+    }
+    LOGE(("Unknown acceleration structure preset " + value).c_str());
+    return AccelerationStructurePreset::FastTrace;
+}
+
+BlasMode parseBlasMode(const std::string& value)
+{
+    if (value == "monolithic")
+    {
+        return BlasMode::Monolithic;
+    }
+    if (value == "per-submesh")
+    {
+        return BlasMode::PerSubmesh;
+    }
+    LOGE(("Unknown BLAS mode " + value).c_str());
+    return BlasMode::Monolithic;
+}
+
+PositionFormat parsePositionFormat(const std::string& value)
+{
+    if (value == "vertex")
+    {
+        return PositionFormat::Vertex;
+    }
+    if (value == "float3")
+    {
+        return PositionFormat::Float3;
+    }
+    if (value == "snorm16")
+    {
+        return PositionFormat::Snorm16;
+    }
+    LOGE(("Unknown position format " + value).c_str());
+    return PositionFormat::Float3;
+}
+
+ShadingData parseShadingData(const std::string& value)
+{
+    if (value == "vertices")
+    {
+        return ShadingData::Vertices;
+    }
+    if (value == "baked")
+    {
+        return ShadingData::Baked;
+    }
+    LOGE(("Unknown shading data " + value).c_str());
+    return ShadingData::Vertices;
+}
+
+Renderer parseRenderer(const std::string& value)
+{
+    if (value == "pipeline")
+    {
+        return Renderer::Pipeline;
+    }
+    if (value == "ray-query")
+    {
+        return Renderer::RayQuery;
+    }
+    if (value == "wavefront")
+    {
+        return Renderer::Wavefront;
+    }
+    LOGE(("Unknown renderer " + value).c_str());
+    return Renderer::Pipeline;
+}
+
+Sampling parseSampling(const std::string& value)
+{
+    if (value == "fixed")
+    {
+        return Sampling::Fixed;
+    }
+    if (value == "uniform")
+    {
+        return Sampling::Uniform;
+    }
+    if (value == "adaptive")
+    {
+        return Sampling::Adaptive;
+    }
+    LOGE(("Unknown sampling " + value).c_str());
+    return Sampling::Fixed;
+}
+
+SecondaryRays parseSecondaryRays(const std::string& value)
+{
+    if (value == "full")
+    {
+        return SecondaryRays::Full;
+    }
+    if (value == "half")
+    {
+        return SecondaryRays::Half;
+    }
+    if (value == "checkerboard")
+    {
+        return SecondaryRays::Checkerboard;
+    }
+    LOGE(("Unknown secondary rays " + value).c_str());
+    return SecondaryRays::Full;
+}
+
+bool parseOnOff(const std::string& option, const std::string& value)
+{
+    if (value == "on")
+    {
+        return true;
+    }
+    if (value == "off")
+    {
+        return false;
+    }
+    LOGE(("Invalid value " + value + " for " + option + ", expected on or off").c_str());
+    return false;
+}
+
+uint64_t parseNumber(const std::string& option, const std::string& value)
+{
+    size_t end = 0;
+    uint64_t number = 0;
+    try
+    {
+        number = std::stoull(value, &end);
+    }
+    catch (...)
+    {
+        end = 0;
+    }
+
+    if (end == 0 || end != value.size())
+    {
+        LOGE(("Invalid value " + value + " for " + option).c_str());
+    }
+    return number;
+}
+
+void printUsage()
+{
+    printf("Usage: vkrt [options]\n"
+           "  --rasterizer            Use the rasterizer instead of the raytracer\n"
+           "  --scene <name>          sponza, soup, small-meshes, huge-mesh or tentacles\n"
+           "  --instances <n>         Number of model instances laid out in a grid\n"
+           "  --triangles <n>         Triangle count of a procedural model\n"
+           "  --meshes <n>            Mesh count of the small-meshes and tentacles scenes\n"
+           "  --textures <n>          Texture count of a procedural model\n"
+           "  --seed <n>              Random seed of a procedural model\n"
+           "  --lights <n>            Point light count, more than 4 are sampled through a light tree\n"
+           "  --frames <n>            Exit after n frames and print frame time summary\n"
+           "  --as-preset <name>      fast-trace, fast-build or low-memory acceleration structure builds\n"
+           "  --blas-mode <name>      monolithic or per-submesh BLAS\n"
+           "  --position-format <f>   BLAS build positions: vertex, float3 or snorm16\n"
+           "  --no-as-cache           Always build the BLAS instead of loading it from the disk cache\n"
+           "  --animate-instances     Move the instances every frame and update the TLAS\n"
+           "  --alpha-test <on|off>   Cut out alpha masked materials, on by default\n"
+           "  --accumulate <on|off>   Accumulate samples while the camera is still, on by default\n"
+           "  --denoise <on|off>      Denoise one sample per pixel with SVGF instead of accumulating, off by default\n"
+           "  --texture-lod <on|off>  Select texture levels with ray cones, on by default\n"
+           "  --shading-data <name>   Hit shader triangle data: vertices or baked per-triangle records\n"
+           "  --material-classes <on|off> Specialized hit shaders per material class, on by default\n"
+           "  --renderer <name>       pipeline, ray-query or wavefront at startup, R cycles at runtime\n"
+           "  --wavefront-depth <n>   Maximum hits along a path of the wavefront renderer, 2 by default\n"
+           "  --wavefront-sort <on|off> Sort the wavefront hits by material before shading, on by default\n"
+           "  --views <n>             Camera views traced by one pipeline launch, 1 by default\n"
+           "  --sampling <mode>       fixed, uniform or adaptive samples per pixel of the accumulation, fixed by default\n"
+           "  --samples-per-pixel <n> Average samples per pixel and frame of uniform and adaptive sampling, 1 by default\n"
+           "  --render-scale <pct>    Trace resolution in percent of the window, upscaled to it below 100, 100 by default\n"
+           "  --secondary-rays <mode> full, half or checkerboard pixels tracing shadows and reflections, full by default\n"
+           "  --threads <n>           Job system threads, 0 uses all, 1 runs everything on the main thread\n"
+           "  --pin-threads           Pin job system worker threads to cores\n"
+           "  --no-render-thread      Render the raytracer frames on the main thread\n");
+}
+} // namespace
+
+Options parseOptions(int argc, char** argv)
+{
+    Options options;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string option = argv[i];
+
+        if (option == "--help")
+        {
+            printUsage();
+            exit(0);
+        }
+        if (option == "--rasterizer")
+        {
+            options.useRasterizer = true;
+            continue;
+        }
+        if (option == "--pin-threads")
+        {
+            options.pinThreads = true;
+            continue;
+        }
+        if (option == "--animate-instances")
+        {
+            options.animateInstances = true;
+            continue;
+        }
+        if (option == "--no-as-cache")
+        {
+            options.accelerationStructureCache = false;
+            continue;
+        }
+        if (option == "--no-render-thread")
+        {
+            options.renderThread = false;
+            continue;
+        }
+
+        if (i + 1 >= argc)
+        {
+            printUsage();
+            LOGE(("Missing value for " + option).c_str());
+        }
+        const std::string value = argv[++i];
+
+        if (option == "--scene")
+        {
+            options.scene.model = parseSceneModel(value);
+        }
+        else if (option == "--instances")
+        {
+            options.scene.instanceCount = static_cast<uint32_t>(parseNumber(option, value));
+        }
+        else if (option == "--triangles")
+        {
+            options.scene.triangleCount = parseNumber(option, value);
+        }
+        else if (option == "--meshes")
+        {
+            options.scene.meshCount = static_cast<uint32_t>(parseNumber(option, value));
+        }
+        else if (option == "--textures")
+        {
+            options.scene.textureCount = static_cast<uint32_t>(parseNumber(option, value));
+        }
+        else if (option == "--seed")
+        {
+            options.scene.seed = static_cast<uint32_t>(parseNumber(option, value));
+        }
+        else if (option == "--lights")
+        {
+            options.scene.lightCount = static_cast<uint32_t>(parseNumber(option, value));
+        }
+        else if (option == "--frames")
+        {
+            options.frameCount = static_cast<uint32_t>(parseNumber(option, value));
+        }
+        else if (option == "--as-preset")
+        {
+            options.accelerationStructurePreset = parseAccelerationStructurePreset(value);
+        }
+        else if (option == "--blas-mode")
+        {
+            options.blasMode = parseBlasMode(value);
+        }
+        else if (option == "--alpha-test")
+        {
+            options.alphaTest = parseOnOff(option, value);
+        }
+        else if (option == "--accumulate")
+        {
+            options.accumulate = parseOnOff(option, value);
+        }
+        else if (option == "--denoise")
+        {
+            options.denoise = parseOnOff(option, value);
+        }
+        else if (option == "--texture-lod")
+        {
+            options.textureLod = parseOnOff(option, value);
+        }
+        else if (option == "--shading-data")
+        {
+            options.shadingData = parseShadingData(value);
+        }
+        else if (option == "--material-classes")
+        {
+            options.materialClasses = parseOnOff(option, value);
+        }
+        else if (option == "--renderer")
+        {
+            options.renderer = parseRenderer(value);
+        }
+        else if (option == "--wavefront-depth")
+        {
+            options.wavefrontDepth = static_cast<uint32_t>(parseNumber(option, value));
+        }
+        else if (option == "--wavefront-sort")
+        {
+            options.wavefrontSort = parseOnOff(option, value);
+        }
+        else if (option == "--views")
+        {
+            options.viewCount = static_cast<uint32_t>(parseNumber(option, value));
+        }
+        else if (option == "--sampling")
+        {
+            options.sampling = parseSampling(value);
+        }
+        else if (option == "--secondary-rays")
+        {
+            options.secondaryRays = parseSecondaryRays(value);
+        }
+        else if (option == "--samples-per-pixel")
+        {
+            options.samplesPerPixel = static_cast<uint32_t>(parseNumber(option, value));
+        }
+        else if (option == "--render-scale")
+        {
+            options.renderScale = static_cast<uint32_t>(parseNumber(option, value));
+        }
+        else if (option == "--position-format")
+        {
+            options.positionFormat = parsePositionFormat(value);
+        }
+        else if (option == "--threads")
+        {
+            options.threadCount = static_cast<uint32_t>(parseNumber(option, value));
+        }
+        else
+        {
+            printUsage();
+            LOGE(("Unknown option " + option).c_str());
+        }
+    }
+
+    CHECK(options.scene.instanceCount > 0);
+    CHECK(options.scene.meshCount > 0);
+    CHECK(options.scene.textureCount > 0);
+    CHECK(options.scene.lightCount > 0);
+    CHECK(options.wavefrontDepth > 0);
+    CHECK(options.viewCount > 0);
+    CHECK(options.samplesPerPixel > 0);
+    CHECK(options.renderScale > 0 && options.renderScale <= 100);
+
+    return options;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "Scene.hpp"
+#include <cstdint>
+
+enum class AccelerationStructurePreset
+{
+    FastTrace,
+    FastBuild,
+    LowMemory
+};
+
+enum class BlasMode
+{
+    Monolithic,
+    PerSubmesh
+};
+
+// Vertex positions read by the BLAS builds
+enum class PositionFormat
+{
+    // Positions inside the full vertex, 64-byte stride
+    Vertex,
+    // Separate tightly packed 12-byte float3 stream
+    Float3,
+    // Separate 8-byte R16G16B16A16_SNORM stream with a dequantization transform
+    Snorm16
+};
+
+// Where the closest-hit shader reads the triangle attributes from
+enum class ShadingData
+{
+    // Index buffer, then the three full 64-byte vertices
+    Vertices,
+    // One precomputed 64-byte record per triangle with compact UVs, normals, tangents and the material id
+    Baked
+};
+
+// What traces and shades the rays of the raytracer
+enum class Renderer
+{
+    // Ray tracing pipeline with the shader binding table
+    Pipeline,
+    // One compute shader thread per pixel with inline ray queries
+    RayQuery,
+    // Ray query compute kernels connected by queues in device memory, with the hits sorted by material
+    Wavefront
+};
+
+// How the raytracer distributes the samples of a frame over the pixels
+enum class Sampling
+{
+    // One sample per pixel without tracking the noise
+    Fixed,
+    // The same samples for every pixel, with the per-pixel variance tracked for comparison with Adaptive
+    Uniform,
+    // A fixed budget of samples per frame, spent on the pixels with the highest estimated error
+    Adaptive
+};
+
+// Pixels of the pipeline renderer whose primary hits trace shadow and reflection rays, the others reconstruct them
+enum class SecondaryRays
+{
+    // Every pixel
+    Full,
+    // One pixel of each 2x2 quad, rotating through the quad over 4 frames
+    Half,
+    // Every other pixel in a checkerboard that flips every frame
+    Checkerboard
+};
+
+struct Options
+{
+    SceneParameters scene;
+    // Exit after this many frames, 0 runs until the window is closed
+    uint32_t frameCount = 0;
+    // Job system threads including the main thread, 0 uses all hardware threads and 1 runs everything on the main thread
+    uint32_t threadCount = 0;
+    bool pinThreads = false;
+    // Record and submit the raytracer frames on a separate thread from the input and camera simulation
+    bool renderThread = true;
+    bool useRasterizer = false;
+    // Build flags of the BLAS and TLAS, fast-trace and low-memory also compact the BLAS
+    AccelerationStructurePreset accelerationStructurePreset = AccelerationStructurePreset::FastTrace;
+    // One BLAS with all submeshes or one BLAS per submesh
+    BlasMode blasMode = BlasMode::Monolithic;
+    PositionFormat positionFormat = PositionFormat::Float3;
+    // Store serialized BLASes on disk and load them instead of building when the geometry, device and driver match
+    bool accelerationStructureCache = true;
+    // Move the scene instances every frame, which refits or rebuilds the TLAS per frame
+    bool animateInstances = false;
+    // Cut out alpha masked materials, off renders everything opaque
+    bool alphaTest = true;
+    // Average the frames while the camera and the scene are still, with jittered pixels and soft shadows
+    bool accumulate = true;
+    // Filter one sample per pixel with the SVGF denoiser instead of accumulating
+    bool denoise = false;
+    // Select the texture levels in the hit shader with ray cones, off always samples the full resolution
+    bool textureLod = true;
+    ShadingData shadingData = ShadingData::Vertices;
+    // Give each material class its own specialized closest-hit shader, off runs the full shader for every material
+    bool materialClasses = true;
+    // Renderer at startup, R cycles through them at runtime
+    Renderer renderer = Renderer::Pipeline;
+    // Maximum number of hits along a path of the wavefront renderer, 2 matches the reflections of the others
+    uint32_t wavefrontDepth = 2;
+    // Sort the hits of the wavefront renderer by material before shading them
+    bool wavefrontSort = true;
+    // Camera views traced by one launch of the pipeline renderer, the views after the first are rotated around the
+    // camera and written to a layered image
+    uint32_t viewCount = 1;
+    // Uniform and Adaptive need the accumulation and are ignored by the denoiser and the compute renderers
+    Sampling sampling = Sampling::Fixed;
+    // Average samples per pixel and frame of Uniform and Adaptive sampling
+    uint32_t samplesPerPixel = 1;
+    // Trace resolution in percent of the window per axis, below 100 the image is upscaled and sharpened to the window
+    uint32_t renderScale = 100;
+    // Half and Checkerboard are ignored with uniform or adaptive sampling and by the compute renderers
+    SecondaryRays secondaryRays = SecondaryRays::Full;
+};
+
+Options parseOptions(int argc, char** argv);
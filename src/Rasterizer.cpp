@@ -2,6 +2,8 @@
 #include "VulkanUtils.hpp"
 #include "Utils.hpp"
 #include "DebugMarker.hpp"
+#include "Scene.hpp"
+#include "MeshAssembly.hpp"
 #include <imgui.h>
 #include <glm/glm.hpp>
 #include <GLFW/glfw3.h>
@@ -17,9 +19,11 @@ const VkImageSubresourceRange c_defaultSubresourceRance{VK_IMAGE_ASPECT_COLOR_BI
 const VkSampleCountFlagBits c_msaaSampleCount = VK_SAMPLE_COUNT_8_BIT;
 } // namespace
 
-Rasterizer::Rasterizer(Context& context) :
+Rasterizer::Rasterizer(Context& context, const Options& options) :
     m_context(context),
     m_device(context.getDevice()),
+    m_options(options),
+    m_constructionStartTime(std::chrono::high_resolution_clock::now()),
     m_lastRenderTime(std::chrono::high_resolution_clock::now())
 {
     loadModel();
@@ -41,9 +45,14 @@ Rasterizer::Rasterizer(Context& context) :
     updateUboDescriptorSets();
     updateTexturesDescriptorSets();
     createVertexAndIndexBuffer();
+    createSkinning();
+    createInstanceBuffer();
     allocateCommandBuffers();
     releaseModel();
     initializeGUI();
+
+    // Don't count the setup time as the first frame
+    m_lastRenderTime = std::chrono::high_resolution_clock::now();
 }
 
 Rasterizer::~Rasterizer()
@@ -51,9 +60,11 @@ Rasterizer::~Rasterizer()
     vkDeviceWaitIdle(m_device);
 
     m_gui.reset();
+    m_skinning.reset();
 
     vkDestroyBuffer(m_device, m_attributeBuffer, nullptr);
     vkFreeMemory(m_device, m_attributeBufferMemory, nullptr);
+    destroyBufferAndFreeMemory(m_device, m_instanceBuffer, m_instanceBufferMemory);
     vkDestroyBuffer(m_device, m_uniformBuffer, nullptr);
     vkFreeMemory(m_device, m_uniformBufferMemory, nullptr);
     vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
@@ -115,6 +126,11 @@ bool Rasterizer::render()
     vkResetCommandBuffer(cb, VK_COMMAND_BUFFER_RESET_RELEASE_RESOURCES_BIT);
     vkBeginCommandBuffer(cb, &beginInfo);
 
+    if (m_skinning)
+    {
+        m_skinning->record(cb, imageIndex, getMillisecondsSince(m_constructionStartTime) / 1000.0);
+    }
+
     std::array<VkClearValue, 2> clearValues{};
     clearValues[0].color = {0.0f, 0.0f, 0.2f, 1.0f};
     clearValues[1].depthStencil = {1.0f, 0};
@@ -134,15 +150,17 @@ bool Rasterizer::render()
         DebugMarker::beginLabel(cb, "Render", DebugMarker::blue);
         vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
 
-        VkDeviceSize offsets[] = {0};
-        vkCmdBindVertexBuffers(cb, 0, 1, &m_attributeBuffer, offsets);
+        const std::array<VkBuffer, 2> vertexBuffers{m_attributeBuffer, m_instanceBuffer};
+        const std::array<VkDeviceSize, 2> offsets{0, 0};
+        vkCmdBindVertexBuffers(cb, 0, ui32Size(vertexBuffers), vertexBuffers.data(), offsets.data());
         vkCmdBindIndexBuffer(cb, m_attributeBuffer, m_primitiveInfos[0].indexOffset, VK_INDEX_TYPE_UINT32);
         for (size_t i = 0; i < m_primitiveInfos.size(); ++i)
         {
             const PrimitiveInfo& primitiveInfo = m_primitiveInfos[i];
             const std::vector<VkDescriptorSet> descriptorSets{m_uboDescriptorSets[imageIndex], m_texturesDescriptorSets[primitiveInfo.material]};
             vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, ui32Size(descriptorSets), descriptorSets.data(), 0, nullptr);
-            vkCmdDrawIndexed(cb, primitiveInfo.indexCount, 1, primitiveInfo.firstIndex, primitiveInfo.vertexCountOffset, 0);
+            vkCmdPushConstants(cb, m_pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(float), &primitiveInfo.alphaCutoff);
+            vkCmdDrawIndexed(cb, primitiveInfo.indexCount, m_instanceCount, primitiveInfo.firstIndex, primitiveInfo.vertexCountOffset, 0);
         }
 
         DebugMarker::endLabel(cb);
@@ -182,13 +200,19 @@ bool Rasterizer::update(uint32_t imageIndex)
     m_fps = 1.0f / deltaTime;
     m_lastRenderTime = high_resolution_clock::now();
 
+    m_frameStatistics.addFrame(deltaTime);
+    if (m_options.frameCount > 0 && m_frameStatistics.getFrameCount() > m_options.frameCount)
+    {
+        return false;
+    }
+
     updateCamera(deltaTime);
 
     void* dst;
     VK_CHECK(vkMapMemory(m_device, m_uniformBufferMemory, imageIndex * c_uniformBufferSize, c_uniformBufferSize, 0, &dst));
-    glm::mat4 scaleMatrix = glm::scale(glm::vec3(0.01f, 0.01f, 0.01f));
-    const glm::mat4 wvpMatrix = m_camera.getProjectionMatrix() * m_camera.getViewMatrix() * scaleMatrix;
-    std::memcpy(dst, &wvpMatrix[0], static_cast<size_t>(c_uniformBufferSize));
+    // Model scale is part of the per-instance transforms
+    const glm::mat4 viewProjectionMatrix = m_camera.getProjectionMatrix() * m_camera.getViewMatrix();
+    std::memcpy(dst, &viewProjectionMatrix[0], static_cast<size_t>(c_uniformBufferSize));
     vkUnmapMemory(m_device, m_uniformBufferMemory);
 
     return true;
@@ -196,7 +220,9 @@ bool Rasterizer::update(uint32_t imageIndex)
 
 void Rasterizer::loadModel()
 {
-    m_model.reset(new Model("sponza/Sponza.gltf"));
+    Scene scene = createScene(m_options.scene);
+    m_model = std::move(scene.model);
+    m_instanceTransforms = std::move(scene.instanceTransforms);
 }
 
 void Rasterizer::releaseModel()
@@ -212,8 +238,8 @@ void Rasterizer::setupCamera()
 
 void Rasterizer::updateCamera(double deltaTime)
 {
-    std::vector<Context::KeyEvent> keyEvents = m_context.getKeyEvents();
-    for (const Context::KeyEvent& keyEvent : keyEvents)
+    Context::KeyEvent keyEvent;
+    while (m_context.popKeyEvent(keyEvent))
     {
         if (keyEvent.action == GLFW_PRESS || keyEvent.action == GLFW_REPEAT)
         {
@@ -733,15 +759,26 @@ void Rasterizer::createGraphicsPipeline()
     pipelineLayoutInfo.setLayoutCount = ui32Size(descriptorSetLayouts);
     pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
 
+    // Alpha cutoff of the material
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(float);
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
     VK_CHECK(vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_pipelineLayout));
     DebugMarker::setObjectName(VK_OBJECT_TYPE_PIPELINE_LAYOUT, m_pipelineLayout, "Pipeline layout - Rasterizer");
 
-    VkVertexInputBindingDescription vertexDescription{};
-    vertexDescription.binding = 0;
-    vertexDescription.stride = sizeof(Model::Vertex);
-    vertexDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    std::array<VkVertexInputBindingDescription, 2> vertexDescriptions{};
+    vertexDescriptions[0].binding = 0;
+    vertexDescriptions[0].stride = sizeof(Model::Vertex);
+    vertexDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    vertexDescriptions[1].binding = 1;
+    vertexDescriptions[1].stride = sizeof(glm::mat4);
+    vertexDescriptions[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
 
-    std::vector<VkVertexInputAttributeDescription> attributeDescriptions(4);
+    std::vector<VkVertexInputAttributeDescription> attributeDescriptions(8);
 
     attributeDescriptions[0].binding = 0;
     attributeDescriptions[0].location = 0;
@@ -763,10 +800,19 @@ void Rasterizer::createGraphicsPipeline()
     attributeDescriptions[3].format = VK_FORMAT_R32G32B32A32_SFLOAT;
     attributeDescriptions[3].offset = offsetof(Model::Vertex, tangent);
 
+    // Instance model matrix, one location per column
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        attributeDescriptions[4 + i].binding = 1;
+        attributeDescriptions[4 + i].location = 4 + i;
+        attributeDescriptions[4 + i].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+        attributeDescriptions[4 + i].offset = sizeof(glm::vec4) * i;
+    }
+
     VkPipelineVertexInputStateCreateInfo vertexInputState{};
     vertexInputState.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInputState.vertexBindingDescriptionCount = 1;
-    vertexInputState.pVertexBindingDescriptions = &vertexDescription;
+    vertexInputState.vertexBindingDescriptionCount = ui32Size(vertexDescriptions);
+    vertexInputState.pVertexBindingDescriptions = vertexDescriptions.data();
     vertexInputState.vertexAttributeDescriptionCount = ui32Size(attributeDescriptions);
     vertexInputState.pVertexAttributeDescriptions = attributeDescriptions.data();
 
@@ -1063,6 +1109,8 @@ void Rasterizer::createVertexAndIndexBuffer()
         m_primitiveInfos[i].indexOffset = indexOffset;
         m_primitiveInfos[i].firstIndex = firstIndex;
         m_primitiveInfos[i].material = primitive.material;
+        const Model::Material& material = m_model->materials[primitive.material];
+        m_primitiveInfos[i].alphaCutoff = m_options.alphaTest && material.isAlphaTested() ? material.alphaCutoff : 0.0f;
 
         vertexCountOffset += static_cast<int32_t>(primitive.vertices.size());
         firstIndex += ui32Size(primitive.indices);
@@ -1084,7 +1132,8 @@ void Rasterizer::createVertexAndIndexBuffer()
     bufferInfo.usage = //
         VK_BUFFER_USAGE_TRANSFER_DST_BIT | //
         VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | //
-        VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+        VK_BUFFER_USAGE_INDEX_BUFFER_BIT | //
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
     bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
     VK_CHECK(vkCreateBuffer(m_device, &bufferInfo, nullptr, &m_attributeBuffer));
@@ -1121,6 +1170,60 @@ void Rasterizer::createVertexAndIndexBuffer()
     releaseStagingBuffer(m_device, stagingBuffer);
 }
 
+// The vertices are at the start of the attribute buffer in submesh order, the same layout as the mesh assembly,
+// so the skinned vertices can be written there directly
+void Rasterizer::createSkinning()
+{
+    if (!m_model->isSkinned())
+    {
+        return;
+    }
+
+    const MeshAssembly assembly = assembleMesh(*m_model);
+
+    Skinning::InitData initData{};
+    initData.device = m_device;
+    initData.physicalDevice = m_context.getPhysicalDevice();
+    initData.commandPool = m_context.getGraphicsCommandPool();
+    initData.queue = m_context.getGraphicsQueue();
+    initData.skeleton = &m_model->skeleton;
+    initData.restVertices = &assembly.vertices;
+    initData.skinVertices = &assembly.skinVertices;
+    initData.vertexBuffer = m_attributeBuffer;
+    initData.positionBuffer = VK_NULL_HANDLE;
+    initData.slotCount = ui32Size(m_context.getSwapchainImages());
+    initData.consumerStageMask = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+    initData.consumerAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+    m_skinning = std::make_unique<Skinning>(initData);
+}
+
+void Rasterizer::createInstanceBuffer()
+{
+    m_instanceCount = ui32Size(m_instanceTransforms);
+    const uint64_t bufferSize = sizeof(glm::mat4) * m_instanceTransforms.size();
+
+    const VkPhysicalDevice physicalDevice = m_context.getPhysicalDevice();
+    StagingBuffer stagingBuffer = createStagingBuffer(m_device, physicalDevice, m_instanceTransforms.data(), bufferSize);
+
+    m_instanceBuffer = createBuffer(m_device, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+    m_instanceBufferMemory = allocateAndBindMemory(m_device, physicalDevice, m_instanceBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_BUFFER, m_instanceBuffer, "Buffer - Instance");
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_DEVICE_MEMORY, m_instanceBufferMemory, "Memory - Instance buffer");
+
+    VkBufferCopy copyRegion{};
+    copyRegion.srcOffset = 0;
+    copyRegion.dstOffset = 0;
+    copyRegion.size = bufferSize;
+
+    const SingleTimeCommand command = beginSingleTimeCommands(m_context.getGraphicsCommandPool(), m_device);
+    vkCmdCopyBuffer(command.commandBuffer, stagingBuffer.buffer, m_instanceBuffer, 1, &copyRegion);
+    endSingleTimeCommands(m_context.getGraphicsQueue(), command);
+
+    releaseStagingBuffer(m_device, stagingBuffer);
+
+    m_instanceTransforms.clear();
+}
+
 void Rasterizer::allocateCommandBuffers()
 {
     m_commandBuffers.resize(m_framebuffers.size());
@@ -4,6 +4,10 @@
 #include "Camera.hpp"
 #include "Model.hpp"
 #include "GUI.hpp"
+#include "Options.hpp"
+#include "FrameStatistics.hpp"
+#include "Skinning.hpp"
+#include <glm/glm.hpp>
 #include <vector>
 #include <chrono>
 #include <unordered_map>
@@ -12,7 +16,7 @@
 class Rasterizer final
 {
 public:
-    Rasterizer(Context& context);
+    Rasterizer(Context& context, const Options& options);
     ~Rasterizer();
 
     bool render();
@@ -25,6 +29,8 @@ private:
         uint32_t indexCount;
         uint32_t firstIndex;
         int material;
+        // 0 for opaque materials, nothing is discarded
+        float alphaCutoff{0.0f};
     };
 
     bool update(uint32_t imageIndex);
@@ -51,13 +57,18 @@ private:
     void updateUboDescriptorSets();
     void updateTexturesDescriptorSets();
     void createVertexAndIndexBuffer();
+    void createSkinning();
+    void createInstanceBuffer();
     void allocateCommandBuffers();
     void initializeGUI();
 
     Context& m_context;
     VkDevice m_device;
+    const Options m_options;
+    const std::chrono::high_resolution_clock::time_point m_constructionStartTime;
 
     std::unique_ptr<Model> m_model{nullptr};
+    std::vector<glm::mat4> m_instanceTransforms;
     Camera m_camera;
     std::chrono::steady_clock::time_point m_lastRenderTime;
     std::unordered_map<int, bool> m_keysDown;
@@ -86,7 +97,13 @@ private:
     VkBuffer m_attributeBuffer;
     VkDeviceMemory m_attributeBufferMemory;
     std::vector<PrimitiveInfo> m_primitiveInfos;
+    // Skins into the start of m_attributeBuffer before the render pass
+    std::unique_ptr<Skinning> m_skinning;
+    VkBuffer m_instanceBuffer;
+    VkDeviceMemory m_instanceBufferMemory;
+    uint32_t m_instanceCount;
     std::vector<VkCommandBuffer> m_commandBuffers;
     std::unique_ptr<GUI> m_gui;
     float m_fps;
+    FrameStatistics m_frameStatistics;
 };
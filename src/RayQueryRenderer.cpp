@@ -0,0 +1,76 @@
+#include "RayQueryRenderer.hpp"
+#include "VulkanUtils.hpp"
+#include "DebugMarker.hpp"
+#include "Utils.hpp"
+
+namespace
+{
+// Same as local_size_x and local_size_y in ray_query.comp
+const uint32_t c_workGroupSize = 8;
+} // namespace
+
+RayQueryRenderer::RayQueryRenderer(const InitData& initData) :
+    m_device(initData.device),
+    m_extent(initData.extent)
+{
+    createPipeline(initData.descriptorSetLayouts);
+
+    m_timer = std::make_unique<GpuTimer>(initData.timerName, m_device, initData.physicalDevice, initData.slotCount);
+    m_timer->setItemCount(static_cast<uint64_t>(m_extent.width) * m_extent.height, "pixel");
+}
+
+RayQueryRenderer::~RayQueryRenderer()
+{
+    m_timer.reset();
+
+    vkDestroyPipeline(m_device, m_pipeline, nullptr);
+    vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+}
+
+void RayQueryRenderer::record(VkCommandBuffer commandBuffer, uint32_t slot, const std::vector<VkDescriptorSet>& descriptorSets)
+{
+    DebugMarker::beginLabel(commandBuffer, "Ray query", DebugMarker::blue);
+    m_timer->begin(commandBuffer, slot);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, ui32Size(descriptorSets), descriptorSets.data(), 0, nullptr);
+    vkCmdDispatch(commandBuffer, (m_extent.width + c_workGroupSize - 1) / c_workGroupSize, (m_extent.height + c_workGroupSize - 1) / c_workGroupSize, 1);
+
+    m_timer->end(commandBuffer, slot);
+    DebugMarker::endLabel(commandBuffer);
+}
+
+void RayQueryRenderer::createPipeline(const std::vector<VkDescriptorSetLayout>& descriptorSetLayouts)
+{
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = ui32Size(descriptorSetLayouts);
+    pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
+    pipelineLayoutInfo.pushConstantRangeCount = 0;
+    pipelineLayoutInfo.pPushConstantRanges = nullptr;
+
+    VK_CHECK(vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_pipelineLayout));
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_PIPELINE_LAYOUT, m_pipelineLayout, "Pipeline layout - Ray query");
+
+    VkShaderModule shaderModule = createShaderModule(m_device, getCurrentExecutableDirectory() / "ray_query.comp.spv");
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.pNext = NULL;
+    pipelineInfo.flags = 0;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.pNext = NULL;
+    pipelineInfo.stage.flags = 0;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.stage.pSpecializationInfo = NULL;
+    pipelineInfo.layout = m_pipelineLayout;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineInfo.basePipelineIndex = 0;
+
+    VK_CHECK(vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_pipeline));
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_PIPELINE, m_pipeline, "Pipeline - Ray query");
+
+    vkDestroyShaderModule(m_device, shaderModule, nullptr);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "GpuTimer.hpp"
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <memory>
+#include <string>
+
+// Renders with ray queries from a compute shader instead of the ray tracing pipeline: camera, reflection and shadow
+// rays are traced against the TLAS of the raytracer and the hits are shaded inline, without the shader binding table
+// and payloads. Uses the descriptor sets of the raytracer and writes the same accumulation image and G-buffer, so
+// the two can be switched between frames.
+class RayQueryRenderer final
+{
+public:
+    struct InitData
+    {
+        VkDevice device;
+        VkPhysicalDevice physicalDevice;
+        // Common, material index and textures set layouts of the raytracer, with the compute stage in their bindings
+        std::vector<VkDescriptorSetLayout> descriptorSetLayouts;
+        VkExtent2D extent;
+        std::string timerName;
+        uint32_t slotCount;
+    };
+
+    RayQueryRenderer(const InitData& initData);
+    // Prints the GPU time per pixel
+    ~RayQueryRenderer();
+
+    // Records the dispatch. The descriptor sets are in the order of the layouts, the caller synchronizes the
+    // accumulation image and the G-buffer with the compute shader stage.
+    void record(VkCommandBuffer commandBuffer, uint32_t slot, const std::vector<VkDescriptorSet>& descriptorSets);
+
+private:
+    void createPipeline(const std::vector<VkDescriptorSetLayout>& descriptorSetLayouts);
+
+    VkDevice m_device;
+    const VkExtent2D m_extent;
+
+    VkPipelineLayout m_pipelineLayout;
+    VkPipeline m_pipeline;
+    std::unique_ptr<GpuTimer> m_timer;
+};
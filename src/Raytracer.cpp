@@ -2,13 +2,22 @@
 #include "VulkanUtils.hpp"
 #include "Utils.hpp"
 #include "DebugMarker.hpp"
+#include "Scene.hpp"
+#include "MeshAssembly.hpp"
+#include "TaskGraph.hpp"
+#include "Hash.hpp"
+#include "AccelerationStructureCache.hpp"
+#include "ShaderBindingTable.hpp"
+#include "MaterialClass.hpp"
 #include <imgui.h>
 #include <glm/glm.hpp>
 #include <GLFW/glfw3.h>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/transform.hpp>
+#include <algorithm>
 #include <array>
 #include <cmath>
+#include <string>
 
 namespace
 {
@@ -20,14 +29,31 @@ struct UniformBufferInfo
     glm::vec4 right;
     glm::vec4 up;
     glm::vec4 forward;
-    std::array<glm::vec4, 4> lightPositions;
+    // Reprojects the primary hits into the previous frame for the denoiser motion vectors. Lives in the frame's own
+    // slot, so a frame still in flight keeps the matrix of the frame before it.
+    glm::mat4 previousViewProjection;
+    // Seeds the light sampling
+    uint32_t frameIndex;
+    uint32_t lightCount;
+    // Samples already averaged in the accumulation image, 0 restarts the accumulation
+    uint32_t sampleIndex;
+    // Non-zero when the ray generation shader writes the denoiser G-buffer
+    uint32_t denoise;
+    // Ray cone spread angle of one pixel for the texture LOD, 0 samples the full resolution levels
+    float pixelSpreadAngle;
+    // Non-zero when the closest-hit shader reads the baked per-triangle shading data
+    uint32_t bakedShadingData;
+    // Non-zero when the ray generation shader traces the samples per pixel of the adaptive sampler
+    uint32_t sampleStatistics;
+    // 0 traces shadows and reflections in every pixel, 1 in one pixel per 2x2 quad and 2 in a checkerboard
+    uint32_t secondaryRays;
 };
 
-const std::array<glm::vec4, 4> c_lightPositions{
-    glm::vec4{6.0f, 6.0f, 0.0f, 0.0f}, //
-    glm::vec4{2.0f, 5.0f, 0.0f, 0.0f}, //
-    glm::vec4{-2.0f, 4.0f, 0.0f, 0.0f}, //
-    glm::vec4{-6.0f, 3.0f, 0.0f, 0.0f} //
+// Camera of one view of the batched launch, indexed by gl_LaunchIDEXT.z
+struct ViewInfo
+{
+    glm::mat4 viewInverse;
+    glm::mat4 projInverse;
 };
 
 struct SubmeshInfo
@@ -36,12 +62,161 @@ struct SubmeshInfo
     int metallicRoughnessTextureIndex = -1;
     int normalTextureIndex = -1;
     int indexBufferOffset = 0;
+    // 0 for opaque materials
+    float alphaCutoff = 0.0f;
 };
+// RecordData of tests/ShaderBindingTableTests.cpp mirrors the layout
+static_assert(sizeof(SubmeshInfo) == 20, "Update the shader binding table test");
 
 const size_t c_uniformBufferSize = sizeof(UniformBufferInfo);
+const VkFormat c_accumulationFormat = VK_FORMAT_R32G32B32A32_SFLOAT;
+// RGBA8 is guaranteed to support storage, unlike the BGRA8 of the swapchain
+const VkFormat c_colorFormat = VK_FORMAT_R8G8B8A8_UNORM;
 const VkImageSubresourceRange c_defaultSubresourceRance{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
-const uint32_t c_shaderCount = 4;
-const uint32_t c_shaderGroupCount = 4;
+// Indices into the pipeline's shader stages, the closest-hit shader specialized for material class i is stage i
+const uint32_t c_rayGenShader = c_materialClassCount;
+const uint32_t c_missShader = c_materialClassCount + 1;
+const uint32_t c_shadowMissShader = c_materialClassCount + 2;
+const uint32_t c_anyHitShader = c_materialClassCount + 3;
+const uint32_t c_shadowAnyHitShader = c_materialClassCount + 4;
+const uint32_t c_shaderCount = c_materialClassCount + 5;
+// Indices into the pipeline's shader groups, the camera hit group of material class i is c_hitGroup + i
+const uint32_t c_hitGroup = 0;
+const uint32_t c_shadowHitGroup = c_materialClassCount;
+const uint32_t c_raygenGroup = c_materialClassCount + 1;
+const uint32_t c_missGroup = c_materialClassCount + 2;
+const uint32_t c_shadowMissGroup = c_materialClassCount + 3;
+const uint32_t c_shaderGroupCount = c_materialClassCount + 4;
+// Specialization constants of shader.rchit: base color texture, normal map and reflective
+const uint32_t c_materialClassConstantCount = 3;
+// Mip level of the alpha test in shader.rahit, specialized per hit group. Shadow rays only need coverage, a coarser
+// level is cheaper to fetch and doesn't alias on thin cutouts. Camera rays keep the full resolution level.
+const float c_cameraAlphaLod = 0.0f;
+const float c_shadowAlphaLod = 2.0f;
+// Stages that trace rays and read the vertices: the ray tracing pipeline and the ray query renderer
+const VkPipelineStageFlags c_traversalStageMask = VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+// Hit records per submesh, camera/reflection and shadow. Must match the sbtRecordStride of the shaders.
+const uint32_t c_rayTypeCount = 2;
+const uint32_t c_maxTextureCount = 1024;
+const uint32_t c_maxDescriptorSets = 16;
+// Must match shader.rchit, with more lights than this the hit shader samples the light tree instead of looping over all
+const uint32_t c_maxExactLightCount = 4;
+// Acceleration structures must start at a multiple of 256 bytes in their buffer
+const VkDeviceSize c_accelerationStructureAlignment = 256;
+// A TLAS refit is replaced by a rebuild after this many refits or when an instance has moved further than this
+// fraction of the instance size since the last build
+const uint32_t c_maxTlasRefits = 240;
+const float c_maxTlasRefitDisplacement = 0.5f;
+// Skinned BLASes are rebuilt after this many refits
+const uint32_t c_maxBlasRefits = 120;
+// BLAS builds are batched so that their scratch memory stays below this, unless a single build needs more
+const VkDeviceSize c_maxScratchArenaSize = 64 * 1024 * 1024;
+
+VkBuildAccelerationStructureFlagsKHR getBuildFlags(AccelerationStructurePreset preset)
+{
+    switch (preset)
+    {
+    case AccelerationStructurePreset::FastTrace:
+        return VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
+    case AccelerationStructurePreset::FastBuild:
+        return VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_KHR;
+    case AccelerationStructurePreset::LowMemory:
+        return VK_BUILD_ACCELERATION_STRUCTURE_LOW_MEMORY_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
+    }
+    return 0;
+}
+
+const char* getPresetName(AccelerationStructurePreset preset)
+{
+    switch (preset)
+    {
+    case AccelerationStructurePreset::FastTrace:
+        return "fast-trace";
+    case AccelerationStructurePreset::FastBuild:
+        return "fast-build";
+    case AccelerationStructurePreset::LowMemory:
+        return "low-memory";
+    }
+    return "";
+}
+
+const char* getPositionFormatName(PositionFormat format)
+{
+    switch (format)
+    {
+    case PositionFormat::Vertex:
+        return "vertex";
+    case PositionFormat::Float3:
+        return "float3";
+    case PositionFormat::Snorm16:
+        return "snorm16";
+    }
+    return "";
+}
+
+const char* getRendererName(Renderer renderer)
+{
+    switch (renderer)
+    {
+    case Renderer::Pipeline:
+        return "ray tracing pipeline";
+    case Renderer::RayQuery:
+        return "ray query compute shader";
+    case Renderer::Wavefront:
+        return "wavefront path tracer";
+    }
+    return "";
+}
+
+// The renderer after the given one when cycling with R
+Renderer getNextRenderer(Renderer renderer)
+{
+    switch (renderer)
+    {
+    case Renderer::Pipeline:
+        return Renderer::RayQuery;
+    case Renderer::RayQuery:
+        return Renderer::Wavefront;
+    case Renderer::Wavefront:
+        return Renderer::Pipeline;
+    }
+    return Renderer::Pipeline;
+}
+
+// Material data of every submesh, read by the hit shaders from the shader binding table records
+std::vector<SubmeshInfo> createSubmeshInfos(const Model& model, bool alphaTest)
+{
+    // For each submesh texture indices are stored.
+    // Also index buffer offset is needed, because indices are gathered in one big buffer,
+    // so we need to know where each submesh's indices start.
+    std::vector<SubmeshInfo> submeshInfos(model.submeshes.size());
+    int indexBufferOffset = 0;
+    for (size_t i = 0; i < model.submeshes.size(); ++i)
+    {
+        const Model::Submesh& submesh = model.submeshes[i];
+        submeshInfos[i].baseColorTextureIndex = model.materials[submesh.material].baseColor;
+        submeshInfos[i].normalTextureIndex = model.materials[submesh.material].normalImage;
+        submeshInfos[i].metallicRoughnessTextureIndex = model.materials[submesh.material].metallicRoughnessImage;
+        submeshInfos[i].indexBufferOffset = indexBufferOffset;
+        if (alphaTest && model.materials[submesh.material].isAlphaTested())
+        {
+            submeshInfos[i].alphaCutoff = model.materials[submesh.material].alphaCutoff;
+        }
+
+        indexBufferOffset += submesh.indices.size() / 3;
+
+        // For some materials there's no normal or metallicRoughess, just use some image in that case to avoid crashes
+        submeshInfos[i].normalTextureIndex = std::max(submeshInfos[i].normalTextureIndex, 0);
+        submeshInfos[i].metallicRoughnessTextureIndex = std::max(submeshInfos[i].metallicRoughnessTextureIndex, 0);
+    }
+    return submeshInfos;
+}
+
+// Trace resolution for a scale in percent of the window, rounded to the nearest pixel
+VkExtent2D getRenderExtent(uint32_t renderScale)
+{
+    return {(static_cast<uint32_t>(c_windowWidth) * renderScale + 50) / 100, (static_cast<uint32_t>(c_windowHeight) * renderScale + 50) / 100};
+}
 
 VkMemoryAllocateFlagsInfo c_memoryAllocateFlagsInfo{
     VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO, //
@@ -51,52 +226,155 @@ VkMemoryAllocateFlagsInfo c_memoryAllocateFlagsInfo{
 };
 } // namespace
 
-Raytracer::Raytracer(Context& context) :
+Raytracer::Raytracer(Context& context, const Options& options) :
     m_context(context),
     m_device(context.getDevice()),
-    m_lastRenderTime(std::chrono::high_resolution_clock::now())
+    m_options(options),
+    m_renderExtent(getRenderExtent(options.renderScale)),
+    m_constructionStartTime(std::chrono::high_resolution_clock::now()),
+    m_lastRenderTime(std::chrono::high_resolution_clock::now()),
+    m_lastSimulationTime(std::chrono::high_resolution_clock::now()),
+    m_renderer(options.renderer)
 {
     getFunctionPointers();
-    loadModel();
-    setupCamera();
-    createColorImage();
-    createSwapchainImageViews();
-    createSampler();
-    createTextures();
-    createVertexAndIndexBuffer();
-    createDescriptorPool();
-    createCommonDescriptorSetLayoutAndAllocate();
-    createMaterialIndexDescriptorSetLayoutAndAllocate();
-    createTexturesDescriptorSetLayoutAndAllocate();
-    createPipeline();
-    createCommonBuffer();
-    createMaterialIndexBuffer();
-    allocateCommandBuffers();
-    createBLAS();
-    createTLAS();
-    updateCommonDescriptorSets();
-    updateMaterialIndexDescriptorSet();
-    updateTexturesDescriptorSets();
-    createShaderBindingTable();
+    queryTextureLimit();
+    queryAccelerationStructureProperties();
+
+    const std::string blasModeName = m_options.blasMode == BlasMode::PerSubmesh ? "per-submesh" : "monolithic";
+    const std::string alphaTestName = m_options.alphaTest ? "" : " alpha-test off";
+    const std::string textureLodName = m_options.textureLod ? "" : " texture-lod off";
+    const std::string shadingDataName = m_options.shadingData == ShadingData::Baked ? " baked shading" : "";
+    const std::string materialClassesName = m_options.materialClasses ? "" : " material-classes off";
+    m_timerConfigurationName = std::string(getPresetName(m_options.accelerationStructurePreset)) + " " + blasModeName + alphaTestName + textureLodName;
+    if (m_options.renderScale < 100)
+    {
+        m_timerConfigurationName += " scale " + std::to_string(m_options.renderScale);
+    }
+    const std::string viewsName = m_options.viewCount > 1 ? " views " + std::to_string(m_options.viewCount) : "";
+    std::string secondaryRaysName;
+    if (m_options.secondaryRays == SecondaryRays::Half)
+    {
+        secondaryRaysName = " secondary half";
+    }
+    else if (m_options.secondaryRays == SecondaryRays::Checkerboard)
+    {
+        secondaryRaysName = " secondary checkerboard";
+    }
+    const std::string traceRaysTimerName = "traceRays " + m_timerConfigurationName + shadingDataName + materialClassesName + viewsName + secondaryRaysName;
+    m_traceRaysTimer = std::make_unique<GpuTimer>(traceRaysTimerName, m_device, m_context.getPhysicalDevice(), ui32Size(m_context.getSwapchainImages()));
+    if (m_options.viewCount > 1)
+    {
+        // Compares the cost of a view between batch sizes
+        m_traceRaysTimer->setItemCount(m_options.viewCount, "view");
+    }
+
+    // Setup steps run as soon as their inputs are ready, e.g. the pipeline compiles while the model loads
+    TaskGraph graph;
+    const TaskGraph::TaskId model = graph.add("loadModel", [this]() { loadModel(); });
+    graph.add("setupCamera", [this]() { setupCamera(); });
+    const TaskGraph::TaskId renderTargets = graph.add("createRenderTargets", [this]() { createRenderTargets(); });
+    const TaskGraph::TaskId swapchainImageViews = graph.add("createSwapchainImageViews", [this]() { createSwapchainImageViews(); });
+    const TaskGraph::TaskId sampler = graph.add("createSampler", [this]() { createSampler(); });
+    const TaskGraph::TaskId textures = graph.add("createTextures", [this]() { createTextures(); }, {model});
+    const TaskGraph::TaskId vertexAndIndexBuffer = graph.add("createVertexAndIndexBuffer", [this]() { createVertexAndIndexBuffer(); }, {model});
+    const TaskGraph::TaskId descriptorPool = graph.add("createDescriptorPool", [this]() { createDescriptorPool(); });
+    // Allocations from the same descriptor pool must not happen concurrently so they are chained
+    const TaskGraph::TaskId commonSet = graph.add("createCommonDescriptorSetLayoutAndAllocate", [this]() { createCommonDescriptorSetLayoutAndAllocate(); }, {descriptorPool});
+    const TaskGraph::TaskId materialIndexSet = graph.add("createMaterialIndexDescriptorSetLayoutAndAllocate", [this]() { createMaterialIndexDescriptorSetLayoutAndAllocate(); }, {commonSet});
+    const TaskGraph::TaskId texturesSet = graph.add("createTexturesDescriptorSetLayoutAndAllocate", [this]() { createTexturesDescriptorSetLayoutAndAllocate(); }, {materialIndexSet});
+    const TaskGraph::TaskId pipeline = graph.add("createPipeline", [this]() { createPipeline(); }, {commonSet, materialIndexSet, texturesSet});
+    graph.add("createRayQueryRenderer", [this]() { createRayQueryRenderer(); }, {commonSet, materialIndexSet, texturesSet});
+    graph.add("createWavefrontPathTracer", [this]() { createWavefrontPathTracer(); }, {commonSet, materialIndexSet, texturesSet, model});
+    const TaskGraph::TaskId commonBuffer = graph.add("createCommonBuffer", [this]() { createCommonBuffer(); });
+    const TaskGraph::TaskId materialIndexBuffer = graph.add("createMaterialIndexBuffer", [this]() { createMaterialIndexBuffer(); }, {model});
+    const TaskGraph::TaskId lightBuffers = graph.add("createLightBuffers", [this]() { createLightBuffers(); }, {model});
+    graph.add("allocateCommandBuffers", [this]() { allocateCommandBuffers(); }, {swapchainImageViews});
+    const TaskGraph::TaskId blas = graph.add("createBLAS", [this]() { createBLAS(); }, {vertexAndIndexBuffer});
+    const TaskGraph::TaskId tlas = graph.add("createTLAS", [this]() { createTLAS(); }, {model, blas});
+    graph.add("updateCommonDescriptorSets", [this]() { updateCommonDescriptorSets(); }, {commonSet, tlas, commonBuffer, vertexAndIndexBuffer, lightBuffers, renderTargets});
+    graph.add("updateMaterialIndexDescriptorSet", [this]() { updateMaterialIndexDescriptorSet(); }, {materialIndexSet, materialIndexBuffer});
+    graph.add("updateTexturesDescriptorSets", [this]() { updateTexturesDescriptorSets(); }, {texturesSet, textures, sampler});
+    graph.add("createShaderBindingTable", [this]() { createShaderBindingTable(); }, {pipeline, model});
+
+    graph.execute();
+    graph.printStatistics();
+
+    // Whether the model is skinned is only known after it has loaded
+    const uint32_t slotCount = ui32Size(m_context.getSwapchainImages());
+    if (m_dynamicTlas)
+    {
+        m_tlasUpdateTimer = std::make_unique<GpuTimer>("TLAS update", m_device, m_context.getPhysicalDevice(), slotCount);
+    }
+    if (m_skinning)
+    {
+        uint64_t triangleCount = 0;
+        for (const SubmeshIndexInfo& info : m_submeshIndexInfos)
+        {
+            triangleCount += info.triangleCount;
+        }
+        m_blasRefitTimer = std::make_unique<GpuTimer>("BLAS refit", m_device, m_context.getPhysicalDevice(), slotCount);
+        m_blasRefitTimer->setItemCount(triangleCount, "triangle");
+        m_blasRebuildTimer = std::make_unique<GpuTimer>("BLAS rebuild", m_device, m_context.getPhysicalDevice(), slotCount);
+        m_blasRebuildTimer->setItemCount(triangleCount, "triangle");
+    }
 
     m_model.reset();
+
+    printf("Raytracer setup %.1f ms\n", getMillisecondsSince(m_constructionStartTime));
+
+    publishFrameState();
+
+    // Don't count the setup time as the first frame
+    m_lastRenderTime = std::chrono::high_resolution_clock::now();
+    m_lastSimulationTime = m_lastRenderTime;
 }
 
 Raytracer::~Raytracer()
 {
     vkDeviceWaitIdle(m_device);
 
+    m_traceRaysTimer.reset();
+    m_rayQueryRenderer.reset();
+    m_wavefrontPathTracer.reset();
+    if (m_tlasUpdateTimer)
+    {
+        m_tlasUpdateTimer.reset();
+        printf("TLAS updates: %llu refits, %llu rebuilds\n", static_cast<unsigned long long>(m_tlasRefitCount), static_cast<unsigned long long>(m_tlasRebuildCount));
+    }
+    if (m_skinning)
+    {
+        m_skinning.reset();
+        m_blasRefitTimer.reset();
+        m_blasRebuildTimer.reset();
+        printf("BLAS updates: %llu refits, %llu rebuilds\n", static_cast<unsigned long long>(m_blasRefitCount), static_cast<unsigned long long>(m_blasRebuildCount));
+    }
+
+    vkUnmapMemory(m_device, m_instanceRingMemory);
+
     destroyBufferAndFreeMemory(m_device, m_vertexBuffer, m_vertexBufferMemory);
     destroyBufferAndFreeMemory(m_device, m_indexBuffer, m_indexBufferMemory);
+    destroyBufferAndFreeMemory(m_device, m_positionBuffer, m_positionBufferMemory);
+    destroyBufferAndFreeMemory(m_device, m_positionTransformBuffer, m_positionTransformMemory);
+    destroyBufferAndFreeMemory(m_device, m_shadingDataBuffer, m_shadingDataMemory);
+    vkUnmapMemory(m_device, m_commonBufferMemory);
     destroyBufferAndFreeMemory(m_device, m_commonBuffer, m_commonBufferMemory);
+    vkUnmapMemory(m_device, m_viewBufferMemory);
+    destroyBufferAndFreeMemory(m_device, m_viewBuffer, m_viewBufferMemory);
     destroyBufferAndFreeMemory(m_device, m_materialIndexBuffer, m_materialIndexBufferMemory);
+    destroyBufferAndFreeMemory(m_device, m_lightBuffer, m_lightBufferMemory);
+    destroyBufferAndFreeMemory(m_device, m_lightTreeBuffer, m_lightTreeMemory);
     destroyBufferAndFreeMemory(m_device, m_tlasBuffer, m_tlasMemory);
     destroyBufferAndFreeMemory(m_device, m_blasBuffer, m_blasMemory);
-    destroyBufferAndFreeMemory(m_device, m_blasGeometryInstanceBuffer, m_blasGeometryInstanceMemory);
+    destroyBufferAndFreeMemory(m_device, m_instanceRingBuffer, m_instanceRingMemory);
+    destroyBufferAndFreeMemory(m_device, m_tlasScratchBuffer, m_tlasScratchMemory);
+    destroyBufferAndFreeMemory(m_device, m_blasScratchBuffer, m_blasScratchMemory);
     destroyBufferAndFreeMemory(m_device, m_shaderBindingTableBuffer, m_shaderBindingTableMemory);
 
     m_pvkDestroyAccelerationStructureKHR(m_device, m_tlas, nullptr);
-    m_pvkDestroyAccelerationStructureKHR(m_device, m_blas, nullptr);
+    for (VkAccelerationStructureKHR blas : m_blases)
+    {
+        m_pvkDestroyAccelerationStructureKHR(m_device, blas, nullptr);
+    }
 
     vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
     vkDestroyPipeline(m_device, m_pipeline, nullptr);
@@ -124,9 +402,14 @@ Raytracer::~Raytracer()
         vkDestroyImageView(m_device, imageView, nullptr);
     }
 
-    vkDestroyImageView(m_device, m_colorImageView, nullptr);
-    vkFreeMemory(m_device, m_colorImageMemory, nullptr);
-    vkDestroyImage(m_device, m_colorImage, nullptr);
+    m_upscaler.reset();
+    m_resolvePass.reset();
+    m_denoiser.reset();
+    m_adaptiveSampler.reset();
+    m_secondaryRayReconstruction.reset();
+    destroyStorageImage(m_device, m_accumulationImage);
+    destroyStorageImage(m_device, m_viewImage);
+    destroyStorageImage(m_device, m_colorImage);
 }
 
 bool Raytracer::render()
@@ -149,12 +432,66 @@ bool Raytracer::render()
 
     {
         DebugMarker::beginLabel(cb, "Render", DebugMarker::blue);
-        vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_pipeline);
 
-        const std::vector<VkDescriptorSet> descriptorSets{m_commonDescriptorSet, m_materialIndexDescriptorSet, m_texturesDescriptorSet};
-        vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_pipelineLayout, 0, ui32Size(descriptorSets), descriptorSets.data(), 0, nullptr);
+        const double time = getMillisecondsSince(m_constructionStartTime) / 1000.0;
+        if (m_skinning)
+        {
+            m_skinning->record(cb, imageIndex, time);
+            updateBLAS(cb, imageIndex);
+        }
+        if (m_dynamicTlas)
+        {
+            updateTLAS(cb, imageIndex, time);
+        }
+
+        // The previous frame's resolve must have read the accumulation image, which the ray generation shader or the
+        // compute renderers read and write
+        const VkPipelineStageFlags renderStageMask = m_frameRenderer == Renderer::Pipeline ? VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        VkMemoryBarrier accumulationBarrier{};
+        accumulationBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        accumulationBarrier.pNext = NULL;
+        accumulationBarrier.srcAccessMask = 0;
+        accumulationBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(cb, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, renderStageMask, 0, 1, &accumulationBarrier, 0, nullptr, 0, nullptr);
+
+        const std::vector<VkDescriptorSet> descriptorSets{m_commonDescriptorSets[imageIndex], m_materialIndexDescriptorSet, m_texturesDescriptorSet};
+        if (m_frameRenderer == Renderer::RayQuery)
+        {
+            m_rayQueryRenderer->record(cb, imageIndex, descriptorSets);
+        }
+        else if (m_frameRenderer == Renderer::Wavefront)
+        {
+            m_wavefrontPathTracer->record(cb, imageIndex, descriptorSets);
+        }
+        else
+        {
+            if (m_adaptiveSampler)
+            {
+                m_adaptiveSampler->record(cb, imageIndex, m_accumulatedSampleCount, static_cast<uint32_t>(m_frameStatistics.getFrameCount()));
+            }
+
+            vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_pipeline);
+            vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_pipelineLayout, 0, ui32Size(descriptorSets), descriptorSets.data(), 0, nullptr);
+
+            m_traceRaysTimer->begin(cb, imageIndex);
+            m_pvkCmdTraceRaysKHR(cb, &m_rgenShaderBindingTable, &m_rmissShaderBindingTable, &m_rchitShaderBindingTable, &m_callableShaderBindingTable, m_renderExtent.width, m_renderExtent.height, m_options.viewCount);
+            m_traceRaysTimer->end(cb, imageIndex);
+
+            if (m_secondaryRayReconstruction)
+            {
+                m_secondaryRayReconstruction->record(cb, imageIndex, m_accumulatedSampleCount);
+            }
+        }
 
-        m_pvkCmdTraceRaysKHR(cb, &m_rgenShaderBindingTable, &m_rmissShaderBindingTable, &m_rchitShaderBindingTable, &m_callableShaderBindingTable, c_windowWidth, c_windowHeight, 1);
+        if (m_denoiser)
+        {
+            m_denoiser->record(cb, imageIndex);
+        }
+        m_resolvePass->record(cb, imageIndex);
+        if (m_upscaler)
+        {
+            m_upscaler->record(cb, imageIndex);
+        }
 
         {
             const std::vector<VkImage>& swapchainImages = m_context.getSwapchainImages();
@@ -172,17 +509,19 @@ bool Raytracer::render()
 
             vkCmdPipelineBarrier(cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &swapchainLayoutBarrier);
 
-            VkImageCopy region{};
+            // A blit because the color image is RGBA and the swapchain BGRA, the upscaler output has the window size
+            VkImageBlit region{};
             region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
             region.srcSubresource.baseArrayLayer = 0;
             region.srcSubresource.mipLevel = 0;
             region.srcSubresource.layerCount = 1;
-            region.srcOffset = {0, 0, 0};
+            region.srcOffsets[0] = {0, 0, 0};
+            region.srcOffsets[1] = {c_windowWidth, c_windowHeight, 1};
             region.dstSubresource = region.srcSubresource;
-            region.dstOffset = region.srcOffset;
-            region.extent = {c_windowWidth, c_windowHeight, 1};
+            region.dstOffsets[0] = region.srcOffsets[0];
+            region.dstOffsets[1] = region.srcOffsets[1];
 
-            vkCmdCopyImage(cb, m_colorImage, VK_IMAGE_LAYOUT_GENERAL, swapchainImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+            vkCmdBlitImage(cb, m_upscaler ? m_upscaler->getOutputImage() : m_colorImage.image, VK_IMAGE_LAYOUT_GENERAL, swapchainImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region, VK_FILTER_NEAREST);
 
             swapchainLayoutBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
             swapchainLayoutBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
@@ -199,44 +538,127 @@ bool Raytracer::render()
 
     m_context.submitCommandBuffers({cb});
 
+    if (!m_firstFrameSubmitted)
+    {
+        printf("Time to first frame %.1f ms\n", getMillisecondsSince(m_constructionStartTime));
+        m_firstFrameSubmitted = true;
+    }
+
     return true;
 }
 
-bool Raytracer::update(uint32_t imageIndex)
+bool Raytracer::simulate(double eventWaitTimeout)
 {
-    bool running = m_context.update();
-    if (!running)
+    if (!m_context.update(eventWaitTimeout))
     {
         return false;
     }
 
+    using namespace std::chrono;
+    const double deltaTime = static_cast<double>(duration_cast<nanoseconds>(high_resolution_clock::now() - m_lastSimulationTime).count()) / 1'000'000'000.0;
+    m_lastSimulationTime = high_resolution_clock::now();
+
+    updateCamera(deltaTime);
+    publishFrameState();
+
+    return true;
+}
+
+bool Raytracer::update(uint32_t imageIndex)
+{
     using namespace std::chrono;
     const double deltaTime = static_cast<double>(duration_cast<nanoseconds>(high_resolution_clock::now() - m_lastRenderTime).count()) / 1'000'000'000.0;
     m_fps = 1.0f / deltaTime;
     m_lastRenderTime = high_resolution_clock::now();
 
-    updateCamera(deltaTime);
+    m_frameStatistics.addFrame(deltaTime);
+    if (m_options.frameCount > 0 && m_frameStatistics.getFrameCount() > m_options.frameCount)
+    {
+        return false;
+    }
 
-    void* dst;
-    // Todo: ring buffer
-    VK_CHECK(vkMapMemory(m_device, m_commonBufferMemory, 0, c_uniformBufferSize, 0, &dst));
+    const FrameState& frameState = m_frameStates.read();
+    // The time since the previous render call, which is mostly the previous frame
+    getRendererFrameStatistics(m_frameRenderer).addFrame(deltaTime);
+    m_frameRenderer = frameState.renderer;
 
     UniformBufferInfo uniformBufferInfo{};
-    uniformBufferInfo.forward = toVec4(m_camera.getForward(), 0.0f);
-    uniformBufferInfo.right = toVec4(-m_camera.getLeft(), 0.0f);
-    uniformBufferInfo.up = toVec4(m_camera.getUp(), 0.0f);
-    uniformBufferInfo.position = toVec4(m_camera.getPosition(), 1.0f);
+    uniformBufferInfo.forward = toVec4(frameState.forward, 0.0f);
+    uniformBufferInfo.right = toVec4(-frameState.left, 0.0f);
+    uniformBufferInfo.up = toVec4(frameState.up, 0.0f);
+    uniformBufferInfo.position = toVec4(frameState.position, 1.0f);
+
+    uniformBufferInfo.projInverse = glm::inverse(frameState.projectionMatrix);
+    uniformBufferInfo.viewInverse = glm::inverse(frameState.viewMatrix);
+    uniformBufferInfo.frameIndex = static_cast<uint32_t>(m_frameStatistics.getFrameCount());
+    uniformBufferInfo.lightCount = m_lightCount;
+    uniformBufferInfo.previousViewProjection = m_previousViewProjection;
+    uniformBufferInfo.denoise = m_denoiser ? 1 : 0;
+    uniformBufferInfo.bakedShadingData = m_shadingData == ShadingData::Baked ? 1 : 0;
+    // The projection scales y by 1 / tan(fovY / 2), the pixel angle is the vertical field of view over the height
+    const float tanHalfFovY = 1.0f / std::abs(frameState.projectionMatrix[1][1]);
+    uniformBufferInfo.pixelSpreadAngle = m_options.textureLod ? std::atan(2.0f * tanHalfFovY / static_cast<float>(m_renderExtent.height)) : 0.0f;
+    m_previousViewProjection = frameState.projectionMatrix * frameState.viewMatrix;
+
+    // Any camera or scene change restarts the running average. The denoiser needs a fresh sample every frame.
+    // Switching the renderer restarts it too, their images differ in the noise.
+    const bool still = m_options.accumulate && !m_denoiser && !m_dynamicTlas && frameState.viewMatrix == m_accumulationViewMatrix &&
+                       frameState.projectionMatrix == m_accumulationProjectionMatrix && frameState.renderer == m_accumulationRenderer;
+    m_accumulatedSampleCount = still ? m_accumulatedSampleCount + 1 : 0;
+    m_accumulationViewMatrix = frameState.viewMatrix;
+    m_accumulationProjectionMatrix = frameState.projectionMatrix;
+    m_accumulationRenderer = frameState.renderer;
+    uniformBufferInfo.sampleIndex = m_accumulatedSampleCount;
+    uniformBufferInfo.sampleStatistics = m_adaptiveSampler && m_frameRenderer == Renderer::Pipeline ? 1 : 0;
+    uniformBufferInfo.secondaryRays = 0;
+    if (m_secondaryRayReconstruction && m_frameRenderer == Renderer::Pipeline)
+    {
+        uniformBufferInfo.secondaryRays = m_options.secondaryRays == SecondaryRays::Half ? 1 : 2;
+    }
 
-    uniformBufferInfo.projInverse = glm::inverse(m_camera.getProjectionMatrix());
-    uniformBufferInfo.viewInverse = glm::inverse(m_camera.getViewMatrix());
-    uniformBufferInfo.lightPositions = c_lightPositions;
+    // Frames in flight read their own slot, so the accumulation weight and the seeds of a submitted frame stay intact
+    std::memcpy(m_commonBufferData + m_commonBufferSlotSize * imageIndex, &uniformBufferInfo, static_cast<size_t>(c_uniformBufferSize));
 
-    std::memcpy(dst, &uniformBufferInfo, static_cast<size_t>(c_uniformBufferSize));
-    vkUnmapMemory(m_device, m_commonBufferMemory);
+    // The first view is the camera, the others turn it around its up axis in equal steps, e.g. 6 views see all around.
+    // They follow the camera, so the accumulation restarts for all views together.
+    ViewInfo* views = reinterpret_cast<ViewInfo*>(m_viewBufferData + m_viewBufferSlotSize * imageIndex);
+    for (uint32_t view = 0; view < m_options.viewCount; ++view)
+    {
+        const float angle = glm::radians(360.0f * static_cast<float>(view) / static_cast<float>(m_options.viewCount));
+        views[view].viewInverse = uniformBufferInfo.viewInverse * glm::rotate(angle, glm::vec3(0.0f, 1.0f, 0.0f));
+        views[view].projInverse = uniformBufferInfo.projInverse;
+    }
 
     return true;
 }
 
+FrameStatistics& Raytracer::getRendererFrameStatistics(Renderer renderer)
+{
+    switch (renderer)
+    {
+    case Renderer::RayQuery:
+        return m_rayQueryFrameStatistics;
+    case Renderer::Wavefront:
+        return m_wavefrontFrameStatistics;
+    case Renderer::Pipeline:
+        break;
+    }
+    return m_pipelineFrameStatistics;
+}
+
+void Raytracer::publishFrameState()
+{
+    FrameState frameState;
+    frameState.viewMatrix = m_camera.getViewMatrix();
+    frameState.projectionMatrix = m_camera.getProjectionMatrix();
+    frameState.position = m_camera.getPosition();
+    frameState.forward = m_camera.getForward();
+    frameState.left = m_camera.getLeft();
+    frameState.up = m_camera.getUp();
+    frameState.renderer = m_renderer;
+    m_frameStates.write(frameState);
+}
+
 void Raytracer::getFunctionPointers()
 {
     m_pvkCreateRayTracingPipelinesKHR = (PFN_vkCreateRayTracingPipelinesKHR)vkGetDeviceProcAddr(m_device, "vkCreateRayTracingPipelinesKHR");
@@ -257,11 +679,66 @@ void Raytracer::getFunctionPointers()
     CHECK(m_pvkCmdTraceRaysKHR);
     m_pvkDestroyAccelerationStructureKHR = (PFN_vkDestroyAccelerationStructureKHR)vkGetDeviceProcAddr(m_device, "vkDestroyAccelerationStructureKHR");
     CHECK(m_pvkDestroyAccelerationStructureKHR);
+    m_pvkCmdWriteAccelerationStructuresPropertiesKHR = (PFN_vkCmdWriteAccelerationStructuresPropertiesKHR)vkGetDeviceProcAddr(m_device, "vkCmdWriteAccelerationStructuresPropertiesKHR");
+    CHECK(m_pvkCmdWriteAccelerationStructuresPropertiesKHR);
+    m_pvkCmdCopyAccelerationStructureKHR = (PFN_vkCmdCopyAccelerationStructureKHR)vkGetDeviceProcAddr(m_device, "vkCmdCopyAccelerationStructureKHR");
+    CHECK(m_pvkCmdCopyAccelerationStructureKHR);
+    m_pvkCmdCopyAccelerationStructureToMemoryKHR = (PFN_vkCmdCopyAccelerationStructureToMemoryKHR)vkGetDeviceProcAddr(m_device, "vkCmdCopyAccelerationStructureToMemoryKHR");
+    CHECK(m_pvkCmdCopyAccelerationStructureToMemoryKHR);
+    m_pvkCmdCopyMemoryToAccelerationStructureKHR = (PFN_vkCmdCopyMemoryToAccelerationStructureKHR)vkGetDeviceProcAddr(m_device, "vkCmdCopyMemoryToAccelerationStructureKHR");
+    CHECK(m_pvkCmdCopyMemoryToAccelerationStructureKHR);
+    m_pvkGetDeviceAccelerationStructureCompatibilityKHR = (PFN_vkGetDeviceAccelerationStructureCompatibilityKHR)vkGetDeviceProcAddr(m_device, "vkGetDeviceAccelerationStructureCompatibilityKHR");
+    CHECK(m_pvkGetDeviceAccelerationStructureCompatibilityKHR);
+}
+
+void Raytracer::queryTextureLimit()
+{
+    // The texture descriptor array has a fixed size so the pipeline layout doesn't have to wait for the model
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_context.getPhysicalDevice(), &properties);
+    const VkPhysicalDeviceLimits& limits = properties.limits;
+    m_maxTextureCount = std::min({c_maxTextureCount, limits.maxPerStageDescriptorSamplers, limits.maxPerStageDescriptorSampledImages, limits.maxDescriptorSetSamplers, limits.maxDescriptorSetSampledImages});
+}
+
+void Raytracer::queryAccelerationStructureProperties()
+{
+    VkPhysicalDeviceAccelerationStructurePropertiesKHR accelerationStructureProperties{};
+    accelerationStructureProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR;
+    accelerationStructureProperties.pNext = NULL;
+
+    VkPhysicalDeviceProperties2 physicalDeviceProperties{};
+    physicalDeviceProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    physicalDeviceProperties.pNext = &accelerationStructureProperties;
+    vkGetPhysicalDeviceProperties2(m_context.getPhysicalDevice(), &physicalDeviceProperties);
+
+    m_minScratchOffsetAlignment = accelerationStructureProperties.minAccelerationStructureScratchOffsetAlignment;
 }
 
 void Raytracer::loadModel()
 {
-    m_model.reset(new Model("sponza/Sponza.gltf"));
+    Scene scene = createScene(m_options.scene);
+    m_model = std::move(scene.model);
+    m_instanceTransforms = std::move(scene.instanceTransforms);
+    m_instanceExtent = scene.instanceExtent;
+    m_lights = std::move(scene.lights);
+    m_skinned = m_model->isSkinned();
+    m_dynamicTlas = m_options.animateInstances || m_skinned;
+
+    m_positionFormat = m_options.positionFormat;
+    if (m_skinned && m_positionFormat == PositionFormat::Snorm16)
+    {
+        // The quantization range would change with every pose
+        LOGW("Skinned models can't use snorm16 positions, using float3");
+        m_positionFormat = PositionFormat::Float3;
+    }
+
+    m_shadingData = m_options.shadingData;
+    if (m_skinned && m_shadingData == ShadingData::Baked)
+    {
+        // The skinning compute shader only updates the vertices
+        LOGW("Skinned models can't use baked shading data, using vertices");
+        m_shadingData = ShadingData::Vertices;
+    }
 }
 
 void Raytracer::setupCamera()
@@ -272,13 +749,18 @@ void Raytracer::setupCamera()
 
 void Raytracer::updateCamera(double deltaTime)
 {
-    std::vector<Context::KeyEvent> keyEvents = m_context.getKeyEvents();
-    for (const Context::KeyEvent& keyEvent : keyEvents)
+    Context::KeyEvent keyEvent;
+    while (m_context.popKeyEvent(keyEvent))
     {
         if (keyEvent.action == GLFW_PRESS || keyEvent.action == GLFW_REPEAT)
         {
             m_keysDown[keyEvent.key] = true;
         }
+        if (keyEvent.action == GLFW_PRESS && keyEvent.key == GLFW_KEY_R)
+        {
+            m_renderer = getNextRenderer(m_renderer);
+            printf("Rendering with the %s\n", getRendererName(m_renderer));
+        }
         if (keyEvent.action == GLFW_RELEASE)
         {
             m_keysDown[keyEvent.key] = false;
@@ -323,72 +805,103 @@ void Raytracer::updateCamera(double deltaTime)
     }
 }
 
-void Raytracer::createColorImage()
+void Raytracer::createRenderTargets()
 {
-    VkImageCreateInfo imageInfo{};
-    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-    imageInfo.imageType = VK_IMAGE_TYPE_2D;
-    imageInfo.extent.width = c_windowWidth;
-    imageInfo.extent.height = c_windowHeight;
-    imageInfo.extent.depth = 1;
-    imageInfo.mipLevels = 1;
-    imageInfo.arrayLayers = 1;
-    imageInfo.format = c_surfaceFormat.format;
-    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_STORAGE_BIT;
-    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    imageInfo.flags = 0;
-
-    VK_CHECK(vkCreateImage(m_device, &imageInfo, nullptr, &m_colorImage));
-    DebugMarker::setObjectName(VK_OBJECT_TYPE_IMAGE, m_colorImage, "Image - Color");
-
-    VkMemoryRequirements memRequirements;
-    vkGetImageMemoryRequirements(m_device, m_colorImage, &memRequirements);
-
-    const MemoryTypeResult memoryTypeResult = findMemoryType(m_context.getPhysicalDevice(), memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    CHECK(memoryTypeResult.found);
-
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = memoryTypeResult.typeIndex;
-
-    VK_CHECK(vkAllocateMemory(m_device, &allocInfo, nullptr, &m_colorImageMemory));
-    DebugMarker::setObjectName(VK_OBJECT_TYPE_DEVICE_MEMORY, m_colorImageMemory, "Memory - Color image");
-    VK_CHECK(vkBindImageMemory(m_device, m_colorImage, m_colorImageMemory, 0));
+    const VkPhysicalDevice physicalDevice = m_context.getPhysicalDevice();
+    {
+        const std::lock_guard<std::mutex> gpuLock(m_gpuMutex);
+        const VkCommandPool commandPool = m_context.getGraphicsCommandPool();
+        const VkQueue queue = m_context.getGraphicsQueue();
+        m_accumulationImage = createStorageImage(m_device, physicalDevice, commandPool, queue, m_renderExtent, c_accumulationFormat, VK_IMAGE_USAGE_STORAGE_BIT, "Accumulation");
+        m_colorImage = createStorageImage(m_device, physicalDevice, commandPool, queue, m_renderExtent, c_colorFormat, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, "Color");
+        // A single layer stands in when there are no extra views, the descriptor needs an image
+        const uint32_t viewLayerCount = std::max(m_options.viewCount - 1, 1u);
+        // The extra views are layers of the view image and the views are the depth of the trace rays launch
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        const uint64_t maxLaunchDepth = static_cast<uint64_t>(properties.limits.maxComputeWorkGroupCount[2]) * properties.limits.maxComputeWorkGroupSize[2];
+        const uint64_t maxViewCount = std::min(static_cast<uint64_t>(properties.limits.maxImageArrayLayers) + 1, maxLaunchDepth);
+        if (m_options.viewCount > maxViewCount)
+        {
+            LOGE(("--views " + std::to_string(m_options.viewCount) + " exceeds the device limit of " + std::to_string(maxViewCount)).c_str());
+        }
+        m_viewImage = createStorageImage(m_device, physicalDevice, commandPool, queue, m_renderExtent, viewLayerCount, VK_IMAGE_VIEW_TYPE_2D_ARRAY, c_accumulationFormat, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, "Views");
 
-    VkImageViewCreateInfo createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-    createInfo.image = m_colorImage;
-    createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-    createInfo.format = c_surfaceFormat.format;
-    createInfo.subresourceRange = c_defaultSubresourceRance;
-    createInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        if (m_options.denoise)
+        {
+            Denoiser::InitData denoiserInitData{};
+            denoiserInitData.device = m_device;
+            denoiserInitData.physicalDevice = physicalDevice;
+            denoiserInitData.commandPool = commandPool;
+            denoiserInitData.queue = queue;
+            denoiserInitData.extent = m_renderExtent;
+            denoiserInitData.noisyView = m_accumulationImage.view;
+            denoiserInitData.slotCount = ui32Size(m_context.getSwapchainImages());
+            m_denoiser = std::make_unique<Denoiser>(denoiserInitData);
+        }
 
-    VK_CHECK(vkCreateImageView(m_device, &createInfo, nullptr, &m_colorImageView));
-    DebugMarker::setObjectName(VK_OBJECT_TYPE_IMAGE_VIEW, m_colorImageView, "Image view - Color");
+        if (m_options.sampling != Sampling::Fixed && (m_denoiser || !m_options.accumulate))
+        {
+            LOGW("Uniform and adaptive sampling need the accumulation, using fixed sampling");
+        }
+        else if (m_options.sampling != Sampling::Fixed)
+        {
+            AdaptiveSampler::InitData samplerInitData{};
+            samplerInitData.device = m_device;
+            samplerInitData.physicalDevice = physicalDevice;
+            samplerInitData.commandPool = commandPool;
+            samplerInitData.queue = queue;
+            samplerInitData.extent = m_renderExtent;
+            samplerInitData.accumulationView = m_accumulationImage.view;
+            samplerInitData.adaptive = m_options.sampling == Sampling::Adaptive;
+            samplerInitData.samplesPerPixel = m_options.samplesPerPixel;
+            samplerInitData.slotCount = ui32Size(m_context.getSwapchainImages());
+            m_adaptiveSampler = std::make_unique<AdaptiveSampler>(samplerInitData);
+        }
 
-    VkImageMemoryBarrier barrier{};
-    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier.image = m_colorImage;
-    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.layerCount = 1;
-    barrier.subresourceRange.levelCount = 1;
-    barrier.subresourceRange.baseMipLevel = 0;
-    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
-    barrier.srcAccessMask = VK_ACCESS_NONE;
-    barrier.dstAccessMask = VK_ACCESS_NONE;
+        if (m_options.secondaryRays != SecondaryRays::Full && m_adaptiveSampler)
+        {
+            LOGW("Uniform and adaptive sampling trace secondary rays in every pixel");
+        }
+        else if (m_options.secondaryRays != SecondaryRays::Full)
+        {
+            SecondaryRayReconstruction::InitData reconstructionInitData{};
+            reconstructionInitData.device = m_device;
+            reconstructionInitData.physicalDevice = physicalDevice;
+            reconstructionInitData.commandPool = commandPool;
+            reconstructionInitData.queue = queue;
+            reconstructionInitData.extent = m_renderExtent;
+            reconstructionInitData.accumulationView = m_accumulationImage.view;
+            reconstructionInitData.slotCount = ui32Size(m_context.getSwapchainImages());
+            m_secondaryRayReconstruction = std::make_unique<SecondaryRayReconstruction>(reconstructionInitData);
+        }
+    }
 
-    const SingleTimeCommand command = beginSingleTimeCommands(m_context.getGraphicsCommandPool(), m_device);
-    const VkCommandBuffer& cb = command.commandBuffer;
-    vkCmdPipelineBarrier(cb, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-    endSingleTimeCommands(m_context.getGraphicsQueue(), command);
+    ResolvePass::InitData initData{};
+    initData.device = m_device;
+    initData.physicalDevice = physicalDevice;
+    initData.extent = m_renderExtent;
+    initData.inputView = m_denoiser ? m_denoiser->getOutputView() : m_accumulationImage.view;
+    initData.outputView = m_colorImage.view;
+    initData.producerStageMask = c_traversalStageMask;
+    initData.slotCount = ui32Size(m_context.getSwapchainImages());
+    m_resolvePass = std::make_unique<ResolvePass>(initData);
+
+    if (m_options.renderScale < 100)
+    {
+        Upscaler::InitData upscalerInitData{};
+        upscalerInitData.device = m_device;
+        upscalerInitData.physicalDevice = physicalDevice;
+        upscalerInitData.commandPool = m_context.getGraphicsCommandPool();
+        upscalerInitData.queue = m_context.getGraphicsQueue();
+        upscalerInitData.inputExtent = m_renderExtent;
+        upscalerInitData.outputExtent = c_windowExtent;
+        upscalerInitData.inputView = m_colorImage.view;
+        upscalerInitData.slotCount = ui32Size(m_context.getSwapchainImages());
+
+        const std::lock_guard<std::mutex> gpuLock(m_gpuMutex);
+        m_upscaler = std::make_unique<Upscaler>(upscalerInitData);
+    }
 }
 
 void Raytracer::createSwapchainImageViews()
@@ -426,6 +939,7 @@ void Raytracer::createSwapchainImageViews()
         barrier.srcAccessMask = VK_ACCESS_NONE;
         barrier.dstAccessMask = VK_ACCESS_NONE;
 
+        const std::lock_guard<std::mutex> gpuLock(m_gpuMutex);
         const SingleTimeCommand command = beginSingleTimeCommands(m_context.getGraphicsCommandPool(), m_device);
         const VkCommandBuffer& cb = command.commandBuffer;
         vkCmdPipelineBarrier(cb, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
@@ -461,6 +975,7 @@ void Raytracer::createTextures()
 {
     const std::vector<Model::Image>& images = m_model->images;
     const size_t imageCount = images.size();
+    CHECK(imageCount <= m_maxTextureCount);
     m_images.resize(imageCount);
     m_imageViews.resize(imageCount);
     const VkPhysicalDevice physicalDevice = m_context.getPhysicalDevice();
@@ -506,7 +1021,7 @@ void Raytracer::createTextures()
     const VkDeviceSize singleImageSize = memRequirements.size;
 
     VK_CHECK(vkAllocateMemory(m_device, &allocInfo, nullptr, &m_imageMemory));
-    DebugMarker::setObjectName(VK_OBJECT_TYPE_DEVICE_MEMORY, m_colorImageMemory, "Memory - Texture images");
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_DEVICE_MEMORY, m_imageMemory, "Memory - Texture images");
 
     for (size_t i = 0; i < imageCount; ++i)
     {
@@ -544,13 +1059,16 @@ void Raytracer::createTextures()
         region.imageOffset = {0, 0, 0};
         region.imageExtent = {image.width, image.height, 1};
 
-        const SingleTimeCommand command = beginSingleTimeCommands(m_context.getGraphicsCommandPool(), m_device);
-        const VkCommandBuffer& cb = command.commandBuffer;
+        {
+            const std::lock_guard<std::mutex> gpuLock(m_gpuMutex);
+            const SingleTimeCommand command = beginSingleTimeCommands(m_context.getGraphicsCommandPool(), m_device);
+            const VkCommandBuffer& cb = command.commandBuffer;
 
-        vkCmdPipelineBarrier(cb, transferSrcFlags, transferDstFlags, 0, 0, nullptr, 0, nullptr, 1, &transferDstBarrier);
-        vkCmdCopyBufferToImage(cb, stagingBuffer.buffer, m_images[i], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+            vkCmdPipelineBarrier(cb, transferSrcFlags, transferDstFlags, 0, 0, nullptr, 0, nullptr, 1, &transferDstBarrier);
+            vkCmdCopyBufferToImage(cb, stagingBuffer.buffer, m_images[i], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
 
-        endSingleTimeCommands(m_context.getGraphicsQueue(), command);
+            endSingleTimeCommands(m_context.getGraphicsQueue(), command);
+        }
 
         releaseStagingBuffer(m_device, stagingBuffer);
 
@@ -588,6 +1106,7 @@ void Raytracer::createMipmaps(VkImage image, uint32_t mipLevels, glm::uvec2 imag
     int32_t mipWidth = imageSize.x;
     int32_t mipHeight = imageSize.y;
 
+    const std::lock_guard<std::mutex> gpuLock(m_gpuMutex);
     const SingleTimeCommand command = beginSingleTimeCommands(m_context.getGraphicsCommandPool(), m_device);
     const VkCommandBuffer& cb = command.commandBuffer;
 
@@ -641,60 +1160,14 @@ void Raytracer::createMipmaps(VkImage image, uint32_t mipLevels, glm::uvec2 imag
 
 void Raytracer::createVertexAndIndexBuffer()
 {
-    /*
-    Create two big buffers: one for vertices and one for indices.
-
-    Vertices can be copied one after another.
-
-    Indices need to have an index offset because every submesh starts indexing from 0.
-    So if first submesh has indices 0,1,2 and second also has 0,1,2,
-    the second submesh indices need to be updated to have 3,4,5 so it maps correctly to one
-    big continuous vertex buffer.
-
-    Also for each submesh, gather highest index, triangle (primitive) count and index byte offset
-    because BLAS creation needs them.
-    */
-
-    m_vertexDataSize = m_model->vertexBufferSizeInBytes;
-    m_indexDataSize = m_model->indexBufferSizeInBytes;
-    std::vector<uint8_t> vertexData(m_vertexDataSize, 0);
-    std::vector<uint8_t> indexData(m_indexDataSize, 0);
-
-    const int indexCount = m_indexDataSize / sizeof(Model::Index);
-    std::vector<Model::Index> indices(indexCount);
-    int indexCounter = 0;
-    Model::Index indexCounterOffset = 0;
-    size_t vertexByteOffset = 0;
-    size_t indexByteOffset = 0;
-
-    for (const Model::Submesh& submesh : m_model->submeshes)
+    // Create two big buffers: one for vertices and one for indices.
+    MeshAssembly assembly = assembleMesh(*m_model);
+    if (m_options.accelerationStructureCache)
     {
-        Model::Index highestIndex = 0;
-        for (Model::Index index : submesh.indices)
-        {
-            indices[indexCounter] = indexCounterOffset + index;
-            highestIndex = std::max(highestIndex, index);
-            ++indexCounter;
-        }
-
-        m_submeshIndexInfos.push_back(
-            SubmeshIndexInfo{
-                highestIndex, //
-                ui32Size(submesh.indices) / 3, //
-                indexByteOffset //
-            } //
-        );
-
-        indexCounterOffset += submesh.vertices.size();
-
-        const size_t vertexSize = sizeof(Model::Vertex) * submesh.vertices.size();
-        std::memcpy(&vertexData[vertexByteOffset], submesh.vertices.data(), vertexSize);
-        vertexByteOffset += vertexSize;
-        indexByteOffset += sizeof(Model::Index) * submesh.indices.size();
+        m_geometryHash = hashMeshAssembly(assembly);
     }
-
-    CHECK(m_indexDataSize == (sizeof(Model::Index) * indices.size()));
-    std::memcpy(&indexData[0], indices.data(), m_indexDataSize);
+    m_vertexDataSize = m_model->vertexBufferSizeInBytes;
+    m_indexDataSize = m_model->indexBufferSizeInBytes;
 
     const VkPhysicalDevice physicalDevice = m_context.getPhysicalDevice();
     const VkBufferUsageFlags usage = //
@@ -708,7 +1181,7 @@ void Raytracer::createVertexAndIndexBuffer()
     copyRegion.dstOffset = 0;
 
     { // Vertex
-        StagingBuffer stagingBuffer = createStagingBuffer(m_device, physicalDevice, vertexData.data(), m_vertexDataSize);
+        StagingBuffer stagingBuffer = createStagingBuffer(m_device, physicalDevice, assembly.vertices.data(), m_vertexDataSize);
 
         m_vertexBuffer = createBuffer(m_device, m_vertexDataSize, usage);
         m_vertexBufferMemory = allocateAndBindMemory(m_device, physicalDevice, m_vertexBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
@@ -717,6 +1190,7 @@ void Raytracer::createVertexAndIndexBuffer()
 
         copyRegion.size = m_vertexDataSize;
 
+        const std::lock_guard<std::mutex> gpuLock(m_gpuMutex);
         const SingleTimeCommand command = beginSingleTimeCommands(m_context.getGraphicsCommandPool(), m_device);
         vkCmdCopyBuffer(command.commandBuffer, stagingBuffer.buffer, m_vertexBuffer, 1, &copyRegion);
         endSingleTimeCommands(m_context.getGraphicsQueue(), command);
@@ -724,7 +1198,7 @@ void Raytracer::createVertexAndIndexBuffer()
         releaseStagingBuffer(m_device, stagingBuffer);
     }
     { // Index
-        StagingBuffer stagingBuffer = createStagingBuffer(m_device, physicalDevice, indexData.data(), m_indexDataSize);
+        StagingBuffer stagingBuffer = createStagingBuffer(m_device, physicalDevice, assembly.indices.data(), m_indexDataSize);
 
         m_indexBuffer = createBuffer(m_device, m_indexDataSize, usage);
         m_indexBufferMemory = allocateAndBindMemory(m_device, physicalDevice, m_indexBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
@@ -733,35 +1207,153 @@ void Raytracer::createVertexAndIndexBuffer()
 
         copyRegion.size = m_indexDataSize;
 
+        const std::lock_guard<std::mutex> gpuLock(m_gpuMutex);
         const SingleTimeCommand command = beginSingleTimeCommands(m_context.getGraphicsCommandPool(), m_device);
         vkCmdCopyBuffer(command.commandBuffer, stagingBuffer.buffer, m_indexBuffer, 1, &copyRegion);
         endSingleTimeCommands(m_context.getGraphicsQueue(), command);
 
         releaseStagingBuffer(m_device, stagingBuffer);
     }
+    if (m_positionFormat != PositionFormat::Vertex)
+    { // Position stream for the BLAS builds, the shaders keep reading the full vertices
+        std::vector<glm::vec3> packedPositions;
+        QuantizedPositions quantizedPositions;
+        const void* positionData = nullptr;
+        if (m_positionFormat == PositionFormat::Float3)
+        {
+            packedPositions = packPositions(assembly.vertices);
+            positionData = packedPositions.data();
+            m_positionDataSize = sizeof(glm::vec3) * packedPositions.size();
+        }
+        else
+        {
+            quantizedPositions = quantizePositions(assembly.vertices);
+            positionData = quantizedPositions.positions.data();
+            m_positionDataSize = sizeof(glm::i16vec4) * quantizedPositions.positions.size();
+        }
+        StagingBuffer stagingBuffer = createStagingBuffer(m_device, physicalDevice, positionData, m_positionDataSize);
+
+        m_positionBuffer = createBuffer(m_device, m_positionDataSize, usage);
+        m_positionBufferMemory = allocateAndBindMemory(m_device, physicalDevice, m_positionBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        DebugMarker::setObjectName(VK_OBJECT_TYPE_BUFFER, m_positionBuffer, "Buffer - Position");
+        DebugMarker::setObjectName(VK_OBJECT_TYPE_DEVICE_MEMORY, m_positionBufferMemory, "Memory - Position buffer");
+
+        // The builds scale the snorm positions back to the model bounds with the geometry transform
+        StagingBuffer transformStagingBuffer{};
+        if (m_positionFormat == PositionFormat::Snorm16)
+        {
+            const glm::vec3& center = quantizedPositions.center;
+            const glm::vec3& halfExtent = quantizedPositions.halfExtent;
+            const VkTransformMatrixKHR dequantization{{
+                {halfExtent.x, 0.0f, 0.0f, center.x}, //
+                {0.0f, halfExtent.y, 0.0f, center.y}, //
+                {0.0f, 0.0f, halfExtent.z, center.z} //
+            }};
+            transformStagingBuffer = createStagingBuffer(m_device, physicalDevice, &dequantization, sizeof(VkTransformMatrixKHR));
+
+            m_positionTransformBuffer = createBuffer(m_device, sizeof(VkTransformMatrixKHR), usage);
+            m_positionTransformMemory = allocateAndBindMemory(m_device, physicalDevice, m_positionTransformBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            DebugMarker::setObjectName(VK_OBJECT_TYPE_BUFFER, m_positionTransformBuffer, "Buffer - Position dequantization");
+            DebugMarker::setObjectName(VK_OBJECT_TYPE_DEVICE_MEMORY, m_positionTransformMemory, "Memory - Position dequantization");
+        }
+
+        const std::lock_guard<std::mutex> gpuLock(m_gpuMutex);
+        const SingleTimeCommand command = beginSingleTimeCommands(m_context.getGraphicsCommandPool(), m_device);
+        copyRegion.size = m_positionDataSize;
+        vkCmdCopyBuffer(command.commandBuffer, stagingBuffer.buffer, m_positionBuffer, 1, &copyRegion);
+        if (m_positionTransformBuffer != VK_NULL_HANDLE)
+        {
+            copyRegion.size = sizeof(VkTransformMatrixKHR);
+            vkCmdCopyBuffer(command.commandBuffer, transformStagingBuffer.buffer, m_positionTransformBuffer, 1, &copyRegion);
+        }
+        endSingleTimeCommands(m_context.getGraphicsQueue(), command);
+
+        releaseStagingBuffer(m_device, stagingBuffer);
+        if (m_positionTransformBuffer != VK_NULL_HANDLE)
+        {
+            releaseStagingBuffer(m_device, transformStagingBuffer);
+        }
+    }
+
+    if (m_shadingData == ShadingData::Baked)
+    { // Per-triangle shading data, the shaders keep the vertices and indices for the any-hit shaders and the BLAS builds
+        const std::chrono::high_resolution_clock::time_point bakeStartTime = std::chrono::high_resolution_clock::now();
+        const std::vector<TriangleShadingData> shadingData = bakeShadingData(assembly);
+        const double bakeTime = getMillisecondsSince(bakeStartTime);
+        const size_t shadingDataSize = sizeof(TriangleShadingData) * shadingData.size();
+        StagingBuffer stagingBuffer = createStagingBuffer(m_device, physicalDevice, shadingData.data(), shadingDataSize);
+
+        m_shadingDataBuffer = createBuffer(m_device, shadingDataSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+        m_shadingDataMemory = allocateAndBindMemory(m_device, physicalDevice, m_shadingDataBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        DebugMarker::setObjectName(VK_OBJECT_TYPE_BUFFER, m_shadingDataBuffer, "Buffer - Shading data");
+        DebugMarker::setObjectName(VK_OBJECT_TYPE_DEVICE_MEMORY, m_shadingDataMemory, "Memory - Shading data");
+
+        copyRegion.size = shadingDataSize;
+
+        const std::lock_guard<std::mutex> gpuLock(m_gpuMutex);
+        const SingleTimeCommand command = beginSingleTimeCommands(m_context.getGraphicsCommandPool(), m_device);
+        vkCmdCopyBuffer(command.commandBuffer, stagingBuffer.buffer, m_shadingDataBuffer, 1, &copyRegion);
+        endSingleTimeCommands(m_context.getGraphicsQueue(), command);
+
+        releaseStagingBuffer(m_device, stagingBuffer);
+
+        printf("Shading data: %zu triangles baked in %.1f ms, %.1f MB (vertices and indices %.1f MB)\n",
+               shadingData.size(),
+               bakeTime,
+               toMegabytes(shadingDataSize),
+               toMegabytes(m_vertexDataSize + m_indexDataSize));
+    }
+
+    if (m_skinned)
+    {
+        // All instances share the model, so they share one set of skinned vertices
+        Skinning::InitData initData{};
+        initData.device = m_device;
+        initData.physicalDevice = physicalDevice;
+        initData.commandPool = m_context.getGraphicsCommandPool();
+        initData.queue = m_context.getGraphicsQueue();
+        initData.skeleton = &m_model->skeleton;
+        initData.restVertices = &assembly.vertices;
+        initData.skinVertices = &assembly.skinVertices;
+        initData.vertexBuffer = m_vertexBuffer;
+        initData.positionBuffer = m_positionBuffer;
+        initData.slotCount = ui32Size(m_context.getSwapchainImages());
+        initData.consumerStageMask = VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR | c_traversalStageMask;
+        initData.consumerAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        const std::lock_guard<std::mutex> gpuLock(m_gpuMutex);
+        m_skinning = std::make_unique<Skinning>(initData);
+    }
+
+    // Last, the shading data bake reads the submesh ranges of the assembly
+    m_submeshIndexInfos = std::move(assembly.submeshIndexInfos);
 }
 
 void Raytracer::createDescriptorPool()
 {
+    // One common set per swapchain image
+    const uint32_t commonSetCount = ui32Size(m_context.getSwapchainImages());
+
     std::array<VkDescriptorPoolSize, 5> poolSizes{};
     poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[0].descriptorCount = ui32Size(m_context.getSwapchainImages());
+    poolSizes[0].descriptorCount = commonSetCount;
     poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSizes[1].descriptorCount = ui32Size(m_model->materials);
+    poolSizes[1].descriptorCount = m_maxTextureCount;
     poolSizes[2].type = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
-    poolSizes[2].descriptorCount = 1;
+    poolSizes[2].descriptorCount = commonSetCount;
+    // Accumulation image, the three denoiser G-buffer images, the view image, the sample statistics and the three
+    // secondary ray reconstruction images of the common sets
     poolSizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-    poolSizes[3].descriptorCount = 1;
+    poolSizes[3].descriptorCount = 9 * commonSetCount;
+    // Index, vertex, light, light tree, shading data and view buffers of the common sets and the material index buffer
     poolSizes[4].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    poolSizes[4].descriptorCount = 1;
-
-    const uint32_t maxSets = ui32Size(m_model->materials) + 64;
+    poolSizes[4].descriptorCount = 6 * commonSetCount + 1;
 
     VkDescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     poolInfo.poolSizeCount = ui32Size(poolSizes);
     poolInfo.pPoolSizes = poolSizes.data();
-    poolInfo.maxSets = maxSets;
+    poolInfo.maxSets = c_maxDescriptorSets + commonSetCount;
 
     VK_CHECK(vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &m_descriptorPool));
     DebugMarker::setObjectName(VK_OBJECT_TYPE_DESCRIPTOR_POOL, m_descriptorPool, "Descriptor pool - Raytracer");
@@ -769,32 +1361,82 @@ void Raytracer::createDescriptorPool()
 
 void Raytracer::createCommonDescriptorSetLayoutAndAllocate()
 {
-    std::vector<VkDescriptorSetLayoutBinding> bindings(5);
+    // The compute stage is the ray query renderer, which reads the same resources as the ray tracing shaders
+    std::vector<VkDescriptorSetLayoutBinding> bindings(17);
     bindings[0].binding = 0;
     bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
     bindings[0].descriptorCount = 1;
-    bindings[0].stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
+    bindings[0].stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT;
     bindings[0].pImmutableSamplers = nullptr;
     bindings[1].binding = 1;
     bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
     bindings[1].descriptorCount = 1;
-    bindings[1].stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
+    bindings[1].stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT;
     bindings[1].pImmutableSamplers = nullptr;
     bindings[2].binding = 2;
     bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
     bindings[2].descriptorCount = 1;
-    bindings[2].stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
+    bindings[2].stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT;
     bindings[2].pImmutableSamplers = nullptr;
     bindings[3].binding = 3;
     bindings[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
     bindings[3].descriptorCount = 1;
-    bindings[3].stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
+    bindings[3].stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT;
     bindings[3].pImmutableSamplers = nullptr;
     bindings[4].binding = 4;
     bindings[4].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
     bindings[4].descriptorCount = 1;
-    bindings[4].stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+    bindings[4].stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT;
     bindings[4].pImmutableSamplers = nullptr;
+    bindings[5].binding = 5;
+    bindings[5].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[5].descriptorCount = 1;
+    bindings[5].stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[5].pImmutableSamplers = nullptr;
+    bindings[6].binding = 6;
+    bindings[6].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[6].descriptorCount = 1;
+    bindings[6].stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[6].pImmutableSamplers = nullptr;
+    // Denoiser G-buffer: normal and depth, motion and material id, albedo
+    for (uint32_t binding = 7; binding < 10; ++binding)
+    {
+        bindings[binding].binding = binding;
+        bindings[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        bindings[binding].descriptorCount = 1;
+        bindings[binding].stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT;
+        bindings[binding].pImmutableSamplers = nullptr;
+    }
+    bindings[10].binding = 10;
+    bindings[10].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[10].descriptorCount = 1;
+    bindings[10].stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
+    bindings[10].pImmutableSamplers = nullptr;
+    // Cameras and layered output of the batched views, only the pipeline renderer traces more than one view
+    bindings[11].binding = 11;
+    bindings[11].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[11].descriptorCount = 1;
+    bindings[11].stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+    bindings[11].pImmutableSamplers = nullptr;
+    bindings[12].binding = 12;
+    bindings[12].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    bindings[12].descriptorCount = 1;
+    bindings[12].stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+    bindings[12].pImmutableSamplers = nullptr;
+    bindings[13].binding = 13;
+    bindings[13].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    bindings[13].descriptorCount = 1;
+    bindings[13].stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+    bindings[13].pImmutableSamplers = nullptr;
+    // Secondary ray reconstruction: radiance, normal and depth, albedo
+    for (uint32_t binding = 14; binding < 17; ++binding)
+    {
+        bindings[binding].binding = binding;
+        bindings[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        bindings[binding].descriptorCount = 1;
+        bindings[binding].stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+        bindings[binding].pImmutableSamplers = nullptr;
+    }
 
     VkDescriptorSetLayoutCreateInfo layoutInfo{};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -804,7 +1446,9 @@ void Raytracer::createCommonDescriptorSetLayoutAndAllocate()
     VK_CHECK(vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &m_commonDescriptorSetLayout));
     DebugMarker::setObjectName(VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, m_commonDescriptorSetLayout, "Desc set layout - Common");
 
-    const std::vector<VkDescriptorSetLayout> layouts{m_commonDescriptorSetLayout};
+    // One set per swapchain image, which differ in the slot of the per-frame buffers
+    const std::vector<VkDescriptorSetLayout> layouts(m_context.getSwapchainImages().size(), m_commonDescriptorSetLayout);
+    m_commonDescriptorSets.resize(layouts.size());
 
     VkDescriptorSetAllocateInfo descriptorSetAllocateInfo{};
     descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
@@ -813,8 +1457,11 @@ void Raytracer::createCommonDescriptorSetLayoutAndAllocate()
     descriptorSetAllocateInfo.descriptorSetCount = ui32Size(layouts);
     descriptorSetAllocateInfo.pSetLayouts = layouts.data();
 
-    VK_CHECK(vkAllocateDescriptorSets(m_device, &descriptorSetAllocateInfo, &m_commonDescriptorSet));
-    DebugMarker::setObjectName(VK_OBJECT_TYPE_DESCRIPTOR_SET, m_commonDescriptorSet, "Desc set - Common");
+    VK_CHECK(vkAllocateDescriptorSets(m_device, &descriptorSetAllocateInfo, m_commonDescriptorSets.data()));
+    for (size_t i = 0; i < m_commonDescriptorSets.size(); ++i)
+    {
+        DebugMarker::setObjectName(VK_OBJECT_TYPE_DESCRIPTOR_SET, m_commonDescriptorSets[i], "Desc set - Common " + std::to_string(i));
+    }
 }
 
 void Raytracer::createMaterialIndexDescriptorSetLayoutAndAllocate()
@@ -823,7 +1470,7 @@ void Raytracer::createMaterialIndexDescriptorSetLayoutAndAllocate()
     bindings[0].binding = 0;
     bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
     bindings[0].descriptorCount = 1;
-    bindings[0].stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
+    bindings[0].stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT;
     bindings[0].pImmutableSamplers = nullptr;
 
     VkDescriptorBindingFlagsEXT bindFlag = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT;
@@ -860,13 +1507,23 @@ void Raytracer::createTexturesDescriptorSetLayoutAndAllocate()
 {
     std::array<VkDescriptorSetLayoutBinding, 1> bindings{};
     bindings[0].binding = 0;
-    bindings[0].descriptorCount = ui32Size(m_images);
+    bindings[0].descriptorCount = m_maxTextureCount;
     bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    bindings[0].stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
+    bindings[0].stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT;
     bindings[0].pImmutableSamplers = nullptr;
 
+    // Only the first m_images.size() elements are written
+    VkDescriptorBindingFlagsEXT bindFlag = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT;
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfoEXT extendedInfo{};
+    extendedInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+    extendedInfo.pNext = nullptr;
+    extendedInfo.bindingCount = 1u;
+    extendedInfo.pBindingFlags = &bindFlag;
+
     VkDescriptorSetLayoutCreateInfo layoutInfo{};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.pNext = &extendedInfo;
     layoutInfo.bindingCount = ui32Size(bindings);
     layoutInfo.pBindings = bindings.data();
 
@@ -900,72 +1557,130 @@ void Raytracer::createPipeline()
     VkShaderModule rayGenShaderModule = createShaderModule(m_device, currentPath / "shader.rgen.spv");
     VkShaderModule missShaderModule = createShaderModule(m_device, currentPath / "shader.rmiss.spv");
     VkShaderModule shadowMissShaderModule = createShaderModule(m_device, currentPath / "shader_shadow.rmiss.spv");
+    VkShaderModule anyHitShaderModule = createShaderModule(m_device, currentPath / "shader.rahit.spv");
+
+    // The closest-hit shader is compiled once per material class, with the unused texture reads and the reflection
+    // branch removed through its specialization constants
+    std::array<VkSpecializationMapEntry, c_materialClassConstantCount> specializationMapEntries;
+    for (uint32_t i = 0; i < c_materialClassConstantCount; ++i)
+    {
+        specializationMapEntries[i].constantID = i;
+        specializationMapEntries[i].offset = i * sizeof(VkBool32);
+        specializationMapEntries[i].size = sizeof(VkBool32);
+    }
+    std::array<std::array<VkBool32, c_materialClassConstantCount>, c_materialClassCount> specializationData;
+    std::array<VkSpecializationInfo, c_materialClassCount> specializationInfos;
+    for (uint32_t materialClass = 0; materialClass < c_materialClassCount; ++materialClass)
+    {
+        specializationData[materialClass][0] = (materialClass & c_materialClassBaseColorTexture) != 0 ? VK_TRUE : VK_FALSE;
+        specializationData[materialClass][1] = (materialClass & c_materialClassNormalMap) != 0 ? VK_TRUE : VK_FALSE;
+        specializationData[materialClass][2] = (materialClass & c_materialClassReflective) != 0 ? VK_TRUE : VK_FALSE;
+        specializationInfos[materialClass].mapEntryCount = ui32Size(specializationMapEntries);
+        specializationInfos[materialClass].pMapEntries = specializationMapEntries.data();
+        specializationInfos[materialClass].dataSize = sizeof(specializationData[materialClass]);
+        specializationInfos[materialClass].pData = specializationData[materialClass].data();
+    }
+
+    // The any-hit shader is shared by the camera and shadow hit groups, which only differ in the alpha test's mip level
+    VkSpecializationMapEntry alphaLodMapEntry{0, 0, sizeof(float)};
+    VkSpecializationInfo cameraAnyHitSpecializationInfo{1, &alphaLodMapEntry, sizeof(float), &c_cameraAlphaLod};
+    VkSpecializationInfo shadowAnyHitSpecializationInfo{1, &alphaLodMapEntry, sizeof(float), &c_shadowAlphaLod};
 
     std::array<VkPipelineShaderStageCreateInfo, c_shaderCount> shaderStageCreateInfoList;
 
-    shaderStageCreateInfoList[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    shaderStageCreateInfoList[0].pNext = NULL;
-    shaderStageCreateInfoList[0].flags = 0;
-    shaderStageCreateInfoList[0].stage = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
-    shaderStageCreateInfoList[0].module = closesHitShaderModule;
-    shaderStageCreateInfoList[0].pName = "main";
-    shaderStageCreateInfoList[0].pSpecializationInfo = NULL;
-    shaderStageCreateInfoList[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    shaderStageCreateInfoList[1].pNext = NULL;
-    shaderStageCreateInfoList[1].flags = 0;
-    shaderStageCreateInfoList[1].stage = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
-    shaderStageCreateInfoList[1].module = rayGenShaderModule;
-    shaderStageCreateInfoList[1].pName = "main";
-    shaderStageCreateInfoList[1].pSpecializationInfo = NULL;
-    shaderStageCreateInfoList[2].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    shaderStageCreateInfoList[2].pNext = NULL;
-    shaderStageCreateInfoList[2].flags = 0;
-    shaderStageCreateInfoList[2].stage = VK_SHADER_STAGE_MISS_BIT_KHR;
-    shaderStageCreateInfoList[2].module = missShaderModule;
-    shaderStageCreateInfoList[2].pName = "main";
-    shaderStageCreateInfoList[2].pSpecializationInfo = NULL;
-    shaderStageCreateInfoList[3].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    shaderStageCreateInfoList[3].pNext = NULL;
-    shaderStageCreateInfoList[3].flags = 0;
-    shaderStageCreateInfoList[3].stage = VK_SHADER_STAGE_MISS_BIT_KHR;
-    shaderStageCreateInfoList[3].module = shadowMissShaderModule;
-    shaderStageCreateInfoList[3].pName = "main";
-    shaderStageCreateInfoList[3].pSpecializationInfo = NULL;
+    for (uint32_t materialClass = 0; materialClass < c_materialClassCount; ++materialClass)
+    {
+        shaderStageCreateInfoList[materialClass].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaderStageCreateInfoList[materialClass].pNext = NULL;
+        shaderStageCreateInfoList[materialClass].flags = 0;
+        shaderStageCreateInfoList[materialClass].stage = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
+        shaderStageCreateInfoList[materialClass].module = closesHitShaderModule;
+        shaderStageCreateInfoList[materialClass].pName = "main";
+        shaderStageCreateInfoList[materialClass].pSpecializationInfo = &specializationInfos[materialClass];
+    }
+    shaderStageCreateInfoList[c_rayGenShader].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStageCreateInfoList[c_rayGenShader].pNext = NULL;
+    shaderStageCreateInfoList[c_rayGenShader].flags = 0;
+    shaderStageCreateInfoList[c_rayGenShader].stage = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+    shaderStageCreateInfoList[c_rayGenShader].module = rayGenShaderModule;
+    shaderStageCreateInfoList[c_rayGenShader].pName = "main";
+    shaderStageCreateInfoList[c_rayGenShader].pSpecializationInfo = NULL;
+    shaderStageCreateInfoList[c_missShader].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStageCreateInfoList[c_missShader].pNext = NULL;
+    shaderStageCreateInfoList[c_missShader].flags = 0;
+    shaderStageCreateInfoList[c_missShader].stage = VK_SHADER_STAGE_MISS_BIT_KHR;
+    shaderStageCreateInfoList[c_missShader].module = missShaderModule;
+    shaderStageCreateInfoList[c_missShader].pName = "main";
+    shaderStageCreateInfoList[c_missShader].pSpecializationInfo = NULL;
+    shaderStageCreateInfoList[c_shadowMissShader].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStageCreateInfoList[c_shadowMissShader].pNext = NULL;
+    shaderStageCreateInfoList[c_shadowMissShader].flags = 0;
+    shaderStageCreateInfoList[c_shadowMissShader].stage = VK_SHADER_STAGE_MISS_BIT_KHR;
+    shaderStageCreateInfoList[c_shadowMissShader].module = shadowMissShaderModule;
+    shaderStageCreateInfoList[c_shadowMissShader].pName = "main";
+    shaderStageCreateInfoList[c_shadowMissShader].pSpecializationInfo = NULL;
+    shaderStageCreateInfoList[c_anyHitShader].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStageCreateInfoList[c_anyHitShader].pNext = NULL;
+    shaderStageCreateInfoList[c_anyHitShader].flags = 0;
+    shaderStageCreateInfoList[c_anyHitShader].stage = VK_SHADER_STAGE_ANY_HIT_BIT_KHR;
+    shaderStageCreateInfoList[c_anyHitShader].module = anyHitShaderModule;
+    shaderStageCreateInfoList[c_anyHitShader].pName = "main";
+    shaderStageCreateInfoList[c_anyHitShader].pSpecializationInfo = &cameraAnyHitSpecializationInfo;
+    shaderStageCreateInfoList[c_shadowAnyHitShader].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStageCreateInfoList[c_shadowAnyHitShader].pNext = NULL;
+    shaderStageCreateInfoList[c_shadowAnyHitShader].flags = 0;
+    shaderStageCreateInfoList[c_shadowAnyHitShader].stage = VK_SHADER_STAGE_ANY_HIT_BIT_KHR;
+    shaderStageCreateInfoList[c_shadowAnyHitShader].module = anyHitShaderModule;
+    shaderStageCreateInfoList[c_shadowAnyHitShader].pName = "main";
+    shaderStageCreateInfoList[c_shadowAnyHitShader].pSpecializationInfo = &shadowAnyHitSpecializationInfo;
 
     std::array<VkRayTracingShaderGroupCreateInfoKHR, c_shaderGroupCount> shaderGroupCreateInfoList;
 
-    shaderGroupCreateInfoList[0].sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR;
-    shaderGroupCreateInfoList[0].pNext = NULL;
-    shaderGroupCreateInfoList[0].type = VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_KHR;
-    shaderGroupCreateInfoList[0].generalShader = VK_SHADER_UNUSED_KHR;
-    shaderGroupCreateInfoList[0].closestHitShader = 0;
-    shaderGroupCreateInfoList[0].anyHitShader = VK_SHADER_UNUSED_KHR;
-    shaderGroupCreateInfoList[0].intersectionShader = VK_SHADER_UNUSED_KHR;
-    shaderGroupCreateInfoList[0].pShaderGroupCaptureReplayHandle = NULL;
-    shaderGroupCreateInfoList[1].sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR;
-    shaderGroupCreateInfoList[1].pNext = NULL;
-    shaderGroupCreateInfoList[1].type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR;
-    shaderGroupCreateInfoList[1].generalShader = 1;
-    shaderGroupCreateInfoList[1].closestHitShader = VK_SHADER_UNUSED_KHR;
-    shaderGroupCreateInfoList[1].anyHitShader = VK_SHADER_UNUSED_KHR;
-    shaderGroupCreateInfoList[1].intersectionShader = VK_SHADER_UNUSED_KHR;
-    shaderGroupCreateInfoList[1].pShaderGroupCaptureReplayHandle = NULL;
-    shaderGroupCreateInfoList[2].sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR;
-    shaderGroupCreateInfoList[2].pNext = NULL;
-    shaderGroupCreateInfoList[2].type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR;
-    shaderGroupCreateInfoList[2].generalShader = 2;
-    shaderGroupCreateInfoList[2].closestHitShader = VK_SHADER_UNUSED_KHR;
-    shaderGroupCreateInfoList[2].anyHitShader = VK_SHADER_UNUSED_KHR;
-    shaderGroupCreateInfoList[2].intersectionShader = VK_SHADER_UNUSED_KHR;
-    shaderGroupCreateInfoList[2].pShaderGroupCaptureReplayHandle = NULL;
-    shaderGroupCreateInfoList[3].sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR;
-    shaderGroupCreateInfoList[3].pNext = NULL;
-    shaderGroupCreateInfoList[3].type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR;
-    shaderGroupCreateInfoList[3].generalShader = 3;
-    shaderGroupCreateInfoList[3].closestHitShader = VK_SHADER_UNUSED_KHR;
-    shaderGroupCreateInfoList[3].anyHitShader = VK_SHADER_UNUSED_KHR;
-    shaderGroupCreateInfoList[3].intersectionShader = VK_SHADER_UNUSED_KHR;
-    shaderGroupCreateInfoList[3].pShaderGroupCaptureReplayHandle = NULL;
+    for (uint32_t materialClass = 0; materialClass < c_materialClassCount; ++materialClass)
+    {
+        VkRayTracingShaderGroupCreateInfoKHR& hitGroup = shaderGroupCreateInfoList[c_hitGroup + materialClass];
+        hitGroup.sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR;
+        hitGroup.pNext = NULL;
+        hitGroup.type = VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_KHR;
+        hitGroup.generalShader = VK_SHADER_UNUSED_KHR;
+        hitGroup.closestHitShader = materialClass;
+        hitGroup.anyHitShader = c_anyHitShader;
+        hitGroup.intersectionShader = VK_SHADER_UNUSED_KHR;
+        hitGroup.pShaderGroupCaptureReplayHandle = NULL;
+    }
+    // Shadow rays skip the closest hit shader, only the alpha test is needed
+    shaderGroupCreateInfoList[c_shadowHitGroup].sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR;
+    shaderGroupCreateInfoList[c_shadowHitGroup].pNext = NULL;
+    shaderGroupCreateInfoList[c_shadowHitGroup].type = VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_KHR;
+    shaderGroupCreateInfoList[c_shadowHitGroup].generalShader = VK_SHADER_UNUSED_KHR;
+    shaderGroupCreateInfoList[c_shadowHitGroup].closestHitShader = VK_SHADER_UNUSED_KHR;
+    shaderGroupCreateInfoList[c_shadowHitGroup].anyHitShader = c_shadowAnyHitShader;
+    shaderGroupCreateInfoList[c_shadowHitGroup].intersectionShader = VK_SHADER_UNUSED_KHR;
+    shaderGroupCreateInfoList[c_shadowHitGroup].pShaderGroupCaptureReplayHandle = NULL;
+    shaderGroupCreateInfoList[c_raygenGroup].sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR;
+    shaderGroupCreateInfoList[c_raygenGroup].pNext = NULL;
+    shaderGroupCreateInfoList[c_raygenGroup].type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR;
+    shaderGroupCreateInfoList[c_raygenGroup].generalShader = c_rayGenShader;
+    shaderGroupCreateInfoList[c_raygenGroup].closestHitShader = VK_SHADER_UNUSED_KHR;
+    shaderGroupCreateInfoList[c_raygenGroup].anyHitShader = VK_SHADER_UNUSED_KHR;
+    shaderGroupCreateInfoList[c_raygenGroup].intersectionShader = VK_SHADER_UNUSED_KHR;
+    shaderGroupCreateInfoList[c_raygenGroup].pShaderGroupCaptureReplayHandle = NULL;
+    shaderGroupCreateInfoList[c_missGroup].sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR;
+    shaderGroupCreateInfoList[c_missGroup].pNext = NULL;
+    shaderGroupCreateInfoList[c_missGroup].type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR;
+    shaderGroupCreateInfoList[c_missGroup].generalShader = c_missShader;
+    shaderGroupCreateInfoList[c_missGroup].closestHitShader = VK_SHADER_UNUSED_KHR;
+    shaderGroupCreateInfoList[c_missGroup].anyHitShader = VK_SHADER_UNUSED_KHR;
+    shaderGroupCreateInfoList[c_missGroup].intersectionShader = VK_SHADER_UNUSED_KHR;
+    shaderGroupCreateInfoList[c_missGroup].pShaderGroupCaptureReplayHandle = NULL;
+    shaderGroupCreateInfoList[c_shadowMissGroup].sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR;
+    shaderGroupCreateInfoList[c_shadowMissGroup].pNext = NULL;
+    shaderGroupCreateInfoList[c_shadowMissGroup].type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR;
+    shaderGroupCreateInfoList[c_shadowMissGroup].generalShader = c_shadowMissShader;
+    shaderGroupCreateInfoList[c_shadowMissGroup].closestHitShader = VK_SHADER_UNUSED_KHR;
+    shaderGroupCreateInfoList[c_shadowMissGroup].anyHitShader = VK_SHADER_UNUSED_KHR;
+    shaderGroupCreateInfoList[c_shadowMissGroup].intersectionShader = VK_SHADER_UNUSED_KHR;
+    shaderGroupCreateInfoList[c_shadowMissGroup].pShaderGroupCaptureReplayHandle = NULL;
 
     VkRayTracingPipelineCreateInfoKHR rayTracingPipelineCreateInfo{};
     rayTracingPipelineCreateInfo.sType = VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_CREATE_INFO_KHR;
@@ -989,16 +1704,74 @@ void Raytracer::createPipeline()
     vkDestroyShaderModule(m_device, rayGenShaderModule, nullptr);
     vkDestroyShaderModule(m_device, missShaderModule, nullptr);
     vkDestroyShaderModule(m_device, shadowMissShaderModule, nullptr);
+    vkDestroyShaderModule(m_device, anyHitShaderModule, nullptr);
 }
 
-void Raytracer::createCommonBuffer()
+void Raytracer::createRayQueryRenderer()
 {
-    const uint64_t bufferSize = c_uniformBufferSize;
+    RayQueryRenderer::InitData initData{};
+    initData.device = m_device;
+    initData.physicalDevice = m_context.getPhysicalDevice();
+    initData.descriptorSetLayouts = {m_commonDescriptorSetLayout, m_materialIndexDescriptorSetLayout, m_texturesDescriptorSetLayout};
+    initData.extent = m_renderExtent;
+    initData.timerName = "rayQuery " + m_timerConfigurationName;
+    initData.slotCount = ui32Size(m_context.getSwapchainImages());
+    m_rayQueryRenderer = std::make_unique<RayQueryRenderer>(initData);
+}
 
-    m_commonBuffer = createBuffer(m_device, bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
-    m_commonBufferMemory = allocateAndBindMemory(m_device, m_context.getPhysicalDevice(), m_commonBuffer, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+void Raytracer::createWavefrontPathTracer()
+{
+    // Hits are sorted by material, submeshes without one share the first key
+    std::vector<uint32_t> sortKeys(m_model->submeshes.size());
+    for (size_t i = 0; i < sortKeys.size(); ++i)
+    {
+        sortKeys[i] = static_cast<uint32_t>(m_model->submeshes[i].material + 1);
+    }
+
+    WavefrontPathTracer::InitData initData{};
+    initData.device = m_device;
+    initData.physicalDevice = m_context.getPhysicalDevice();
+    initData.commandPool = m_context.getGraphicsCommandPool();
+    initData.queue = m_context.getGraphicsQueue();
+    initData.descriptorSetLayouts = {m_commonDescriptorSetLayout, m_materialIndexDescriptorSetLayout, m_texturesDescriptorSetLayout};
+    initData.extent = m_renderExtent;
+    initData.sortKeys = sortKeys;
+    initData.sortKeyCount = ui32Size(m_model->materials) + 1;
+    initData.sortHits = m_options.wavefrontSort;
+    initData.maxDepth = m_options.wavefrontDepth;
+    initData.timerSuffix = m_timerConfigurationName + (m_options.wavefrontSort ? "" : " unsorted");
+    initData.slotCount = ui32Size(m_context.getSwapchainImages());
+
+    const std::lock_guard<std::mutex> gpuLock(m_gpuMutex);
+    m_wavefrontPathTracer = std::make_unique<WavefrontPathTracer>(initData);
+}
+
+void Raytracer::createCommonBuffer()
+{
+    // One slot per swapchain image like the instance ring, each bound by the common descriptor set of that image
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_context.getPhysicalDevice(), &properties);
+    m_commonBufferSlotSize = alignUp(c_uniformBufferSize, properties.limits.minUniformBufferOffsetAlignment);
+    const uint64_t bufferSize = m_commonBufferSlotSize * m_context.getSwapchainImages().size();
+
+    m_commonBuffer = createBuffer(m_device, bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+    m_commonBufferMemory = allocateAndBindMemory(m_device, m_context.getPhysicalDevice(), m_commonBuffer, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
     DebugMarker::setObjectName(VK_OBJECT_TYPE_BUFFER, m_commonBuffer, "Buffer - Common uniform buffer");
     DebugMarker::setObjectName(VK_OBJECT_TYPE_DEVICE_MEMORY, m_commonBufferMemory, "Memory - Common uniform memory");
+    void* commonBufferData;
+    VK_CHECK(vkMapMemory(m_device, m_commonBufferMemory, 0, bufferSize, 0, &commonBufferData));
+    m_commonBufferData = static_cast<uint8_t*>(commonBufferData);
+
+    // Written every frame like the uniform buffer, so it stays mapped and has a slot per swapchain image too
+    m_viewBufferSlotSize = alignUp(sizeof(ViewInfo) * m_options.viewCount, properties.limits.minStorageBufferOffsetAlignment);
+    const uint64_t viewBufferSize = m_viewBufferSlotSize * m_context.getSwapchainImages().size();
+    m_viewBuffer = createBuffer(m_device, viewBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    m_viewBufferMemory = allocateAndBindMemory(m_device, m_context.getPhysicalDevice(), m_viewBuffer, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_BUFFER, m_viewBuffer, "Buffer - View buffer");
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_DEVICE_MEMORY, m_viewBufferMemory, "Memory - View memory");
+    void* viewBufferData;
+    VK_CHECK(vkMapMemory(m_device, m_viewBufferMemory, 0, viewBufferSize, 0, &viewBufferData));
+    m_viewBufferData = static_cast<uint8_t*>(viewBufferData);
 }
 
 void Raytracer::createMaterialIndexBuffer()
@@ -1011,6 +1784,50 @@ void Raytracer::createMaterialIndexBuffer()
     DebugMarker::setObjectName(VK_OBJECT_TYPE_DEVICE_MEMORY, m_materialIndexBufferMemory, "Memory - Material index memory");
 }
 
+void Raytracer::createLightBuffers()
+{
+    const std::chrono::high_resolution_clock::time_point startTime = std::chrono::high_resolution_clock::now();
+    const std::vector<LightTreeNode> lightTree = buildLightTree(m_lights);
+    const double buildTime = getMillisecondsSince(startTime);
+    m_lightCount = ui32Size(m_lights);
+
+    const VkDeviceSize lightDataSize = sizeof(Light) * m_lights.size();
+    const VkDeviceSize lightTreeDataSize = sizeof(LightTreeNode) * lightTree.size();
+    const VkPhysicalDevice physicalDevice = m_context.getPhysicalDevice();
+
+    m_lightBuffer = createBuffer(m_device, lightDataSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    m_lightBufferMemory = allocateAndBindMemory(m_device, physicalDevice, m_lightBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_BUFFER, m_lightBuffer, "Buffer - Lights");
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_DEVICE_MEMORY, m_lightBufferMemory, "Memory - Lights");
+
+    m_lightTreeBuffer = createBuffer(m_device, lightTreeDataSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    m_lightTreeMemory = allocateAndBindMemory(m_device, physicalDevice, m_lightTreeBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_BUFFER, m_lightTreeBuffer, "Buffer - Light tree");
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_DEVICE_MEMORY, m_lightTreeMemory, "Memory - Light tree");
+
+    StagingBuffer lightStagingBuffer = createStagingBuffer(m_device, physicalDevice, m_lights.data(), lightDataSize);
+    StagingBuffer lightTreeStagingBuffer = createStagingBuffer(m_device, physicalDevice, lightTree.data(), lightTreeDataSize);
+
+    {
+        const std::lock_guard<std::mutex> gpuLock(m_gpuMutex);
+        const SingleTimeCommand command = beginSingleTimeCommands(m_context.getGraphicsCommandPool(), m_device);
+        VkBufferCopy copyRegion{0, 0, lightDataSize};
+        vkCmdCopyBuffer(command.commandBuffer, lightStagingBuffer.buffer, m_lightBuffer, 1, &copyRegion);
+        copyRegion.size = lightTreeDataSize;
+        vkCmdCopyBuffer(command.commandBuffer, lightTreeStagingBuffer.buffer, m_lightTreeBuffer, 1, &copyRegion);
+        endSingleTimeCommands(m_context.getGraphicsQueue(), command);
+    }
+
+    releaseStagingBuffer(m_device, lightStagingBuffer);
+    releaseStagingBuffer(m_device, lightTreeStagingBuffer);
+
+    printf("Lights: %u lights, %zu light tree nodes built in %.2f ms, %s\n",
+           m_lightCount,
+           lightTree.size(),
+           buildTime,
+           m_lightCount > c_maxExactLightCount ? "sampled through the light tree" : "all evaluated per hit");
+}
+
 void Raytracer::allocateCommandBuffers()
 {
     m_commandBuffers.resize(m_swapchainImageViews.size());
@@ -1021,6 +1838,7 @@ void Raytracer::allocateCommandBuffers()
     allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
     allocInfo.commandBufferCount = ui32Size(m_commandBuffers);
 
+    const std::lock_guard<std::mutex> gpuLock(m_gpuMutex);
     VK_CHECK(vkAllocateCommandBuffers(m_device, &allocInfo, m_commandBuffers.data()));
 }
 
@@ -1028,48 +1846,82 @@ void Raytracer::createBLAS()
 {
     const VkPhysicalDevice physicalDevice = m_context.getPhysicalDevice();
 
-    // Setup geometry and get build size
-    VkBufferDeviceAddressInfo vertexBufferDeviceAddressInfo{};
-    vertexBufferDeviceAddressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
-    vertexBufferDeviceAddressInfo.pNext = NULL;
-    vertexBufferDeviceAddressInfo.buffer = m_vertexBuffer;
+    VkPhysicalDeviceIDProperties idProperties{};
+    idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+    idProperties.pNext = NULL;
+
+    VkPhysicalDeviceProperties2 physicalDeviceProperties{};
+    physicalDeviceProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    physicalDeviceProperties.pNext = &idProperties;
+    vkGetPhysicalDeviceProperties2(physicalDevice, &physicalDeviceProperties);
 
-    VkBufferDeviceAddressInfo indexBufferDeviceAddressInfo{};
-    indexBufferDeviceAddressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
-    indexBufferDeviceAddressInfo.pNext = NULL;
-    indexBufferDeviceAddressInfo.buffer = m_indexBuffer;
+    const VkDeviceSize scratchAlignment = m_minScratchOffsetAlignment;
 
-    const VkDeviceAddress vertexBufferDeviceAddress = m_pvkGetBufferDeviceAddressKHR(m_device, &vertexBufferDeviceAddressInfo);
-    const VkDeviceAddress indexBufferDeviceAddress = m_pvkGetBufferDeviceAddressKHR(m_device, &indexBufferDeviceAddressInfo);
+    // Skinned BLASes are refitted every frame and rebuilt in place, so they are not compacted
+    m_blasBuildFlags = getBuildFlags(m_options.accelerationStructurePreset);
+    if (m_skinned)
+    {
+        m_blasBuildFlags &= ~VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
+        m_blasBuildFlags |= VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR;
+    }
+
+    // Setup geometry and get build size. The positions are read from the separate position stream if there is one.
+    const VkDeviceAddress indexBufferDeviceAddress = getBufferDeviceAddress(m_indexBuffer);
+    VkFormat vertexFormat = VK_FORMAT_R32G32B32_SFLOAT;
+    VkDeviceAddress vertexDataDeviceAddress = 0;
+    VkDeviceSize vertexStride = 0;
+    VkDeviceAddress transformDeviceAddress = 0;
+    switch (m_positionFormat)
+    {
+    case PositionFormat::Vertex:
+        vertexDataDeviceAddress = getBufferDeviceAddress(m_vertexBuffer);
+        vertexStride = sizeof(Model::Vertex);
+        break;
+    case PositionFormat::Float3:
+        vertexDataDeviceAddress = getBufferDeviceAddress(m_positionBuffer);
+        vertexStride = sizeof(glm::vec3);
+        break;
+    case PositionFormat::Snorm16:
+        vertexFormat = VK_FORMAT_R16G16B16A16_SNORM;
+        vertexDataDeviceAddress = getBufferDeviceAddress(m_positionBuffer);
+        vertexStride = sizeof(glm::i16vec4);
+        transformDeviceAddress = getBufferDeviceAddress(m_positionTransformBuffer);
+        break;
+    }
 
     const size_t submeshCount = m_submeshIndexInfos.size();
-    std::vector<VkAccelerationStructureGeometryKHR> geometries;
+    std::vector<VkAccelerationStructureGeometryKHR>& geometries = m_blasGeometries;
     std::vector<uint32_t> triangleCounts;
-    std::vector<VkAccelerationStructureBuildRangeInfoKHR> rangeInfos;
+    std::vector<VkAccelerationStructureBuildRangeInfoKHR>& rangeInfos = m_blasRangeInfos;
     geometries.reserve(submeshCount);
     triangleCounts.reserve(submeshCount);
     rangeInfos.reserve(submeshCount);
 
-    // Create one BLAS that has multiple triangle geometries.
-    for (const SubmeshIndexInfo& info : m_submeshIndexInfos)
+    // Only alpha tested geometries are non-opaque, so any hit shaders run only for them
+    uint32_t alphaTestedCount = 0;
+    for (size_t i = 0; i < submeshCount; ++i)
     {
+        const SubmeshIndexInfo& info = m_submeshIndexInfos[i];
+        const bool alphaTested = isAlphaTested(m_model->submeshes[i]);
+        alphaTestedCount += alphaTested ? 1 : 0;
+
         VkAccelerationStructureGeometryDataKHR geometryData{};
         geometryData.triangles.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR;
         geometryData.triangles.pNext = NULL;
-        geometryData.triangles.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT;
-        geometryData.triangles.vertexData = VkDeviceOrHostAddressConstKHR{vertexBufferDeviceAddress};
-        geometryData.triangles.vertexStride = sizeof(Model::Vertex);
+        geometryData.triangles.vertexFormat = vertexFormat;
+        geometryData.triangles.vertexData = VkDeviceOrHostAddressConstKHR{vertexDataDeviceAddress};
+        geometryData.triangles.vertexStride = vertexStride;
         geometryData.triangles.maxVertex = info.maxVertex;
         geometryData.triangles.indexType = VK_INDEX_TYPE_UINT32;
         geometryData.triangles.indexData = VkDeviceOrHostAddressConstKHR{indexBufferDeviceAddress};
-        geometryData.triangles.transformData = VkDeviceOrHostAddressConstKHR{0};
+        geometryData.triangles.transformData = VkDeviceOrHostAddressConstKHR{transformDeviceAddress};
 
         VkAccelerationStructureGeometryKHR geometry{};
         geometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
         geometry.pNext = NULL;
         geometry.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
         geometry.geometry = geometryData;
-        geometry.flags = VK_GEOMETRY_OPAQUE_BIT_KHR;
+        geometry.flags = alphaTested ? 0 : VK_GEOMETRY_OPAQUE_BIT_KHR;
 
         geometries.push_back(geometry);
         triangleCounts.push_back(info.triangleCount);
@@ -1082,134 +1934,578 @@ void Raytracer::createBLAS()
         rangeInfos.push_back(blasBuildRangeInfo);
     }
 
-    VkAccelerationStructureBuildGeometryInfoKHR blasBuildGeometryInfo{};
-    blasBuildGeometryInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
-    blasBuildGeometryInfo.pNext = NULL;
-    blasBuildGeometryInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
-    blasBuildGeometryInfo.flags = 0;
-    blasBuildGeometryInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
-    blasBuildGeometryInfo.srcAccelerationStructure = VK_NULL_HANDLE;
-    blasBuildGeometryInfo.dstAccelerationStructure = VK_NULL_HANDLE;
-    blasBuildGeometryInfo.geometryCount = ui32Size(geometries);
-    blasBuildGeometryInfo.pGeometries = geometries.data();
-    blasBuildGeometryInfo.ppGeometries = NULL;
-    blasBuildGeometryInfo.scratchData = VkDeviceOrHostAddressKHR{0};
-
-    VkAccelerationStructureBuildSizesInfoKHR blasBuildSizesInfo{};
-    blasBuildSizesInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
-    blasBuildSizesInfo.pNext = NULL;
-    blasBuildSizesInfo.accelerationStructureSize = 0;
-    blasBuildSizesInfo.updateScratchSize = 0;
-    blasBuildSizesInfo.buildScratchSize = 0;
-
-    const VkAccelerationStructureBuildTypeKHR buildType = VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR;
-    m_pvkGetAccelerationStructureBuildSizesKHR(m_device, buildType, &blasBuildGeometryInfo, triangleCounts.data(), &blasBuildSizesInfo);
-
-    // Create BLAS buffer
-    m_blasBuffer = createBuffer(m_device, blasBuildSizesInfo.accelerationStructureSize, VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR);
+    // Either one BLAS that has all submeshes as geometries or one BLAS per submesh
+    const bool perSubmesh = m_options.blasMode == BlasMode::PerSubmesh;
+    const uint32_t blasCount = perSubmesh ? ui32Size(geometries) : 1;
+
+    std::vector<VkAccelerationStructureBuildGeometryInfoKHR>& buildInfos = m_blasBuildInfos;
+    buildInfos.resize(blasCount);
+    m_blasBuildRangeInfos.resize(blasCount);
+    std::vector<VkDeviceSize> blasSizes(blasCount);
+    std::vector<VkDeviceSize> blasOffsets(blasCount);
+    m_blasScratchSizes.resize(blasCount);
+    m_blasFirstSubmeshes.resize(blasCount);
+
+    VkDeviceSize blasBufferSize = 0;
+    VkDeviceSize totalScratchSize = 0;
+    for (uint32_t i = 0; i < blasCount; ++i)
+    {
+        const uint32_t firstSubmesh = perSubmesh ? i : 0;
+        m_blasFirstSubmeshes[i] = firstSubmesh;
+
+        VkAccelerationStructureBuildGeometryInfoKHR& buildInfo = buildInfos[i];
+        buildInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+        buildInfo.pNext = NULL;
+        buildInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+        buildInfo.flags = m_blasBuildFlags;
+        buildInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+        buildInfo.srcAccelerationStructure = VK_NULL_HANDLE;
+        buildInfo.dstAccelerationStructure = VK_NULL_HANDLE;
+        buildInfo.geometryCount = perSubmesh ? 1 : ui32Size(geometries);
+        buildInfo.pGeometries = &geometries[firstSubmesh];
+        buildInfo.ppGeometries = NULL;
+        buildInfo.scratchData = VkDeviceOrHostAddressKHR{0};
+        m_blasBuildRangeInfos[i] = &rangeInfos[firstSubmesh];
+
+        VkAccelerationStructureBuildSizesInfoKHR buildSizesInfo{};
+        buildSizesInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
+        buildSizesInfo.pNext = NULL;
+        buildSizesInfo.accelerationStructureSize = 0;
+        buildSizesInfo.updateScratchSize = 0;
+        buildSizesInfo.buildScratchSize = 0;
+
+        m_pvkGetAccelerationStructureBuildSizesKHR(m_device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &buildInfo, &triangleCounts[firstSubmesh], &buildSizesInfo);
+
+        blasSizes[i] = buildSizesInfo.accelerationStructureSize;
+        blasOffsets[i] = blasBufferSize;
+        blasBufferSize += alignUp(buildSizesInfo.accelerationStructureSize, c_accelerationStructureAlignment);
+        // The scratch of a skinned BLAS is kept for the refits and rebuilds
+        const VkDeviceSize scratchSize = m_skinned ? std::max(buildSizesInfo.buildScratchSize, buildSizesInfo.updateScratchSize) : buildSizesInfo.buildScratchSize;
+        m_blasScratchSizes[i] = alignUp(scratchSize, scratchAlignment);
+        totalScratchSize += m_blasScratchSizes[i];
+    }
+
+    // Everything that affects the build result is part of the cache key
+    std::filesystem::path cachePath;
+    if (m_options.accelerationStructureCache)
+    {
+        uint64_t cacheKey = m_geometryHash;
+        cacheKey = fnv1aValue(buildInfos[0].flags, cacheKey);
+        cacheKey = fnv1aValue(m_positionFormat, cacheKey);
+        for (const VkAccelerationStructureGeometryKHR& geometry : geometries)
+        {
+            cacheKey = fnv1aValue(geometry.flags, cacheKey);
+        }
+        cacheKey = fnv1aValue(blasCount, cacheKey);
+        cacheKey = fnv1a(idProperties.deviceUUID, VK_UUID_SIZE, cacheKey);
+        cacheKey = fnv1a(idProperties.driverUUID, VK_UUID_SIZE, cacheKey);
+        cacheKey = fnv1aValue(physicalDeviceProperties.properties.driverVersion, cacheKey);
+        cachePath = getAccelerationStructureCachePath(cacheKey);
+
+        if (loadBLASFromCache(cachePath, blasCount))
+        {
+            if (m_skinned)
+            {
+                createBLASScratchArena();
+            }
+            return;
+        }
+    }
+
+    // All BLASes are placed in one buffer
+    m_blasBuffer = createBuffer(m_device, blasBufferSize, VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR);
+    m_blasMemory = allocateAndBindMemory(m_device, physicalDevice, m_blasBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    createBLASes(blasSizes, blasOffsets);
+
+    createBLASScratchArena();
+
+    // Compacted size queries
+    const bool compact = (m_blasBuildFlags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR) != 0;
+    VkQueryPool compactedSizeQueryPool = VK_NULL_HANDLE;
+    if (compact)
+    {
+        VkQueryPoolCreateInfo queryPoolInfo{};
+        queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolInfo.pNext = NULL;
+        queryPoolInfo.queryType = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR;
+        queryPoolInfo.queryCount = blasCount;
+
+        VK_CHECK(vkCreateQueryPool(m_device, &queryPoolInfo, nullptr, &compactedSizeQueryPool));
+    }
+
+    // Build BLASes
+    VkMemoryBarrier buildBarrier{};
+    buildBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    buildBarrier.pNext = NULL;
+    buildBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+    buildBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+    const VkPipelineStageFlags buildStage = VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR;
+
+    const std::lock_guard<std::mutex> gpuLock(m_gpuMutex);
+    const std::chrono::high_resolution_clock::time_point buildStartTime = std::chrono::high_resolution_clock::now();
+
+    const SingleTimeCommand command = beginSingleTimeCommands(m_context.getGraphicsCommandPool(), m_device);
+    const VkCommandBuffer& cb = command.commandBuffer;
+
+    const uint32_t batchCount = recordBLASBuilds(cb, VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR);
+
+    if (compact)
+    {
+        // The compacted sizes are known only after the builds have finished
+        vkCmdPipelineBarrier(cb, buildStage, buildStage, 0, 1, &buildBarrier, 0, nullptr, 0, nullptr);
+        vkCmdResetQueryPool(cb, compactedSizeQueryPool, 0, blasCount);
+        m_pvkCmdWriteAccelerationStructuresPropertiesKHR(cb, blasCount, m_blases.data(), VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR, compactedSizeQueryPool, 0);
+    }
+
+    endSingleTimeCommands(m_context.getGraphicsQueue(), command);
+
+    // Measured on CPU around a blocking submit so this includes submission overhead
+    printf("BLAS build (%s, %s, %s positions %.1f MB): %u BLAS, %zu geometries (%u alpha tested), %u batches, %.1f ms, %.1f MB, scratch arena %.1f MB of %.1f MB total\n",
+           getPresetName(m_options.accelerationStructurePreset),
+           perSubmesh ? "per-submesh" : "monolithic",
+           getPositionFormatName(m_positionFormat),
+           toMegabytes(m_positionFormat == PositionFormat::Vertex ? m_vertexDataSize : m_positionDataSize),
+           blasCount,
+           geometries.size(),
+           alphaTestedCount,
+           batchCount,
+           getMillisecondsSince(buildStartTime),
+           toMegabytes(blasBufferSize),
+           toMegabytes(m_blasScratchArenaSize),
+           toMegabytes(totalScratchSize));
+
+    if (!m_skinned)
+    {
+        destroyBufferAndFreeMemory(m_device, m_blasScratchBuffer, m_blasScratchMemory);
+        m_blasScratchBuffer = VK_NULL_HANDLE;
+        m_blasScratchMemory = VK_NULL_HANDLE;
+    }
+
+    if (compact)
+    {
+        std::vector<VkDeviceSize> compactedSizes(blasCount);
+        VK_CHECK(vkGetQueryPoolResults(m_device, compactedSizeQueryPool, 0, blasCount, sizeof(VkDeviceSize) * blasCount, compactedSizes.data(), sizeof(VkDeviceSize), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+        vkDestroyQueryPool(m_device, compactedSizeQueryPool, nullptr);
+
+        const VkDeviceSize compactedBufferSize = compactBLAS(compactedSizes);
+        printf("BLAS compaction: %.1f MB -> %.1f MB\n", toMegabytes(blasBufferSize), toMegabytes(compactedBufferSize));
+    }
+
+    if (m_options.accelerationStructureCache)
+    {
+        storeBLASInCache(cachePath);
+    }
+}
+
+// Restores the BLASes from serialized data if the cache file exists and was written by a compatible device and driver
+bool Raytracer::loadBLASFromCache(const std::filesystem::path& path, uint32_t blasCount)
+{
+    const std::chrono::high_resolution_clock::time_point loadStartTime = std::chrono::high_resolution_clock::now();
+
+    std::vector<SerializedAccelerationStructure> serializedBlases;
+    if (!readAccelerationStructureCache(path, serializedBlases) || serializedBlases.size() != blasCount)
+    {
+        return false;
+    }
+
+    std::vector<VkDeviceSize> sizes(blasCount);
+    std::vector<VkDeviceSize> offsets(blasCount);
+    std::vector<VkDeviceSize> serializedOffsets(blasCount);
+    VkDeviceSize blasBufferSize = 0;
+    VkDeviceSize serializedSize = 0;
+    for (uint32_t i = 0; i < blasCount; ++i)
+    {
+        const SerializedAccelerationStructure& serializedBlas = serializedBlases[i];
+        sizes[i] = getDeserializedSize(serializedBlas);
+        if (sizes[i] == 0)
+        {
+            return false;
+        }
+
+        VkAccelerationStructureVersionInfoKHR versionInfo{};
+        versionInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_VERSION_INFO_KHR;
+        versionInfo.pNext = NULL;
+        versionInfo.pVersionData = serializedBlas.data();
+
+        VkAccelerationStructureCompatibilityKHR compatibility = VK_ACCELERATION_STRUCTURE_COMPATIBILITY_INCOMPATIBLE_KHR;
+        m_pvkGetDeviceAccelerationStructureCompatibilityKHR(m_device, &versionInfo, &compatibility);
+        if (compatibility != VK_ACCELERATION_STRUCTURE_COMPATIBILITY_COMPATIBLE_KHR)
+        {
+            printf("BLAS cache %s is not compatible with this device and driver\n", path.string().c_str());
+            return false;
+        }
+
+        offsets[i] = blasBufferSize;
+        blasBufferSize += alignUp(sizes[i], c_accelerationStructureAlignment);
+        serializedOffsets[i] = serializedSize;
+        serializedSize += alignUp(serializedBlas.size(), c_accelerationStructureAlignment);
+    }
+
+    // The serialized data is read by the device from a host visible buffer, each at a 256 byte aligned address
+    const VkPhysicalDevice physicalDevice = m_context.getPhysicalDevice();
+    VkBuffer uploadBuffer = createBuffer(m_device, serializedSize + c_accelerationStructureAlignment, VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+    VkDeviceMemory uploadMemory = allocateAndBindMemory(m_device, physicalDevice, uploadBuffer, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    const VkDeviceAddress uploadBufferDeviceAddress = getBufferDeviceAddress(uploadBuffer);
+    const VkDeviceAddress uploadDeviceAddress = alignUp(uploadBufferDeviceAddress, c_accelerationStructureAlignment);
+
+    void* uploadMemoryMapped;
+    VK_CHECK(vkMapMemory(m_device, uploadMemory, 0, VK_WHOLE_SIZE, 0, &uploadMemoryMapped));
+    char* uploadData = static_cast<char*>(uploadMemoryMapped) + (uploadDeviceAddress - uploadBufferDeviceAddress);
+    for (uint32_t i = 0; i < blasCount; ++i)
+    {
+        memcpy(uploadData + serializedOffsets[i], serializedBlases[i].data(), serializedBlases[i].size());
+    }
+    vkUnmapMemory(m_device, uploadMemory);
+
+    m_blasBuffer = createBuffer(m_device, blasBufferSize, VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR);
     m_blasMemory = allocateAndBindMemory(m_device, physicalDevice, m_blasBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    createBLASes(sizes, offsets);
+
+    {
+        const std::lock_guard<std::mutex> gpuLock(m_gpuMutex);
+        const SingleTimeCommand command = beginSingleTimeCommands(m_context.getGraphicsCommandPool(), m_device);
+        for (uint32_t i = 0; i < blasCount; ++i)
+        {
+            VkCopyMemoryToAccelerationStructureInfoKHR copyInfo{};
+            copyInfo.sType = VK_STRUCTURE_TYPE_COPY_MEMORY_TO_ACCELERATION_STRUCTURE_INFO_KHR;
+            copyInfo.pNext = NULL;
+            copyInfo.src.deviceAddress = uploadDeviceAddress + serializedOffsets[i];
+            copyInfo.dst = m_blases[i];
+            copyInfo.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_DESERIALIZE_KHR;
+
+            m_pvkCmdCopyMemoryToAccelerationStructureKHR(command.commandBuffer, &copyInfo);
+        }
+        endSingleTimeCommands(m_context.getGraphicsQueue(), command);
+    }
+
+    destroyBufferAndFreeMemory(m_device, uploadBuffer, uploadMemory);
+
+    printf("BLAS loaded from cache: %u BLAS, %.1f ms, %.1f MB serialized, %.1f MB\n",
+           blasCount,
+           getMillisecondsSince(loadStartTime),
+           toMegabytes(serializedSize),
+           toMegabytes(blasBufferSize));
+    return true;
+}
+
+// Serializes the BLASes into the cache file. The GPU lock must be held.
+void Raytracer::storeBLASInCache(const std::filesystem::path& path)
+{
+    const uint32_t blasCount = ui32Size(m_blases);
+
+    VkQueryPoolCreateInfo queryPoolInfo{};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.pNext = NULL;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_SERIALIZATION_SIZE_KHR;
+    queryPoolInfo.queryCount = blasCount;
+
+    VkQueryPool serializationSizeQueryPool;
+    VK_CHECK(vkCreateQueryPool(m_device, &queryPoolInfo, nullptr, &serializationSizeQueryPool));
+
+    VkMemoryBarrier buildBarrier{};
+    buildBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    buildBarrier.pNext = NULL;
+    buildBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+    buildBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+    const VkPipelineStageFlags buildStage = VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR;
+
+    {
+        const SingleTimeCommand command = beginSingleTimeCommands(m_context.getGraphicsCommandPool(), m_device);
+        vkCmdPipelineBarrier(command.commandBuffer, buildStage, buildStage, 0, 1, &buildBarrier, 0, nullptr, 0, nullptr);
+        vkCmdResetQueryPool(command.commandBuffer, serializationSizeQueryPool, 0, blasCount);
+        m_pvkCmdWriteAccelerationStructuresPropertiesKHR(command.commandBuffer, blasCount, m_blases.data(), VK_QUERY_TYPE_ACCELERATION_STRUCTURE_SERIALIZATION_SIZE_KHR, serializationSizeQueryPool, 0);
+        endSingleTimeCommands(m_context.getGraphicsQueue(), command);
+    }
 
-    // Create BLAS
-    VkAccelerationStructureCreateInfoKHR blasCreateInfo{};
-    blasCreateInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
-    blasCreateInfo.pNext = NULL;
-    blasCreateInfo.createFlags = 0;
-    blasCreateInfo.buffer = m_blasBuffer;
-    blasCreateInfo.offset = 0;
-    blasCreateInfo.size = blasBuildSizesInfo.accelerationStructureSize;
-    blasCreateInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
-    blasCreateInfo.deviceAddress = 0;
+    std::vector<VkDeviceSize> serializedSizes(blasCount);
+    VK_CHECK(vkGetQueryPoolResults(m_device, serializationSizeQueryPool, 0, blasCount, sizeof(VkDeviceSize) * blasCount, serializedSizes.data(), sizeof(VkDeviceSize), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+    vkDestroyQueryPool(m_device, serializationSizeQueryPool, nullptr);
 
-    VK_CHECK(m_pvkCreateAccelerationStructureKHR(m_device, &blasCreateInfo, NULL, &m_blas));
+    std::vector<VkDeviceSize> serializedOffsets(blasCount);
+    VkDeviceSize serializedSize = 0;
+    for (uint32_t i = 0; i < blasCount; ++i)
+    {
+        serializedOffsets[i] = serializedSize;
+        serializedSize += alignUp(serializedSizes[i], c_accelerationStructureAlignment);
+    }
 
-    VkAccelerationStructureDeviceAddressInfoKHR blasDeviceAddressInfo{};
-    blasDeviceAddressInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
-    blasDeviceAddressInfo.pNext = NULL;
-    blasDeviceAddressInfo.accelerationStructure = m_blas;
+    VkBuffer readbackBuffer = createBuffer(m_device, serializedSize + c_accelerationStructureAlignment, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+    VkDeviceMemory readbackMemory = allocateAndBindMemory(m_device, m_context.getPhysicalDevice(), readbackBuffer, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    const VkDeviceAddress readbackBufferDeviceAddress = getBufferDeviceAddress(readbackBuffer);
+    const VkDeviceAddress readbackDeviceAddress = alignUp(readbackBufferDeviceAddress, c_accelerationStructureAlignment);
 
-    m_blasDeviceAddress = m_pvkGetAccelerationStructureDeviceAddressKHR(m_device, &blasDeviceAddressInfo);
+    {
+        const SingleTimeCommand command = beginSingleTimeCommands(m_context.getGraphicsCommandPool(), m_device);
+        for (uint32_t i = 0; i < blasCount; ++i)
+        {
+            VkCopyAccelerationStructureToMemoryInfoKHR copyInfo{};
+            copyInfo.sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_TO_MEMORY_INFO_KHR;
+            copyInfo.pNext = NULL;
+            copyInfo.src = m_blases[i];
+            copyInfo.dst.deviceAddress = readbackDeviceAddress + serializedOffsets[i];
+            copyInfo.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_SERIALIZE_KHR;
+
+            m_pvkCmdCopyAccelerationStructureToMemoryKHR(command.commandBuffer, &copyInfo);
+        }
+        endSingleTimeCommands(m_context.getGraphicsQueue(), command);
+    }
 
-    // Create BLAS scratch buffer
-    VkBuffer blasScratchBuffer;
-    VkDeviceMemory blasScratchMemory;
+    std::vector<SerializedAccelerationStructure> serializedBlases(blasCount);
+    void* readbackMemoryMapped;
+    VK_CHECK(vkMapMemory(m_device, readbackMemory, 0, VK_WHOLE_SIZE, 0, &readbackMemoryMapped));
+    const char* readbackData = static_cast<const char*>(readbackMemoryMapped) + (readbackDeviceAddress - readbackBufferDeviceAddress);
+    for (uint32_t i = 0; i < blasCount; ++i)
+    {
+        const char* serializedBlas = readbackData + serializedOffsets[i];
+        serializedBlases[i].assign(serializedBlas, serializedBlas + serializedSizes[i]);
+    }
+    vkUnmapMemory(m_device, readbackMemory);
+    destroyBufferAndFreeMemory(m_device, readbackBuffer, readbackMemory);
 
-    blasScratchBuffer = createBuffer(m_device, blasBuildSizesInfo.buildScratchSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
-    blasScratchMemory = allocateAndBindMemory(m_device, physicalDevice, blasScratchBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if (!writeAccelerationStructureCache(path, serializedBlases))
+    {
+        LOGW(("Couldn't write the BLAS cache " + path.string()).c_str());
+        return;
+    }
+    printf("BLAS stored in cache: %.1f MB to %s\n", toMegabytes(serializedSize), path.string().c_str());
+}
 
-    VkBufferDeviceAddressInfo blasScratchBufferDeviceAddressInfo{};
-    blasScratchBufferDeviceAddressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
-    blasScratchBufferDeviceAddressInfo.pNext = NULL;
-    blasScratchBufferDeviceAddressInfo.buffer = blasScratchBuffer;
+// Creates the BLAS handles in m_blasBuffer at the given offsets
+void Raytracer::createBLASes(const std::vector<VkDeviceSize>& sizes, const std::vector<VkDeviceSize>& offsets)
+{
+    m_blases.resize(sizes.size());
+    m_blasDeviceAddresses.resize(sizes.size());
+    for (size_t i = 0; i < sizes.size(); ++i)
+    {
+        VkAccelerationStructureCreateInfoKHR blasCreateInfo{};
+        blasCreateInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
+        blasCreateInfo.pNext = NULL;
+        blasCreateInfo.createFlags = 0;
+        blasCreateInfo.buffer = m_blasBuffer;
+        blasCreateInfo.offset = offsets[i];
+        blasCreateInfo.size = sizes[i];
+        blasCreateInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+        blasCreateInfo.deviceAddress = 0;
+
+        VK_CHECK(m_pvkCreateAccelerationStructureKHR(m_device, &blasCreateInfo, NULL, &m_blases[i]));
+
+        VkAccelerationStructureDeviceAddressInfoKHR blasDeviceAddressInfo{};
+        blasDeviceAddressInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
+        blasDeviceAddressInfo.pNext = NULL;
+        blasDeviceAddressInfo.accelerationStructure = m_blases[i];
+
+        m_blasDeviceAddresses[i] = m_pvkGetAccelerationStructureDeviceAddressKHR(m_device, &blasDeviceAddressInfo);
+    }
+}
+
+// Copies the BLASes into a buffer of their compacted size and frees the worst case sized one. The GPU lock must be held.
+// Returns the size of the new buffer.
+VkDeviceSize Raytracer::compactBLAS(const std::vector<VkDeviceSize>& compactedSizes)
+{
+    std::vector<VkDeviceSize> compactedOffsets(compactedSizes.size());
+    VkDeviceSize compactedBufferSize = 0;
+    for (size_t i = 0; i < compactedSizes.size(); ++i)
+    {
+        compactedOffsets[i] = compactedBufferSize;
+        compactedBufferSize += alignUp(compactedSizes[i], c_accelerationStructureAlignment);
+    }
 
-    VkDeviceAddress blasScratchBufferDeviceAddress = m_pvkGetBufferDeviceAddressKHR(m_device, &blasScratchBufferDeviceAddressInfo);
+    const std::vector<VkAccelerationStructureKHR> sourceBlases = std::move(m_blases);
+    const VkBuffer sourceBuffer = m_blasBuffer;
+    const VkDeviceMemory sourceMemory = m_blasMemory;
 
-    // Build BLAS
-    blasBuildGeometryInfo.dstAccelerationStructure = m_blas;
-    blasBuildGeometryInfo.scratchData.deviceAddress = blasScratchBufferDeviceAddress;
+    m_blasBuffer = createBuffer(m_device, compactedBufferSize, VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR);
+    m_blasMemory = allocateAndBindMemory(m_device, m_context.getPhysicalDevice(), m_blasBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    createBLASes(compactedSizes, compactedOffsets);
 
     const SingleTimeCommand command = beginSingleTimeCommands(m_context.getGraphicsCommandPool(), m_device);
-    const VkCommandBuffer& cb = command.commandBuffer;
-    const VkAccelerationStructureBuildRangeInfoKHR* blasBuildRangeInfos = rangeInfos.data();
-    m_pvkCmdBuildAccelerationStructuresKHR(cb, 1, &blasBuildGeometryInfo, &blasBuildRangeInfos);
+    for (size_t i = 0; i < sourceBlases.size(); ++i)
+    {
+        VkCopyAccelerationStructureInfoKHR copyInfo{};
+        copyInfo.sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR;
+        copyInfo.pNext = NULL;
+        copyInfo.src = sourceBlases[i];
+        copyInfo.dst = m_blases[i];
+        copyInfo.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR;
+
+        m_pvkCmdCopyAccelerationStructureKHR(command.commandBuffer, &copyInfo);
+    }
     endSingleTimeCommands(m_context.getGraphicsQueue(), command);
 
-    destroyBufferAndFreeMemory(m_device, blasScratchBuffer, blasScratchMemory);
+    for (VkAccelerationStructureKHR blas : sourceBlases)
+    {
+        m_pvkDestroyAccelerationStructureKHR(m_device, blas, nullptr);
+    }
+    destroyBufferAndFreeMemory(m_device, sourceBuffer, sourceMemory);
+
+    return compactedBufferSize;
+}
+
+// The BLAS builds share one scratch arena. If they don't all fit, they are split into batches that reuse it.
+void Raytracer::createBLASScratchArena()
+{
+    VkDeviceSize maxScratchSize = 0;
+    VkDeviceSize totalScratchSize = 0;
+    for (VkDeviceSize scratchSize : m_blasScratchSizes)
+    {
+        maxScratchSize = std::max(maxScratchSize, scratchSize);
+        totalScratchSize += scratchSize;
+    }
+    m_blasScratchArenaSize = std::max(maxScratchSize, std::min(totalScratchSize, c_maxScratchArenaSize));
+
+    m_blasScratchBuffer = createBuffer(m_device, m_blasScratchArenaSize + m_minScratchOffsetAlignment, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+    m_blasScratchMemory = allocateAndBindMemory(m_device, m_context.getPhysicalDevice(), m_blasScratchBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    m_blasScratchDeviceAddress = alignUp(getBufferDeviceAddress(m_blasScratchBuffer), m_minScratchOffsetAlignment);
+}
+
+// Records the builds or in-place refits of all BLASes in as few batches as the scratch arena allows, returns the batch count
+uint32_t Raytracer::recordBLASBuilds(VkCommandBuffer commandBuffer, VkBuildAccelerationStructureModeKHR mode)
+{
+    const uint32_t blasCount = ui32Size(m_blases);
+    for (uint32_t i = 0; i < blasCount; ++i)
+    {
+        m_blasBuildInfos[i].mode = mode;
+        m_blasBuildInfos[i].srcAccelerationStructure = mode == VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR ? m_blases[i] : VK_NULL_HANDLE;
+        m_blasBuildInfos[i].dstAccelerationStructure = m_blases[i];
+    }
+
+    VkMemoryBarrier scratchBarrier{};
+    scratchBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    scratchBarrier.pNext = NULL;
+    scratchBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+    scratchBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+    const VkPipelineStageFlags buildStage = VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR;
+
+    uint32_t batchCount = 0;
+    for (uint32_t batchBegin = 0; batchBegin < blasCount; ++batchCount)
+    {
+        uint32_t batchEnd = batchBegin;
+        VkDeviceSize scratchOffset = 0;
+        while (batchEnd < blasCount && scratchOffset + m_blasScratchSizes[batchEnd] <= m_blasScratchArenaSize)
+        {
+            m_blasBuildInfos[batchEnd].scratchData.deviceAddress = m_blasScratchDeviceAddress + scratchOffset;
+            scratchOffset += m_blasScratchSizes[batchEnd];
+            ++batchEnd;
+        }
+
+        if (batchBegin > 0)
+        {
+            // The previous batch has to finish using the scratch arena
+            vkCmdPipelineBarrier(commandBuffer, buildStage, buildStage, 0, 1, &scratchBarrier, 0, nullptr, 0, nullptr);
+        }
+        m_pvkCmdBuildAccelerationStructuresKHR(commandBuffer, batchEnd - batchBegin, &m_blasBuildInfos[batchBegin], &m_blasBuildRangeInfos[batchBegin]);
+        batchBegin = batchEnd;
+    }
+    return batchCount;
+}
+
+// Refits the BLASes to the skinned vertices. A refit keeps the tree of the last build, which fits worse the further
+// the pose moves from it, so the BLASes are rebuilt in place every c_maxBlasRefits frames.
+void Raytracer::updateBLAS(VkCommandBuffer commandBuffer, uint32_t slot)
+{
+    const bool rebuild = m_blasRefitsSinceBuild >= c_maxBlasRefits;
+
+    // The previous frames may still trace against the BLASes and the scratch arena is reused
+    VkMemoryBarrier buildBarrier{};
+    buildBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    buildBarrier.pNext = NULL;
+    buildBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+    buildBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+    vkCmdPipelineBarrier(commandBuffer,
+                         c_traversalStageMask | VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                         VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                         0,
+                         1,
+                         &buildBarrier,
+                         0,
+                         nullptr,
+                         0,
+                         nullptr);
+
+    GpuTimer& timer = rebuild ? *m_blasRebuildTimer : *m_blasRefitTimer;
+    timer.begin(commandBuffer, slot);
+    recordBLASBuilds(commandBuffer, rebuild ? VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR : VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR);
+    timer.end(commandBuffer, slot);
+
+    // The TLAS update and the traversal read the BLASes
+    VkMemoryBarrier readBarrier{};
+    readBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    readBarrier.pNext = NULL;
+    readBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+    readBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                         VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR | c_traversalStageMask,
+                         0,
+                         1,
+                         &readBarrier,
+                         0,
+                         nullptr,
+                         0,
+                         nullptr);
+
+    if (rebuild)
+    {
+        m_blasRefitsSinceBuild = 0;
+        ++m_blasRebuildCount;
+    }
+    else
+    {
+        ++m_blasRefitsSinceBuild;
+        ++m_blasRefitCount;
+    }
+}
+
+bool Raytracer::isAlphaTested(const Model::Submesh& submesh) const
+{
+    return m_options.alphaTest && m_model->materials[submesh.material].isAlphaTested();
+}
+
+VkDeviceAddress Raytracer::getBufferDeviceAddress(VkBuffer buffer) const
+{
+    VkBufferDeviceAddressInfo bufferDeviceAddressInfo{};
+    bufferDeviceAddressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+    bufferDeviceAddressInfo.pNext = NULL;
+    bufferDeviceAddressInfo.buffer = buffer;
+
+    return m_pvkGetBufferDeviceAddressKHR(m_device, &bufferDeviceAddressInfo);
 }
 
 void Raytracer::createTLAS()
 {
     const VkPhysicalDevice physicalDevice = m_context.getPhysicalDevice();
 
-    // Setup BLAS instance buffer
-    // clang-format off
-    const std::vector<float> matrixData{
-        0.01f, 0.0f, 0.0f, 0.0f,
-        0.0f, 0.01f, 0.0f, 0.0f,
-        0.0f, 0.0f, 0.01f, 0.0f
-    };
-    // clang-format on
-    VkAccelerationStructureInstanceKHR blasInstance{};
-    std::memcpy(blasInstance.transform.matrix, matrixData.data(), sizeof(float) * matrixData.size());
-    blasInstance.instanceCustomIndex = 0;
-    blasInstance.mask = 0xFF;
-    blasInstance.instanceShaderBindingTableRecordOffset = 0;
-    blasInstance.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
-    blasInstance.accelerationStructureReference = m_blasDeviceAddress;
-
-    m_blasGeometryInstanceBuffer = createBuffer(m_device, sizeof(VkAccelerationStructureInstanceKHR), VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
-    m_blasGeometryInstanceMemory = allocateAndBindMemory(m_device, physicalDevice, m_blasGeometryInstanceBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-
-    void* hostBlasGeometryInstanceMemoryMapped;
-    VK_CHECK(vkMapMemory(m_device, m_blasGeometryInstanceMemory, 0, sizeof(VkAccelerationStructureInstanceKHR), 0, &hostBlasGeometryInstanceMemoryMapped));
-    memcpy(hostBlasGeometryInstanceMemoryMapped, &blasInstance, sizeof(VkAccelerationStructureInstanceKHR));
-    vkUnmapMemory(m_device, m_blasGeometryInstanceMemory);
-
-    VkBufferDeviceAddressInfo blasGeometryInstanceDeviceAddressInfo{};
-    blasGeometryInstanceDeviceAddressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
-    blasGeometryInstanceDeviceAddressInfo.pNext = NULL;
-    blasGeometryInstanceDeviceAddressInfo.buffer = m_blasGeometryInstanceBuffer;
-
-    VkDeviceAddress blasGeometryInstanceDeviceAddress = m_pvkGetBufferDeviceAddressKHR(m_device, &blasGeometryInstanceDeviceAddressInfo);
+    // Instance ring with one slot per swapchain image, so a frame never overwrites the instances of a frame in flight.
+    // It stays mapped for the per-frame updates.
+    const uint32_t instanceCount = ui32Size(m_instanceTransforms) * ui32Size(m_blases);
+    const uint32_t ringSlotCount = m_dynamicTlas ? ui32Size(m_context.getSwapchainImages()) : 1;
+    const VkDeviceSize instanceRingSize = sizeof(VkAccelerationStructureInstanceKHR) * instanceCount * ringSlotCount;
+    m_tlasInstanceCount = instanceCount;
+
+    m_instanceRingBuffer = createBuffer(m_device, instanceRingSize, VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+    m_instanceRingMemory = allocateAndBindMemory(m_device, physicalDevice, m_instanceRingBuffer, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    m_instanceRingDeviceAddress = getBufferDeviceAddress(m_instanceRingBuffer);
+
+    void* instanceRingMapped;
+    VK_CHECK(vkMapMemory(m_device, m_instanceRingMemory, 0, instanceRingSize, 0, &instanceRingMapped));
+    m_instanceRingMapped = static_cast<VkAccelerationStructureInstanceKHR*>(instanceRingMapped);
+    writeInstances(m_instanceTransforms, 0);
+
+    // Animated instances and skinned BLASes are refitted every frame, which needs the update flag at build time
+    m_tlasBuildFlags = getBuildFlags(m_options.accelerationStructurePreset) & ~VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
+    if (m_dynamicTlas)
+    {
+        m_tlasBuildFlags |= VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR;
+    }
 
     // Setup TLAS build size info
-    VkAccelerationStructureGeometryDataKHR tlasGeometryData{};
-    tlasGeometryData.instances.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
-    tlasGeometryData.instances.pNext = NULL;
-    tlasGeometryData.instances.arrayOfPointers = VK_FALSE;
-    tlasGeometryData.instances.data.deviceAddress = blasGeometryInstanceDeviceAddress;
-
-    VkAccelerationStructureGeometryKHR tlasGeometry{};
-    tlasGeometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
-    tlasGeometry.pNext = NULL;
-    tlasGeometry.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR;
-    tlasGeometry.geometry = tlasGeometryData;
-    tlasGeometry.flags = VK_GEOMETRY_OPAQUE_BIT_KHR;
+    const VkAccelerationStructureGeometryKHR tlasGeometry = getTLASGeometry(0);
 
     VkAccelerationStructureBuildGeometryInfoKHR tlasBuildGeometryInfo{};
     tlasBuildGeometryInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
     tlasBuildGeometryInfo.pNext = NULL;
     tlasBuildGeometryInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
-    tlasBuildGeometryInfo.flags = 0;
+    tlasBuildGeometryInfo.flags = m_tlasBuildFlags;
     tlasBuildGeometryInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
     tlasBuildGeometryInfo.srcAccelerationStructure = VK_NULL_HANDLE;
     tlasBuildGeometryInfo.dstAccelerationStructure = VK_NULL_HANDLE;
@@ -1225,7 +2521,7 @@ void Raytracer::createTLAS()
     tlasBuildSizesInfo.updateScratchSize = 0;
     tlasBuildSizesInfo.buildScratchSize = 0;
 
-    std::vector<uint32_t> topLevelMaxPrimitiveCountList = {1};
+    std::vector<uint32_t> topLevelMaxPrimitiveCountList = {instanceCount};
 
     m_pvkGetAccelerationStructureBuildSizesKHR(m_device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &tlasBuildGeometryInfo, topLevelMaxPrimitiveCountList.data(), &tlasBuildSizesInfo);
 
@@ -1246,40 +2542,178 @@ void Raytracer::createTLAS()
 
     VK_CHECK(m_pvkCreateAccelerationStructureKHR(m_device, &tlasCreateInfo, NULL, &m_tlas));
 
-    // TLAS scratch buffer
-    VkBuffer tlasScratchBuffer;
-    VkDeviceMemory tlasScratchMemory;
+    // TLAS scratch buffer, kept for the per-frame updates and rebuilds
+    const VkDeviceSize scratchSize = std::max(tlasBuildSizesInfo.buildScratchSize, tlasBuildSizesInfo.updateScratchSize);
+    m_tlasScratchBuffer = createBuffer(m_device, scratchSize + m_minScratchOffsetAlignment, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+    m_tlasScratchMemory = allocateAndBindMemory(m_device, physicalDevice, m_tlasScratchBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    m_tlasScratchDeviceAddress = alignUp(getBufferDeviceAddress(m_tlasScratchBuffer), m_minScratchOffsetAlignment);
+
+    // Build TLAS
+    const std::lock_guard<std::mutex> gpuLock(m_gpuMutex);
+    const std::chrono::high_resolution_clock::time_point buildStartTime = std::chrono::high_resolution_clock::now();
 
-    tlasScratchBuffer = createBuffer(m_device, tlasBuildSizesInfo.buildScratchSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
-    tlasScratchMemory = allocateAndBindMemory(m_device, physicalDevice, tlasScratchBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    const SingleTimeCommand command = beginSingleTimeCommands(m_context.getGraphicsCommandPool(), m_device);
+    recordTLASBuild(command.commandBuffer, 0, VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR);
+    endSingleTimeCommands(m_context.getGraphicsQueue(), command);
 
-    VkBufferDeviceAddressInfo tlasScratchBufferDeviceAddressInfo{};
-    tlasScratchBufferDeviceAddressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
-    tlasScratchBufferDeviceAddressInfo.pNext = NULL;
-    tlasScratchBufferDeviceAddressInfo.buffer = tlasScratchBuffer;
+    printf("TLAS build: %u instances, %.1f ms, %.1f MB, scratch %.1f MB, instance ring %.1f MB\n",
+           instanceCount,
+           getMillisecondsSince(buildStartTime),
+           toMegabytes(tlasBuildSizesInfo.accelerationStructureSize),
+           toMegabytes(scratchSize),
+           toMegabytes(instanceRingSize));
+
+    m_tlasBuildPositions.resize(m_instanceTransforms.size());
+    for (size_t i = 0; i < m_instanceTransforms.size(); ++i)
+    {
+        m_tlasBuildPositions[i] = glm::vec3(m_instanceTransforms[i][3]);
+    }
+}
 
-    VkDeviceAddress tlasScratchBufferDeviceAddress = m_pvkGetBufferDeviceAddressKHR(m_device, &tlasScratchBufferDeviceAddressInfo);
+// Writes one instance per scene transform and BLAS into a slot of the instance ring
+void Raytracer::writeInstances(const std::vector<glm::mat4>& transforms, uint32_t slot)
+{
+    const uint32_t blasCount = ui32Size(m_blases);
+    CHECK(ui32Size(transforms) * blasCount == m_tlasInstanceCount);
 
-    // Build TLAS
+    VkAccelerationStructureInstanceKHR* instances = m_instanceRingMapped + static_cast<size_t>(slot) * m_tlasInstanceCount;
+    for (uint32_t i = 0; i < ui32Size(transforms); ++i)
+    {
+        // VkTransformMatrixKHR is a row-major 3x4 matrix, glm is column-major
+        const glm::mat4& transform = transforms[i];
+        VkTransformMatrixKHR instanceTransform;
+        for (int row = 0; row < 3; ++row)
+        {
+            for (int column = 0; column < 4; ++column)
+            {
+                instanceTransform.matrix[row][column] = transform[column][row];
+            }
+        }
+
+        for (uint32_t blasIndex = 0; blasIndex < blasCount; ++blasIndex)
+        {
+            VkAccelerationStructureInstanceKHR blasInstance{};
+            blasInstance.transform = instanceTransform;
+            // The hit shader finds the submesh with the custom index + the geometry index
+            blasInstance.instanceCustomIndex = m_blasFirstSubmeshes[blasIndex];
+            blasInstance.mask = 0xFF;
+            // The hit records are per submesh and ray type, the geometry index is added with the stride of the rays
+            blasInstance.instanceShaderBindingTableRecordOffset = m_blasFirstSubmeshes[blasIndex] * c_rayTypeCount;
+            blasInstance.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
+            blasInstance.accelerationStructureReference = m_blasDeviceAddresses[blasIndex];
+
+            // Written as a whole because the mapped memory may be uncached
+            instances[i * blasCount + blasIndex] = blasInstance;
+        }
+    }
+}
+
+VkAccelerationStructureGeometryKHR Raytracer::getTLASGeometry(uint32_t slot) const
+{
+    VkAccelerationStructureGeometryDataKHR tlasGeometryData{};
+    tlasGeometryData.instances.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
+    tlasGeometryData.instances.pNext = NULL;
+    tlasGeometryData.instances.arrayOfPointers = VK_FALSE;
+    tlasGeometryData.instances.data.deviceAddress = m_instanceRingDeviceAddress + sizeof(VkAccelerationStructureInstanceKHR) * slot * m_tlasInstanceCount;
+
+    VkAccelerationStructureGeometryKHR tlasGeometry{};
+    tlasGeometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+    tlasGeometry.pNext = NULL;
+    tlasGeometry.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR;
+    tlasGeometry.geometry = tlasGeometryData;
+    tlasGeometry.flags = VK_GEOMETRY_OPAQUE_BIT_KHR;
+    return tlasGeometry;
+}
+
+// Builds the TLAS from the instances in a ring slot, or refits it in place with the update mode
+void Raytracer::recordTLASBuild(VkCommandBuffer commandBuffer, uint32_t slot, VkBuildAccelerationStructureModeKHR mode)
+{
+    const VkAccelerationStructureGeometryKHR tlasGeometry = getTLASGeometry(slot);
+
+    VkAccelerationStructureBuildGeometryInfoKHR tlasBuildGeometryInfo{};
+    tlasBuildGeometryInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+    tlasBuildGeometryInfo.pNext = NULL;
+    tlasBuildGeometryInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
+    tlasBuildGeometryInfo.flags = m_tlasBuildFlags;
+    tlasBuildGeometryInfo.mode = mode;
+    tlasBuildGeometryInfo.srcAccelerationStructure = mode == VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR ? m_tlas : VK_NULL_HANDLE;
     tlasBuildGeometryInfo.dstAccelerationStructure = m_tlas;
-    tlasBuildGeometryInfo.scratchData.deviceAddress = tlasScratchBufferDeviceAddress;
+    tlasBuildGeometryInfo.geometryCount = 1;
+    tlasBuildGeometryInfo.pGeometries = &tlasGeometry;
+    tlasBuildGeometryInfo.ppGeometries = NULL;
+    tlasBuildGeometryInfo.scratchData.deviceAddress = m_tlasScratchDeviceAddress;
 
     VkAccelerationStructureBuildRangeInfoKHR tlasBuildRangeInfo{};
-    tlasBuildRangeInfo.primitiveCount = 1;
+    tlasBuildRangeInfo.primitiveCount = m_tlasInstanceCount;
     tlasBuildRangeInfo.primitiveOffset = 0;
     tlasBuildRangeInfo.firstVertex = 0;
     tlasBuildRangeInfo.transformOffset = 0;
 
-    const SingleTimeCommand command = beginSingleTimeCommands(m_context.getGraphicsCommandPool(), m_device);
-    const VkCommandBuffer& cb = command.commandBuffer;
-
     const VkAccelerationStructureBuildRangeInfoKHR* tlasBuildRangeInfos = &tlasBuildRangeInfo;
+    m_pvkCmdBuildAccelerationStructuresKHR(commandBuffer, 1, &tlasBuildGeometryInfo, &tlasBuildRangeInfos);
+}
 
-    m_pvkCmdBuildAccelerationStructuresKHR(cb, 1, &tlasBuildGeometryInfo, &tlasBuildRangeInfos);
-
-    endSingleTimeCommands(m_context.getGraphicsQueue(), command);
+// Moves the instances and records a TLAS refit. A refit keeps the tree of the last build, so its quality drops as the
+// instances move away from where they were built. Then a full rebuild is recorded instead.
+// Static instances over skinned BLASes are refitted too, because the BLAS bounds change.
+void Raytracer::updateTLAS(VkCommandBuffer commandBuffer, uint32_t slot, double time)
+{
+    if (m_options.animateInstances)
+    {
+        animateInstances(m_instanceTransforms, m_instanceExtent, time, m_animatedTransforms);
+    }
+    const std::vector<glm::mat4>& transforms = m_options.animateInstances ? m_animatedTransforms : m_instanceTransforms;
+    writeInstances(transforms, slot);
 
-    destroyBufferAndFreeMemory(m_device, tlasScratchBuffer, tlasScratchMemory);
+    float maxDisplacement = 0.0f;
+    for (size_t i = 0; i < transforms.size(); ++i)
+    {
+        maxDisplacement = std::max(maxDisplacement, glm::distance(glm::vec3(transforms[i][3]), m_tlasBuildPositions[i]));
+    }
+    const bool rebuild = m_tlasRefitsSinceBuild >= c_maxTlasRefits || maxDisplacement > c_maxTlasRefitDisplacement * glm::length(m_instanceExtent);
+
+    // The previous frames may still trace against the TLAS and the scratch buffer is reused
+    VkMemoryBarrier buildBarrier{};
+    buildBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    buildBarrier.pNext = NULL;
+    buildBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+    buildBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+    vkCmdPipelineBarrier(commandBuffer,
+                         c_traversalStageMask | VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                         VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                         0,
+                         1,
+                         &buildBarrier,
+                         0,
+                         nullptr,
+                         0,
+                         nullptr);
+
+    m_tlasUpdateTimer->begin(commandBuffer, slot);
+    recordTLASBuild(commandBuffer, slot, rebuild ? VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR : VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR);
+    m_tlasUpdateTimer->end(commandBuffer, slot);
+
+    VkMemoryBarrier traceBarrier{};
+    traceBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    traceBarrier.pNext = NULL;
+    traceBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+    traceBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, c_traversalStageMask, 0, 1, &traceBarrier, 0, nullptr, 0, nullptr);
+
+    if (rebuild)
+    {
+        for (size_t i = 0; i < transforms.size(); ++i)
+        {
+            m_tlasBuildPositions[i] = glm::vec3(transforms[i][3]);
+        }
+        m_tlasRefitsSinceBuild = 0;
+        ++m_tlasRebuildCount;
+    }
+    else
+    {
+        ++m_tlasRefitsSinceBuild;
+        ++m_tlasRefitCount;
+    }
 }
 
 void Raytracer::updateCommonDescriptorSets()
@@ -1291,10 +2725,11 @@ void Raytracer::updateCommonDescriptorSets()
     accelerationStructureDescriptorInfo.accelerationStructureCount = 1;
     accelerationStructureDescriptorInfo.pAccelerationStructures = &m_tlas;
 
+    // The slot of the set's swapchain image, set per set below
     VkDescriptorBufferInfo uniformDescriptorInfo{};
     uniformDescriptorInfo.buffer = m_commonBuffer;
     uniformDescriptorInfo.offset = 0;
-    uniformDescriptorInfo.range = VK_WHOLE_SIZE;
+    uniformDescriptorInfo.range = c_uniformBufferSize;
 
     VkDescriptorBufferInfo indexDescriptorInfo{};
     indexDescriptorInfo.buffer = m_indexBuffer;
@@ -1306,16 +2741,71 @@ void Raytracer::updateCommonDescriptorSets()
     vertexDescriptorInfo.offset = 0;
     vertexDescriptorInfo.range = VK_WHOLE_SIZE;
 
+    VkDescriptorBufferInfo lightDescriptorInfo{};
+    lightDescriptorInfo.buffer = m_lightBuffer;
+    lightDescriptorInfo.offset = 0;
+    lightDescriptorInfo.range = VK_WHOLE_SIZE;
+
+    VkDescriptorBufferInfo lightTreeDescriptorInfo{};
+    lightTreeDescriptorInfo.buffer = m_lightTreeBuffer;
+    lightTreeDescriptorInfo.offset = 0;
+    lightTreeDescriptorInfo.range = VK_WHOLE_SIZE;
+
+    // Without baked shading data the closest-hit shader never reads it, the vertex buffer stands in
+    VkDescriptorBufferInfo shadingDataDescriptorInfo{};
+    shadingDataDescriptorInfo.buffer = m_shadingDataBuffer != VK_NULL_HANDLE ? m_shadingDataBuffer : m_vertexBuffer;
+    shadingDataDescriptorInfo.offset = 0;
+    shadingDataDescriptorInfo.range = VK_WHOLE_SIZE;
+
+    // The slot of the set's swapchain image like the uniform buffer
+    VkDescriptorBufferInfo viewDescriptorInfo{};
+    viewDescriptorInfo.buffer = m_viewBuffer;
+    viewDescriptorInfo.offset = 0;
+    viewDescriptorInfo.range = sizeof(ViewInfo) * m_options.viewCount;
+
     VkDescriptorImageInfo imageDescriptorInfo{};
     imageDescriptorInfo.sampler = VK_NULL_HANDLE;
-    imageDescriptorInfo.imageView = m_colorImageView;
+    imageDescriptorInfo.imageView = m_accumulationImage.view;
     imageDescriptorInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
 
+    VkDescriptorImageInfo viewImageDescriptorInfo{};
+    viewImageDescriptorInfo.sampler = VK_NULL_HANDLE;
+    viewImageDescriptorInfo.imageView = m_viewImage.view;
+    viewImageDescriptorInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    // Without the adaptive sampler the ray generation shader never reads the statistics, like the G-buffer
+    VkDescriptorImageInfo sampleStatisticsDescriptorInfo{};
+    sampleStatisticsDescriptorInfo.sampler = VK_NULL_HANDLE;
+    sampleStatisticsDescriptorInfo.imageView = m_adaptiveSampler ? m_adaptiveSampler->getStatisticsView() : m_accumulationImage.view;
+    sampleStatisticsDescriptorInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    // Without the denoiser the ray generation shader never writes the G-buffer, any image of a matching format will do
+    std::array<VkDescriptorImageInfo, 3> gBufferDescriptorInfos{};
+    gBufferDescriptorInfos[0].imageView = m_denoiser ? m_denoiser->getNormalDepthView() : m_accumulationImage.view;
+    gBufferDescriptorInfos[1].imageView = m_denoiser ? m_denoiser->getMotionMaterialView() : m_accumulationImage.view;
+    gBufferDescriptorInfos[2].imageView = m_denoiser ? m_denoiser->getAlbedoView() : m_colorImage.view;
+    for (VkDescriptorImageInfo& info : gBufferDescriptorInfos)
+    {
+        info.sampler = VK_NULL_HANDLE;
+        info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    }
+
+    // Same for the reconstruction images without half or checkerboard secondary rays
+    std::array<VkDescriptorImageInfo, 3> reconstructionDescriptorInfos{};
+    reconstructionDescriptorInfos[0].imageView = m_secondaryRayReconstruction ? m_secondaryRayReconstruction->getRadianceView() : m_accumulationImage.view;
+    reconstructionDescriptorInfos[1].imageView = m_secondaryRayReconstruction ? m_secondaryRayReconstruction->getNormalDepthView() : m_accumulationImage.view;
+    reconstructionDescriptorInfos[2].imageView = m_secondaryRayReconstruction ? m_secondaryRayReconstruction->getAlbedoView() : m_colorImage.view;
+    for (VkDescriptorImageInfo& info : reconstructionDescriptorInfos)
+    {
+        info.sampler = VK_NULL_HANDLE;
+        info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    }
+
     // Write sets
     VkWriteDescriptorSet writeAccelerationStructure{};
     writeAccelerationStructure.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
     writeAccelerationStructure.pNext = &accelerationStructureDescriptorInfo;
-    writeAccelerationStructure.dstSet = m_commonDescriptorSet;
+    writeAccelerationStructure.dstSet = VK_NULL_HANDLE;
     writeAccelerationStructure.dstBinding = 0;
     writeAccelerationStructure.dstArrayElement = 0;
     writeAccelerationStructure.descriptorCount = 1;
@@ -1327,7 +2817,7 @@ void Raytracer::updateCommonDescriptorSets()
     VkWriteDescriptorSet writeUniformBuffer{};
     writeUniformBuffer.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
     writeUniformBuffer.pNext = NULL;
-    writeUniformBuffer.dstSet = m_commonDescriptorSet;
+    writeUniformBuffer.dstSet = VK_NULL_HANDLE;
     writeUniformBuffer.dstBinding = 1;
     writeUniformBuffer.dstArrayElement = 0;
     writeUniformBuffer.descriptorCount = 1;
@@ -1339,7 +2829,7 @@ void Raytracer::updateCommonDescriptorSets()
     VkWriteDescriptorSet writeIndexBuffer{};
     writeIndexBuffer.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
     writeIndexBuffer.pNext = NULL;
-    writeIndexBuffer.dstSet = m_commonDescriptorSet;
+    writeIndexBuffer.dstSet = VK_NULL_HANDLE;
     writeIndexBuffer.dstBinding = 2;
     writeIndexBuffer.dstArrayElement = 0;
     writeIndexBuffer.descriptorCount = 1;
@@ -1351,7 +2841,7 @@ void Raytracer::updateCommonDescriptorSets()
     VkWriteDescriptorSet writeVertexBuffer{};
     writeVertexBuffer.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
     writeVertexBuffer.pNext = NULL;
-    writeVertexBuffer.dstSet = m_commonDescriptorSet;
+    writeVertexBuffer.dstSet = VK_NULL_HANDLE;
     writeVertexBuffer.dstBinding = 3;
     writeVertexBuffer.dstArrayElement = 0;
     writeVertexBuffer.descriptorCount = 1;
@@ -1363,7 +2853,7 @@ void Raytracer::updateCommonDescriptorSets()
     VkWriteDescriptorSet writeImage{};
     writeImage.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
     writeImage.pNext = NULL;
-    writeImage.dstSet = m_commonDescriptorSet;
+    writeImage.dstSet = VK_NULL_HANDLE;
     writeImage.dstBinding = 4;
     writeImage.dstArrayElement = 0;
     writeImage.descriptorCount = 1;
@@ -1372,15 +2862,148 @@ void Raytracer::updateCommonDescriptorSets()
     writeImage.pBufferInfo = NULL;
     writeImage.pTexelBufferView = NULL;
 
+    VkWriteDescriptorSet writeLightBuffer{};
+    writeLightBuffer.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writeLightBuffer.pNext = NULL;
+    writeLightBuffer.dstSet = VK_NULL_HANDLE;
+    writeLightBuffer.dstBinding = 5;
+    writeLightBuffer.dstArrayElement = 0;
+    writeLightBuffer.descriptorCount = 1;
+    writeLightBuffer.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writeLightBuffer.pImageInfo = NULL;
+    writeLightBuffer.pBufferInfo = &lightDescriptorInfo;
+    writeLightBuffer.pTexelBufferView = NULL;
+
+    VkWriteDescriptorSet writeShadingDataBuffer{};
+    writeShadingDataBuffer.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writeShadingDataBuffer.pNext = NULL;
+    writeShadingDataBuffer.dstSet = VK_NULL_HANDLE;
+    writeShadingDataBuffer.dstBinding = 10;
+    writeShadingDataBuffer.dstArrayElement = 0;
+    writeShadingDataBuffer.descriptorCount = 1;
+    writeShadingDataBuffer.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writeShadingDataBuffer.pImageInfo = NULL;
+    writeShadingDataBuffer.pBufferInfo = &shadingDataDescriptorInfo;
+    writeShadingDataBuffer.pTexelBufferView = NULL;
+
+    VkWriteDescriptorSet writeLightTreeBuffer{};
+    writeLightTreeBuffer.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writeLightTreeBuffer.pNext = NULL;
+    writeLightTreeBuffer.dstSet = VK_NULL_HANDLE;
+    writeLightTreeBuffer.dstBinding = 6;
+    writeLightTreeBuffer.dstArrayElement = 0;
+    writeLightTreeBuffer.descriptorCount = 1;
+    writeLightTreeBuffer.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writeLightTreeBuffer.pImageInfo = NULL;
+    writeLightTreeBuffer.pBufferInfo = &lightTreeDescriptorInfo;
+    writeLightTreeBuffer.pTexelBufferView = NULL;
+
+    VkWriteDescriptorSet writeViewBuffer{};
+    writeViewBuffer.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writeViewBuffer.pNext = NULL;
+    writeViewBuffer.dstSet = VK_NULL_HANDLE;
+    writeViewBuffer.dstBinding = 11;
+    writeViewBuffer.dstArrayElement = 0;
+    writeViewBuffer.descriptorCount = 1;
+    writeViewBuffer.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writeViewBuffer.pImageInfo = NULL;
+    writeViewBuffer.pBufferInfo = &viewDescriptorInfo;
+    writeViewBuffer.pTexelBufferView = NULL;
+
+    VkWriteDescriptorSet writeViewImage{};
+    writeViewImage.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writeViewImage.pNext = NULL;
+    writeViewImage.dstSet = VK_NULL_HANDLE;
+    writeViewImage.dstBinding = 12;
+    writeViewImage.dstArrayElement = 0;
+    writeViewImage.descriptorCount = 1;
+    writeViewImage.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    writeViewImage.pImageInfo = &viewImageDescriptorInfo;
+    writeViewImage.pBufferInfo = NULL;
+    writeViewImage.pTexelBufferView = NULL;
+
+    VkWriteDescriptorSet writeSampleStatisticsImage{};
+    writeSampleStatisticsImage.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writeSampleStatisticsImage.pNext = NULL;
+    writeSampleStatisticsImage.dstSet = VK_NULL_HANDLE;
+    writeSampleStatisticsImage.dstBinding = 13;
+    writeSampleStatisticsImage.dstArrayElement = 0;
+    writeSampleStatisticsImage.descriptorCount = 1;
+    writeSampleStatisticsImage.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    writeSampleStatisticsImage.pImageInfo = &sampleStatisticsDescriptorInfo;
+    writeSampleStatisticsImage.pBufferInfo = NULL;
+    writeSampleStatisticsImage.pTexelBufferView = NULL;
+
     std::vector<VkWriteDescriptorSet> writeDescriptorSets{
         writeAccelerationStructure, //
         writeUniformBuffer, //
         writeIndexBuffer, //
         writeVertexBuffer, //
-        writeImage //
+        writeImage, //
+        writeLightBuffer, //
+        writeLightTreeBuffer, //
+        writeShadingDataBuffer, //
+        writeViewBuffer, //
+        writeViewImage, //
+        writeSampleStatisticsImage //
     };
 
-    vkUpdateDescriptorSets(m_device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
+    for (uint32_t i = 0; i < ui32Size(gBufferDescriptorInfos); ++i)
+    {
+        VkWriteDescriptorSet writeGBufferImage{};
+        writeGBufferImage.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writeGBufferImage.pNext = NULL;
+        writeGBufferImage.dstSet = VK_NULL_HANDLE;
+        writeGBufferImage.dstBinding = 7 + i;
+        writeGBufferImage.dstArrayElement = 0;
+        writeGBufferImage.descriptorCount = 1;
+        writeGBufferImage.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        writeGBufferImage.pImageInfo = &gBufferDescriptorInfos[i];
+        writeGBufferImage.pBufferInfo = NULL;
+        writeGBufferImage.pTexelBufferView = NULL;
+        writeDescriptorSets.push_back(writeGBufferImage);
+    }
+
+    for (uint32_t i = 0; i < ui32Size(reconstructionDescriptorInfos); ++i)
+    {
+        VkWriteDescriptorSet writeReconstructionImage{};
+        writeReconstructionImage.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writeReconstructionImage.pNext = NULL;
+        writeReconstructionImage.dstSet = VK_NULL_HANDLE;
+        writeReconstructionImage.dstBinding = 14 + i;
+        writeReconstructionImage.dstArrayElement = 0;
+        writeReconstructionImage.descriptorCount = 1;
+        writeReconstructionImage.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        writeReconstructionImage.pImageInfo = &reconstructionDescriptorInfos[i];
+        writeReconstructionImage.pBufferInfo = NULL;
+        writeReconstructionImage.pTexelBufferView = NULL;
+        writeDescriptorSets.push_back(writeReconstructionImage);
+    }
+
+    // The sets only differ in the slots of the uniform and view buffers
+    std::vector<VkDescriptorBufferInfo> slotUniformDescriptorInfos(m_commonDescriptorSets.size(), uniformDescriptorInfo);
+    std::vector<VkDescriptorBufferInfo> slotViewDescriptorInfos(m_commonDescriptorSets.size(), viewDescriptorInfo);
+    std::vector<VkWriteDescriptorSet> slotWriteDescriptorSets;
+    for (size_t slot = 0; slot < m_commonDescriptorSets.size(); ++slot)
+    {
+        slotUniformDescriptorInfos[slot].offset = m_commonBufferSlotSize * slot;
+        slotViewDescriptorInfos[slot].offset = m_viewBufferSlotSize * slot;
+        for (VkWriteDescriptorSet write : writeDescriptorSets)
+        {
+            write.dstSet = m_commonDescriptorSets[slot];
+            if (write.pBufferInfo == &uniformDescriptorInfo)
+            {
+                write.pBufferInfo = &slotUniformDescriptorInfos[slot];
+            }
+            else if (write.pBufferInfo == &viewDescriptorInfo)
+            {
+                write.pBufferInfo = &slotViewDescriptorInfos[slot];
+            }
+            slotWriteDescriptorSets.push_back(write);
+        }
+    }
+
+    vkUpdateDescriptorSets(m_device, ui32Size(slotWriteDescriptorSets), slotWriteDescriptorSets.data(), 0, NULL);
 }
 
 void Raytracer::updateMaterialIndexDescriptorSet()
@@ -1406,25 +3029,7 @@ void Raytracer::updateMaterialIndexDescriptorSet()
 
     vkUpdateDescriptorSets(m_device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
 
-    // For each submesh texture indices are stored.
-    // Also index buffer offset is needed, because indices are gathered in one big buffer,
-    // so we need to know where each submesh's indices start.
-    std::vector<SubmeshInfo> submeshInfos(m_model->submeshes.size());
-    int indexBufferOffset = 0;
-    for (size_t i = 0; i < m_model->submeshes.size(); ++i)
-    {
-        const Model::Submesh& submesh = m_model->submeshes[i];
-        submeshInfos[i].baseColorTextureIndex = m_model->materials[submesh.material].baseColor;
-        submeshInfos[i].normalTextureIndex = m_model->materials[submesh.material].normalImage;
-        submeshInfos[i].metallicRoughnessTextureIndex = m_model->materials[submesh.material].metallicRoughnessImage;
-        submeshInfos[i].indexBufferOffset = indexBufferOffset;
-
-        indexBufferOffset += submesh.indices.size() / 3;
-
-        // For some materials there's no normal or metallicRoughess, just use some image in that case to avoid crashes
-        submeshInfos[i].normalTextureIndex = std::max(submeshInfos[i].normalTextureIndex, 0);
-        submeshInfos[i].metallicRoughnessTextureIndex = std::max(submeshInfos[i].metallicRoughnessTextureIndex, 0);
-    }
+    const std::vector<SubmeshInfo> submeshInfos = createSubmeshInfos(*m_model, m_options.alphaTest);
 
     VkBufferCopy copyRegion{};
     copyRegion.srcOffset = 0;
@@ -1434,6 +3039,7 @@ void Raytracer::updateMaterialIndexDescriptorSet()
     const VkPhysicalDevice physicalDevice = m_context.getPhysicalDevice();
     StagingBuffer stagingBuffer = createStagingBuffer(m_device, physicalDevice, submeshInfos.data(), copyRegion.size);
 
+    const std::lock_guard<std::mutex> gpuLock(m_gpuMutex);
     const SingleTimeCommand command = beginSingleTimeCommands(m_context.getGraphicsCommandPool(), m_device);
     vkCmdCopyBuffer(command.commandBuffer, stagingBuffer.buffer, m_materialIndexBuffer, 1, &copyRegion);
     endSingleTimeCommands(m_context.getGraphicsQueue(), command);
@@ -1484,27 +3090,54 @@ void Raytracer::createShaderBindingTable()
 
     vkGetPhysicalDeviceProperties2(physicalDevice, &physicalDeviceProperties2);
 
-    const VkDeviceSize shaderGroupHandleSize = static_cast<VkDeviceSize>(physicalDeviceRayTracingPipelineProperties.shaderGroupHandleSize);
-    const VkDeviceSize shaderBindingTableSize = shaderGroupHandleSize * c_shaderGroupCount;
-    const uint32_t shaderGroupBaseAlignment = physicalDeviceRayTracingPipelineProperties.shaderGroupBaseAlignment;
-
-    const VkBufferUsageFlags usage = VK_BUFFER_USAGE_SHADER_BINDING_TABLE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
-    m_shaderBindingTableBuffer = createBuffer(m_device, shaderBindingTableSize, usage);
-    m_shaderBindingTableMemory = allocateAndBindMemory(m_device, physicalDevice, m_shaderBindingTableBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-
-    std::vector<char> shaderGroupHandlesBuffer(shaderBindingTableSize, 0);
-    VK_CHECK(m_pvkGetRayTracingShaderGroupHandlesKHR(m_device, m_pipeline, 0, c_shaderGroupCount, shaderBindingTableSize, shaderGroupHandlesBuffer.data()));
-
-    void* sbtMemoryMapped;
-    VK_CHECK(vkMapMemory(m_device, m_shaderBindingTableMemory, 0, shaderBindingTableSize, 0, &sbtMemoryMapped));
+    ShaderBindingTableBuilder::Limits limits{};
+    limits.handleSize = physicalDeviceRayTracingPipelineProperties.shaderGroupHandleSize;
+    limits.handleAlignment = physicalDeviceRayTracingPipelineProperties.shaderGroupHandleAlignment;
+    limits.baseAlignment = physicalDeviceRayTracingPipelineProperties.shaderGroupBaseAlignment;
+    limits.maxStride = physicalDeviceRayTracingPipelineProperties.maxShaderGroupStride;
+
+    std::vector<uint8_t> groupHandles(static_cast<size_t>(limits.handleSize) * c_shaderGroupCount);
+    VK_CHECK(m_pvkGetRayTracingShaderGroupHandlesKHR(m_device, m_pipeline, 0, c_shaderGroupCount, groupHandles.size(), groupHandles.data()));
+
+    // One record per submesh and ray type, so the hit shaders read the material inline instead of from a buffer.
+    // The TLAS instances start at their first submesh and the rays pick their type with the record offset.
+    // The camera record of a submesh also selects the closest-hit variant of its material class.
+    const std::vector<SubmeshInfo> submeshInfos = createSubmeshInfos(*m_model, m_options.alphaTest);
+    std::vector<uint32_t> materialClasses(m_model->materials.size(), c_materialClassGeneric);
+    if (m_options.materialClasses)
+    {
+        const std::chrono::high_resolution_clock::time_point classifyStartTime = std::chrono::high_resolution_clock::now();
+        materialClasses = classifyMaterials(*m_model);
+        printf("Classified %zu materials in %.2f ms\n", materialClasses.size(), getMillisecondsSince(classifyStartTime));
+    }
 
-    for (uint32_t i = 0; i < c_shaderGroupCount; ++i)
+    ShaderBindingTableBuilder builder(limits);
+    builder.addRaygen(c_raygenGroup);
+    builder.addMiss(c_missGroup);
+    builder.addMiss(c_shadowMissGroup);
+    std::array<uint32_t, c_materialClassCount> submeshCounts{};
+    for (size_t i = 0; i < submeshInfos.size(); ++i)
     {
-        memcpy(sbtMemoryMapped, &shaderGroupHandlesBuffer[i * shaderGroupHandleSize], shaderGroupHandleSize);
-        sbtMemoryMapped = (char*)sbtMemoryMapped + shaderGroupBaseAlignment;
+        const uint32_t materialClass = materialClasses[m_model->submeshes[i].material];
+        ++submeshCounts[materialClass];
+        builder.addHit(c_hitGroup + materialClass, &submeshInfos[i], sizeof(submeshInfos[i]));
+        builder.addHit(c_shadowHitGroup, &submeshInfos[i], sizeof(submeshInfos[i]));
     }
+    for (uint32_t materialClass = 0; materialClass < c_materialClassCount; ++materialClass)
+    {
+        if (submeshCounts[materialClass] > 0)
+        {
+            printf("  %u submeshes %s\n", submeshCounts[materialClass], getMaterialClassName(materialClass).c_str());
+        }
+    }
+    const ShaderBindingTable table = builder.build(groupHandles);
 
-    vkUnmapMemory(m_device, m_shaderBindingTableMemory);
+    // The buffer's device address only has the alignment of its memory requirements, so the table starts at the first
+    // multiple of the base alignment in a buffer that is large enough for any start
+    const VkDeviceSize bufferSize = table.data.size() + limits.baseAlignment - 1;
+    const VkBufferUsageFlags usage = VK_BUFFER_USAGE_SHADER_BINDING_TABLE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+    m_shaderBindingTableBuffer = createBuffer(m_device, bufferSize, usage);
+    m_shaderBindingTableMemory = allocateAndBindMemory(m_device, physicalDevice, m_shaderBindingTableBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
 
     VkBufferDeviceAddressInfo shaderBindingTableBufferDeviceAddressInfo{};
     shaderBindingTableBufferDeviceAddressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
@@ -1512,18 +3145,24 @@ void Raytracer::createShaderBindingTable()
     shaderBindingTableBufferDeviceAddressInfo.buffer = m_shaderBindingTableBuffer;
 
     const VkDeviceAddress shaderBindingTableBufferDeviceAddress = m_pvkGetBufferDeviceAddressKHR(m_device, &shaderBindingTableBufferDeviceAddressInfo);
+    const VkDeviceAddress tableDeviceAddress = alignUp(shaderBindingTableBufferDeviceAddress, limits.baseAlignment);
+    const VkDeviceSize tableOffset = tableDeviceAddress - shaderBindingTableBufferDeviceAddress;
 
-    const VkDeviceSize groupSize = c_shaderCount * shaderGroupBaseAlignment;
-
-    m_rchitShaderBindingTable.deviceAddress = shaderBindingTableBufferDeviceAddress + 0 * shaderGroupBaseAlignment;
-    m_rchitShaderBindingTable.stride = shaderGroupBaseAlignment;
-    m_rchitShaderBindingTable.size = groupSize * 1;
-
-    m_rgenShaderBindingTable.deviceAddress = shaderBindingTableBufferDeviceAddress + 1 * shaderGroupBaseAlignment;
-    m_rgenShaderBindingTable.stride = groupSize;
-    m_rgenShaderBindingTable.size = groupSize * 1;
+    void* sbtMemoryMapped;
+    VK_CHECK(vkMapMemory(m_device, m_shaderBindingTableMemory, 0, bufferSize, 0, &sbtMemoryMapped));
+    memcpy(static_cast<uint8_t*>(sbtMemoryMapped) + tableOffset, table.data.data(), table.data.size());
+    vkUnmapMemory(m_device, m_shaderBindingTableMemory);
 
-    m_rmissShaderBindingTable.deviceAddress = shaderBindingTableBufferDeviceAddress + 2 * shaderGroupBaseAlignment;
-    m_rmissShaderBindingTable.stride = shaderGroupBaseAlignment;
-    m_rmissShaderBindingTable.size = groupSize * 2;
+    const auto toRegion = [tableDeviceAddress](const ShaderBindingTableRegion& region) {
+        return VkStridedDeviceAddressRegionKHR{tableDeviceAddress + region.offset, region.stride, region.size};
+    };
+    m_rgenShaderBindingTable = toRegion(table.raygen);
+    m_rmissShaderBindingTable = toRegion(table.miss);
+    m_rchitShaderBindingTable = toRegion(table.hit);
+
+    printf("Shader binding table: %zu hit records with %zu bytes of material data, %llu byte stride, %.2f MB\n",
+           c_rayTypeCount * submeshInfos.size(),
+           sizeof(SubmeshInfo),
+           static_cast<unsigned long long>(table.hit.stride),
+           toMegabytes(table.data.size()));
 }
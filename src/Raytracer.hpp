@@ -3,34 +3,65 @@
 #include "Context.hpp"
 #include "Camera.hpp"
 #include "Model.hpp"
+#include "MeshAssembly.hpp"
+#include "Options.hpp"
+#include "FrameStatistics.hpp"
+#include "TripleBuffer.hpp"
+#include "GpuTimer.hpp"
+#include "Skinning.hpp"
+#include "LightTree.hpp"
+#include "ResolvePass.hpp"
+#include "Denoiser.hpp"
+#include "AdaptiveSampler.hpp"
+#include "Upscaler.hpp"
+#include "SecondaryRayReconstruction.hpp"
+#include "RayQueryRenderer.hpp"
+#include "WavefrontPathTracer.hpp"
+#include <glm/glm.hpp>
 #include <vector>
 #include <chrono>
 #include <unordered_map>
 #include <memory>
+#include <mutex>
+#include <filesystem>
+#include <string>
 
 class Raytracer final
 {
 public:
-    Raytracer(Context& context);
+    Raytracer(Context& context, const Options& options);
     ~Raytracer();
 
+    // Input and camera simulation, must be called from the main thread. Waits up to eventWaitTimeout seconds for input.
+    bool simulate(double eventWaitTimeout);
+    // Command recording and submission, can run on its own thread
     bool render();
 
 private:
-    struct SubmeshIndexInfo
+    // Camera state handed from the simulation to the render thread
+    struct FrameState
     {
-        Model::Index maxVertex;
-        uint32_t triangleCount;
-        uint64_t indexByteOffset;
+        glm::mat4 viewMatrix{1.0f};
+        glm::mat4 projectionMatrix{1.0f};
+        glm::vec3 position{};
+        glm::vec3 forward{};
+        glm::vec3 left{};
+        glm::vec3 up{};
+        Renderer renderer = Renderer::Pipeline;
     };
 
     bool update(uint32_t imageIndex);
+    // The frame times of one renderer
+    FrameStatistics& getRendererFrameStatistics(Renderer renderer);
+    void publishFrameState();
 
     void getFunctionPointers();
+    void queryTextureLimit();
+    void queryAccelerationStructureProperties();
     void loadModel();
     void setupCamera();
     void updateCamera(double deltaTime);
-    void createColorImage();
+    void createRenderTargets();
     void createSwapchainImageViews();
     void createSampler();
     void createTextures();
@@ -41,11 +72,27 @@ private:
     void createMaterialIndexDescriptorSetLayoutAndAllocate();
     void createTexturesDescriptorSetLayoutAndAllocate();
     void createPipeline();
+    void createRayQueryRenderer();
+    void createWavefrontPathTracer();
     void createCommonBuffer();
     void createMaterialIndexBuffer();
+    void createLightBuffers();
     void allocateCommandBuffers();
     void createBLAS();
+    void createBLASes(const std::vector<VkDeviceSize>& sizes, const std::vector<VkDeviceSize>& offsets);
+    VkDeviceSize compactBLAS(const std::vector<VkDeviceSize>& compactedSizes);
+    bool loadBLASFromCache(const std::filesystem::path& path, uint32_t blasCount);
+    void storeBLASInCache(const std::filesystem::path& path);
+    void createBLASScratchArena();
+    uint32_t recordBLASBuilds(VkCommandBuffer commandBuffer, VkBuildAccelerationStructureModeKHR mode);
+    void updateBLAS(VkCommandBuffer commandBuffer, uint32_t slot);
+    bool isAlphaTested(const Model::Submesh& submesh) const;
+    VkDeviceAddress getBufferDeviceAddress(VkBuffer buffer) const;
     void createTLAS();
+    void writeInstances(const std::vector<glm::mat4>& transforms, uint32_t slot);
+    VkAccelerationStructureGeometryKHR getTLASGeometry(uint32_t slot) const;
+    void recordTLASBuild(VkCommandBuffer commandBuffer, uint32_t slot, VkBuildAccelerationStructureModeKHR mode);
+    void updateTLAS(VkCommandBuffer commandBuffer, uint32_t slot, double time);
     void updateCommonDescriptorSets();
     void updateMaterialIndexDescriptorSet();
     void updateTexturesDescriptorSets();
@@ -53,6 +100,12 @@ private:
 
     Context& m_context;
     VkDevice m_device;
+    const Options m_options;
+    // Size of the traced and accumulated images, the window size scaled by the render scale
+    const VkExtent2D m_renderExtent;
+    const std::chrono::high_resolution_clock::time_point m_constructionStartTime;
+    // Guards the graphics queue and command pool while setup tasks run in parallel
+    std::mutex m_gpuMutex;
 
     PFN_vkCreateRayTracingPipelinesKHR m_pvkCreateRayTracingPipelinesKHR;
     PFN_vkGetBufferDeviceAddressKHR m_pvkGetBufferDeviceAddressKHR;
@@ -63,26 +116,65 @@ private:
     PFN_vkGetRayTracingShaderGroupHandlesKHR m_pvkGetRayTracingShaderGroupHandlesKHR;
     PFN_vkCmdTraceRaysKHR m_pvkCmdTraceRaysKHR;
     PFN_vkDestroyAccelerationStructureKHR m_pvkDestroyAccelerationStructureKHR;
+    PFN_vkCmdWriteAccelerationStructuresPropertiesKHR m_pvkCmdWriteAccelerationStructuresPropertiesKHR;
+    PFN_vkCmdCopyAccelerationStructureKHR m_pvkCmdCopyAccelerationStructureKHR;
+    PFN_vkCmdCopyAccelerationStructureToMemoryKHR m_pvkCmdCopyAccelerationStructureToMemoryKHR;
+    PFN_vkCmdCopyMemoryToAccelerationStructureKHR m_pvkCmdCopyMemoryToAccelerationStructureKHR;
+    PFN_vkGetDeviceAccelerationStructureCompatibilityKHR m_pvkGetDeviceAccelerationStructureCompatibilityKHR;
 
     std::unique_ptr<Model> m_model{nullptr};
+    std::vector<glm::mat4> m_instanceTransforms;
+    glm::vec3 m_instanceExtent{0.0f};
+    std::vector<glm::mat4> m_animatedTransforms;
     Camera m_camera;
     std::chrono::steady_clock::time_point m_lastRenderTime;
+    std::chrono::steady_clock::time_point m_lastSimulationTime;
+    TripleBuffer<FrameState> m_frameStates;
     std::unordered_map<int, bool> m_keysDown;
-    VkImage m_colorImage;
-    VkDeviceMemory m_colorImageMemory;
-    VkImageView m_colorImageView;
+    // Cycled with R on the simulation thread, read from the frame state on the render thread
+    Renderer m_renderer = Renderer::Pipeline;
+    Renderer m_frameRenderer = Renderer::Pipeline;
+    // Running average of the samples since the camera or the scene last changed
+    StorageImage m_accumulationImage;
+    uint32_t m_accumulatedSampleCount = 0;
+    glm::mat4 m_accumulationViewMatrix{1.0f};
+    glm::mat4 m_accumulationProjectionMatrix{1.0f};
+    Renderer m_accumulationRenderer = Renderer::Pipeline;
+    // Running averages of the views after the first, layer i is view i + 1
+    StorageImage m_viewImage;
+    // Tonemapped by the resolve pass from the accumulation image, blitted to the swapchain or upscaled first
+    StorageImage m_colorImage;
+    std::unique_ptr<ResolvePass> m_resolvePass;
+    // Replaces the accumulation with spatiotemporal filtering when enabled
+    std::unique_ptr<Denoiser> m_denoiser;
+    // Decides the samples per pixel of the pipeline renderer's accumulation, only with uniform or adaptive sampling
+    std::unique_ptr<AdaptiveSampler> m_adaptiveSampler;
+    // Fills in the shadows and reflections of the pixels without secondary rays, only with half or checkerboard
+    std::unique_ptr<SecondaryRayReconstruction> m_secondaryRayReconstruction;
+    // Upscales the color image to the window when the render scale is below 100
+    std::unique_ptr<Upscaler> m_upscaler;
+    // View projection of the last updated frame, only read by the shaders through the uniform buffer slot of the next
+    glm::mat4 m_previousViewProjection{1.0f};
     std::vector<VkImageView> m_swapchainImageViews;
     VkSampler m_sampler;
     std::vector<VkImage> m_images;
     VkDeviceMemory m_imageMemory;
     std::vector<VkImageView> m_imageViews;
+    uint32_t m_maxTextureCount;
+    VkDeviceSize m_minScratchOffsetAlignment;
     VkDescriptorSetLayout m_commonDescriptorSetLayout;
     VkDescriptorSetLayout m_materialIndexDescriptorSetLayout;
     VkDescriptorSetLayout m_texturesDescriptorSetLayout;
     VkPipelineLayout m_pipelineLayout;
     VkPipeline m_pipeline;
+    // Alternatives to m_pipeline with the same descriptor sets
+    std::unique_ptr<RayQueryRenderer> m_rayQueryRenderer;
+    std::unique_ptr<WavefrontPathTracer> m_wavefrontPathTracer;
+    // Options that affect all renderers, part of their GPU timer names
+    std::string m_timerConfigurationName;
     VkDescriptorPool m_descriptorPool;
-    VkDescriptorSet m_commonDescriptorSet;
+    // Indexed by the swapchain image, each binds that image's slot of the common uniform buffer
+    std::vector<VkDescriptorSet> m_commonDescriptorSets;
     VkDescriptorSet m_materialIndexDescriptorSet;
     VkDescriptorSet m_texturesDescriptorSet;
     VkBuffer m_vertexBuffer;
@@ -92,21 +184,84 @@ private:
     std::vector<SubmeshIndexInfo> m_submeshIndexInfos;
     size_t m_vertexDataSize;
     size_t m_indexDataSize;
+    // Separate position stream for the BLAS builds, not created for PositionFormat::Vertex
+    PositionFormat m_positionFormat = PositionFormat::Float3;
+    VkBuffer m_positionBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_positionBufferMemory = VK_NULL_HANDLE;
+    size_t m_positionDataSize = 0;
+    // Maps the snorm16 positions back to the model bounds
+    VkBuffer m_positionTransformBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_positionTransformMemory = VK_NULL_HANDLE;
+    // Per-triangle records for the closest-hit shader, only created for ShadingData::Baked
+    ShadingData m_shadingData = ShadingData::Vertices;
+    VkBuffer m_shadingDataBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_shadingDataMemory = VK_NULL_HANDLE;
+    uint64_t m_geometryHash = 0;
+    // One uniform buffer slot per swapchain image, mapped for the lifetime of the raytracer
     VkBuffer m_commonBuffer;
     VkDeviceMemory m_commonBufferMemory;
+    uint8_t* m_commonBufferData = nullptr;
+    VkDeviceSize m_commonBufferSlotSize = 0;
+    // Camera of each view of the launch, one slot per swapchain image, mapped for the lifetime of the raytracer
+    VkBuffer m_viewBuffer;
+    VkDeviceMemory m_viewBufferMemory;
+    uint8_t* m_viewBufferData = nullptr;
+    VkDeviceSize m_viewBufferSlotSize = 0;
     VkBuffer m_materialIndexBuffer;
     VkDeviceMemory m_materialIndexBufferMemory;
+    std::vector<Light> m_lights;
+    uint32_t m_lightCount = 0;
+    VkBuffer m_lightBuffer;
+    VkDeviceMemory m_lightBufferMemory;
+    // Nodes of the light BVH over m_lights, built on the CPU when the lights are uploaded
+    VkBuffer m_lightTreeBuffer;
+    VkDeviceMemory m_lightTreeMemory;
 
     VkBuffer m_blasBuffer;
     VkDeviceMemory m_blasMemory;
-    VkAccelerationStructureKHR m_blas;
-    VkDeviceAddress m_blasDeviceAddress;
+    // One BLAS for the whole model or one per submesh, all in the same buffer
+    std::vector<VkAccelerationStructureKHR> m_blases;
+    std::vector<VkDeviceAddress> m_blasDeviceAddresses;
+    std::vector<uint32_t> m_blasFirstSubmeshes;
+    VkBuildAccelerationStructureFlagsKHR m_blasBuildFlags = 0;
+    // Kept after the initial build because skinned BLASes are refitted and rebuilt with them every frame
+    std::vector<VkAccelerationStructureGeometryKHR> m_blasGeometries;
+    std::vector<VkAccelerationStructureBuildRangeInfoKHR> m_blasRangeInfos;
+    std::vector<VkAccelerationStructureBuildGeometryInfoKHR> m_blasBuildInfos;
+    std::vector<const VkAccelerationStructureBuildRangeInfoKHR*> m_blasBuildRangeInfos;
+    std::vector<VkDeviceSize> m_blasScratchSizes;
+    VkBuffer m_blasScratchBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_blasScratchMemory = VK_NULL_HANDLE;
+    VkDeviceAddress m_blasScratchDeviceAddress = 0;
+    VkDeviceSize m_blasScratchArenaSize = 0;
+    uint32_t m_blasRefitsSinceBuild = 0;
+    uint64_t m_blasRefitCount = 0;
+    uint64_t m_blasRebuildCount = 0;
 
-    VkBuffer m_blasGeometryInstanceBuffer;
-    VkDeviceMemory m_blasGeometryInstanceMemory;
+    bool m_skinned = false;
+    // Skins into m_vertexBuffer before the BLAS updates
+    std::unique_ptr<Skinning> m_skinning;
+
+    // Persistently mapped, one slot of instances per frame in flight
+    VkBuffer m_instanceRingBuffer;
+    VkDeviceMemory m_instanceRingMemory;
+    VkAccelerationStructureInstanceKHR* m_instanceRingMapped = nullptr;
+    VkDeviceAddress m_instanceRingDeviceAddress;
+    uint32_t m_tlasInstanceCount = 0;
     VkBuffer m_tlasBuffer;
     VkDeviceMemory m_tlasMemory;
     VkAccelerationStructureKHR m_tlas;
+    VkBuildAccelerationStructureFlagsKHR m_tlasBuildFlags = 0;
+    // Animated instances or skinned BLASes need a TLAS refit every frame
+    bool m_dynamicTlas = false;
+    VkBuffer m_tlasScratchBuffer;
+    VkDeviceMemory m_tlasScratchMemory;
+    VkDeviceAddress m_tlasScratchDeviceAddress;
+    // Instance positions of the last full TLAS build, refits degrade as the instances move away from them
+    std::vector<glm::vec3> m_tlasBuildPositions;
+    uint32_t m_tlasRefitsSinceBuild = 0;
+    uint64_t m_tlasRefitCount = 0;
+    uint64_t m_tlasRebuildCount = 0;
 
     VkBuffer m_shaderBindingTableBuffer;
     VkDeviceMemory m_shaderBindingTableMemory;
@@ -117,4 +272,14 @@ private:
 
     std::vector<VkCommandBuffer> m_commandBuffers;
     float m_fps;
+    bool m_firstFrameSubmitted = false;
+    std::unique_ptr<GpuTimer> m_traceRaysTimer;
+    std::unique_ptr<GpuTimer> m_tlasUpdateTimer;
+    std::unique_ptr<GpuTimer> m_blasRefitTimer;
+    std::unique_ptr<GpuTimer> m_blasRebuildTimer;
+    FrameStatistics m_frameStatistics;
+    // The frames of each renderer on their own, for comparing them after switching at runtime
+    FrameStatistics m_pipelineFrameStatistics{"ray tracing pipeline", false};
+    FrameStatistics m_rayQueryFrameStatistics{"ray query", false};
+    FrameStatistics m_wavefrontFrameStatistics{"wavefront", false};
 };
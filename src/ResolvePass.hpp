@@ -0,0 +1,45 @@
+#pragma once
+
+#include "GpuTimer.hpp"
+#include <vulkan/vulkan.h>
+#include <memory>
+
+// Tonemaps the high precision radiance written by the raytracer into an 8-bit image that can be blitted to the swapchain
+class ResolvePass final
+{
+public:
+    struct InitData
+    {
+        VkDevice device;
+        VkPhysicalDevice physicalDevice;
+        VkExtent2D extent;
+        // RGBA32F input, in VK_IMAGE_LAYOUT_GENERAL
+        VkImageView inputView;
+        // RGBA8 output, in VK_IMAGE_LAYOUT_GENERAL
+        VkImageView outputView;
+        // Where the input is written before the resolve
+        VkPipelineStageFlags producerStageMask;
+        uint32_t slotCount;
+    };
+
+    ResolvePass(const InitData& initData);
+    ~ResolvePass();
+
+    // Records the dispatch with barriers on both sides, afterwards the output can be read by transfers
+    void record(VkCommandBuffer commandBuffer, uint32_t slot);
+
+private:
+    void createPipeline();
+    void createDescriptorSet(VkImageView inputView, VkImageView outputView);
+
+    VkDevice m_device;
+    const VkExtent2D m_extent;
+    const VkPipelineStageFlags m_producerStageMask;
+
+    VkDescriptorSetLayout m_descriptorSetLayout;
+    VkDescriptorPool m_descriptorPool;
+    VkDescriptorSet m_descriptorSet;
+    VkPipelineLayout m_pipelineLayout;
+    VkPipeline m_pipeline;
+    std::unique_ptr<GpuTimer> m_timer;
+};
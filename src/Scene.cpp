@@ -0,0 +1,516 @@
+#include "Scene.hpp"
+#include "Utils.hpp"
+#include <glm/gtx/transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <random>
+#include <chrono>
+#include <cmath>
+
+namespace
+{
+const float c_sponzaScale = 0.01f;
+const float c_proceduralScale = 1.0f;
+const float c_proceduralAreaSize = 20.0f;
+const float c_proceduralAreaHeight = 10.0f;
+const float c_instanceSpacing = 1.1f;
+// Of the instance height
+const float c_animationAmplitude = 0.1f;
+const double c_animationFrequency = 0.5;
+const double c_twoPi = 6.283185307179586;
+const float c_uvRepeat = 4.0f;
+const uint32_t c_tentacleJointCount = 8;
+const uint32_t c_tentacleSideCount = 12;
+const uint32_t c_tentacleKeyCount = 17;
+const float c_tentacleAnimationDuration = 2.0f;
+// Of the tentacle spacing
+const float c_tentacleRadius = 0.1f;
+const float c_tentacleHeight = 2.0f;
+// Per joint, in radians
+const float c_tentacleBendAngle = 0.35f;
+const uint32_t c_imageSize = 64;
+const uint32_t c_checkerSize = 8;
+const float c_lightIntensity = 10.0f;
+const float c_lightRadius = 0.2f;
+const std::array<glm::vec3, 4> c_defaultLightPositions{
+    glm::vec3{6.0f, 6.0f, 0.0f}, //
+    glm::vec3{2.0f, 5.0f, 0.0f}, //
+    glm::vec3{-2.0f, 4.0f, 0.0f}, //
+    glm::vec3{-6.0f, 3.0f, 0.0f} //
+};
+// Random lights keep the total intensity of the default lights per this much floor area
+const float c_lightReferenceArea = c_proceduralAreaSize * c_proceduralAreaSize;
+// Of the bounds, keeps random lights off the walls, floor and ceiling
+const float c_lightBoundsMargin = 0.1f;
+
+// Images shared by all procedural materials, base color images follow these
+enum SharedImage
+{
+    FlatNormal = 0,
+    Dielectric = 1,
+    Metallic = 2,
+    Count = 3
+};
+
+Model::Image createSolidImage(glm::u8vec4 color)
+{
+    Model::Image image;
+    image.width = c_imageSize;
+    image.height = c_imageSize;
+    image.components = 4;
+    image.bitsPerChannel = 8;
+    image.data.resize(c_imageSize * c_imageSize * 4);
+    for (size_t i = 0; i < image.data.size(); i += 4)
+    {
+        image.data[i + 0] = color.r;
+        image.data[i + 1] = color.g;
+        image.data[i + 2] = color.b;
+        image.data[i + 3] = color.a;
+    }
+    return image;
+}
+
+// The dark squares get darkAlpha, 0 cuts them out of alpha masked materials
+Model::Image createCheckerImage(glm::u8vec4 color, uint8_t darkAlpha)
+{
+    Model::Image image = createSolidImage(color);
+    const glm::u8vec4 darkColor(color.r / 2, color.g / 2, color.b / 2, darkAlpha);
+    for (uint32_t y = 0; y < c_imageSize; ++y)
+    {
+        for (uint32_t x = 0; x < c_imageSize; ++x)
+        {
+            if (((x / c_checkerSize) + (y / c_checkerSize)) % 2 == 0)
+            {
+                continue;
+            }
+            const size_t offset = (y * c_imageSize + x) * 4;
+            image.data[offset + 0] = darkColor.r;
+            image.data[offset + 1] = darkColor.g;
+            image.data[offset + 2] = darkColor.b;
+            image.data[offset + 3] = darkColor.a;
+        }
+    }
+    return image;
+}
+
+void createMaterials(Model& model, uint32_t textureCount, std::mt19937& generator)
+{
+    std::uniform_int_distribution<int> colorDistribution(64, 255);
+
+    model.images.resize(SharedImage::Count);
+    model.images[SharedImage::FlatNormal] = createSolidImage({128, 128, 255, 255});
+    model.images[SharedImage::Dielectric] = createSolidImage({0, 255, 0, 255});
+    model.images[SharedImage::Metallic] = createSolidImage({0, 64, 255, 255});
+
+    const uint32_t materialCount = std::max(textureCount, 1u);
+    model.materials.resize(materialCount);
+    for (uint32_t i = 0; i < materialCount; ++i)
+    {
+        // Every fourth material is alpha masked so that the any-hit path gets exercised
+        const bool alphaMasked = i % 4 == 1;
+        const glm::u8vec4 color(colorDistribution(generator), colorDistribution(generator), colorDistribution(generator), 255);
+        model.images.push_back(createCheckerImage(color, alphaMasked ? 0 : 255));
+
+        Model::Material& material = model.materials[i];
+        material.alphaMode = alphaMasked ? Model::AlphaMode::Mask : Model::AlphaMode::Opaque;
+        material.baseColor = static_cast<int>(model.images.size()) - 1;
+        material.normalImage = SharedImage::FlatNormal;
+        // Every fourth material is reflective so that the reflection path gets exercised as well
+        material.metallicRoughnessImage = i % 4 == 3 ? SharedImage::Metallic : SharedImage::Dielectric;
+    }
+}
+
+// Heightfield patch on the XZ-plane made of quadsPerSide^2 quads, two triangles each
+void appendPatch(Model::Submesh& submesh, const glm::vec3& origin, float size, uint32_t quadsPerSide, float frequency, float amplitude)
+{
+    const Model::Index firstVertex = static_cast<Model::Index>(submesh.vertices.size());
+    const uint32_t verticesPerSide = quadsPerSide + 1;
+
+    submesh.vertices.reserve(submesh.vertices.size() + verticesPerSide * verticesPerSide);
+    for (uint32_t z = 0; z < verticesPerSide; ++z)
+    {
+        for (uint32_t x = 0; x < verticesPerSide; ++x)
+        {
+            const float u = static_cast<float>(x) / quadsPerSide;
+            const float v = static_cast<float>(z) / quadsPerSide;
+            const float px = origin.x + u * size;
+            const float pz = origin.z + v * size;
+            const float height = amplitude * std::sin(px * frequency) * std::cos(pz * frequency);
+            const float dhdx = amplitude * frequency * std::cos(px * frequency) * std::cos(pz * frequency);
+            const float dhdz = -amplitude * frequency * std::sin(px * frequency) * std::sin(pz * frequency);
+
+            Model::Vertex vertex;
+            vertex.position = glm::vec4(px, origin.y + height, pz, 1.0f);
+            vertex.normal = glm::vec4(glm::normalize(glm::vec3(-dhdx, 1.0f, -dhdz)), 0.0f);
+            vertex.uv = glm::vec4(u * c_uvRepeat, v * c_uvRepeat, 0.0f, 0.0f);
+            vertex.tangent = glm::vec4(glm::normalize(glm::vec3(1.0f, dhdx, 0.0f)), 1.0f);
+            submesh.vertices.push_back(vertex);
+        }
+    }
+
+    submesh.indices.reserve(submesh.indices.size() + quadsPerSide * quadsPerSide * 6);
+    for (uint32_t z = 0; z < quadsPerSide; ++z)
+    {
+        for (uint32_t x = 0; x < quadsPerSide; ++x)
+        {
+            const Model::Index a = firstVertex + z * verticesPerSide + x;
+            const Model::Index b = a + 1;
+            const Model::Index c = a + verticesPerSide;
+            const Model::Index d = c + 1;
+            submesh.indices.insert(submesh.indices.end(), {a, c, b, b, c, d});
+        }
+    }
+}
+
+uint32_t getQuadsPerSide(uint64_t triangleCount)
+{
+    const double quadCount = static_cast<double>(triangleCount) / 2.0;
+    return std::max(1u, static_cast<uint32_t>(std::round(std::sqrt(quadCount))));
+}
+
+std::unique_ptr<Model> createHugeMesh(const SceneParameters& parameters, std::mt19937& generator)
+{
+    std::unique_ptr<Model> model(new Model());
+    createMaterials(*model, parameters.textureCount, generator);
+
+    model->submeshes.resize(1);
+    model->submeshes[0].material = 0;
+    const glm::vec3 origin{-c_proceduralAreaSize * 0.5f, 0.0f, -c_proceduralAreaSize * 0.5f};
+    appendPatch(model->submeshes[0], origin, c_proceduralAreaSize, getQuadsPerSide(parameters.triangleCount), 1.0f, 0.5f);
+    return model;
+}
+
+std::unique_ptr<Model> createSmallMeshes(const SceneParameters& parameters, std::mt19937& generator)
+{
+    std::unique_ptr<Model> model(new Model());
+    createMaterials(*model, parameters.textureCount, generator);
+
+    const uint32_t meshCount = std::max(parameters.meshCount, 1u);
+    const uint64_t trianglesPerMesh = std::max<uint64_t>(parameters.triangleCount / meshCount, 2);
+    const uint32_t quadsPerSide = getQuadsPerSide(trianglesPerMesh);
+    const uint32_t meshesPerSide = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(meshCount))));
+    const float cellSize = c_proceduralAreaSize / meshesPerSide;
+    std::uniform_real_distribution<float> heightDistribution(0.0f, c_proceduralAreaHeight);
+
+    model->submeshes.resize(meshCount);
+    for (uint32_t i = 0; i < meshCount; ++i)
+    {
+        Model::Submesh& submesh = model->submeshes[i];
+        submesh.material = static_cast<int>(i % model->materials.size());
+
+        const glm::vec3 origin{
+            -c_proceduralAreaSize * 0.5f + (i % meshesPerSide) * cellSize, //
+            heightDistribution(generator), //
+            -c_proceduralAreaSize * 0.5f + (i / meshesPerSide) * cellSize //
+        };
+        appendPatch(submesh, origin, cellSize * 0.8f, quadsPerSide, 4.0f / cellSize, cellSize * 0.1f);
+    }
+    return model;
+}
+
+std::unique_ptr<Model> createTriangleSoup(const SceneParameters& parameters, std::mt19937& generator)
+{
+    std::unique_ptr<Model> model(new Model());
+    createMaterials(*model, parameters.textureCount, generator);
+
+    const uint64_t triangleCount = std::max<uint64_t>(parameters.triangleCount, 1);
+    const float halfSize = c_proceduralAreaSize * 0.5f;
+    const float triangleSize = 1.5f * c_proceduralAreaSize / static_cast<float>(std::cbrt(static_cast<double>(triangleCount)));
+    std::uniform_real_distribution<float> xzDistribution(-halfSize, halfSize);
+    std::uniform_real_distribution<float> yDistribution(0.0f, c_proceduralAreaHeight);
+    std::uniform_real_distribution<float> offsetDistribution(-triangleSize, triangleSize);
+
+    // One submesh per material so that the texture count matters for the soup as well
+    const size_t submeshCount = model->materials.size();
+    model->submeshes.resize(submeshCount);
+    for (size_t i = 0; i < submeshCount; ++i)
+    {
+        Model::Submesh& submesh = model->submeshes[i];
+        submesh.material = static_cast<int>(i);
+
+        const uint64_t submeshTriangleCount = triangleCount / submeshCount + (i < triangleCount % submeshCount ? 1 : 0);
+        submesh.vertices.reserve(submeshTriangleCount * 3);
+        submesh.indices.reserve(submeshTriangleCount * 3);
+
+        for (uint64_t t = 0; t < submeshTriangleCount; ++t)
+        {
+            const glm::vec3 center{xzDistribution(generator), yDistribution(generator), xzDistribution(generator)};
+            std::array<glm::vec3, 3> positions;
+            for (glm::vec3& position : positions)
+            {
+                position = center + glm::vec3{offsetDistribution(generator), offsetDistribution(generator), offsetDistribution(generator)};
+            }
+
+            const glm::vec3 edge0 = positions[1] - positions[0];
+            const glm::vec3 edge1 = positions[2] - positions[0];
+            const glm::vec3 crossProduct = glm::cross(edge0, edge1);
+            const glm::vec3 normal = glm::length(crossProduct) > 0.0f ? glm::normalize(crossProduct) : c_up;
+            const glm::vec3 tangent = glm::length(edge0) > 0.0f ? glm::normalize(edge0) : c_right;
+            const std::array<glm::vec2, 3> uvs{glm::vec2{0.0f, 0.0f}, glm::vec2{1.0f, 0.0f}, glm::vec2{0.0f, 1.0f}};
+
+            for (size_t v = 0; v < positions.size(); ++v)
+            {
+                Model::Vertex vertex;
+                vertex.position = glm::vec4(positions[v], 1.0f);
+                vertex.normal = glm::vec4(normal, 0.0f);
+                vertex.uv = glm::vec4(uvs[v], 0.0f, 0.0f);
+                vertex.tangent = glm::vec4(tangent, 1.0f);
+                submesh.indices.push_back(static_cast<Model::Index>(submesh.vertices.size()));
+                submesh.vertices.push_back(vertex);
+            }
+        }
+    }
+    return model;
+}
+
+// Tubes standing on the XZ-plane, each bent by a chain of joints that sways back and forth
+std::unique_ptr<Model> createTentacles(const SceneParameters& parameters, std::mt19937& generator)
+{
+    std::unique_ptr<Model> model(new Model());
+    createMaterials(*model, parameters.textureCount, generator);
+
+    const uint32_t tentacleCount = std::max(parameters.meshCount, 1u);
+    const uint64_t trianglesPerTentacle = std::max<uint64_t>(parameters.triangleCount / tentacleCount, 2 * c_tentacleSideCount);
+    const uint32_t ringCount = static_cast<uint32_t>(std::max<uint64_t>(trianglesPerTentacle / (2 * c_tentacleSideCount), 1));
+    const uint32_t tentaclesPerSide = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(tentacleCount))));
+    const float cellSize = c_proceduralAreaSize / tentaclesPerSide;
+    const float radius = c_tentacleRadius * cellSize;
+    const float height = c_tentacleHeight * cellSize;
+    const float segmentLength = height / (c_tentacleJointCount - 1);
+    std::uniform_real_distribution<float> phaseDistribution(0.0f, static_cast<float>(c_twoPi));
+
+    Model::Skeleton& skeleton = model->skeleton;
+    Model::Animation animation;
+    animation.duration = c_tentacleAnimationDuration;
+
+    model->submeshes.resize(tentacleCount);
+    for (uint32_t i = 0; i < tentacleCount; ++i)
+    {
+        const glm::vec3 origin{
+            -c_proceduralAreaSize * 0.5f + (static_cast<float>(i % tentaclesPerSide) + 0.5f) * cellSize, //
+            0.0f, //
+            -c_proceduralAreaSize * 0.5f + (static_cast<float>(i / tentaclesPerSide) + 0.5f) * cellSize //
+        };
+        const uint32_t firstJoint = ui32Size(skeleton.nodes);
+
+        // Joint chain from the base to the tip, parents are added before their children
+        for (uint32_t j = 0; j < c_tentacleJointCount; ++j)
+        {
+            Model::Node node;
+            node.parent = j == 0 ? -1 : static_cast<int>(firstJoint + j - 1);
+            node.translation = j == 0 ? origin : glm::vec3(0.0f, segmentLength, 0.0f);
+            skeleton.nodeOrder.push_back(static_cast<int>(skeleton.nodes.size()));
+            skeleton.joints.push_back(static_cast<int>(skeleton.nodes.size()));
+            skeleton.inverseBindMatrices.push_back(glm::translate(-(origin + glm::vec3(0.0f, segmentLength * j, 0.0f))));
+            skeleton.nodes.push_back(node);
+        }
+
+        // Every joint above the base bends around the same random horizontal axis with a delay along the chain
+        const float axisAngle = phaseDistribution(generator);
+        const glm::vec3 bendAxis{std::cos(axisAngle), 0.0f, std::sin(axisAngle)};
+        const float phase = phaseDistribution(generator);
+        for (uint32_t j = 1; j < c_tentacleJointCount; ++j)
+        {
+            Model::AnimationChannel channel;
+            channel.node = static_cast<int>(firstJoint + j);
+            channel.path = Model::AnimationPath::Rotation;
+            for (uint32_t k = 0; k < c_tentacleKeyCount; ++k)
+            {
+                const float time = c_tentacleAnimationDuration * k / (c_tentacleKeyCount - 1);
+                const float angle = c_tentacleBendAngle * std::sin(static_cast<float>(c_twoPi) * time / c_tentacleAnimationDuration + phase - 0.5f * j);
+                const glm::quat rotation = glm::angleAxis(angle, bendAxis);
+                channel.times.push_back(time);
+                channel.values.push_back(glm::vec4(rotation.x, rotation.y, rotation.z, rotation.w));
+            }
+            animation.channels.push_back(std::move(channel));
+        }
+
+        Model::Submesh& submesh = model->submeshes[i];
+        submesh.material = static_cast<int>(i % model->materials.size());
+        submesh.vertices.reserve((ringCount + 1) * (c_tentacleSideCount + 1));
+        submesh.skinVertices.reserve((ringCount + 1) * (c_tentacleSideCount + 1));
+        for (uint32_t ring = 0; ring <= ringCount; ++ring)
+        {
+            const float y = height * ring / ringCount;
+            const uint32_t segment = std::min(static_cast<uint32_t>(y / segmentLength), c_tentacleJointCount - 2);
+            const float blend = std::min(y / segmentLength - segment, 1.0f);
+
+            Model::SkinVertex skinVertex;
+            skinVertex.joints = glm::uvec4(firstJoint + segment, firstJoint + segment + 1, firstJoint, firstJoint);
+            skinVertex.weights = glm::vec4(1.0f - blend, blend, 0.0f, 0.0f);
+
+            for (uint32_t side = 0; side <= c_tentacleSideCount; ++side)
+            {
+                const float angle = static_cast<float>(c_twoPi) * side / c_tentacleSideCount;
+                const glm::vec3 normal{std::cos(angle), 0.0f, std::sin(angle)};
+
+                Model::Vertex vertex;
+                vertex.position = glm::vec4(origin + normal * radius + glm::vec3(0.0f, y, 0.0f), 1.0f);
+                vertex.normal = glm::vec4(normal, 0.0f);
+                vertex.uv = glm::vec4(static_cast<float>(side) / c_tentacleSideCount, y / height * c_uvRepeat, 0.0f, 0.0f);
+                vertex.tangent = glm::vec4(-normal.z, 0.0f, normal.x, 1.0f);
+                submesh.vertices.push_back(vertex);
+                submesh.skinVertices.push_back(skinVertex);
+            }
+        }
+
+        submesh.indices.reserve(ringCount * c_tentacleSideCount * 6);
+        for (uint32_t ring = 0; ring < ringCount; ++ring)
+        {
+            for (uint32_t side = 0; side < c_tentacleSideCount; ++side)
+            {
+                const Model::Index a = ring * (c_tentacleSideCount + 1) + side;
+                const Model::Index b = a + 1;
+                const Model::Index c = a + c_tentacleSideCount + 1;
+                const Model::Index d = c + 1;
+                submesh.indices.insert(submesh.indices.end(), {a, c, b, b, c, d});
+            }
+        }
+    }
+
+    skeleton.animations.push_back(std::move(animation));
+    return model;
+}
+
+void createInstanceGrid(const Model& model, uint32_t instanceCount, float scale, Scene& scene)
+{
+    glm::vec3 boundsMin{std::numeric_limits<float>::max()};
+    glm::vec3 boundsMax{std::numeric_limits<float>::lowest()};
+    for (const Model::Submesh& submesh : model.submeshes)
+    {
+        for (const Model::Vertex& vertex : submesh.vertices)
+        {
+            boundsMin = glm::min(boundsMin, glm::vec3(vertex.position));
+            boundsMax = glm::max(boundsMax, glm::vec3(vertex.position));
+        }
+    }
+
+    scene.instanceExtent = (boundsMax - boundsMin) * scale;
+    const glm::vec3 spacing = scene.instanceExtent * c_instanceSpacing;
+    const uint32_t instancesPerSide = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(instanceCount))));
+
+    scene.instanceTransforms.resize(instanceCount);
+    glm::vec3 lastTranslation{0.0f};
+    for (uint32_t i = 0; i < instanceCount; ++i)
+    {
+        const glm::vec3 translation{(i % instancesPerSide) * spacing.x, 0.0f, (i / instancesPerSide) * spacing.z};
+        scene.instanceTransforms[i] = glm::translate(translation) * glm::scale(glm::vec3(scale));
+        lastTranslation = glm::max(lastTranslation, translation);
+    }
+    scene.boundsMin = boundsMin * scale;
+    scene.boundsMax = boundsMax * scale + lastTranslation;
+}
+
+const char* getSceneModelName(SceneModel sceneModel)
+{
+    switch (sceneModel)
+    {
+    case SceneModel::Sponza: return "sponza";
+    case SceneModel::TriangleSoup: return "soup";
+    case SceneModel::SmallMeshes: return "small-meshes";
+    case SceneModel::HugeMesh: return "huge-mesh";
+    case SceneModel::Tentacles: return "tentacles";
+    }
+    return "unknown";
+}
+} // namespace
+
+Scene createScene(const SceneParameters& parameters)
+{
+    const std::chrono::high_resolution_clock::time_point startTime = std::chrono::high_resolution_clock::now();
+    std::mt19937 generator(parameters.seed);
+
+    Scene scene;
+    float scale = c_proceduralScale;
+    switch (parameters.model)
+    {
+    case SceneModel::Sponza:
+        scene.model.reset(new Model("sponza/Sponza.gltf"));
+        scale = c_sponzaScale;
+        break;
+    case SceneModel::TriangleSoup:
+        scene.model = createTriangleSoup(parameters, generator);
+        break;
+    case SceneModel::SmallMeshes:
+        scene.model = createSmallMeshes(parameters, generator);
+        break;
+    case SceneModel::HugeMesh:
+        scene.model = createHugeMesh(parameters, generator);
+        break;
+    case SceneModel::Tentacles:
+        scene.model = createTentacles(parameters, generator);
+        break;
+    }
+
+    Model& model = *scene.model;
+    model.updateBufferSizes();
+    createInstanceGrid(model, std::max(parameters.instanceCount, 1u), scale, scene);
+    scene.lights = createLights(parameters.lightCount, scene.boundsMin, scene.boundsMax, parameters.seed);
+
+    uint64_t triangleCount = 0;
+    for (const Model::Submesh& submesh : model.submeshes)
+    {
+        triangleCount += submesh.indices.size() / 3;
+    }
+
+    printf("Scene %s: %zu submeshes, %llu triangles, %zu joints, %zu images, %zu instances (%llu instanced triangles), %zu lights, %.1f MB geometry, created in %.1f ms\n",
+           getSceneModelName(parameters.model),
+           model.submeshes.size(),
+           static_cast<unsigned long long>(triangleCount),
+           model.skeleton.joints.size(),
+           model.images.size(),
+           scene.instanceTransforms.size(),
+           static_cast<unsigned long long>(triangleCount * scene.instanceTransforms.size()),
+           scene.lights.size(),
+           toMegabytes(model.vertexBufferSizeInBytes + model.indexBufferSizeInBytes),
+           getMillisecondsSince(startTime));
+
+    return scene;
+}
+
+std::vector<Light> createLights(uint32_t lightCount, const glm::vec3& boundsMin, const glm::vec3& boundsMax, uint32_t seed)
+{
+    std::vector<Light> lights(lightCount);
+    if (lightCount <= c_defaultLightPositions.size())
+    {
+        for (uint32_t i = 0; i < lightCount; ++i)
+        {
+            lights[i].position = c_defaultLightPositions[i];
+            lights[i].intensity = c_lightIntensity;
+            lights[i].radius = c_lightRadius;
+        }
+        return lights;
+    }
+
+    const glm::vec3 margin = c_lightBoundsMargin * (boundsMax - boundsMin);
+    const glm::vec3 lightMin = boundsMin + margin;
+    const glm::vec3 lightMax = boundsMax - margin;
+    const float floorArea = std::max((boundsMax.x - boundsMin.x) * (boundsMax.z - boundsMin.z), c_lightReferenceArea);
+    const float intensity = c_lightIntensity * static_cast<float>(c_defaultLightPositions.size()) * floorArea / (c_lightReferenceArea * static_cast<float>(lightCount));
+
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<float> unitDistribution(0.0f, 1.0f);
+    std::uniform_real_distribution<float> colorDistribution(0.5f, 1.0f);
+    for (Light& light : lights)
+    {
+        const glm::vec3 t{unitDistribution(generator), unitDistribution(generator), unitDistribution(generator)};
+        light.position = lightMin + t * (lightMax - lightMin);
+        light.intensity = intensity;
+        light.radius = c_lightRadius;
+        light.color = glm::vec3(colorDistribution(generator), colorDistribution(generator), colorDistribution(generator));
+    }
+    return lights;
+}
+
+void animateInstances(const std::vector<glm::mat4>& baseTransforms, glm::vec3 instanceExtent, double time, std::vector<glm::mat4>& transforms)
+{
+    transforms.resize(baseTransforms.size());
+    const float amplitude = c_animationAmplitude * instanceExtent.y;
+    for (size_t i = 0; i < baseTransforms.size(); ++i)
+    {
+        const double phase = c_twoPi * (c_animationFrequency * time + 0.1 * static_cast<double>(i));
+        transforms[i] = glm::translate(glm::vec3(0.0f, amplitude * static_cast<float>(std::sin(phase)), 0.0f)) * baseTransforms[i];
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Model.hpp"
+#include "LightTree.hpp"
+#include <glm/glm.hpp>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+enum class SceneModel
+{
+    Sponza,
+    TriangleSoup,
+    SmallMeshes,
+    HugeMesh,
+    // Skinned and animated tubes, one mesh with its own joint chain each
+    Tentacles
+};
+
+struct SceneParameters
+{
+    SceneModel model = SceneModel::Sponza;
+    // Instances of the model are laid out in a grid on the XZ-plane
+    uint32_t instanceCount = 1;
+    // Total triangle count of one procedural model, split evenly between meshes for SmallMeshes and Tentacles
+    uint64_t triangleCount = 1'000'000;
+    uint32_t meshCount = 1'000;
+    uint32_t textureCount = 8;
+    // Up to four lights use the fixed default positions, more are scattered randomly over the scene bounds
+    uint32_t lightCount = 4;
+    uint32_t seed = 1;
+};
+
+struct Scene
+{
+    std::unique_ptr<Model> model;
+    std::vector<glm::mat4> instanceTransforms;
+    // World space bounds size of one instance
+    glm::vec3 instanceExtent{0.0f};
+    // World space bounds of all instances
+    glm::vec3 boundsMin{0.0f};
+    glm::vec3 boundsMax{0.0f};
+    std::vector<Light> lights;
+};
+
+Scene createScene(const SceneParameters& parameters);
+std::vector<Light> createLights(uint32_t lightCount, const glm::vec3& boundsMin, const glm::vec3& boundsMax, uint32_t seed);
+// Moves each instance up and down with its own phase, for exercising dynamic TLAS updates
+void animateInstances(const std::vector<glm::mat4>& baseTransforms, glm::vec3 instanceExtent, double time, std::vector<glm::mat4>& transforms);
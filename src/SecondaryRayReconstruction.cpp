@@ -0,0 +1,180 @@
+#include "SecondaryRayReconstruction.hpp"
+#include "DebugMarker.hpp"
+#include "Utils.hpp"
+#include <array>
+
+namespace
+{
+// Same as local_size_x and local_size_y in secondary_reconstruct.comp
+const uint32_t c_workGroupSize = 8;
+const VkFormat c_radianceFormat = VK_FORMAT_R32G32B32A32_SFLOAT;
+const VkFormat c_normalDepthFormat = VK_FORMAT_R32G32B32A32_SFLOAT;
+const VkFormat c_albedoFormat = VK_FORMAT_R8G8B8A8_UNORM;
+// Radiance, normal and depth, albedo and accumulation
+const uint32_t c_bindingCount = 4;
+
+struct PushConstants
+{
+    uint32_t sampleIndex;
+};
+} // namespace
+
+SecondaryRayReconstruction::SecondaryRayReconstruction(const InitData& initData) :
+    m_device(initData.device),
+    m_extent(initData.extent)
+{
+    m_radiance = createStorageImage(m_device, initData.physicalDevice, initData.commandPool, initData.queue, m_extent, c_radianceFormat, VK_IMAGE_USAGE_STORAGE_BIT, "Secondary radiance");
+    m_normalDepth = createStorageImage(m_device, initData.physicalDevice, initData.commandPool, initData.queue, m_extent, c_normalDepthFormat, VK_IMAGE_USAGE_STORAGE_BIT, "Secondary normal depth");
+    m_albedo = createStorageImage(m_device, initData.physicalDevice, initData.commandPool, initData.queue, m_extent, c_albedoFormat, VK_IMAGE_USAGE_STORAGE_BIT, "Secondary albedo");
+
+    createPipeline();
+    createDescriptorSet(initData.accumulationView);
+
+    m_timer = std::make_unique<GpuTimer>("secondary reconstruction", m_device, initData.physicalDevice, initData.slotCount);
+    m_timer->setItemCount(static_cast<uint64_t>(m_extent.width) * m_extent.height, "pixel");
+}
+
+SecondaryRayReconstruction::~SecondaryRayReconstruction()
+{
+    m_timer.reset();
+
+    vkDestroyPipeline(m_device, m_pipeline, nullptr);
+    vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+    vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, nullptr);
+
+    destroyStorageImage(m_device, m_albedo);
+    destroyStorageImage(m_device, m_normalDepth);
+    destroyStorageImage(m_device, m_radiance);
+}
+
+void SecondaryRayReconstruction::record(VkCommandBuffer commandBuffer, uint32_t slot, uint32_t sampleIndex)
+{
+    DebugMarker::beginLabel(commandBuffer, "Secondary reconstruction", DebugMarker::green);
+
+    // The ray generation shader has written the images and the previous frame's resolve may still read the accumulation
+    VkMemoryBarrier inputBarrier{};
+    inputBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    inputBarrier.pNext = NULL;
+    inputBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    inputBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    const VkPipelineStageFlags inputStageMask = VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    vkCmdPipelineBarrier(commandBuffer, inputStageMask, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &inputBarrier, 0, nullptr, 0, nullptr);
+
+    m_timer->begin(commandBuffer, slot);
+
+    const PushConstants pushConstants{sampleIndex};
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+    vkCmdDispatch(commandBuffer, (m_extent.width + c_workGroupSize - 1) / c_workGroupSize, (m_extent.height + c_workGroupSize - 1) / c_workGroupSize, 1);
+
+    m_timer->end(commandBuffer, slot);
+
+    DebugMarker::endLabel(commandBuffer);
+}
+
+void SecondaryRayReconstruction::createPipeline()
+{
+    std::array<VkDescriptorSetLayoutBinding, c_bindingCount> bindings{};
+    for (uint32_t i = 0; i < ui32Size(bindings); ++i)
+    {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        bindings[i].pImmutableSamplers = nullptr;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = ui32Size(bindings);
+    layoutInfo.pBindings = bindings.data();
+
+    VK_CHECK(vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &m_descriptorSetLayout));
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, m_descriptorSetLayout, "Desc set layout - Secondary reconstruction");
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(PushConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    VK_CHECK(vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_pipelineLayout));
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_PIPELINE_LAYOUT, m_pipelineLayout, "Pipeline layout - Secondary reconstruction");
+
+    VkShaderModule shaderModule = createShaderModule(m_device, getCurrentExecutableDirectory() / "secondary_reconstruct.comp.spv");
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.pNext = NULL;
+    pipelineInfo.flags = 0;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.pNext = NULL;
+    pipelineInfo.stage.flags = 0;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.stage.pSpecializationInfo = NULL;
+    pipelineInfo.layout = m_pipelineLayout;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineInfo.basePipelineIndex = 0;
+
+    VK_CHECK(vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_pipeline));
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_PIPELINE, m_pipeline, "Pipeline - Secondary reconstruction");
+
+    vkDestroyShaderModule(m_device, shaderModule, nullptr);
+}
+
+void SecondaryRayReconstruction::createDescriptorSet(VkImageView accumulationView)
+{
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSize.descriptorCount = c_bindingCount;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    poolInfo.maxSets = 1;
+
+    VK_CHECK(vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &m_descriptorPool));
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_DESCRIPTOR_POOL, m_descriptorPool, "Descriptor pool - Secondary reconstruction");
+
+    VkDescriptorSetAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocateInfo.pNext = NULL;
+    allocateInfo.descriptorPool = m_descriptorPool;
+    allocateInfo.descriptorSetCount = 1;
+    allocateInfo.pSetLayouts = &m_descriptorSetLayout;
+
+    VK_CHECK(vkAllocateDescriptorSets(m_device, &allocateInfo, &m_descriptorSet));
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_DESCRIPTOR_SET, m_descriptorSet, "Desc set - Secondary reconstruction");
+
+    std::array<VkDescriptorImageInfo, c_bindingCount> imageInfos{};
+    imageInfos[0] = {VK_NULL_HANDLE, m_radiance.view, VK_IMAGE_LAYOUT_GENERAL};
+    imageInfos[1] = {VK_NULL_HANDLE, m_normalDepth.view, VK_IMAGE_LAYOUT_GENERAL};
+    imageInfos[2] = {VK_NULL_HANDLE, m_albedo.view, VK_IMAGE_LAYOUT_GENERAL};
+    imageInfos[3] = {VK_NULL_HANDLE, accumulationView, VK_IMAGE_LAYOUT_GENERAL};
+
+    std::array<VkWriteDescriptorSet, c_bindingCount> descriptorWrites{};
+    for (uint32_t i = 0; i < ui32Size(descriptorWrites); ++i)
+    {
+        descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[i].pNext = NULL;
+        descriptorWrites[i].dstSet = m_descriptorSet;
+        descriptorWrites[i].dstBinding = i;
+        descriptorWrites[i].dstArrayElement = 0;
+        descriptorWrites[i].descriptorCount = 1;
+        descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        descriptorWrites[i].pImageInfo = &imageInfos[i];
+    }
+
+    vkUpdateDescriptorSets(m_device, ui32Size(descriptorWrites), descriptorWrites.data(), 0, nullptr);
+}
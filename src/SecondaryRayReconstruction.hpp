@@ -0,0 +1,61 @@
+#pragma once
+
+#include "GpuTimer.hpp"
+#include "VulkanUtils.hpp"
+#include <vulkan/vulkan.h>
+#include <memory>
+
+// Reconstructs the shadows and reflections of the pixels that only trace primary rays. With half or checkerboard
+// secondary rays, the ray generation shader traces every primary ray but only a rotating subset of the pixels shade
+// their hits with shadow and reflection rays. It writes the radiance, the primary surface and its albedo into the
+// images of this class instead of accumulating. A compute pass then fills in the other pixels from the lighting of
+// their traced neighbors on the same surface and averages the frame into the accumulation image.
+class SecondaryRayReconstruction final
+{
+public:
+    struct InitData
+    {
+        VkDevice device;
+        VkPhysicalDevice physicalDevice;
+        // Used for creating the images, must not be in use by other threads during construction
+        VkCommandPool commandPool;
+        VkQueue queue;
+        VkExtent2D extent;
+        // RGBA32F running average, in VK_IMAGE_LAYOUT_GENERAL
+        VkImageView accumulationView;
+        uint32_t slotCount;
+    };
+
+    SecondaryRayReconstruction(const InitData& initData);
+    ~SecondaryRayReconstruction();
+
+    // RGBA32F radiance of the frame, alpha is 0 where the primary hit traced no secondary rays
+    VkImageView getRadianceView() const { return m_radiance.view; }
+    // RGBA32F normal and hit distance of the primary hit, negative on a miss
+    VkImageView getNormalDepthView() const { return m_normalDepth.view; }
+    // RGBA8 albedo of the primary hit
+    VkImageView getAlbedoView() const { return m_albedo.view; }
+
+    // Records the reconstruction with a barrier after the ray generation shader, which must have written the images.
+    // Afterwards the accumulation image has been written by a compute shader. sampleIndex is the one of the uniform
+    // buffer, 0 restarts the accumulation.
+    void record(VkCommandBuffer commandBuffer, uint32_t slot, uint32_t sampleIndex);
+
+private:
+    void createPipeline();
+    void createDescriptorSet(VkImageView accumulationView);
+
+    VkDevice m_device;
+    const VkExtent2D m_extent;
+
+    StorageImage m_radiance;
+    StorageImage m_normalDepth;
+    StorageImage m_albedo;
+
+    VkDescriptorSetLayout m_descriptorSetLayout;
+    VkDescriptorPool m_descriptorPool;
+    VkDescriptorSet m_descriptorSet;
+    VkPipelineLayout m_pipelineLayout;
+    VkPipeline m_pipeline;
+    std::unique_ptr<GpuTimer> m_timer;
+};
@@ -0,0 +1,96 @@
+#include "ShaderBindingTable.hpp"
+#include "Utils.hpp"
+#include <algorithm>
+#include <cstring>
+
+ShaderBindingTableBuilder::ShaderBindingTableBuilder(const Limits& limits) :
+    m_limits(limits)
+{
+    CHECK(m_limits.handleSize > 0);
+    CHECK(m_limits.handleAlignment > 0 && m_limits.baseAlignment % m_limits.handleAlignment == 0);
+}
+
+void ShaderBindingTableBuilder::addRaygen(uint32_t group, const void* data, size_t dataSize)
+{
+    addRecord(m_raygenRecords, group, data, dataSize);
+}
+
+void ShaderBindingTableBuilder::addMiss(uint32_t group, const void* data, size_t dataSize)
+{
+    addRecord(m_missRecords, group, data, dataSize);
+}
+
+void ShaderBindingTableBuilder::addHit(uint32_t group, const void* data, size_t dataSize)
+{
+    addRecord(m_hitRecords, group, data, dataSize);
+}
+
+ShaderBindingTable ShaderBindingTableBuilder::build(const std::vector<uint8_t>& groupHandles) const
+{
+    CHECK(m_raygenRecords.size() == 1);
+
+    ShaderBindingTable table;
+
+    // The raygen region has exactly one record, its size must equal the stride
+    table.raygen.offset = 0;
+    table.raygen.stride = getStride(m_raygenRecords);
+    table.raygen.size = table.raygen.stride;
+
+    table.miss.offset = alignUp(table.raygen.offset + table.raygen.size, m_limits.baseAlignment);
+    table.miss.stride = getStride(m_missRecords);
+    table.miss.size = table.miss.stride * m_missRecords.size();
+
+    table.hit.offset = alignUp(table.miss.offset + table.miss.size, m_limits.baseAlignment);
+    table.hit.stride = getStride(m_hitRecords);
+    table.hit.size = table.hit.stride * m_hitRecords.size();
+
+    table.data.resize(table.hit.offset + table.hit.size, 0);
+    writeRegion(m_raygenRecords, groupHandles, table.raygen, table.data);
+    writeRegion(m_missRecords, groupHandles, table.miss, table.data);
+    writeRegion(m_hitRecords, groupHandles, table.hit, table.data);
+
+    return table;
+}
+
+void ShaderBindingTableBuilder::addRecord(std::vector<Record>& records, uint32_t group, const void* data, size_t dataSize)
+{
+    CHECK(dataSize == 0 || data != nullptr);
+    Record record;
+    record.group = group;
+    record.data.resize(dataSize);
+    if (dataSize > 0)
+    {
+        std::memcpy(record.data.data(), data, dataSize);
+    }
+    records.push_back(std::move(record));
+}
+
+uint64_t ShaderBindingTableBuilder::getStride(const std::vector<Record>& records) const
+{
+    size_t maxDataSize = 0;
+    for (const Record& record : records)
+    {
+        maxDataSize = std::max(maxDataSize, record.data.size());
+    }
+    const uint64_t stride = alignUp(m_limits.handleSize + maxDataSize, m_limits.handleAlignment);
+    CHECK(stride <= m_limits.maxStride);
+    return stride;
+}
+
+void ShaderBindingTableBuilder::writeRegion(const std::vector<Record>& records, const std::vector<uint8_t>& groupHandles, const ShaderBindingTableRegion& region, std::vector<uint8_t>& data) const
+{
+    CHECK(region.offset % m_limits.baseAlignment == 0 && region.stride % m_limits.handleAlignment == 0);
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        const Record& record = records[i];
+        const size_t handleOffset = static_cast<size_t>(record.group) * m_limits.handleSize;
+        CHECK(handleOffset + m_limits.handleSize <= groupHandles.size());
+
+        uint8_t* destination = data.data() + region.offset + i * region.stride;
+        std::memcpy(destination, groupHandles.data() + handleOffset, m_limits.handleSize);
+        if (!record.data.empty())
+        {
+            std::memcpy(destination + m_limits.handleSize, record.data.data(), record.data.size());
+        }
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Location of one shader binding table region, the offset is relative to the start of the table
+struct ShaderBindingTableRegion
+{
+    uint64_t offset = 0;
+    uint64_t stride = 0;
+    uint64_t size = 0;
+};
+
+// Table contents ready to be copied into a buffer with the shader binding table usage
+struct ShaderBindingTable
+{
+    std::vector<uint8_t> data;
+    ShaderBindingTableRegion raygen;
+    ShaderBindingTableRegion miss;
+    ShaderBindingTableRegion hit;
+};
+
+// Lays out the raygen, miss and hit regions of a shader binding table on the CPU. Every record is a group handle
+// followed by optional inline data that the shaders read through shaderRecordEXT. Each region starts at a multiple
+// of the base alignment and its records share one stride, which fits the largest record of the region and is a
+// multiple of the handle alignment. Has no Vulkan dependency so the layout can be checked without a device.
+class ShaderBindingTableBuilder final
+{
+public:
+    // From VkPhysicalDeviceRayTracingPipelinePropertiesKHR
+    struct Limits
+    {
+        uint32_t handleSize;
+        uint32_t handleAlignment;
+        uint32_t baseAlignment;
+        uint32_t maxStride;
+    };
+
+    explicit ShaderBindingTableBuilder(const Limits& limits);
+
+    // The group indexes the handles passed to build(). Records of a region are in the order they are added, so the
+    // n-th hit record is the one that sbtRecordOffset, sbtRecordStride and the instance offset resolve to n.
+    void addRaygen(uint32_t group, const void* data = nullptr, size_t dataSize = 0);
+    void addMiss(uint32_t group, const void* data = nullptr, size_t dataSize = 0);
+    void addHit(uint32_t group, const void* data = nullptr, size_t dataSize = 0);
+
+    // Handles of all groups as returned by vkGetRayTracingShaderGroupHandlesKHR, handleSize bytes each.
+    // Requires exactly one raygen record.
+    ShaderBindingTable build(const std::vector<uint8_t>& groupHandles) const;
+
+private:
+    struct Record
+    {
+        uint32_t group;
+        std::vector<uint8_t> data;
+    };
+
+    static void addRecord(std::vector<Record>& records, uint32_t group, const void* data, size_t dataSize);
+    uint64_t getStride(const std::vector<Record>& records) const;
+    void writeRegion(const std::vector<Record>& records, const std::vector<uint8_t>& groupHandles, const ShaderBindingTableRegion& region, std::vector<uint8_t>& data) const;
+
+    const Limits m_limits;
+    std::vector<Record> m_raygenRecords;
+    std::vector<Record> m_missRecords;
+    std::vector<Record> m_hitRecords;
+};
@@ -0,0 +1,263 @@
+#include "Skinning.hpp"
+#include "VulkanUtils.hpp"
+#include "DebugMarker.hpp"
+#include "Utils.hpp"
+#include <array>
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+// Same as local_size_x in skinning.comp
+const uint32_t c_workGroupSize = 64;
+
+struct PushConstants
+{
+    uint32_t vertexCount;
+    uint32_t firstJoint;
+    uint32_t writePositions;
+};
+} // namespace
+
+Skinning::Skinning(const InitData& initData) :
+    m_device(initData.device),
+    m_physicalDevice(initData.physicalDevice),
+    m_skeleton(*initData.skeleton),
+    m_vertexCount(ui32Size(*initData.restVertices)),
+    m_jointCount(ui32Size(initData.skeleton->joints)),
+    m_slotCount(initData.slotCount),
+    m_consumerStageMask(initData.consumerStageMask),
+    m_consumerAccessMask(initData.consumerAccessMask),
+    m_writePositions(initData.positionBuffer != VK_NULL_HANDLE)
+{
+    CHECK(initData.skinVertices->size() == initData.restVertices->size());
+    CHECK(m_jointCount > 0);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_physicalDevice, &properties);
+    m_maxWorkGroupCountX = properties.limits.maxComputeWorkGroupCount[0];
+
+    createInputBuffers(initData);
+    createJointBuffer();
+    createPipeline();
+    createDescriptorSet(initData.vertexBuffer, initData.positionBuffer);
+
+    m_timer = std::make_unique<GpuTimer>("skinning", m_device, m_physicalDevice, m_slotCount);
+    m_timer->setItemCount(m_vertexCount, "vertex");
+
+    printf("Skinning: %u vertices, %u joints, %zu animations\n", m_vertexCount, m_jointCount, m_skeleton.animations.size());
+}
+
+Skinning::~Skinning()
+{
+    m_timer.reset();
+
+    vkUnmapMemory(m_device, m_jointMemory);
+    destroyBufferAndFreeMemory(m_device, m_restVertexBuffer, m_restVertexMemory);
+    destroyBufferAndFreeMemory(m_device, m_skinVertexBuffer, m_skinVertexMemory);
+    destroyBufferAndFreeMemory(m_device, m_jointBuffer, m_jointMemory);
+
+    vkDestroyPipeline(m_device, m_pipeline, nullptr);
+    vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+    vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, nullptr);
+}
+
+void Skinning::record(VkCommandBuffer commandBuffer, uint32_t slot, double time)
+{
+    poseSkeleton(m_skeleton, time, m_pose);
+    std::memcpy(m_jointsMapped + static_cast<size_t>(slot) * m_jointCount, m_pose.jointMatrices.data(), sizeof(glm::mat4) * m_jointCount);
+
+    DebugMarker::beginLabel(commandBuffer, "Skinning", DebugMarker::green);
+
+    // The previous frames may still read the vertices that are overwritten
+    VkMemoryBarrier writeBarrier{};
+    writeBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    writeBarrier.pNext = NULL;
+    writeBarrier.srcAccessMask = 0;
+    writeBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, m_consumerStageMask, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &writeBarrier, 0, nullptr, 0, nullptr);
+
+    m_timer->begin(commandBuffer, slot);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
+
+    PushConstants pushConstants{};
+    pushConstants.vertexCount = m_vertexCount;
+    pushConstants.firstJoint = slot * m_jointCount;
+    pushConstants.writePositions = m_writePositions ? 1 : 0;
+    vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+
+    // Spread over a 2D grid when one dimension isn't enough
+    const uint32_t groupCount = (m_vertexCount + c_workGroupSize - 1) / c_workGroupSize;
+    const uint32_t groupCountX = std::min(groupCount, m_maxWorkGroupCountX);
+    const uint32_t groupCountY = (groupCount + groupCountX - 1) / groupCountX;
+    vkCmdDispatch(commandBuffer, groupCountX, groupCountY, 1);
+
+    m_timer->end(commandBuffer, slot);
+
+    VkMemoryBarrier readBarrier{};
+    readBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    readBarrier.pNext = NULL;
+    readBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    readBarrier.dstAccessMask = m_consumerAccessMask;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, m_consumerStageMask, 0, 1, &readBarrier, 0, nullptr, 0, nullptr);
+
+    DebugMarker::endLabel(commandBuffer);
+}
+
+void Skinning::createInputBuffers(const InitData& initData)
+{
+    const VkDeviceSize restVertexSize = sizeof(Model::Vertex) * initData.restVertices->size();
+    const VkDeviceSize skinVertexSize = sizeof(Model::SkinVertex) * initData.skinVertices->size();
+    const VkBufferUsageFlags usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+
+    m_restVertexBuffer = createBuffer(m_device, restVertexSize, usage);
+    m_restVertexMemory = allocateAndBindMemory(m_device, m_physicalDevice, m_restVertexBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_BUFFER, m_restVertexBuffer, "Buffer - Rest pose vertex");
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_DEVICE_MEMORY, m_restVertexMemory, "Memory - Rest pose vertex buffer");
+
+    m_skinVertexBuffer = createBuffer(m_device, skinVertexSize, usage);
+    m_skinVertexMemory = allocateAndBindMemory(m_device, m_physicalDevice, m_skinVertexBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_BUFFER, m_skinVertexBuffer, "Buffer - Skin vertex");
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_DEVICE_MEMORY, m_skinVertexMemory, "Memory - Skin vertex buffer");
+
+    StagingBuffer restVertexStaging = createStagingBuffer(m_device, m_physicalDevice, initData.restVertices->data(), restVertexSize);
+    StagingBuffer skinVertexStaging = createStagingBuffer(m_device, m_physicalDevice, initData.skinVertices->data(), skinVertexSize);
+
+    VkBufferCopy copyRegion{};
+    copyRegion.srcOffset = 0;
+    copyRegion.dstOffset = 0;
+
+    const SingleTimeCommand command = beginSingleTimeCommands(initData.commandPool, m_device);
+    copyRegion.size = restVertexSize;
+    vkCmdCopyBuffer(command.commandBuffer, restVertexStaging.buffer, m_restVertexBuffer, 1, &copyRegion);
+    copyRegion.size = skinVertexSize;
+    vkCmdCopyBuffer(command.commandBuffer, skinVertexStaging.buffer, m_skinVertexBuffer, 1, &copyRegion);
+    endSingleTimeCommands(initData.queue, command);
+
+    releaseStagingBuffer(m_device, restVertexStaging);
+    releaseStagingBuffer(m_device, skinVertexStaging);
+}
+
+void Skinning::createJointBuffer()
+{
+    const VkDeviceSize jointBufferSize = sizeof(glm::mat4) * m_jointCount * m_slotCount;
+    m_jointBuffer = createBuffer(m_device, jointBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    m_jointMemory = allocateAndBindMemory(m_device, m_physicalDevice, m_jointBuffer, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_BUFFER, m_jointBuffer, "Buffer - Joint matrices");
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_DEVICE_MEMORY, m_jointMemory, "Memory - Joint matrices");
+
+    void* jointsMapped;
+    VK_CHECK(vkMapMemory(m_device, m_jointMemory, 0, jointBufferSize, 0, &jointsMapped));
+    m_jointsMapped = static_cast<glm::mat4*>(jointsMapped);
+}
+
+void Skinning::createPipeline()
+{
+    std::array<VkDescriptorSetLayoutBinding, 5> bindings{};
+    for (uint32_t i = 0; i < ui32Size(bindings); ++i)
+    {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        bindings[i].pImmutableSamplers = nullptr;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = ui32Size(bindings);
+    layoutInfo.pBindings = bindings.data();
+
+    VK_CHECK(vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &m_descriptorSetLayout));
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, m_descriptorSetLayout, "Desc set layout - Skinning");
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(PushConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    VK_CHECK(vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_pipelineLayout));
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_PIPELINE_LAYOUT, m_pipelineLayout, "Pipeline layout - Skinning");
+
+    VkShaderModule shaderModule = createShaderModule(m_device, getCurrentExecutableDirectory() / "skinning.comp.spv");
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.pNext = NULL;
+    pipelineInfo.flags = 0;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.pNext = NULL;
+    pipelineInfo.stage.flags = 0;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.stage.pSpecializationInfo = NULL;
+    pipelineInfo.layout = m_pipelineLayout;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineInfo.basePipelineIndex = 0;
+
+    VK_CHECK(vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_pipeline));
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_PIPELINE, m_pipeline, "Pipeline - Skinning");
+
+    vkDestroyShaderModule(m_device, shaderModule, nullptr);
+}
+
+void Skinning::createDescriptorSet(VkBuffer vertexBuffer, VkBuffer positionBuffer)
+{
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSize.descriptorCount = 5;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    poolInfo.maxSets = 1;
+
+    VK_CHECK(vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &m_descriptorPool));
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_DESCRIPTOR_POOL, m_descriptorPool, "Descriptor pool - Skinning");
+
+    VkDescriptorSetAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocateInfo.pNext = NULL;
+    allocateInfo.descriptorPool = m_descriptorPool;
+    allocateInfo.descriptorSetCount = 1;
+    allocateInfo.pSetLayouts = &m_descriptorSetLayout;
+
+    VK_CHECK(vkAllocateDescriptorSets(m_device, &allocateInfo, &m_descriptorSet));
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_DESCRIPTOR_SET, m_descriptorSet, "Desc set - Skinning");
+
+    // The vertex buffer may have other data after the vertices, e.g. the indices of the rasterizer
+    std::array<VkDescriptorBufferInfo, 5> bufferInfos{};
+    bufferInfos[0] = {m_restVertexBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[1] = {m_skinVertexBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[2] = {m_jointBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[3] = {vertexBuffer, 0, sizeof(Model::Vertex) * m_vertexCount};
+    // Every binding needs a valid buffer, the shader doesn't write the placeholder
+    bufferInfos[4] = m_writePositions ? VkDescriptorBufferInfo{positionBuffer, 0, sizeof(glm::vec3) * m_vertexCount} : bufferInfos[3];
+
+    std::array<VkWriteDescriptorSet, 5> descriptorWrites{};
+    for (uint32_t i = 0; i < ui32Size(descriptorWrites); ++i)
+    {
+        descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[i].pNext = NULL;
+        descriptorWrites[i].dstSet = m_descriptorSet;
+        descriptorWrites[i].dstBinding = i;
+        descriptorWrites[i].dstArrayElement = 0;
+        descriptorWrites[i].descriptorCount = 1;
+        descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+    }
+
+    vkUpdateDescriptorSets(m_device, ui32Size(descriptorWrites), descriptorWrites.data(), 0, nullptr);
+}
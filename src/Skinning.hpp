@@ -0,0 +1,80 @@
+#pragma once
+
+#include "Model.hpp"
+#include "Animation.hpp"
+#include "GpuTimer.hpp"
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <memory>
+
+// Animates a skinned model on the GPU. The skeleton is posed on the CPU and a compute shader skins the rest pose
+// vertices into the vertex buffer of the renderer, which then reads them like static vertices.
+class Skinning final
+{
+public:
+    struct InitData
+    {
+        VkDevice device;
+        VkPhysicalDevice physicalDevice;
+        // Used for uploading the rest pose, must not be in use by other threads during construction
+        VkCommandPool commandPool;
+        VkQueue queue;
+        const Model::Skeleton* skeleton;
+        const std::vector<Model::Vertex>* restVertices;
+        const std::vector<Model::SkinVertex>* skinVertices;
+        // Receives the skinned vertices at offset 0, needs the storage buffer usage
+        VkBuffer vertexBuffer;
+        // Optional tightly packed float3 positions of the skinned vertices, VK_NULL_HANDLE if not needed
+        VkBuffer positionBuffer;
+        // One set of joint matrices per frame in flight
+        uint32_t slotCount;
+        // Where the skinned vertices are read after the dispatch
+        VkPipelineStageFlags consumerStageMask;
+        VkAccessFlags consumerAccessMask;
+    };
+
+    Skinning(const InitData& initData);
+    // Prints the GPU time per skinned vertex
+    ~Skinning();
+
+    // Poses the skeleton at time in seconds and records the skinning dispatch with barriers on both sides,
+    // so the previous frames have finished reading the vertices and the consumers see the new ones
+    void record(VkCommandBuffer commandBuffer, uint32_t slot, double time);
+
+    uint32_t getVertexCount() const { return m_vertexCount; }
+
+private:
+    void createInputBuffers(const InitData& initData);
+    void createJointBuffer();
+    void createPipeline();
+    void createDescriptorSet(VkBuffer vertexBuffer, VkBuffer positionBuffer);
+
+    VkDevice m_device;
+    VkPhysicalDevice m_physicalDevice;
+    const Model::Skeleton m_skeleton;
+    SkeletonPose m_pose;
+    const uint32_t m_vertexCount;
+    const uint32_t m_jointCount;
+    const uint32_t m_slotCount;
+    const VkPipelineStageFlags m_consumerStageMask;
+    const VkAccessFlags m_consumerAccessMask;
+    const bool m_writePositions;
+    uint32_t m_maxWorkGroupCountX = 0;
+
+    VkBuffer m_restVertexBuffer;
+    VkDeviceMemory m_restVertexMemory;
+    VkBuffer m_skinVertexBuffer;
+    VkDeviceMemory m_skinVertexMemory;
+    // Persistently mapped, one slot of joint matrices per frame in flight
+    VkBuffer m_jointBuffer;
+    VkDeviceMemory m_jointMemory;
+    glm::mat4* m_jointsMapped = nullptr;
+
+    VkDescriptorSetLayout m_descriptorSetLayout;
+    VkDescriptorPool m_descriptorPool;
+    VkDescriptorSet m_descriptorSet;
+    VkPipelineLayout m_pipelineLayout;
+    VkPipeline m_pipeline;
+    std::unique_ptr<GpuTimer> m_timer;
+};
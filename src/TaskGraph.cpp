@@ -0,0 +1,102 @@
+#include "TaskGraph.hpp"
+#include "Utils.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+TaskGraph::TaskId TaskGraph::add(const std::string& name, Function function, const std::vector<TaskId>& dependencies)
+{
+    const TaskId id = ui32Size(m_tasks);
+    for (TaskId dependency : dependencies)
+    {
+        CHECK(dependency < id);
+    }
+
+    Task task;
+    task.name = name;
+    task.function = std::move(function);
+    task.dependencies = dependencies;
+    m_tasks.push_back(std::move(task));
+    return id;
+}
+
+void TaskGraph::execute(JobSystem& jobSystem)
+{
+    m_threadCount = jobSystem.getThreadCount();
+    const std::chrono::high_resolution_clock::time_point startTime = std::chrono::high_resolution_clock::now();
+
+    // Tasks are stored in a topological order so the dependencies are always scheduled first
+    std::vector<JobSystem::JobHandle> jobs;
+    jobs.reserve(m_tasks.size());
+    for (Task& task : m_tasks)
+    {
+        std::vector<JobSystem::JobHandle> dependencies;
+        for (TaskId dependency : task.dependencies)
+        {
+            dependencies.push_back(jobs[dependency]);
+        }
+
+        Task* taskPtr = &task;
+        jobs.push_back(jobSystem.schedule(
+            [taskPtr, startTime, &jobSystem]() {
+                taskPtr->threadIndex = jobSystem.getCurrentThreadIndex();
+                taskPtr->startMs = getMillisecondsSince(startTime);
+                taskPtr->function();
+                taskPtr->durationMs = getMillisecondsSince(startTime) - taskPtr->startMs;
+            },
+            dependencies));
+    }
+
+    jobSystem.wait(jobs);
+
+    m_wallTimeMs = getMillisecondsSince(startTime);
+}
+
+void TaskGraph::printStatistics() const
+{
+    if (m_tasks.empty())
+    {
+        return;
+    }
+
+    // Tasks are stored in a topological order, so the longest path to each task can be found in one pass
+    std::vector<double> pathTimes(m_tasks.size(), 0.0);
+    std::vector<int> pathPredecessors(m_tasks.size(), -1);
+    double sequentialTime = 0.0;
+    for (size_t i = 0; i < m_tasks.size(); ++i)
+    {
+        const Task& task = m_tasks[i];
+        for (TaskId dependency : task.dependencies)
+        {
+            if (pathTimes[dependency] > pathTimes[i])
+            {
+                pathTimes[i] = pathTimes[dependency];
+                pathPredecessors[i] = static_cast<int>(dependency);
+            }
+        }
+        pathTimes[i] += task.durationMs;
+        sequentialTime += task.durationMs;
+    }
+
+    printf("%-50s %7s %10s %10s\n", "Task", "thread", "start ms", "time ms");
+    for (const Task& task : m_tasks)
+    {
+        printf("%-50s %7u %10.1f %10.1f\n", task.name.c_str(), task.threadIndex, task.startMs, task.durationMs);
+    }
+
+    int criticalTask = static_cast<int>(std::max_element(pathTimes.begin(), pathTimes.end()) - pathTimes.begin());
+    const double criticalPathTime = pathTimes[criticalTask];
+    std::string criticalPath;
+    for (; criticalTask >= 0; criticalTask = pathPredecessors[criticalTask])
+    {
+        criticalPath = m_tasks[criticalTask].name + (criticalPath.empty() ? "" : " -> " + criticalPath);
+    }
+
+    printf("Task graph: %zu tasks on %u threads, wall %.1f ms, sequential sum %.1f ms, critical path %.1f ms\n",
+           m_tasks.size(),
+           m_threadCount,
+           m_wallTimeMs,
+           sequentialTime,
+           criticalPathTime);
+    printf("Critical path: %s\n", criticalPath.c_str());
+}
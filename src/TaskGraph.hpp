@@ -0,0 +1,37 @@
+#pragma once
+
+#include "JobSystem.hpp"
+#include <functional>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Runs a set of named tasks as jobs, each task starts when all its dependencies have finished.
+// Tasks can only depend on tasks added before them so the graph is always acyclic.
+class TaskGraph final
+{
+public:
+    using TaskId = uint32_t;
+    using Function = std::function<void()>;
+
+    TaskId add(const std::string& name, Function function, const std::vector<TaskId>& dependencies = {});
+    // Blocks until all tasks have finished, the calling thread runs tasks too
+    void execute(JobSystem& jobSystem = JobSystem::get());
+    // Per task timings, the sum of all task times and the critical path of the last execution
+    void printStatistics() const;
+
+private:
+    struct Task
+    {
+        std::string name;
+        Function function;
+        std::vector<TaskId> dependencies;
+        double startMs = 0.0;
+        double durationMs = 0.0;
+        uint32_t threadIndex = 0;
+    };
+
+    std::vector<Task> m_tasks;
+    uint32_t m_threadCount = 0;
+    double m_wallTimeMs = 0.0;
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Lock-free latest-value exchange between one writer and one reader thread.
+// The writer and the reader each own one buffer and swap it with the shared middle one, so neither ever waits.
+template<typename T>
+class TripleBuffer final
+{
+public:
+    void write(const T& value)
+    {
+        m_buffers[m_writeIndex] = value;
+        const uint8_t previous = m_middle.exchange(m_writeIndex | c_newDataBit, std::memory_order_acq_rel);
+        m_writeIndex = previous & c_indexMask;
+    }
+
+    // Returns the latest written value, or the same value as the previous call if nothing new was written
+    const T& read()
+    {
+        if (m_middle.load(std::memory_order_relaxed) & c_newDataBit)
+        {
+            const uint8_t previous = m_middle.exchange(m_readIndex, std::memory_order_acq_rel);
+            m_readIndex = previous & c_indexMask;
+        }
+        return m_buffers[m_readIndex];
+    }
+
+private:
+    static constexpr uint8_t c_indexMask = 0x3;
+    static constexpr uint8_t c_newDataBit = 0x4;
+
+    std::array<T, 3> m_buffers{};
+    uint8_t m_writeIndex = 0;
+    std::atomic<uint8_t> m_middle{1};
+    uint8_t m_readIndex = 2;
+};
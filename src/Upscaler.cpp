@@ -0,0 +1,216 @@
+#include "Upscaler.hpp"
+#include "DebugMarker.hpp"
+#include "Utils.hpp"
+#include <array>
+#include <string>
+
+namespace
+{
+// Same as local_size_x and local_size_y in upscale.comp and sharpen.comp
+const uint32_t c_workGroupSize = 8;
+const VkFormat c_format = VK_FORMAT_R8G8B8A8_UNORM;
+// 0 to 1, 1 sharpens the most
+const float c_sharpness = 0.5f;
+
+// Same as in sharpen.comp, upscale.comp ignores it
+struct PushConstants
+{
+    float sharpness;
+};
+} // namespace
+
+Upscaler::Upscaler(const InitData& initData) :
+    m_device(initData.device),
+    m_outputExtent(initData.outputExtent)
+{
+    m_upscaled = createStorageImage(m_device, initData.physicalDevice, initData.commandPool, initData.queue, m_outputExtent, c_format, VK_IMAGE_USAGE_STORAGE_BIT, "Upscaled");
+    m_output = createStorageImage(m_device, initData.physicalDevice, initData.commandPool, initData.queue, m_outputExtent, c_format, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, "Upscaler output");
+
+    createPipelines();
+    createDescriptorSets(initData.inputView);
+
+    const uint64_t pixelCount = static_cast<uint64_t>(m_outputExtent.width) * m_outputExtent.height;
+    m_upscaleTimer = std::make_unique<GpuTimer>("upscale " + std::to_string(initData.inputExtent.width) + "x" + std::to_string(initData.inputExtent.height), m_device, initData.physicalDevice, initData.slotCount);
+    m_upscaleTimer->setItemCount(pixelCount, "pixel");
+    m_sharpenTimer = std::make_unique<GpuTimer>("sharpen", m_device, initData.physicalDevice, initData.slotCount);
+    m_sharpenTimer->setItemCount(pixelCount, "pixel");
+}
+
+Upscaler::~Upscaler()
+{
+    m_sharpenTimer.reset();
+    m_upscaleTimer.reset();
+
+    vkDestroyPipeline(m_device, m_sharpenPipeline, nullptr);
+    vkDestroyPipeline(m_device, m_upscalePipeline, nullptr);
+    vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+    vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, nullptr);
+
+    destroyStorageImage(m_device, m_output);
+    destroyStorageImage(m_device, m_upscaled);
+}
+
+void Upscaler::record(VkCommandBuffer commandBuffer, uint32_t slot)
+{
+    DebugMarker::beginLabel(commandBuffer, "Upscale", DebugMarker::green);
+
+    // The input has been resolved and the previous frame's transfer may still read the output
+    VkMemoryBarrier inputBarrier{};
+    inputBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    inputBarrier.pNext = NULL;
+    inputBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    inputBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &inputBarrier, 0, nullptr, 0, nullptr);
+
+    m_upscaleTimer->begin(commandBuffer, slot);
+    dispatch(commandBuffer, m_upscalePipeline, m_upscaleDescriptorSet);
+    m_upscaleTimer->end(commandBuffer, slot);
+
+    VkMemoryBarrier upscaledBarrier{};
+    upscaledBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    upscaledBarrier.pNext = NULL;
+    upscaledBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    upscaledBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &upscaledBarrier, 0, nullptr, 0, nullptr);
+
+    m_sharpenTimer->begin(commandBuffer, slot);
+    const PushConstants pushConstants{c_sharpness};
+    vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+    dispatch(commandBuffer, m_sharpenPipeline, m_sharpenDescriptorSet);
+    m_sharpenTimer->end(commandBuffer, slot);
+
+    VkMemoryBarrier outputBarrier{};
+    outputBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    outputBarrier.pNext = NULL;
+    outputBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    outputBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &outputBarrier, 0, nullptr, 0, nullptr);
+
+    DebugMarker::endLabel(commandBuffer);
+}
+
+void Upscaler::dispatch(VkCommandBuffer commandBuffer, VkPipeline pipeline, VkDescriptorSet descriptorSet)
+{
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+    vkCmdDispatch(commandBuffer, (m_outputExtent.width + c_workGroupSize - 1) / c_workGroupSize, (m_outputExtent.height + c_workGroupSize - 1) / c_workGroupSize, 1);
+}
+
+void Upscaler::createPipelines()
+{
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+    for (uint32_t i = 0; i < ui32Size(bindings); ++i)
+    {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        bindings[i].pImmutableSamplers = nullptr;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = ui32Size(bindings);
+    layoutInfo.pBindings = bindings.data();
+
+    VK_CHECK(vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &m_descriptorSetLayout));
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, m_descriptorSetLayout, "Desc set layout - Upscaler");
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(PushConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    VK_CHECK(vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_pipelineLayout));
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_PIPELINE_LAYOUT, m_pipelineLayout, "Pipeline layout - Upscaler");
+
+    const std::array<const char*, 2> shaderNames = {"upscale.comp.spv", "sharpen.comp.spv"};
+    std::array<VkPipeline*, 2> pipelines = {&m_upscalePipeline, &m_sharpenPipeline};
+    const std::array<const char*, 2> pipelineNames = {"Pipeline - Upscale", "Pipeline - Sharpen"};
+    for (uint32_t i = 0; i < ui32Size(shaderNames); ++i)
+    {
+        VkShaderModule shaderModule = createShaderModule(m_device, getCurrentExecutableDirectory() / shaderNames[i]);
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.pNext = NULL;
+        pipelineInfo.flags = 0;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.pNext = NULL;
+        pipelineInfo.stage.flags = 0;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.stage.pSpecializationInfo = NULL;
+        pipelineInfo.layout = m_pipelineLayout;
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+        pipelineInfo.basePipelineIndex = 0;
+
+        VK_CHECK(vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, pipelines[i]));
+        DebugMarker::setObjectName(VK_OBJECT_TYPE_PIPELINE, *pipelines[i], pipelineNames[i]);
+
+        vkDestroyShaderModule(m_device, shaderModule, nullptr);
+    }
+}
+
+void Upscaler::createDescriptorSets(VkImageView inputView)
+{
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSize.descriptorCount = 4;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    poolInfo.maxSets = 2;
+
+    VK_CHECK(vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &m_descriptorPool));
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_DESCRIPTOR_POOL, m_descriptorPool, "Descriptor pool - Upscaler");
+
+    const std::array<VkDescriptorSetLayout, 2> setLayouts = {m_descriptorSetLayout, m_descriptorSetLayout};
+    std::array<VkDescriptorSet, 2> descriptorSets{};
+
+    VkDescriptorSetAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocateInfo.pNext = NULL;
+    allocateInfo.descriptorPool = m_descriptorPool;
+    allocateInfo.descriptorSetCount = ui32Size(setLayouts);
+    allocateInfo.pSetLayouts = setLayouts.data();
+
+    VK_CHECK(vkAllocateDescriptorSets(m_device, &allocateInfo, descriptorSets.data()));
+    m_upscaleDescriptorSet = descriptorSets[0];
+    m_sharpenDescriptorSet = descriptorSets[1];
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_DESCRIPTOR_SET, m_upscaleDescriptorSet, "Desc set - Upscale");
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_DESCRIPTOR_SET, m_sharpenDescriptorSet, "Desc set - Sharpen");
+
+    // Input to upscaled, then upscaled to output
+    std::array<VkDescriptorImageInfo, 4> imageInfos{};
+    imageInfos[0] = {VK_NULL_HANDLE, inputView, VK_IMAGE_LAYOUT_GENERAL};
+    imageInfos[1] = {VK_NULL_HANDLE, m_upscaled.view, VK_IMAGE_LAYOUT_GENERAL};
+    imageInfos[2] = {VK_NULL_HANDLE, m_upscaled.view, VK_IMAGE_LAYOUT_GENERAL};
+    imageInfos[3] = {VK_NULL_HANDLE, m_output.view, VK_IMAGE_LAYOUT_GENERAL};
+
+    std::array<VkWriteDescriptorSet, 4> descriptorWrites{};
+    for (uint32_t i = 0; i < ui32Size(descriptorWrites); ++i)
+    {
+        descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[i].pNext = NULL;
+        descriptorWrites[i].dstSet = descriptorSets[i / 2];
+        descriptorWrites[i].dstBinding = i % 2;
+        descriptorWrites[i].dstArrayElement = 0;
+        descriptorWrites[i].descriptorCount = 1;
+        descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        descriptorWrites[i].pImageInfo = &imageInfos[i];
+    }
+
+    vkUpdateDescriptorSets(m_device, ui32Size(descriptorWrites), descriptorWrites.data(), 0, nullptr);
+}
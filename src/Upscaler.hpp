@@ -0,0 +1,59 @@
+#pragma once
+
+#include "GpuTimer.hpp"
+#include "VulkanUtils.hpp"
+#include <vulkan/vulkan.h>
+#include <memory>
+
+// Upscales the tonemapped image of a reduced trace resolution to the window. An edge-adaptive Lanczos pass writes an
+// intermediate image at the output size, then a contrast-adaptive sharpening pass restores the detail the lower
+// resolution lost and writes the image that is blitted to the swapchain.
+class Upscaler final
+{
+public:
+    struct InitData
+    {
+        VkDevice device;
+        VkPhysicalDevice physicalDevice;
+        // Used for creating the images, must not be in use by other threads during construction
+        VkCommandPool commandPool;
+        VkQueue queue;
+        VkExtent2D inputExtent;
+        VkExtent2D outputExtent;
+        // RGBA8 input, in VK_IMAGE_LAYOUT_GENERAL
+        VkImageView inputView;
+        uint32_t slotCount;
+    };
+
+    Upscaler(const InitData& initData);
+    ~Upscaler();
+
+    // RGBA8 at the output extent in VK_IMAGE_LAYOUT_GENERAL, can be the source of transfers
+    VkImage getOutputImage() const { return m_output.image; }
+
+    // Records both passes with barriers on both sides. The input must have been written by a compute shader or a
+    // transfer, afterwards the output can be read by transfers.
+    void record(VkCommandBuffer commandBuffer, uint32_t slot);
+
+private:
+    void createPipelines();
+    void createDescriptorSets(VkImageView inputView);
+    void dispatch(VkCommandBuffer commandBuffer, VkPipeline pipeline, VkDescriptorSet descriptorSet);
+
+    VkDevice m_device;
+    const VkExtent2D m_outputExtent;
+
+    // Upscaled before sharpening
+    StorageImage m_upscaled;
+    StorageImage m_output;
+
+    VkDescriptorSetLayout m_descriptorSetLayout;
+    VkDescriptorPool m_descriptorPool;
+    VkDescriptorSet m_upscaleDescriptorSet;
+    VkDescriptorSet m_sharpenDescriptorSet;
+    VkPipelineLayout m_pipelineLayout;
+    VkPipeline m_upscalePipeline;
+    VkPipeline m_sharpenPipeline;
+    std::unique_ptr<GpuTimer> m_upscaleTimer;
+    std::unique_ptr<GpuTimer> m_sharpenTimer;
+};
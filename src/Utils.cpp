@@ -3,6 +3,8 @@
 #include <Windows.h>
 #else
 #include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
 #endif
 
 glm::vec4 toVec4(glm::vec3 v, float w)
@@ -10,6 +12,22 @@ glm::vec4 toVec4(glm::vec3 v, float w)
     return glm::vec4(v.x, v.y, v.z, w);
 }
 
+double toMegabytes(uint64_t bytes)
+{
+    return static_cast<double>(bytes) / (1024.0 * 1024.0);
+}
+
+uint64_t alignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+double getMillisecondsSince(std::chrono::high_resolution_clock::time_point startTime)
+{
+    using namespace std::chrono;
+    return static_cast<double>(duration_cast<nanoseconds>(high_resolution_clock::now() - startTime).count()) / 1'000'000.0;
+}
+
 std::filesystem::path getCurrentExecutableDirectory()
 {
     char path[260] = {0};
@@ -29,4 +47,27 @@ std::filesystem::path getCurrentExecutableDirectory()
     std::filesystem::path result = path;
     result = result.parent_path();
     return result;
+}
+
+bool pinCurrentThreadToCore(uint32_t core)
+{
+#ifdef _WIN32
+    if (core >= sizeof(DWORD_PTR) * 8)
+    {
+        return false;
+    }
+    return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << core) != 0;
+#elif defined(__linux__)
+    if (core >= CPU_SETSIZE)
+    {
+        return false;
+    }
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(core, &cpuSet);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuSet) == 0;
+#else
+    (void)core;
+    return false;
+#endif
 }
\ No newline at end of file
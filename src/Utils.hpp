@@ -2,6 +2,7 @@
 
 #include <glm/glm.hpp>
 #include <cstdint>
+#include <chrono>
 #include <filesystem>
 #include <string>
 
@@ -43,6 +44,9 @@ const glm::vec4 c_leftZero(c_left.x, c_left.y, c_left.z, 0.0f);
 const glm::vec3 c_right(1.0f, 0.0f, 0.0f);
 
 glm::vec4 toVec4(glm::vec3 v, float w);
+double toMegabytes(uint64_t bytes);
+uint64_t alignUp(uint64_t value, uint64_t alignment);
+double getMillisecondsSince(std::chrono::high_resolution_clock::time_point startTime);
 
 template<typename T>
 uint32_t ui32Size(const T& container)
@@ -51,3 +55,5 @@ uint32_t ui32Size(const T& container)
 }
 
 std::filesystem::path getCurrentExecutableDirectory();
+// Returns false if the platform doesn't support pinning or the core doesn't exist
+bool pinCurrentThreadToCore(uint32_t core);
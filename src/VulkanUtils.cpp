@@ -330,3 +330,84 @@ void destroyBufferAndFreeMemory(VkDevice device, VkBuffer buffer, VkDeviceMemory
     vkDestroyBuffer(device, buffer, nullptr);
     vkFreeMemory(device, memory, nullptr);
 }
+
+StorageImage createStorageImage(VkDevice device, VkPhysicalDevice physicalDevice, VkCommandPool commandPool, VkQueue queue, VkExtent2D extent, VkFormat format, VkImageUsageFlags usage, const std::string& name)
+{
+    return createStorageImage(device, physicalDevice, commandPool, queue, extent, 1, VK_IMAGE_VIEW_TYPE_2D, format, usage, name);
+}
+
+StorageImage createStorageImage(VkDevice device, VkPhysicalDevice physicalDevice, VkCommandPool commandPool, VkQueue queue, VkExtent2D extent, uint32_t layerCount, VkImageViewType viewType, VkFormat format, VkImageUsageFlags usage, const std::string& name)
+{
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent.width = extent.width;
+    imageInfo.extent.height = extent.height;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = layerCount;
+    imageInfo.format = format;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = usage;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.flags = 0;
+
+    StorageImage storageImage;
+    VK_CHECK(vkCreateImage(device, &imageInfo, nullptr, &storageImage.image));
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_IMAGE, storageImage.image, "Image - " + name);
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(device, storageImage.image, &memRequirements);
+
+    const MemoryTypeResult memoryTypeResult = findMemoryType(physicalDevice, memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    CHECK(memoryTypeResult.found);
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = memoryTypeResult.typeIndex;
+
+    VK_CHECK(vkAllocateMemory(device, &allocInfo, nullptr, &storageImage.memory));
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_DEVICE_MEMORY, storageImage.memory, "Memory - " + name + " image");
+    VK_CHECK(vkBindImageMemory(device, storageImage.image, storageImage.memory, 0));
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = storageImage.image;
+    viewInfo.viewType = viewType;
+    viewInfo.format = format;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.baseMipLevel = 0;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.baseArrayLayer = 0;
+    viewInfo.subresourceRange.layerCount = layerCount;
+
+    VK_CHECK(vkCreateImageView(device, &viewInfo, nullptr, &storageImage.view));
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_IMAGE_VIEW, storageImage.view, "Image view - " + name);
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.image = storageImage.image;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.subresourceRange = viewInfo.subresourceRange;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcAccessMask = VK_ACCESS_NONE;
+    barrier.dstAccessMask = VK_ACCESS_NONE;
+
+    const SingleTimeCommand command = beginSingleTimeCommands(commandPool, device);
+    vkCmdPipelineBarrier(command.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+    endSingleTimeCommands(queue, command);
+
+    return storageImage;
+}
+
+void destroyStorageImage(VkDevice device, const StorageImage& image)
+{
+    vkDestroyImageView(device, image.view, nullptr);
+    vkDestroyImage(device, image.image, nullptr);
+    vkFreeMemory(device, image.memory, nullptr);
+}
@@ -6,6 +6,7 @@
 #include <cstdint>
 #include <cassert>
 #include <filesystem>
+#include <string>
 
 const std::vector<const char*> c_validationLayers = {"VK_LAYER_KHRONOS_validation"};
 const std::vector<const char*> c_instanceExtensions = {VK_EXT_DEBUG_UTILS_EXTENSION_NAME};
@@ -13,6 +14,7 @@ const std::vector<const char*> c_deviceExtensions = {
     VK_KHR_SWAPCHAIN_EXTENSION_NAME, //
     VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME, //
     VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME, //
+    VK_KHR_RAY_QUERY_EXTENSION_NAME, //
     VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME, //
     VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME, //
     VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME, //
@@ -69,6 +71,14 @@ struct StagingBuffer
     VkDeviceMemory memory;
 };
 
+// Device local 2D image with one mip level and a view of it
+struct StorageImage
+{
+    VkImage image = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+};
+
 struct BarrierStageFlags
 {
     VkPipelineStageFlags src;
@@ -93,4 +103,10 @@ StagingBuffer createStagingBuffer(VkDevice device, VkPhysicalDevice physicalDevi
 void releaseStagingBuffer(VkDevice device, const StagingBuffer& buffer);
 VkBuffer createBuffer(VkDevice device, VkDeviceSize size, VkBufferUsageFlags usageFlags);
 VkDeviceMemory allocateAndBindMemory(VkDevice device, VkPhysicalDevice physicalDevice, VkBuffer buffer, VkMemoryPropertyFlagBits propertyFlags);
-void destroyBufferAndFreeMemory(VkDevice device, VkBuffer buffer, VkDeviceMemory memory);
\ No newline at end of file
+void destroyBufferAndFreeMemory(VkDevice device, VkBuffer buffer, VkDeviceMemory memory);
+// Transitions the image to VK_IMAGE_LAYOUT_GENERAL, where it stays for storage image and transfer access.
+// The command pool and queue must not be in use by other threads.
+StorageImage createStorageImage(VkDevice device, VkPhysicalDevice physicalDevice, VkCommandPool commandPool, VkQueue queue, VkExtent2D extent, VkFormat format, VkImageUsageFlags usage, const std::string& name);
+// Layered version, the view covers all layers
+StorageImage createStorageImage(VkDevice device, VkPhysicalDevice physicalDevice, VkCommandPool commandPool, VkQueue queue, VkExtent2D extent, uint32_t layerCount, VkImageViewType viewType, VkFormat format, VkImageUsageFlags usage, const std::string& name);
+void destroyStorageImage(VkDevice device, const StorageImage& image);
\ No newline at end of file
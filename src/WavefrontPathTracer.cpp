@@ -0,0 +1,476 @@
+#include "WavefrontPathTracer.hpp"
+#include "VulkanUtils.hpp"
+#include "DebugMarker.hpp"
+#include "Utils.hpp"
+#include <array>
+#include <cstddef>
+
+namespace
+{
+// Values of the c_stage specialization constant of wavefront.comp
+const uint32_t c_stageGenerate = 0;
+const uint32_t c_stageExtend = 1;
+const uint32_t c_stageSort = 2;
+const uint32_t c_stageShade = 3;
+const uint32_t c_stageShadow = 4;
+const uint32_t c_stageAccumulate = 5;
+const uint32_t c_stageControlExtend = 6;
+const uint32_t c_stageControlSort = 7;
+const uint32_t c_stageControlShadow = 8;
+const uint32_t c_stageCount = 9;
+const std::array<const char*, c_stageCount> c_stageNames{"generate", "extend", "sort", "shade", "shadow", "accumulate", "control extend", "control sort", "control shadow"};
+
+// Same as local_size_x in wavefront.comp
+const uint32_t c_workGroupSize = 64;
+// Sizes of the std430 structs in wavefront.comp
+const VkDeviceSize c_rayStride = 32;
+const VkDeviceSize c_hitStride = 96;
+const VkDeviceSize c_pathStride = 16;
+const VkDeviceSize c_shadowPathStride = 8;
+const VkDeviceSize c_shadowRayStride = 48;
+const uint32_t c_maxShadowRaysPerHit = 4;
+// Byte offsets in the QueueState block of wavefront.comp
+const VkDeviceSize c_extendArgsOffset = 16;
+const VkDeviceSize c_hitArgsOffset = 32;
+const VkDeviceSize c_shadowArgsOffset = 48;
+const VkDeviceSize c_statisticsOffset = 64;
+// Rays, hits and shadow rays
+const uint32_t c_statisticsPerDepth = 3;
+const uint32_t c_bindingCount = 9;
+
+struct PushConstants
+{
+    uint32_t depth;
+};
+
+struct SpecializationData
+{
+    uint32_t stage;
+    uint32_t sortKeyCount;
+    VkBool32 sortHits;
+    uint32_t maxDepth;
+};
+
+void computeBarrier(VkCommandBuffer commandBuffer)
+{
+    // The next kernel reads the queues and its indirect arguments
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.pNext = NULL;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                         0,
+                         1,
+                         &barrier,
+                         0,
+                         nullptr,
+                         0,
+                         nullptr);
+}
+} // namespace
+
+WavefrontPathTracer::WavefrontPathTracer(const InitData& initData) :
+    m_device(initData.device),
+    m_physicalDevice(initData.physicalDevice),
+    m_extent(initData.extent),
+    m_pixelCount(initData.extent.width * initData.extent.height),
+    m_sortKeyCount(initData.sortKeyCount),
+    m_sortHits(initData.sortHits),
+    m_maxDepth(initData.maxDepth),
+    m_statisticsPending(initData.slotCount, false)
+{
+    CHECK(m_maxDepth > 0);
+    CHECK(m_sortKeyCount > 0);
+
+    const VkDeviceSize queueSize = createBuffers(initData.commandPool, initData.queue, initData.sortKeys);
+    createDescriptorSet();
+    createPipelines(initData.descriptorSetLayouts);
+    createTimers(initData.timerSuffix, initData.slotCount);
+
+    printf("Wavefront path tracer: depth %u, %u sort keys%s, %.1f MB of queues\n",
+           m_maxDepth,
+           m_sortKeyCount,
+           m_sortHits ? "" : ", hits not sorted",
+           static_cast<double>(queueSize) / (1024.0 * 1024.0));
+}
+
+WavefrontPathTracer::~WavefrontPathTracer()
+{
+    vkDeviceWaitIdle(m_device);
+    for (uint32_t slot = 0; slot < m_statisticsPending.size(); ++slot)
+    {
+        readStatistics(slot);
+    }
+
+    m_generateTimer.reset();
+    for (uint32_t depth = 0; depth < m_maxDepth; ++depth)
+    {
+        m_extendTimers[depth].reset();
+        m_sortTimers[depth].reset();
+        m_shadeTimers[depth].reset();
+        m_shadowTimers[depth].reset();
+    }
+    m_accumulateTimer.reset();
+
+    for (VkPipeline pipeline : m_pipelines)
+    {
+        vkDestroyPipeline(m_device, pipeline, nullptr);
+    }
+    vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+    vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, nullptr);
+
+    vkUnmapMemory(m_device, m_statisticsReadbackBuffer.memory);
+    for (const Buffer* buffer : {&m_queueStateBuffer,
+                                 &m_rayBuffer,
+                                 &m_hitBuffer,
+                                 &m_sortKeyBuffer,
+                                 &m_keyCountBuffer,
+                                 &m_sortedHitBuffer,
+                                 &m_pathBuffer,
+                                 &m_shadowQueueBuffer,
+                                 &m_shadowRayBuffer,
+                                 &m_statisticsReadbackBuffer})
+    {
+        destroyBufferAndFreeMemory(m_device, buffer->buffer, buffer->memory);
+    }
+}
+
+void WavefrontPathTracer::record(VkCommandBuffer commandBuffer, uint32_t slot, const std::vector<VkDescriptorSet>& descriptorSets)
+{
+    readStatistics(slot);
+
+    DebugMarker::beginLabel(commandBuffer, "Wavefront", DebugMarker::blue);
+
+    // The previous frame's kernels and statistics copy must be done with the queues before they are overwritten
+    VkMemoryBarrier frameBarrier{};
+    frameBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    frameBarrier.pNext = NULL;
+    frameBarrier.srcAccessMask = 0;
+    frameBarrier.dstAccessMask = 0;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &frameBarrier, 0, nullptr, 0, nullptr);
+
+    // All stages share the pipeline layout, so the sets stay bound when the pipelines change
+    std::vector<VkDescriptorSet> allDescriptorSets = descriptorSets;
+    allDescriptorSets.push_back(m_descriptorSet);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, ui32Size(allDescriptorSets), allDescriptorSets.data(), 0, nullptr);
+
+    const uint32_t pixelGroupCount = (m_pixelCount + c_workGroupSize - 1) / c_workGroupSize;
+    m_generateTimer->begin(commandBuffer, slot);
+    dispatch(commandBuffer, c_stageGenerate, 0, pixelGroupCount);
+    computeBarrier(commandBuffer);
+    m_generateTimer->end(commandBuffer, slot);
+
+    for (uint32_t depth = 0; depth < m_maxDepth; ++depth)
+    {
+        m_extendTimers[depth]->begin(commandBuffer, slot);
+        dispatch(commandBuffer, c_stageControlExtend, depth, 1);
+        computeBarrier(commandBuffer);
+        dispatchIndirect(commandBuffer, c_stageExtend, depth, c_extendArgsOffset);
+        computeBarrier(commandBuffer);
+        m_extendTimers[depth]->end(commandBuffer, slot);
+
+        m_sortTimers[depth]->begin(commandBuffer, slot);
+        dispatch(commandBuffer, c_stageControlSort, depth, 1);
+        computeBarrier(commandBuffer);
+        if (m_sortHits)
+        {
+            dispatchIndirect(commandBuffer, c_stageSort, depth, c_hitArgsOffset);
+            computeBarrier(commandBuffer);
+        }
+        m_sortTimers[depth]->end(commandBuffer, slot);
+
+        m_shadeTimers[depth]->begin(commandBuffer, slot);
+        dispatchIndirect(commandBuffer, c_stageShade, depth, c_hitArgsOffset);
+        computeBarrier(commandBuffer);
+        m_shadeTimers[depth]->end(commandBuffer, slot);
+
+        m_shadowTimers[depth]->begin(commandBuffer, slot);
+        dispatch(commandBuffer, c_stageControlShadow, depth, 1);
+        computeBarrier(commandBuffer);
+        dispatchIndirect(commandBuffer, c_stageShadow, depth, c_shadowArgsOffset);
+        computeBarrier(commandBuffer);
+        m_shadowTimers[depth]->end(commandBuffer, slot);
+    }
+
+    m_accumulateTimer->begin(commandBuffer, slot);
+    dispatch(commandBuffer, c_stageAccumulate, 0, pixelGroupCount);
+    m_accumulateTimer->end(commandBuffer, slot);
+
+    recordStatisticsCopy(commandBuffer, slot);
+
+    DebugMarker::endLabel(commandBuffer);
+}
+
+WavefrontPathTracer::Buffer WavefrontPathTracer::createDeviceBuffer(VkDeviceSize size, VkBufferUsageFlags usage, const std::string& name)
+{
+    Buffer buffer;
+    buffer.buffer = createBuffer(m_device, size, usage);
+    buffer.memory = allocateAndBindMemory(m_device, m_physicalDevice, buffer.buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_BUFFER, buffer.buffer, "Buffer - Wavefront " + name);
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_DEVICE_MEMORY, buffer.memory, "Memory - Wavefront " + name);
+    return buffer;
+}
+
+VkDeviceSize WavefrontPathTracer::createBuffers(VkCommandPool commandPool, VkQueue queue, const std::vector<uint32_t>& sortKeys)
+{
+    const VkDeviceSize statisticsSize = sizeof(uint32_t) * c_statisticsPerDepth * m_maxDepth;
+    const VkDeviceSize pixelCount = m_pixelCount;
+    const VkBufferUsageFlags storage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+
+    m_queueStateBuffer = createDeviceBuffer(c_statisticsOffset + statisticsSize, storage | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, "queue state");
+    // Two queues that the depths alternate between, the next depth's rays are appended while the current ones are read
+    m_rayBuffer = createDeviceBuffer(2 * pixelCount * c_rayStride, storage, "rays");
+    m_hitBuffer = createDeviceBuffer(pixelCount * c_hitStride, storage, "hits");
+    m_sortKeyBuffer = createDeviceBuffer(sizeof(uint32_t) * sortKeys.size(), storage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, "sort keys");
+    m_keyCountBuffer = createDeviceBuffer(2 * sizeof(uint32_t) * m_sortKeyCount, storage, "key counts");
+    m_sortedHitBuffer = createDeviceBuffer(sizeof(uint32_t) * pixelCount, storage, "sorted hits");
+    m_pathBuffer = createDeviceBuffer(pixelCount * c_pathStride, storage, "paths");
+    m_shadowQueueBuffer = createDeviceBuffer(pixelCount * c_shadowPathStride, storage, "shadow queue");
+    m_shadowRayBuffer = createDeviceBuffer(pixelCount * c_maxShadowRaysPerHit * c_shadowRayStride, storage, "shadow rays");
+    const VkDeviceSize queueSize = pixelCount * (2 * c_rayStride + c_hitStride + sizeof(uint32_t) + c_pathStride + c_shadowPathStride + c_maxShadowRaysPerHit * c_shadowRayStride);
+
+    const uint32_t slotCount = ui32Size(m_statisticsPending);
+    m_statisticsReadbackBuffer.buffer = createBuffer(m_device, slotCount * statisticsSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    m_statisticsReadbackBuffer.memory = allocateAndBindMemory(m_device, m_physicalDevice, m_statisticsReadbackBuffer.buffer, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_BUFFER, m_statisticsReadbackBuffer.buffer, "Buffer - Wavefront statistics readback");
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_DEVICE_MEMORY, m_statisticsReadbackBuffer.memory, "Memory - Wavefront statistics readback");
+    void* statisticsMapped;
+    VK_CHECK(vkMapMemory(m_device, m_statisticsReadbackBuffer.memory, 0, VK_WHOLE_SIZE, 0, &statisticsMapped));
+    m_statisticsReadback = static_cast<const uint32_t*>(statisticsMapped);
+
+    const VkDeviceSize sortKeysSize = sizeof(uint32_t) * sortKeys.size();
+    StagingBuffer stagingBuffer = createStagingBuffer(m_device, m_physicalDevice, sortKeys.data(), sortKeysSize);
+    const SingleTimeCommand command = beginSingleTimeCommands(commandPool, m_device);
+    VkBufferCopy copyRegion{0, 0, sortKeysSize};
+    vkCmdCopyBuffer(command.commandBuffer, stagingBuffer.buffer, m_sortKeyBuffer.buffer, 1, &copyRegion);
+    endSingleTimeCommands(queue, command);
+    releaseStagingBuffer(m_device, stagingBuffer);
+
+    return queueSize;
+}
+
+void WavefrontPathTracer::createDescriptorSet()
+{
+    std::vector<VkDescriptorSetLayoutBinding> bindings(c_bindingCount);
+    for (uint32_t i = 0; i < c_bindingCount; ++i)
+    {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        bindings[i].pImmutableSamplers = nullptr;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = ui32Size(bindings);
+    layoutInfo.pBindings = bindings.data();
+
+    VK_CHECK(vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &m_descriptorSetLayout));
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, m_descriptorSetLayout, "Desc set layout - Wavefront");
+
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSize.descriptorCount = c_bindingCount;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    poolInfo.maxSets = 1;
+
+    VK_CHECK(vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &m_descriptorPool));
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_DESCRIPTOR_POOL, m_descriptorPool, "Descriptor pool - Wavefront");
+
+    VkDescriptorSetAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocateInfo.pNext = NULL;
+    allocateInfo.descriptorPool = m_descriptorPool;
+    allocateInfo.descriptorSetCount = 1;
+    allocateInfo.pSetLayouts = &m_descriptorSetLayout;
+
+    VK_CHECK(vkAllocateDescriptorSets(m_device, &allocateInfo, &m_descriptorSet));
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_DESCRIPTOR_SET, m_descriptorSet, "Desc set - Wavefront");
+
+    // In binding order of the shader
+    const std::array<VkBuffer, c_bindingCount> buffers{m_queueStateBuffer.buffer,
+                                                       m_rayBuffer.buffer,
+                                                       m_hitBuffer.buffer,
+                                                       m_sortKeyBuffer.buffer,
+                                                       m_keyCountBuffer.buffer,
+                                                       m_sortedHitBuffer.buffer,
+                                                       m_pathBuffer.buffer,
+                                                       m_shadowQueueBuffer.buffer,
+                                                       m_shadowRayBuffer.buffer};
+    std::vector<VkDescriptorBufferInfo> bufferInfos(c_bindingCount);
+    std::vector<VkWriteDescriptorSet> descriptorWrites(c_bindingCount);
+    for (uint32_t i = 0; i < c_bindingCount; ++i)
+    {
+        bufferInfos[i] = {buffers[i], 0, VK_WHOLE_SIZE};
+
+        descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[i].pNext = NULL;
+        descriptorWrites[i].dstSet = m_descriptorSet;
+        descriptorWrites[i].dstBinding = i;
+        descriptorWrites[i].dstArrayElement = 0;
+        descriptorWrites[i].descriptorCount = 1;
+        descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+    }
+
+    vkUpdateDescriptorSets(m_device, ui32Size(descriptorWrites), descriptorWrites.data(), 0, nullptr);
+}
+
+void WavefrontPathTracer::createPipelines(const std::vector<VkDescriptorSetLayout>& descriptorSetLayouts)
+{
+    std::vector<VkDescriptorSetLayout> setLayouts = descriptorSetLayouts;
+    setLayouts.push_back(m_descriptorSetLayout);
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(PushConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = ui32Size(setLayouts);
+    pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    VK_CHECK(vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_pipelineLayout));
+    DebugMarker::setObjectName(VK_OBJECT_TYPE_PIPELINE_LAYOUT, m_pipelineLayout, "Pipeline layout - Wavefront");
+
+    VkShaderModule shaderModule = createShaderModule(m_device, getCurrentExecutableDirectory() / "wavefront.comp.spv");
+
+    const std::array<VkSpecializationMapEntry, 4> mapEntries{{
+        {0, offsetof(SpecializationData, stage), sizeof(uint32_t)}, //
+        {1, offsetof(SpecializationData, sortKeyCount), sizeof(uint32_t)}, //
+        {2, offsetof(SpecializationData, sortHits), sizeof(VkBool32)}, //
+        {3, offsetof(SpecializationData, maxDepth), sizeof(uint32_t)} //
+    }};
+    std::vector<SpecializationData> specializationData(c_stageCount);
+    std::vector<VkSpecializationInfo> specializationInfos(c_stageCount);
+    std::vector<VkComputePipelineCreateInfo> pipelineInfos(c_stageCount);
+    for (uint32_t stage = 0; stage < c_stageCount; ++stage)
+    {
+        specializationData[stage].stage = stage;
+        specializationData[stage].sortKeyCount = m_sortKeyCount;
+        specializationData[stage].sortHits = m_sortHits ? VK_TRUE : VK_FALSE;
+        specializationData[stage].maxDepth = m_maxDepth;
+
+        specializationInfos[stage].mapEntryCount = ui32Size(mapEntries);
+        specializationInfos[stage].pMapEntries = mapEntries.data();
+        specializationInfos[stage].dataSize = sizeof(SpecializationData);
+        specializationInfos[stage].pData = &specializationData[stage];
+
+        VkComputePipelineCreateInfo& pipelineInfo = pipelineInfos[stage];
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.pNext = NULL;
+        pipelineInfo.flags = 0;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.pNext = NULL;
+        pipelineInfo.stage.flags = 0;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.stage.pSpecializationInfo = &specializationInfos[stage];
+        pipelineInfo.layout = m_pipelineLayout;
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+        pipelineInfo.basePipelineIndex = 0;
+    }
+
+    m_pipelines.resize(c_stageCount);
+    VK_CHECK(vkCreateComputePipelines(m_device, VK_NULL_HANDLE, ui32Size(pipelineInfos), pipelineInfos.data(), nullptr, m_pipelines.data()));
+    for (uint32_t stage = 0; stage < c_stageCount; ++stage)
+    {
+        DebugMarker::setObjectName(VK_OBJECT_TYPE_PIPELINE, m_pipelines[stage], std::string("Pipeline - Wavefront ") + c_stageNames[stage]);
+    }
+
+    vkDestroyShaderModule(m_device, shaderModule, nullptr);
+}
+
+void WavefrontPathTracer::createTimers(const std::string& timerSuffix, uint32_t slotCount)
+{
+    m_generateTimer = std::make_unique<GpuTimer>("wavefront generate " + timerSuffix, m_device, m_physicalDevice, slotCount);
+    m_generateTimer->setItemCount(m_pixelCount, "pixel");
+    m_accumulateTimer = std::make_unique<GpuTimer>("wavefront accumulate " + timerSuffix, m_device, m_physicalDevice, slotCount);
+    m_accumulateTimer->setItemCount(m_pixelCount, "pixel");
+
+    // The item counts are read back per frame, so the summaries show the rays or hits per second of each depth
+    for (uint32_t depth = 0; depth < m_maxDepth; ++depth)
+    {
+        const std::string depthName = " depth " + std::to_string(depth) + " " + timerSuffix;
+        m_extendTimers.push_back(std::make_unique<GpuTimer>("wavefront extend" + depthName, m_device, m_physicalDevice, slotCount));
+        m_extendTimers.back()->setItemCount(0, "ray");
+        m_sortTimers.push_back(std::make_unique<GpuTimer>("wavefront sort" + depthName, m_device, m_physicalDevice, slotCount));
+        m_sortTimers.back()->setItemCount(0, "hit");
+        m_shadeTimers.push_back(std::make_unique<GpuTimer>("wavefront shade" + depthName, m_device, m_physicalDevice, slotCount));
+        m_shadeTimers.back()->setItemCount(0, "hit");
+        m_shadowTimers.push_back(std::make_unique<GpuTimer>("wavefront shadow" + depthName, m_device, m_physicalDevice, slotCount));
+        m_shadowTimers.back()->setItemCount(0, "shadow ray");
+    }
+}
+
+void WavefrontPathTracer::dispatch(VkCommandBuffer commandBuffer, uint32_t stage, uint32_t depth, uint32_t groupCount)
+{
+    const PushConstants pushConstants{depth};
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelines[stage]);
+    vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+    vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+}
+
+void WavefrontPathTracer::dispatchIndirect(VkCommandBuffer commandBuffer, uint32_t stage, uint32_t depth, VkDeviceSize argsOffset)
+{
+    const PushConstants pushConstants{depth};
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelines[stage]);
+    vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+    vkCmdDispatchIndirect(commandBuffer, m_queueStateBuffer.buffer, argsOffset);
+}
+
+void WavefrontPathTracer::recordStatisticsCopy(VkCommandBuffer commandBuffer, uint32_t slot)
+{
+    VkMemoryBarrier copyBarrier{};
+    copyBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    copyBarrier.pNext = NULL;
+    copyBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    copyBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &copyBarrier, 0, nullptr, 0, nullptr);
+
+    const VkDeviceSize statisticsSize = sizeof(uint32_t) * c_statisticsPerDepth * m_maxDepth;
+    VkBufferCopy copyRegion{c_statisticsOffset, slot * statisticsSize, statisticsSize};
+    vkCmdCopyBuffer(commandBuffer, m_queueStateBuffer.buffer, m_statisticsReadbackBuffer.buffer, 1, &copyRegion);
+
+    VkMemoryBarrier hostBarrier{};
+    hostBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    hostBarrier.pNext = NULL;
+    hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &hostBarrier, 0, nullptr, 0, nullptr);
+
+    m_statisticsPending[slot] = true;
+}
+
+void WavefrontPathTracer::readStatistics(uint32_t slot)
+{
+    if (!m_statisticsPending[slot])
+    {
+        return;
+    }
+
+    // Like the GPU timers, the command buffer of the slot has finished when it is recorded again
+    const uint32_t* statistics = m_statisticsReadback + slot * c_statisticsPerDepth * m_maxDepth;
+    for (uint32_t depth = 0; depth < m_maxDepth; ++depth)
+    {
+        const uint32_t* depthStatistics = statistics + depth * c_statisticsPerDepth;
+        m_extendTimers[depth]->addItems(depthStatistics[0]);
+        m_sortTimers[depth]->addItems(depthStatistics[1]);
+        m_shadeTimers[depth]->addItems(depthStatistics[1]);
+        m_shadowTimers[depth]->addItems(depthStatistics[2]);
+    }
+    m_statisticsPending[slot] = false;
+}
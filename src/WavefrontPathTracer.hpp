@@ -0,0 +1,103 @@
+#pragma once
+
+#include "GpuTimer.hpp"
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <memory>
+#include <string>
+#include <cstdint>
+
+// Path tracer built from ray query compute kernels that communicate through ray, hit and shadow ray queues in device
+// memory. Every depth extends all queued rays, sorts the hits by material, shades them in that order and then tests
+// the shadow rays they queued, so the threads of a wave shade the same material instead of diverging over whatever
+// their paths hit. The queue lengths only exist on the GPU, the kernels are dispatched indirectly from arguments that
+// a single work group control kernel writes between them. Uses the descriptor sets of the raytracer as sets 0 to 2
+// and writes the same accumulation image and G-buffer as the other renderers.
+class WavefrontPathTracer final
+{
+public:
+    struct InitData
+    {
+        VkDevice device;
+        VkPhysicalDevice physicalDevice;
+        // Used for uploading the sort keys, must not be in use by other threads during construction
+        VkCommandPool commandPool;
+        VkQueue queue;
+        // Common, material index and textures set layouts of the raytracer, with the compute stage in their bindings
+        std::vector<VkDescriptorSetLayout> descriptorSetLayouts;
+        VkExtent2D extent;
+        // Per submesh, hits are shaded in the order of their submesh's key. Keys are less than sortKeyCount.
+        std::vector<uint32_t> sortKeys;
+        uint32_t sortKeyCount;
+        // Off shades the hits in the order the extend kernel found them
+        bool sortHits;
+        // Maximum number of hits along a path, including the primary hit
+        uint32_t maxDepth;
+        // Appended to the GPU timer names
+        std::string timerSuffix;
+        uint32_t slotCount;
+    };
+
+    WavefrontPathTracer(const InitData& initData);
+    // Prints the GPU time and the throughput of every stage per depth
+    ~WavefrontPathTracer();
+
+    // Records all stages. The descriptor sets are in the order of the layouts, the caller synchronizes the
+    // accumulation image and the G-buffer with the compute shader stage.
+    void record(VkCommandBuffer commandBuffer, uint32_t slot, const std::vector<VkDescriptorSet>& descriptorSets);
+
+private:
+    struct Buffer
+    {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+    };
+
+    Buffer createDeviceBuffer(VkDeviceSize size, VkBufferUsageFlags usage, const std::string& name);
+    // Returns the size of the per pixel queues
+    VkDeviceSize createBuffers(VkCommandPool commandPool, VkQueue queue, const std::vector<uint32_t>& sortKeys);
+    void createDescriptorSet();
+    void createPipelines(const std::vector<VkDescriptorSetLayout>& descriptorSetLayouts);
+    void createTimers(const std::string& timerSuffix, uint32_t slotCount);
+    void dispatch(VkCommandBuffer commandBuffer, uint32_t stage, uint32_t depth, uint32_t groupCount);
+    void dispatchIndirect(VkCommandBuffer commandBuffer, uint32_t stage, uint32_t depth, VkDeviceSize argsOffset);
+    void recordStatisticsCopy(VkCommandBuffer commandBuffer, uint32_t slot);
+    void readStatistics(uint32_t slot);
+
+    VkDevice m_device;
+    VkPhysicalDevice m_physicalDevice;
+    const VkExtent2D m_extent;
+    const uint32_t m_pixelCount;
+    const uint32_t m_sortKeyCount;
+    const bool m_sortHits;
+    const uint32_t m_maxDepth;
+
+    Buffer m_queueStateBuffer;
+    Buffer m_rayBuffer;
+    Buffer m_hitBuffer;
+    Buffer m_sortKeyBuffer;
+    Buffer m_keyCountBuffer;
+    Buffer m_sortedHitBuffer;
+    Buffer m_pathBuffer;
+    Buffer m_shadowQueueBuffer;
+    Buffer m_shadowRayBuffer;
+    // Per slot copy of the ray, hit and shadow ray counts of each depth, read when the slot is recorded again
+    Buffer m_statisticsReadbackBuffer;
+    const uint32_t* m_statisticsReadback = nullptr;
+    std::vector<bool> m_statisticsPending;
+
+    VkDescriptorSetLayout m_descriptorSetLayout;
+    VkDescriptorPool m_descriptorPool;
+    VkDescriptorSet m_descriptorSet;
+    VkPipelineLayout m_pipelineLayout;
+    // Indexed by the stage
+    std::vector<VkPipeline> m_pipelines;
+
+    std::unique_ptr<GpuTimer> m_generateTimer;
+    std::unique_ptr<GpuTimer> m_accumulateTimer;
+    // Indexed by the depth, the extend, sort and shadow timers include the control kernel before them
+    std::vector<std::unique_ptr<GpuTimer>> m_extendTimers;
+    std::vector<std::unique_ptr<GpuTimer>> m_sortTimers;
+    std::vector<std::unique_ptr<GpuTimer>> m_shadeTimers;
+    std::vector<std::unique_ptr<GpuTimer>> m_shadowTimers;
+};
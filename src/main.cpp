@@ -1,17 +1,84 @@
 #include "Context.hpp"
 #include "Rasterizer.hpp"
 #include "Raytracer.hpp"
+#include "Options.hpp"
+#include "JobSystem.hpp"
+#include <atomic>
+#include <thread>
 
-int main(void)
+namespace
 {
-    Context context;
-    //Rasterizer graphicsApp(context);
-    Raytracer graphicsApp(context);
+// How long the main thread waits for input before simulating the camera again
+const double c_simulationInterval = 1.0 / 500.0;
+
+template<typename GraphicsApp>
+void run(Context& context, const Options& options)
+{
+    GraphicsApp graphicsApp(context, options);
 
     bool running = true;
     while (running)
     {
         running = graphicsApp.render();
+        JobSystem::get().runMainThreadJobs();
+    }
+}
+
+// GLFW input has to be handled on the main thread, so the camera is simulated there and the frames are recorded
+// and submitted on a render thread
+void runRaytracer(Context& context, const Options& options)
+{
+    Raytracer raytracer(context, options);
+
+    if (!options.renderThread)
+    {
+        bool running = true;
+        while (running)
+        {
+            running = raytracer.simulate(0.0) && raytracer.render();
+            JobSystem::get().runMainThreadJobs();
+        }
+        return;
+    }
+
+    std::atomic<bool> running{true};
+    std::thread renderThread([&raytracer, &running]() {
+        while (running.load(std::memory_order_relaxed) && raytracer.render())
+        {
+        }
+        running.store(false, std::memory_order_relaxed);
+    });
+
+    while (running.load(std::memory_order_relaxed))
+    {
+        if (!raytracer.simulate(c_simulationInterval))
+        {
+            running.store(false, std::memory_order_relaxed);
+        }
+        JobSystem::get().runMainThreadJobs();
+    }
+
+    renderThread.join();
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const Options options = parseOptions(argc, argv);
+
+    JobSystemSettings jobSystemSettings;
+    jobSystemSettings.threadCount = options.threadCount;
+    jobSystemSettings.pinThreads = options.pinThreads;
+    JobSystem::configure(jobSystemSettings);
+
+    Context context;
+    if (options.useRasterizer)
+    {
+        run<Rasterizer>(context, options);
+    }
+    else
+    {
+        runRaytracer(context, options);
     }
 
     return 0;
@@ -0,0 +1,117 @@
+#include "Tests.hpp"
+#include "AccelerationStructureCache.hpp"
+#include "Hash.hpp"
+#include "JobSystem.hpp"
+#include "Utils.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+
+namespace
+{
+// Same as c_chunkSize in Hash.cpp
+const size_t c_hashChunkSize = 1 << 20;
+
+std::filesystem::path getTestCachePath()
+{
+    return std::filesystem::temp_directory_path() / "vkrt-tests-cache" / "as-test.bin";
+}
+
+// Sizes and contents differ per acceleration structure, and one is empty
+std::vector<SerializedAccelerationStructure> createAccelerationStructures()
+{
+    std::vector<SerializedAccelerationStructure> accelerationStructures(4);
+    for (size_t i = 0; i < accelerationStructures.size(); ++i)
+    {
+        accelerationStructures[i].resize(i * 1000 + (i > 0 ? 7 : 0));
+        for (size_t j = 0; j < accelerationStructures[i].size(); ++j)
+        {
+            accelerationStructures[i][j] = static_cast<uint8_t>(i * 31 + j * 7);
+        }
+    }
+    return accelerationStructures;
+}
+
+void checkRoundTrip()
+{
+    const std::filesystem::path path = getTestCachePath();
+    const std::vector<SerializedAccelerationStructure> written = createAccelerationStructures();
+    CHECK(writeAccelerationStructureCache(path, written));
+
+    std::vector<SerializedAccelerationStructure> read;
+    CHECK(readAccelerationStructureCache(path, read));
+    CHECK(read == written);
+
+    // A write that was cut short must not be read back as a smaller cache
+    const uintmax_t fileSize = std::filesystem::file_size(path);
+    std::filesystem::resize_file(path, fileSize - 1);
+    CHECK(!readAccelerationStructureCache(path, read));
+
+    std::error_code error;
+    std::filesystem::remove(path, error);
+}
+
+// A count beyond what the file can hold is rejected before anything is allocated for it
+void checkCorruptCount()
+{
+    const std::filesystem::path path = getTestCachePath();
+    CHECK(writeAccelerationStructureCache(path, createAccelerationStructures()));
+    {
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        const uint32_t count = 0xffffffff;
+        file.seekp(2 * sizeof(uint32_t));
+        file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    }
+
+    std::vector<SerializedAccelerationStructure> read;
+    CHECK(!readAccelerationStructureCache(path, read));
+    CHECK(read.empty());
+
+    CHECK(!readAccelerationStructureCache(path.parent_path() / "missing.bin", read));
+
+    std::error_code error;
+    std::filesystem::remove(path, error);
+}
+
+// The cache key must not depend on the thread count, and hashParallel is defined as fnv1a over the chunk hashes
+void checkHashParallel()
+{
+    std::vector<uint8_t> data(c_hashChunkSize * 3 + 12345);
+    for (size_t i = 0; i < data.size(); ++i)
+    {
+        data[i] = static_cast<uint8_t>(i * 2654435761u >> 24);
+    }
+
+    std::vector<uint64_t> chunkHashes;
+    for (size_t offset = 0; offset < data.size(); offset += c_hashChunkSize)
+    {
+        chunkHashes.push_back(fnv1a(data.data() + offset, std::min(c_hashChunkSize, data.size() - offset)));
+    }
+    const uint64_t expected = fnv1a(chunkHashes.data(), chunkHashes.size() * sizeof(uint64_t), fnv1aValue(data.size()));
+
+    const uint32_t hardwareThreadCount = std::max(std::thread::hardware_concurrency(), 2u);
+    for (uint32_t threadCount : {1u, 2u, hardwareThreadCount})
+    {
+        JobSystemSettings settings;
+        settings.threadCount = threadCount;
+        JobSystem jobSystem(settings);
+        CHECK(hashParallel(data.data(), data.size(), c_fnv1aOffsetBasis, jobSystem) == expected);
+    }
+
+    // Continuing from a previous hash must change the result
+    JobSystemSettings settings;
+    settings.threadCount = 1;
+    JobSystem jobSystem(settings);
+    CHECK(hashParallel(data.data(), data.size(), expected, jobSystem) != expected);
+    CHECK(hashParallel(data.data(), 0, c_fnv1aOffsetBasis, jobSystem) == fnv1aValue(size_t{0}));
+}
+} // namespace
+
+void runAccelerationStructureCacheTests()
+{
+    checkRoundTrip();
+    checkCorruptCount();
+    checkHashParallel();
+    printf("AccelerationStructureCache: round trip, corrupt count and hash checked\n");
+}
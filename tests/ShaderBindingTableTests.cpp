@@ -0,0 +1,112 @@
+#include "Tests.hpp"
+#include "ShaderBindingTable.hpp"
+#include "Utils.hpp"
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+// Raygen, miss and shadow miss groups come first like in the raytracer
+const uint32_t c_firstHitGroup = 3;
+const uint32_t c_hitGroupCount = 5;
+
+// Same layout as the SubmeshInfo of Raytracer.cpp: texture indices, index buffer offset and alpha cutoff. Its 20 bytes
+// aren't a multiple of the handle alignment, so the records are padded to the stride.
+struct RecordData
+{
+    int values[4];
+    float alphaCutoff;
+};
+static_assert(sizeof(RecordData) == 20, "Must match SubmeshInfo in Raytracer.cpp");
+
+// Every byte of a handle is its group index, so the group of a record can be read back from the table
+std::vector<uint8_t> createGroupHandles(const ShaderBindingTableBuilder::Limits& limits, uint32_t groupCount)
+{
+    std::vector<uint8_t> groupHandles(static_cast<size_t>(limits.handleSize) * groupCount);
+    for (uint32_t group = 0; group < groupCount; ++group)
+    {
+        std::memset(groupHandles.data() + static_cast<size_t>(group) * limits.handleSize, static_cast<int>(group), limits.handleSize);
+    }
+    return groupHandles;
+}
+
+void checkRecord(const ShaderBindingTable& table, const ShaderBindingTableBuilder::Limits& limits, uint64_t offset, uint32_t group, const void* data, size_t dataSize)
+{
+    CHECK(offset + limits.handleSize + dataSize <= table.data.size());
+    for (uint32_t i = 0; i < limits.handleSize; ++i)
+    {
+        CHECK(table.data[offset + i] == group);
+    }
+    CHECK(dataSize == 0 || std::memcmp(table.data.data() + offset + limits.handleSize, data, dataSize) == 0);
+}
+
+void checkRegion(const ShaderBindingTableRegion& region, const ShaderBindingTableBuilder::Limits& limits, uint64_t recordCount)
+{
+    CHECK(region.offset % limits.baseAlignment == 0);
+    CHECK(region.stride % limits.handleAlignment == 0);
+    CHECK(region.stride <= limits.maxStride);
+    CHECK(region.size == region.stride * recordCount);
+}
+
+// Two hit records per hit group with inline data, one for camera and one for shadow rays like in the raytracer
+void checkLayout(const ShaderBindingTableBuilder::Limits& limits)
+{
+    ShaderBindingTableBuilder builder(limits);
+    builder.addRaygen(0);
+    builder.addMiss(1);
+    builder.addMiss(2);
+    std::vector<RecordData> recordData(c_hitGroupCount * 2);
+    for (uint32_t group = 0; group < c_hitGroupCount; ++group)
+    {
+        for (uint32_t i = 0; i < 2; ++i)
+        {
+            RecordData& data = recordData[group * 2 + i];
+            data = {{static_cast<int>(group), static_cast<int>(i), -1, static_cast<int>(group * 2 + i)}, 0.5f + 0.1f * static_cast<float>(i)};
+            builder.addHit(c_firstHitGroup + group, &data, sizeof(data));
+        }
+    }
+    const ShaderBindingTable table = builder.build(createGroupHandles(limits, c_firstHitGroup + c_hitGroupCount));
+
+    checkRegion(table.raygen, limits, 1);
+    checkRegion(table.miss, limits, 2);
+    checkRegion(table.hit, limits, c_hitGroupCount * 2);
+    CHECK(table.raygen.offset == 0);
+    CHECK(table.miss.offset >= table.raygen.offset + table.raygen.size);
+    CHECK(table.hit.offset >= table.miss.offset + table.miss.size);
+    // None of the limits below fit a record exactly, the padding after the data must stay zero
+    CHECK(table.hit.stride > limits.handleSize + sizeof(RecordData));
+    CHECK(table.data.size() == table.hit.offset + table.hit.size);
+
+    checkRecord(table, limits, table.raygen.offset, 0, nullptr, 0);
+    checkRecord(table, limits, table.miss.offset, 1, nullptr, 0);
+    checkRecord(table, limits, table.miss.offset + table.miss.stride, 2, nullptr, 0);
+    for (uint32_t group = 0; group < c_hitGroupCount; ++group)
+    {
+        for (uint32_t i = 0; i < 2; ++i)
+        {
+            const uint64_t offset = table.hit.offset + (group * 2 + i) * table.hit.stride;
+            checkRecord(table, limits, offset, c_firstHitGroup + group, &recordData[group * 2 + i], sizeof(RecordData));
+            for (uint64_t j = limits.handleSize + sizeof(RecordData); j < table.hit.stride; ++j)
+            {
+                CHECK(table.data[offset + j] == 0);
+            }
+        }
+    }
+}
+} // namespace
+
+void runShaderBindingTableTests()
+{
+    // Handle size, handle alignment, base alignment and max stride of common devices
+    const std::vector<ShaderBindingTableBuilder::Limits> limitsList{
+        {32, 32, 64, 4096},
+        {32, 32, 32, 4096},
+        {32, 64, 64, 4096},
+        {16, 16, 256, 65535},
+    };
+    for (const ShaderBindingTableBuilder::Limits& limits : limitsList)
+    {
+        checkLayout(limits);
+    }
+    printf("ShaderBindingTable: checked %zu device limits\n", limitsList.size());
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+// Each function runs the checks of one core module and aborts through CHECK on the first failure
+void runShaderBindingTableTests();
+void runAccelerationStructureCacheTests();
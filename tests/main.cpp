@@ -0,0 +1,11 @@
+#include "Tests.hpp"
+#include <cstdio>
+
+int main()
+{
+    runShaderBindingTableTests();
+    runAccelerationStructureCacheTests();
+
+    printf("All tests passed\n");
+    return 0;
+}